@@ -0,0 +1,493 @@
+/******************************************************************************
+ *
+ *	bench_main.c -
+ *		bgmbench, a microbenchmark of BGM's public entry points and the
+ *		song and attribute lookups under them. It runs on the null BASS
+ *		backend (see null/bass_null.h), so what it measures is BGM itself,
+ *		with 1, 100 and 10,000 songs loaded, and writes the results as
+ *		JSON so two builds can be diffed.
+ *
+ *	Building (Linux):
+ *		gcc -std=gnu99 -O2 -Isrc/null -Isrc -o bgmbench src/bench_main.c
+ *		    src/bgm*.c src/null/bass_null.c src/null/win32_null.c
+ *		    -lpthread -lm
+ *
+ *	Usage: bgmbench [output.json] >/dev/null
+ *		Results go to bgmbench.json if no file is given. BGM is built with
+ *		DEBUG, so the error paths print to stdout as they would in the DLL;
+ *		send it somewhere cheap. The songs are small WAVs written to a
+ *		"bgmbench.tmp" folder in the working directory, which is removed
+ *		afterwards. Error reports are turned off, as writing the log file
+ *		would swamp the error paths being timed.
+ *
+ *	Each result is the mean over enough calls to take BENCH_MINTIME, e.g.
+ *		{ "name": "GetAttrById", "songs": 100, "iters": 262144,
+ *		  "ns_per_op": 95.2 }
+ *
+ *	Last, how long a stream that was stopped takes to be heard again once
+ *	it is played, in the null backend's virtual time, with a plain stop
+ *	("PlayAfterStop") and with the "primedstop" global attribute set
+ *	("PlayAfterPrimedStop"):
+ *		{ "name": "PlayAfterStop", "songs": 10000, "iters": 20,
+ *		  "ms_to_audible": 110.0 }
+ *	For it, a stream played with nothing buffered isn't heard for an update
+ *	period (BASS_CONFIG_UPDATEPERIOD), as BASS fills its buffer on the next
+ *	update (see BASSNULL_SetStartDelay()). Audio is only mixed every
+ *	BASSNULL_PERIOD ms, so that is as quick as anything can be heard. Both
+ *	figures (110 and 10 ms with the defaults) come out of that model, not
+ *	out of real BASS; how far a real device's start latency drops has to
+ *	be measured on one.
+ *
+ *	Then the same for an internet stream, from bgm_LoadNetStream() to
+ *	being heard, with the "netcache" folder empty ("NetStreamCold") and
+ *	with the song cached there by an earlier load ("NetStreamWarm"). The
+ *	null backend serves the song's WAV as BENCH_NETURL, its first byte
+ *	BENCH_NETLATENCY ms after it's asked for and the rest at BENCH_NETRATE
+ *	bytes a second (see BASSNULL_SetNet()). A cold load is heard once
+ *	BASS's pre-buffer has come, which for a song this short is all of it;
+ *	a warm one plays from disk, and only waits for the update period.
+ *
+ *****************************************************************************/
+
+#include "bgm.h"
+#include "bass_null.h"
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// Shortest time (ms) a measurement runs for
+#define BENCH_MINTIME 50
+
+// Most songs loaded at once, and the folder they're written to
+#define BENCH_MAXSONGS 10000
+#define BENCH_DIR      "bgmbench.tmp"
+
+// Stop and play cycles the start latency is the mean of
+#define BENCH_LATTRIALS 20
+
+// The internet stream: where the null backend serves it, how long its
+// first byte takes (ms) and how fast the rest comes (bytes a second, 128
+// kbps)
+#define BENCH_NETURL     "http://bgmbench/song00000.wav"
+#define BENCH_NETLATENCY 50
+#define BENCH_NETRATE    16000
+
+// An ID and a filename no song has, for the error paths
+#define BENCH_BADID    0x7FFFFFFF
+#define BENCH_BADFNAME BENCH_DIR "/missing.wav"
+
+/******************************************************************************
+ * Typedefs, structs, etc.
+ *****************************************************************************/
+
+/*	BENCH -
+		One thing to time. proc does it once, for the i-th call.
+*/
+typedef struct {
+	const char	*name;
+	void		(*proc)( DWORD i );
+} BENCH;
+
+/******************************************************************************
+ * Globals
+ *****************************************************************************/
+
+DWORD	bench_ids[BENCH_MAXSONGS];			// Loaded songs' IDs...
+SONG	*bench_songs[BENCH_MAXSONGS];		// ...their SONGs...
+char	bench_fnames[BENCH_MAXSONGS+1][32];	// ...and filenames (plus the
+											// one load/unload churns)
+DWORD	bench_count;						// How many are loaded
+FILE	*bench_out;							// The JSON file
+DWORD	bench_results;						// How many have been written
+
+/******************************************************************************
+ * Function implementations
+ *****************************************************************************/
+
+/*	BenchWriteWav() -
+		Writes a tenth of a second of quiet 8kHz mono WAV. Returns FALSE if
+		it can't. */
+BOOL BenchWriteWav( const char *fname )
+{
+	BYTE head[44] = {
+		'R','I','F','F', 0,0,0,0, 'W','A','V','E',
+		'f','m','t',' ', 16,0,0,0, 1,0, 1,0,
+		0x40,0x1F,0,0, 0x80,0x3E,0,0, 2,0, 16,0,
+		'd','a','t','a', 0,0,0,0
+	};
+	short pcm[800];
+	DWORD len = sizeof(pcm);
+	FILE *f;
+	int i;
+
+	for (i = 0; i < 800; i++)
+		pcm[i] = (short)((i % 40) * 50 - 1000);
+	head[4] = (BYTE)(len+36);
+	head[5] = (BYTE)((len+36) >> 8);
+	head[40] = (BYTE)len;
+	head[41] = (BYTE)(len >> 8);
+
+	f = fopen(fname, "wb");
+	if (!f)
+		return FALSE;
+	fwrite(head, 1, sizeof(head), f);
+	fwrite(pcm, 1, sizeof(pcm), f);
+	return fclose(f) == 0;
+}
+
+/*	BenchNs() -
+		Returns how many nanoseconds there were between two performance
+		counter readings. */
+double BenchNs( LARGE_INTEGER *from,
+                LARGE_INTEGER *to )
+{
+	LARGE_INTEGER freq;
+
+	QueryPerformanceFrequency(&freq);
+	return (double)(to->QuadPart - from->QuadPart) * 1e9 / freq.QuadPart;
+}
+
+/*	BenchResult() -
+		Writes one result. */
+void BenchResult( const char *name,
+                  DWORD      iters,
+                  double     ns )
+{
+	fprintf(bench_out, "%s\n    { \"name\": \"%s\", \"songs\": %u, "
+	        "\"iters\": %u, \"ns_per_op\": %.1f }",
+	        bench_results++ ? "," : "", name, bench_count, iters, ns);
+	fflush(bench_out);
+}
+
+/*	BenchRun() -
+		Times a BENCH, doubling the calls until they take BENCH_MINTIME,
+		and writes the result. */
+void BenchRun( const BENCH *bench )
+{
+	LARGE_INTEGER t0, t1;
+	DWORD iters = 1, i;
+	double ns;
+
+	// Once to warm up
+	bench->proc(0);
+
+	for (;;) {
+		QueryPerformanceCounter(&t0);
+		for (i = 0; i < iters; i++)
+			bench->proc(i);
+		QueryPerformanceCounter(&t1);
+		ns = BenchNs(&t0, &t1);
+		if (ns >= BENCH_MINTIME*1e6 || iters >= 0x40000000)
+			break;
+		iters *= 2;
+	}
+
+	BenchResult(bench->name, iters, ns/iters);
+}
+
+/*	The benchmarks. Each spreads its calls over every loaded song. */
+
+void BenchGetSongById( DWORD i )
+{
+	_bgm_GetSongById(bench_ids[i % bench_count]);
+}
+
+void BenchGetSongByFname( DWORD i )
+{
+	_bgm_GetSongByFname(bench_fnames[i % bench_count]);
+}
+
+void BenchAccessAttr( DWORD i )
+{
+	char name[16] = "cvolume";
+	DWORD n;
+
+	_bgm_AccessAttr(bench_songs[i % bench_count], name, &n);
+}
+
+void BenchGetAttrById( DWORD i )
+{
+	bgm_GetAttrById(bench_ids[i % bench_count], "cvolume");
+}
+
+void BenchGetAttrByFname( DWORD i )
+{
+	bgm_GetAttrByFname(bench_fnames[i % bench_count], "cvolume");
+}
+
+void BenchSetAttrById( DWORD i )
+{
+	bgm_SetAttrById(bench_ids[i % bench_count], "cvolume",
+	                (i & 1) ? "50" : "100");
+}
+
+void BenchSetAttrByFname( DWORD i )
+{
+	bgm_SetAttrByFname(bench_fnames[i % bench_count], "cvolume",
+	                   (i & 1) ? "50" : "100");
+}
+
+void BenchPlayById( DWORD i )
+{
+	bgm_PlayById(bench_ids[i % bench_count], FALSE);
+}
+
+void BenchStopById( DWORD i )
+{
+	bgm_StopById(bench_ids[i % bench_count]);
+}
+
+void BenchLoadUnload( DWORD i )
+{
+	bgm_UnloadById(bgm_LoadStream(bench_fnames[BENCH_MAXSONGS], FALSE));
+}
+
+void BenchErrorBadId( DWORD i )
+{
+	bgm_GetAttrById(BENCH_BADID, "cvolume");
+}
+
+void BenchErrorBadFname( DWORD i )
+{
+	bgm_GetAttrByFname(BENCH_BADFNAME, "cvolume");
+}
+
+void BenchErrorBadAttr( DWORD i )
+{
+	bgm_GetAttrById(bench_ids[i % bench_count], "nosuchattr");
+}
+
+void BenchErrorPlayBadId( DWORD i )
+{
+	bgm_PlayById(BENCH_BADID, FALSE);
+}
+
+void BenchErrorLoadMissing( DWORD i )
+{
+	bgm_LoadStream(BENCH_BADFNAME, FALSE);
+}
+
+const BENCH bench_list[] = {
+	{ "GetSongById",       BenchGetSongById },
+	{ "GetSongByFname",    BenchGetSongByFname },
+	{ "AccessAttr",        BenchAccessAttr },
+	{ "GetAttrById",       BenchGetAttrById },
+	{ "GetAttrByFname",    BenchGetAttrByFname },
+	{ "SetAttrById",       BenchSetAttrById },
+	{ "SetAttrByFname",    BenchSetAttrByFname },
+	{ "PlayById",          BenchPlayById },
+	{ "StopById",          BenchStopById },
+	{ "LoadUnload",        BenchLoadUnload },
+	{ "ErrorBadId",        BenchErrorBadId },
+	{ "ErrorBadFname",     BenchErrorBadFname },
+	{ "ErrorBadAttr",      BenchErrorBadAttr },
+	{ "ErrorPlayBadId",    BenchErrorPlayBadId },
+	{ "ErrorLoadMissing",  BenchErrorLoadMissing },
+	{ NULL, NULL }
+};
+
+/*	BenchLatency() -
+		Stops and plays the first song BENCH_LATTRIALS times, with stops
+		primed or not, and writes how long it took to be heard after each
+		play, in ms of virtual time. */
+void BenchLatency( const char *name,
+                   BOOL       primed )
+{
+	DWORD id = bench_ids[0], t0, total = 0, i;
+	SONG *song = bench_songs[0];
+
+	bgm_SetAttrById(0, "primedstop", primed ? "1" : "0");
+	BASSNULL_SetStartDelay(BASS_GetConfig(BASS_CONFIG_UPDATEPERIOD));
+
+	for (i = 0; i < BENCH_LATTRIALS; i++) {
+		bgm_PlayById(id, TRUE);
+		BASSNULL_Advance(BASS_GetConfig(BASS_CONFIG_UPDATEPERIOD) +
+		                 BASSNULL_PERIOD);
+		bgm_StopById(id);
+
+		// Mixed in steps of BASSNULL_PERIOD until it has moved (by the
+		// byte, as bgm_GetPosById() is in whole seconds)
+		t0 = BASSNULL_GetTime();
+		bgm_PlayById(id, TRUE);
+		do
+			BASSNULL_Advance(BASSNULL_PERIOD);
+		while (BASS_ChannelGetPosition(song->id) == 0 &&
+		       BASSNULL_GetTime() - t0 < 1000);
+		total += BASSNULL_GetTime() - t0;
+		bgm_StopById(id);
+	}
+
+	BASSNULL_SetStartDelay(0);
+	bgm_SetAttrById(0, "primedstop", "0");
+
+	fprintf(bench_out, "%s\n    { \"name\": \"%s\", \"songs\": %u, "
+	        "\"iters\": %u, \"ms_to_audible\": %.1f }",
+	        bench_results++ ? "," : "", name, bench_count, BENCH_LATTRIALS,
+	        (double)total/BENCH_LATTRIALS);
+	fflush(bench_out);
+}
+
+/*	BenchNetAudible() -
+		Loads BENCH_NETURL, plays it and returns how long it took to be
+		heard, in ms of virtual time, leaving it loaded and its download
+		finished. Returns 0 if it couldn't be loaded. */
+DWORD BenchNetAudible( DWORD *id )
+{
+	DWORD t0, ms;
+	SONG *song;
+
+	t0 = BASSNULL_GetTime();
+	*id = (DWORD)bgm_LoadNetStream(BENCH_NETURL, FALSE);
+	song = _bgm_GetSongById(*id);
+	if (!song)
+		return 0;
+	bgm_PlayById(*id, TRUE);
+	do
+		BASSNULL_Advance(BASSNULL_PERIOD);
+	while (BASS_ChannelGetPosition(song->id) == 0 &&
+	       BASSNULL_GetTime() - t0 < 60000);
+	ms = BASSNULL_GetTime() - t0;
+
+	// Until the cache is written
+	while (BASS_StreamGetFilePosition(song->id, BASS_FILEPOS_DOWNLOAD) <
+	       BASS_StreamGetFilePosition(song->id, BASS_FILEPOS_END))
+		BASSNULL_Advance(BASSNULL_PERIOD);
+	BASSNULL_Advance(BASSNULL_PERIOD);
+	return ms;
+}
+
+/*	BenchNetLatency() -
+		Writes how long BENCH_NETURL takes to be heard after it's loaded,
+		with nothing cached (cold is TRUE) or with it cached, as the mean
+		of BENCH_LATTRIALS loads. Returns FALSE if one fails. */
+BOOL BenchNetLatency( const char *name,
+                      BOOL       cold )
+{
+	char path[512+32], key[512+32+4];
+	DWORD id, ms, total = 0, i;
+
+	bgm_SetAttrById(0, "netcache", BENCH_DIR);
+	_bgm_NetPath(BENCH_NETURL, path);
+	sprintf(key, "%s.key", path);
+	BASSNULL_SetNet(BENCH_DIR, BENCH_NETLATENCY, BENCH_NETRATE);
+	BASSNULL_SetStartDelay(BASS_GetConfig(BASS_CONFIG_UPDATEPERIOD));
+
+	// A warm load needs a load before it to fill the cache
+	if (!cold) {
+		if (!BenchNetAudible(&id))
+			return FALSE;
+		bgm_UnloadById(id);
+	}
+
+	for (i = 0; i < BENCH_LATTRIALS; i++) {
+		if (cold) {
+			remove(key);
+			remove(path);
+		}
+		ms = BenchNetAudible(&id);
+		if (!ms) {
+			fprintf(stderr, "Couldn't load %s: %s\n", BENCH_NETURL,
+			        bgm_Error());
+			return FALSE;
+		}
+		total += ms;
+		bgm_UnloadById(id);
+	}
+
+	remove(key);
+	remove(path);
+	BASSNULL_SetStartDelay(0);
+	BASSNULL_SetNet(NULL, 0, 0);
+	bgm_SetAttrById(0, "netcache", "");
+
+	fprintf(bench_out, "%s\n    { \"name\": \"%s\", \"songs\": %u, "
+	        "\"iters\": %u, \"ms_to_audible\": %.1f }",
+	        bench_results++ ? "," : "", name, bench_count, BENCH_LATTRIALS,
+	        (double)total/BENCH_LATTRIALS);
+	fflush(bench_out);
+	return TRUE;
+}
+
+/*	BenchLoadTo() -
+		Loads songs until there are count, and writes how long each took.
+		Returns FALSE if one fails. */
+BOOL BenchLoadTo( DWORD count )
+{
+	LARGE_INTEGER t0, t1;
+	DWORD from = bench_count, i;
+
+	QueryPerformanceCounter(&t0);
+	for (i = from; i < count; i++) {
+		bench_ids[i] = (DWORD)bgm_LoadStream(bench_fnames[i], FALSE);
+		if (!bench_ids[i]) {
+			fprintf(stderr, "Couldn't load %s: %s\n", bench_fnames[i],
+			        bgm_Error());
+			return FALSE;
+		}
+	}
+	QueryPerformanceCounter(&t1);
+
+	for (i = from; i < count; i++)
+		bench_songs[i] = _bgm_GetSongById(bench_ids[i]);
+	bench_count = count;
+	BenchResult("LoadStream", count - from, BenchNs(&t0, &t1)/(count - from));
+	return TRUE;
+}
+
+int main( int argc, char *argv[] )
+{
+	const DWORD sizes[] = { 1, 100, BENCH_MAXSONGS };
+	const BENCH *bench;
+	BOOL ok = TRUE;
+	DWORD s, i;
+
+	bench_out = fopen(argc > 1 ? argv[1] : "bgmbench.json", "w");
+	if (!bench_out) {
+		fprintf(stderr, "Couldn't write %s.\n",
+		        argc > 1 ? argv[1] : "bgmbench.json");
+		return 1;
+	}
+
+	// The songs
+	mkdir(BENCH_DIR, 0777);
+	for (i = 0; i <= BENCH_MAXSONGS && ok; i++) {
+		sprintf(bench_fnames[i], BENCH_DIR "/song%05u.wav", i);
+		ok = BenchWriteWav(bench_fnames[i]);
+	}
+	if (!ok || !bgm_Init(-1, 44100, 16, 0, 0)) {
+		fprintf(stderr, "Couldn't set up: %s\n", ok ? bgm_Error()
+		                                           : "can't write songs");
+		return 1;
+	}
+	bgm_SetReportErrors(FALSE);
+
+	fprintf(bench_out, "{\n  \"benchmark\": \"bgmbench\",\n"
+	        "  \"backend\": \"null\",\n  \"min_time_ms\": %u,\n"
+	        "  \"results\": [", BENCH_MINTIME);
+
+	for (s = 0; s < sizeof(sizes)/sizeof(sizes[0]) && ok; s++) {
+		fprintf(stderr, "%u songs...\n", sizes[s]);
+		ok = BenchLoadTo(sizes[s]);
+		for (bench = bench_list; ok && bench->name; bench++)
+			BenchRun(bench);
+	}
+	if (ok) {
+		BenchLatency("PlayAfterStop", FALSE);
+		BenchLatency("PlayAfterPrimedStop", TRUE);
+		ok = BenchNetLatency("NetStreamCold", TRUE) &&
+		     BenchNetLatency("NetStreamWarm", FALSE);
+	}
+
+	fprintf(bench_out, "\n  ]\n}\n");
+	fclose(bench_out);
+
+	bgm_Close();
+	for (i = 0; i <= BENCH_MAXSONGS; i++)
+		remove(bench_fnames[i]);
+	remove(BENCH_DIR);
+
+	return ok ? 0 : 1;
+}
+
+/* END OF FILE */
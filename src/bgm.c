@@ -11,13 +11,10 @@
  * Globals
  ******************************************************************************/
 
-char	bgm_tmpStr[1024];  // Place to hold small, temporary strings that will
-                           // be passed to GM
-CONFIG	bgm_config;	// Global configuration information
-
-/*	bgm_song -
-		This pointer holds the address of the first entry in the global list
-		of loaded songs.
+/*	bgm_defaultContext -
+		The context GM uses, and any thread that hasn't picked another with
+		_bgm_ContextUse(). Its song member (bgm_song to the rest of BGM)
+		holds the address of the first entry in the list of loaded songs.
 		The song list is implemented as a dynamically linked list with each
 		entry bearing pointers to both the next and previous entries in a list.
 		At BGM load time, a single entry is automatically created and placed
@@ -26,8 +23,39 @@ CONFIG	bgm_config;	// Global configuration information
 		BGM is unloaded.
 		New entries and be safely added to or removed from the list by means of
 		the _bgm_NewSong() and _bgm_DeleteSong() functions.
+		Every context made by _bgm_ContextNew() has a list of its own, set up
+		the same way.
+*/
+BGM_CONTEXT	bgm_defaultContext = { NULL };
+
+/*	bgm_contextTls -
+		TLS index of each thread's context, or TLS_OUT_OF_INDEXES until a
+		thread first picks one. Threads that never do have NULL in their slot
+		and use bgm_defaultContext, so GM's thread and BASS's never need it.
+*/
+DWORD		bgm_contextTls = TLS_OUT_OF_INDEXES;
+
+/*	bgm_defaultThread -
+		The BGM_THREAD of any thread BGM couldn't make one for. Threads
+		sharing it can see each other's errors and strings, but can still
+		call BGM.
 */
-SONG	*bgm_song;
+BGM_THREAD	bgm_defaultThread = { { "" }, 0, "", "", -1 };
+
+/*	bgm_threadTls -
+		TLS index of each thread's BGM_THREAD, or TLS_OUT_OF_INDEXES until
+		the first thread calls BGM.
+*/
+DWORD		bgm_threadTls = TLS_OUT_OF_INDEXES;
+
+/*	bgm_user -
+		Pointers handed to BASS callbacks as their "user" value. BASS 2.3
+		only has a DWORD for it, which can't hold a pointer on 64-bit
+		builds (like the null backend's, see null/bass_null.c), so callbacks
+		are given an index into this table instead. Slots are claimed with an
+		atomic swap, so this needs no lock and works before bgm_Init().
+*/
+void * volatile bgm_user[BGM_USER_MAX];
 
 /*******************************************************************************
  * Function implementations
@@ -48,38 +76,17 @@ GM_REAL bgm_Init( GM_REAL device,
 				  GM_REAL mono,
 				  GM_REAL win )
 {
-	CHANDATA *qpChan = NULL;
+	BGM_CONTEXT *ctx = &bgm_defaultContext;
 	DWORD flags = 0;
 	
-	// Initialize the error message caches
-	ERROR_CONTEXT("Failed to initialize BGM");
+	// Initialize the calling thread's error message caches
+	bgm_attrTypeLast = -1;
 	strcpy(bgm_errorMsg, "");
+	ERROR_CONTEXT("Failed to initialize BGM");
 	
-	// Initialize the song list
-	
-	bgm_song = NEW(SONG,1); // Create the first song
-	/*** ERROR HANDLER ***/
-		if (!bgm_song) {
-			BGM_ERROR("Out of memory.");
-			return FALSE;
-		}
-	bgm_song->id = 0;
-	strcpy(bgm_song->fname, "");
-	bgm_song->extData = NEW(CHANDATA,1); // Create the QP's channel data slot
-	/*** ERROR HANDLER ***/
-		if (!bgm_song->extData) {
-			BGM_ERROR("Out of memory.");
-			free(bgm_song);
-			return FALSE;
-		}
-	bgm_song->sample = 0;
-	bgm_song->next = NULL;
-	bgm_song->prev = NULL;
-	
-	// Initialize the global config	
-	bgm_config.reportErrors = TRUE;
-	bgm_config.stream = TRUE;
-	bgm_config.use32Bit = (bits==2);
+	// Initialize the song list and the global config
+	if (!_bgm_ContextInit(ctx, bits==2))
+		return FALSE;
 	
 	// Initializing... BASS
 	
@@ -90,12 +97,6 @@ GM_REAL bgm_Init( GM_REAL device,
 	// Default mixing rate
 	if (mixrate==0) mixrate = 44100;
 	
-	// Initialize the QP's channel data slot
-	qpChan = (CHANDATA*)bgm_song->extData;
-	qpChan->freq = 0;
-	qpChan->pan = 0;
-	qpChan->vol = 100;
-	
 	// Get a bitmask for the init flags
 	if (bits==1) flags |= BASS_DEVICE_8BITS;
 	if (mono) flags |= BASS_DEVICE_MONO;
@@ -135,12 +136,23 @@ GM_REAL bgm_Init( GM_REAL device,
 		}
 		// END BASS_ErrorGetCode()
 		
-		free(bgm_song->extData);
-		free(bgm_song);
+		free(ctx->song->extData);
+		free(ctx->song);
+		ctx->song = NULL;
 		return FALSE;
 	}
 	// END Error Handler
 	
+	// Have BASS hand all DSP callbacks floating-point data, so the effects
+	// only need to deal with one sample format.
+	BASS_SetConfig(BASS_CONFIG_FLOATDSP, TRUE);
+	
+	// Set up the master bus, the analysis worker and read-ahead
+	_bgm_BusInit();
+	_bgm_AnalyzeInit();
+	_bgm_IoInit();
+	_bgm_CmdInit();
+	
 	// Success!
 	return TRUE;
 }
@@ -154,20 +166,36 @@ GM_REAL bgm_Close( )
 	BASS_CHANNELINFO info;
 	SONG *node, *prevNode;
 	
+	// Run whatever is still queued before anything goes away
+	_bgm_CmdShutdown();
+	
+	// Unload the songs parked from Quick Play, which aren't in the list
+	_bgm_QpFree(&bgm_defaultContext);
+	
 	// Deallocate the QP song's channel data
-	free(bgm_song->extData);
+	free(bgm_defaultContext.song->extData);
 	
-	// Traverse all nodes
-	node = bgm_song;
+	// Traverse all nodes, unloading each the way _bgm_ContextFree() does so
+	// that what BASS_Free() doesn't know about (downloads, voices,
+	// coalescing) goes with it
+	node = bgm_defaultContext.song;
 	while (node) {
 		prevNode = node;       // Move to the next node. If node becomes "next"
 		node = prevNode->next; // by doing this, the loop will end.
+		_bgm_Clear(prevNode);
 		free(prevNode);	// Delete the old node
 	}
 	// END traverse all nodes
+	bgm_defaultContext.song = NULL;
+	_bgm_CmdSnapFree(&bgm_defaultContext);
 	
-	// Unload BASS and all song data
+	// Stop any analysis still decoding, then unload BASS and all song data.
+	// Read-ahead buffers go last, since BASS closes their files.
+	_bgm_AnalyzeFree();
 	BASS_Free();
+	_bgm_IoShutdown();
+	_bgm_BusFree();
+	bgm_meterOn = FALSE;
 	
 	return TRUE;
 }
@@ -196,9 +224,27 @@ SONG* _bgm_NewSong(	DWORD   id,
 		
 	// Initialize the SONG
 	song->id = id;
+	song->ref = id;
 	strcpy(song->fname,fname);
 	song->extData = extData;
 	song->sample = sample;
+	song->dsp = NULL;
+	song->group = 0;
+	song->normGain = 1.0f;
+	song->userVol = 100;
+	song->fadeEnd = 0;
+	song->music = 0;
+	song->modDirty = FALSE;
+	song->io = NULL;
+	song->net = NULL;
+	song->voices = NULL;
+	song->coalesce = NULL;
+	song->virt = FALSE;
+	song->evicted = FALSE;
+	song->lastUse = GetTickCount();
+	song->lazy = FALSE;
+	song->pending = FALSE;
+	song->primed = FALSE;
 		
 	// Find the last node in the song list.
 	node = bgm_song;
@@ -230,6 +276,8 @@ BOOL _bgm_DeleteSong( SONG *song )
 	if (song==NULL)
 		return FALSE;
 	
+	_bgm_CmdSnapDrop(song);
+	
 	// Unlink the song from the list and destroy it, making sure not to
 	// attach values to NULL pointers. (that would cause a segfault!)
 	if (song->prev != NULL)
@@ -244,15 +292,44 @@ BOOL _bgm_DeleteSong( SONG *song )
 /*	_bgm_GetSongById() -
 		Internal function that gets a pointer to the SONG that has the given
 		ID. If no song could be found in bgm_song with that ID,
-		NULL is returned. */
+		NULL is returned. The song counts as used, and is loaded again if it
+		was evicted (see bgm_mem.c). */
 SONG* _bgm_GetSongById( DWORD id )
 {
 	SONG *node;
 	
+	node = _bgm_PeekSongById(id);
+	_bgm_MemTouch(node);
+	
+	return node;
+}
+
+/*	_bgm_GetSongByFname() -
+		Internal function that gets a pointer to the SONG that has the given
+		ID. If no song could be found in bgm_song with that filename then
+		NULL is returned. The song counts as used, as with
+		_bgm_GetSongById(). */
+SONG* _bgm_GetSongByFname( const char *fname )
+{
+	SONG *node;
+	
+	node = _bgm_PeekSongByFname(fname);
+	_bgm_MemTouch(node);
+	
+	return node;
+}
+
+/*	_bgm_PeekSongById() -
+		Internal function that finds the SONG with the given ID without
+		counting it as used. */
+SONG* _bgm_PeekSongById( DWORD id )
+{
+	SONG *node;
+	
 	if (id==0) return bgm_song;
 	
 	node = bgm_song;
-	while (node->id != id) {
+	while (node->ref != id) {
 		if (node->next == NULL)
 			return NULL; // Id not in list
 		node = node->next;
@@ -261,11 +338,10 @@ SONG* _bgm_GetSongById( DWORD id )
 	return node;
 }
 
-/*	_bgm_GetSongByFname() -
-		Internal function that gets a pointer to the SONG that has the given
-		ID. If no song could be found in bgm_song with that filename then
-		NULL is returned. */
-SONG* _bgm_GetSongByFname( const char *fname )
+/*	_bgm_PeekSongByFname() -
+		Internal function that finds the SONG loaded with the given
+		filename without counting it as used. */
+SONG* _bgm_PeekSongByFname( const char *fname )
 {
 	SONG *node;
 	
@@ -348,3 +424,294 @@ BOOL _bgm_FnameIsUrl( const char *fname )
 	
 	return FALSE;
 }
+
+/*	_bgm_UserNew() -
+		Internal function that puts a pointer in the bgm_user table, for
+		passing to BASS as a callback's "user" value.
+		Returns the value to pass, or 0 if the table is full. */
+DWORD _bgm_UserNew( void *ptr )
+{
+	DWORD i;
+	
+	for (i=0; i<BGM_USER_MAX; i++)
+		if (!bgm_user[i] &&
+		    InterlockedCompareExchangePointer((PVOID*)&bgm_user[i], ptr,
+		                                      NULL) == NULL)
+			return i+1;
+	
+	return 0;
+}
+
+/*	_bgm_UserGet() -
+		Internal function that returns the pointer a callback's "user" value
+		stands for. */
+void* _bgm_UserGet( DWORD user )
+{
+	return bgm_user[user-1];
+}
+
+/*	_bgm_UserFree() -
+		Internal function that gives a "user" value back once BASS will no
+		longer call anything with it. Safe to call with 0. */
+void _bgm_UserFree( DWORD user )
+{
+	if (user)
+		bgm_user[user-1] = NULL;
+}
+
+/*	_bgm_Context() -
+		Internal function that returns the calling thread's context. */
+BGM_CONTEXT* _bgm_Context( )
+{
+	BGM_CONTEXT *ctx = NULL;
+	
+	if (bgm_contextTls != TLS_OUT_OF_INDEXES)
+		ctx = (BGM_CONTEXT*)TlsGetValue(bgm_contextTls);
+	
+	return ctx ? ctx : &bgm_defaultContext;
+}
+
+/*	_bgm_ContextUse() -
+		Internal function that makes ctx the calling thread's context, or
+		bgm_defaultContext if ctx is NULL.
+		Returns the context the thread was using before. */
+BGM_CONTEXT* _bgm_ContextUse( BGM_CONTEXT *ctx )
+{
+	BGM_CONTEXT *old = _bgm_Context();
+	DWORD tls;
+	
+	// The first thread to pick a context allocates the TLS index. Two may
+	// race to it, in which case the loser gives its index back.
+	if (bgm_contextTls == TLS_OUT_OF_INDEXES) {
+		tls = TlsAlloc();
+		if (tls == TLS_OUT_OF_INDEXES)
+			return old;
+		if ((DWORD)InterlockedCompareExchange((LONG volatile*)&bgm_contextTls,
+		      (LONG)tls, (LONG)TLS_OUT_OF_INDEXES) != TLS_OUT_OF_INDEXES)
+			TlsFree(tls);
+	}
+	
+	// The default context is stored as NULL, which every thread starts with
+	TlsSetValue(bgm_contextTls, ctx == &bgm_defaultContext ? NULL : ctx);
+	
+	return old;
+}
+
+/*	_bgm_ContextInit() -
+		Internal function that gives a context its Quick Play song and a
+		default configuration.
+		Returns TRUE on success, FALSE on failure. */
+BOOL _bgm_ContextInit( BGM_CONTEXT *ctx,
+                       BOOL        use32Bit )
+{
+	CHANDATA *qpChan = NULL;
+	SONG *qp = NULL;
+	
+	qp = NEW(SONG,1); // Create the first song
+	/*** ERROR HANDLER ***/
+		if (!qp) {
+			BGM_ERROR("Out of memory.");
+			return FALSE;
+		}
+	qp->id = 0;
+	qp->ref = 0;
+	strcpy(qp->fname, "");
+	qp->extData = NEW(CHANDATA,1); // Create the QP's channel data slot
+	/*** ERROR HANDLER ***/
+		if (!qp->extData) {
+			BGM_ERROR("Out of memory.");
+			free(qp);
+			return FALSE;
+		}
+	qp->sample = 0;
+	qp->dsp = NULL;
+	qp->group = 0;
+	qp->normGain = 1.0f;
+	qp->userVol = 100;
+	qp->fadeEnd = 0;
+	qp->music = 0;
+	qp->modDirty = FALSE;
+	qp->io = NULL;
+	qp->net = NULL;
+	qp->voices = NULL;
+	qp->coalesce = NULL;
+	qp->virt = FALSE;
+	qp->evicted = FALSE;
+	qp->lastUse = 0;
+	qp->lazy = FALSE;
+	qp->pending = FALSE;
+	qp->primed = FALSE;
+	qp->next = NULL;
+	qp->prev = NULL;
+	
+	// Initialize the QP's channel data slot
+	qpChan = (CHANDATA*)qp->extData;
+	qpChan->freq = 0;
+	qpChan->pan = 0;
+	qpChan->vol = 100;
+	
+	ctx->song = qp;
+	ctx->snap = NULL;
+	ctx->voicesDropped = 0;
+	ctx->voicesStolen = 0;
+	ctx->coalesced = 0;
+	ctx->virtPoll = 0;
+	ctx->evictions = 0;
+	ctx->lazyRef = BGM_LAZY_REFBASE;
+	ctx->lazyPoll = 0;
+	ctx->qpWarm = NULL;
+	
+	// Initialize the config
+	ctx->config.reportErrors = TRUE;
+	ctx->config.stream = TRUE;
+	ctx->config.normalize = FALSE;
+	ctx->config.modCache = FALSE;
+	ctx->config.readAhead = 0;
+	strcpy(ctx->config.netCache, "");
+	ctx->config.use32Bit = use32Bit;
+	ctx->config.async = FALSE;
+	ctx->config.voiceBudget = 0;
+	ctx->config.coalesceCap = 200;
+	ctx->config.virtualDb = 0.0f;
+	ctx->config.virtualGain = 0.0f;
+	ctx->config.memBudget = 0;
+	ctx->config.idleTime = 0;
+	ctx->config.qpWarm = BGM_QP_WARM_DEFAULT;
+	ctx->config.primedStop = FALSE;
+	
+	return TRUE;
+}
+
+/*	_bgm_ContextNew() -
+		Internal function that makes a new context, configured like
+		bgm_defaultContext, for a worker thread to _bgm_ContextUse().
+		Returns NULL on failure. */
+BGM_CONTEXT* _bgm_ContextNew( )
+{
+	BGM_CONTEXT *ctx = NULL;
+	
+	ctx = NEW(BGM_CONTEXT,1);
+	/*** ERROR HANDLER ***/
+		if (!ctx) {
+			BGM_ERROR("Out of memory.");
+			return NULL;
+		}
+	if (!_bgm_ContextInit(ctx, bgm_defaultContext.config.use32Bit)) {
+		free(ctx);
+		return NULL;
+	}
+	ctx->config = bgm_defaultContext.config;
+	ctx->config.async = FALSE; // Each context goes async on its own
+	
+	return ctx;
+}
+
+/*	_bgm_ContextFree() -
+		Internal function that unloads every song in a context made by
+		_bgm_ContextNew() and frees it. */
+void _bgm_ContextFree( BGM_CONTEXT *ctx )
+{
+	SONG *node, *prevNode;
+	
+	if (!ctx || ctx == &bgm_defaultContext)
+		return;
+	
+	// Let anything it queued run first
+	_bgm_CmdSync();
+	_bgm_CmdSnapFree(ctx);
+	_bgm_QpFree(ctx);
+	
+	// Deallocate the QP song's channel data
+	free(ctx->song->extData);
+	
+	// Unload and delete every node, the QP song's included
+	node = ctx->song;
+	while (node) {
+		prevNode = node;
+		node = prevNode->next;
+		_bgm_Clear(prevNode);
+		free(prevNode);
+	}
+	
+	free(ctx);
+}
+
+/*	_bgm_Thread() -
+		Internal function that returns the calling thread's BGM_THREAD. */
+BGM_THREAD* _bgm_Thread( )
+{
+	BGM_THREAD *thread;
+	DWORD tls;
+	
+	// The first thread in allocates the TLS index, as with contexts
+	if (bgm_threadTls == TLS_OUT_OF_INDEXES) {
+		tls = TlsAlloc();
+		if (tls == TLS_OUT_OF_INDEXES)
+			return &bgm_defaultThread;
+		if ((DWORD)InterlockedCompareExchange((LONG volatile*)&bgm_threadTls,
+		      (LONG)tls, (LONG)TLS_OUT_OF_INDEXES) != TLS_OUT_OF_INDEXES)
+			TlsFree(tls);
+	}
+	
+	thread = (BGM_THREAD*)TlsGetValue(bgm_threadTls);
+	if (thread)
+		return thread;
+	
+	// This thread's first call
+	thread = NEW(BGM_THREAD,1);
+	if (!thread)
+		return &bgm_defaultThread;
+	memset(thread, 0, sizeof(BGM_THREAD));
+	thread->attrTypeLast = -1;
+	TlsSetValue(bgm_threadTls, thread);
+	
+	return thread;
+}
+
+/*	_bgm_ThreadUse() -
+		Internal function that has the calling thread use another
+		BGM_THREAD. */
+BGM_THREAD* _bgm_ThreadUse( BGM_THREAD *thread )
+{
+	BGM_THREAD *old = _bgm_Thread();
+	
+	TlsSetValue(bgm_threadTls, thread);
+	
+	return old;
+}
+
+/*	_bgm_ThreadFree() -
+		Internal function that frees the calling thread's BGM_THREAD. */
+void _bgm_ThreadFree( )
+{
+	BGM_THREAD *thread;
+	
+	if (bgm_threadTls == TLS_OUT_OF_INDEXES)
+		return;
+	
+	thread = (BGM_THREAD*)TlsGetValue(bgm_threadTls);
+	TlsSetValue(bgm_threadTls, NULL);
+	if (thread != &bgm_defaultThread)
+		free(thread);
+}
+
+/*	_bgm_TmpStr() -
+		Internal function that returns the calling thread's current return
+		string buffer. */
+char* _bgm_TmpStr( )
+{
+	BGM_THREAD *thread = _bgm_Thread();
+	
+	return thread->tmpStr[thread->tmpStrNext];
+}
+
+/*	_bgm_TmpStrNext() -
+		Internal function that moves the calling thread on to its next
+		return string buffer. */
+void _bgm_TmpStrNext( )
+{
+	BGM_THREAD *thread = _bgm_Thread();
+	
+	thread->tmpStrNext = (thread->tmpStrNext + 1) % BGM_TMPSTR_COUNT;
+	strcpy(thread->tmpStr[thread->tmpStrNext], "");
+}
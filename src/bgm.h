@@ -17,8 +17,11 @@
 #include <wtypes.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <ctype.h>
 #include <time.h>
+#include <sys/stat.h>
+#include <math.h>
 #include <bass.h>
 
 /******************************************************************************
@@ -28,6 +31,15 @@
 // Information about BGM
 #define BGM_INFO_VERSION "2.0 beta"
 
+// Most interleaved channels BGM's DSP code keeps per-channel state for
+#define BGM_DSP_MAXCHANS 8
+
+// Most pointers that can be handed to BASS callbacks at once (see bgm_user)
+#define BGM_USER_MAX 4096
+
+// How many strings a thread can have BGM return before the first is reused
+#define BGM_TMPSTR_COUNT 8
+
 // Debugging tool
 #ifdef DEBUG
 	#define DOUT(str,...) printf(str, ## __VA_ARGS__)
@@ -85,6 +97,9 @@ typedef struct ctagCHANDATA {
 */
 typedef struct ctagSONG {
 	DWORD		id;			// ID given by BASS.
+	DWORD		ref;		// ID given to GM. This is the BASS ID the song
+							// was loaded with, and stays the same even if the
+							// song moves to another channel (see bgm_pcm.c).
 	char		fname[512];	// Filename or URL from which the song was
 							// loaded
 	void		*extData;	// Used to associate extended information with the
@@ -95,6 +110,53 @@ typedef struct ctagSONG {
 							// channel. This means that the sample will also
 	                        // need to be freed when the channel is freed.
 	struct
+	ctagSONGDSP	*dsp;		// Mix-time processing attached to the channel,
+							// or NULL if the song doesn't need any.
+	DWORD		group;		// Group the song is in, for ducking
+	float		normGain;	// Loudness normalisation gain currently folded
+							// into the channel volume (see bgm_loud.c)
+	DWORD		userVol;	// Channel volume as the user set it, 0 to 100;
+							// the channel has userVol*normGain
+	DWORD		fadeEnd;	// When the last volume fade on it ends
+	HMUSIC		music;		// Module kept loaded while the song plays from
+							// its PCM cache instead, or 0
+	BOOL		modDirty;	// Module attributes were changed, so the PCM
+							// cache no longer sounds like the song
+	struct
+	ctagIOSTREAM *io;		// Read-ahead buffer the stream is fed from, or
+							// NULL if BASS reads the file itself
+	struct
+	ctagNETCACHE *net;		// Cache an internet stream's download is being
+							// written to, or NULL
+	struct
+	ctagVOICES	*voices;	// Voices the sample plays on, if it was loaded
+							// with bgm_LoadSampleVoices(), or NULL
+	struct
+	ctagCOALESCE *coalesce;	// Window plays are merged in, or NULL if the
+							// song doesn't coalesce them
+	BOOL		virt;		// Paused by BGM because it couldn't be heard,
+							// though it counts as playing (see bgm_virt.c).
+							// Kept in the song, not behind a pointer, so
+							// snapshot stubs can carry it.
+	QWORD		virtPos;	// Where it was paused, in bytes...
+	DWORD		virtStart;	// ...when...
+	float		virtRate;	// ...and how many bytes a ms it was playing
+	BOOL		evicted;	// Channel freed to keep to the memory budget,
+							// to be loaded again when the song is next used
+							// (see bgm_mem.c)
+	DWORD		evictType;	// What it was loaded as (BASS_CTYPE_xxx)...
+	CHANDATA	evictAttrs;	// ...its channel attributes...
+	DWORD		evictLoop;	// ...loop flag...
+	DWORD		evictActive;	// ...whether it was stopped or paused...
+	float		evictPos;	// ...where, in seconds...
+	float		evictLen;	// ...and how long it is, in seconds
+	DWORD		lastUse;	// When the song was last looked up
+	BOOL		lazy;		// Registered, and unloaded again when idle
+							// (see bgm_lazy.c)
+	BOOL		pending;	// Registered and never loaded yet
+	BOOL		primed;		// Rewound with its buffer filled, to start on
+							// it when next played (see bgm_Prime())
+	struct
 	ctagSONG	*next,		// Pointer to the next node in the list
 				*prev;		// Pointer to the previous node in the list.
 							// NOTE: Do not allow these to be changed except by the
@@ -110,19 +172,93 @@ typedef struct ctagCONFIG {
 	    	             	// bgm_error.log
 	BOOL	use32Bit;		// Whether or not to load modules with BASS_SAMPLE_FLOAT
 	BOOL	stream;			// Whether or not to stream by default
+	BOOL	normalize;		// Whether or not to normalise song loudness
+	BOOL	modCache;		// Whether or not to play modules from PCM caches
+	DWORD	readAhead;		// Read-ahead buffer for file streams, in KB, or
+							// 0 to have BASS read them itself
+	char	netCache[512];	// Folder internet streams are cached in, or ""
+							// to not cache them
+	BOOL	async;			// Whether or not calls are handed to the control
+							// thread (see bgm_cmd.c)
+	DWORD	voiceBudget;	// Most sample voices playing at once, or 0 for
+							// no limit (see bgm_voice.c)
+	DWORD	coalesceCap;	// Most a coalesced play is boosted, in percent
+							// of its volume (see bgm_coalesce.c)
+	float	virtualDb;		// Level below which songs go virtual, in dB,
+							// or 0 for never (see bgm_virt.c)
+	float	virtualGain;	// ... and as a linear gain
+	DWORD	memBudget;		// Most memory songs can hold, in bytes, or 0
+							// for no limit (see bgm_mem.c)
+	DWORD	idleTime;		// How long registered songs are kept loaded
+							// unused, in ms, or 0 for ever (see
+							// bgm_lazy.c)
+	DWORD	qpWarm;			// Most songs kept loaded after leaving Quick
+							// Play (see bgm_qpcache.c)
+	BOOL	primedStop;		// Whether or not stopping a stream or module
+							// primes it (see bgm_Prime())
 	
 	
 	// More members to come...
 	
 } CONFIG;
 
+/*	BGM_CONTEXT -
+		Everything that belongs to one instance of BGM: its song list and
+		its configuration. Every function
+		works on the calling thread's context (see _bgm_ContextUse()), which
+		is bgm_defaultContext unless the thread has picked another, so GM
+		sees one BGM as always while tools can run one per worker thread.
+		BASS itself, groups, meters, and the analysis and I/O threads are
+		shared by all of them.
+*/
+typedef struct ctagBGM_CONTEXT {
+	SONG	*song;				// List of loaded songs (see bgm_song)
+	CONFIG	config;				// Configuration (see bgm_config)
+	struct
+	ctagCMDSNAP	*snap;			// Song list snapshot for async mode, or NULL
+	DWORD	voicesDropped;		// Voices that didn't get to play...
+	DWORD	voicesStolen;		// ...and that were cut off for another
+	DWORD	coalesced;			// Plays merged into one already playing
+	DWORD	virtPoll;			// When virtual songs were last checked
+	DWORD	evictions;			// Songs evicted to keep to the memory budget,
+								// or unloaded for being idle
+	DWORD	lazyRef;			// Next ID for a registered song
+	DWORD	lazyPoll;			// When idle songs were last looked for
+	SONG	*qpWarm;			// Songs parked from Quick Play, the latest
+								// first (see bgm_qpcache.c)
+} BGM_CONTEXT;
+
+/*	BGM_THREAD -
+		What BGM keeps for each thread that calls it: the last error, and
+		the strings it has returned. Strings are handed out from a ring of
+		BGM_TMPSTR_COUNT buffers, so one stays valid until the thread has
+		had that many more back, and no thread ever writes over another's.
+*/
+typedef struct ctagBGM_THREAD {
+	char	tmpStr[BGM_TMPSTR_COUNT][1024];	// Strings returned to GM
+	DWORD	tmpStrNext;			// Which of them bgm_tmpStr is
+	char	errorMsg[1024];		// Last error (see bgm_errorMsg)
+	char	errorContext[128];	// Its context (see bgm_errorContext)
+	GM_REAL	attrTypeLast;		// See bgm_attrTypeLast
+} BGM_THREAD;
+
 /******************************************************************************
  * Global Externs
  *****************************************************************************/
 
-extern char		bgm_tmpStr[1024];
-extern CONFIG	bgm_config;
-extern SONG		*bgm_song;
+extern BGM_CONTEXT	bgm_defaultContext;
+extern DWORD		bgm_contextTls;
+extern BGM_THREAD	bgm_defaultThread;
+extern DWORD		bgm_threadTls;
+
+// The calling thread's context's members, by the names they had when BGM
+// was all globals
+#define bgm_config	(_bgm_Context()->config)
+#define bgm_song	(_bgm_Context()->song)
+
+// The buffer the calling thread's next string is returned in; see
+// _bgm_TmpStrNext()
+#define bgm_tmpStr	(_bgm_TmpStr())
 
 /*******************************************************************************
  * Function prototypes
@@ -192,15 +328,28 @@ BOOL _bgm_DeleteSong( SONG *song );
 /*	_bgm_GetSongById() -
 		Internal function that gets a pointer to the SONG that has the given
 		ID. If no song could be found in bgm_song with that ID,
-		NULL is returned. */
+		NULL is returned. The song counts as used, and is loaded again if
+		it was evicted (see bgm_mem.c). */
 SONG* _bgm_GetSongById( DWORD id );
 
 /*	_bgm_GetSongByFname() -
 		Internal function that gets a pointer to the SONG that has the given
 		ID. If no song could be found in bgm_song with that filename then
-		NULL is returned. */
+		NULL is returned. The song counts as used, as with
+		_bgm_GetSongById(). */
 SONG* _bgm_GetSongByFname( const char *fname );
 
+/*	_bgm_PeekSongById() -
+		Internal function that finds a song as _bgm_GetSongById() does, but
+		without counting it as used: an evicted song stays evicted (see
+		bgm_mem.c). */
+SONG* _bgm_PeekSongById( DWORD id );
+
+/*	_bgm_PeekSongByFname() -
+		Internal function that finds a song as _bgm_GetSongByFname() does,
+		but without counting it as used. */
+SONG* _bgm_PeekSongByFname( const char *fname );
+
 /*	_bgm_GetFileType() -
 		Internal function that returns the type of a filename so that the
 		correct loading procedure can be used. The value returned is one of
@@ -215,13 +364,109 @@ DWORD _bgm_GetFileType( const char *fname );
 	URL. Case insensitive. */
 BOOL _bgm_FnameIsUrl( const char *fname );
 
+/*	_bgm_UserNew() -
+		Internal function that registers a pointer to be handed to a BASS
+		callback, whose "user" value is only a DWORD.
+		Returns the value to give BASS, or 0 if too many are in use. */
+DWORD _bgm_UserNew( void *ptr );
+
+/*	_bgm_UserGet() -
+		Internal function that turns a callback's "user" value back into the
+		pointer it was registered for. */
+void* _bgm_UserGet( DWORD user );
+
+/*	_bgm_UserFree() -
+		Internal function that releases a "user" value once BASS can no
+		longer pass it to a callback. Safe to call with 0. */
+void _bgm_UserFree( DWORD user );
+
+/*	_bgm_Context() -
+		Internal function that returns the calling thread's context. */
+BGM_CONTEXT* _bgm_Context( );
+
+/*	_bgm_ContextUse() -
+		Internal function that makes ctx the calling thread's context, or
+		bgm_defaultContext if ctx is NULL.
+		Returns the context the thread was using before. */
+BGM_CONTEXT* _bgm_ContextUse( BGM_CONTEXT *ctx );
+
+/*	_bgm_ContextInit() -
+		Internal function that gives a context its Quick Play song and a
+		default configuration.
+		Returns TRUE on success, FALSE on failure. */
+BOOL _bgm_ContextInit( BGM_CONTEXT *ctx,
+                       BOOL        use32Bit );
+
+/*	_bgm_ContextNew() -
+		Internal function that makes a new context, configured like
+		bgm_defaultContext, for a worker thread to _bgm_ContextUse(). BGM
+		must have been initialized first.
+		Returns NULL on failure. */
+BGM_CONTEXT* _bgm_ContextNew( );
+
+/*	_bgm_ContextFree() -
+		Internal function that unloads every song in a context made by
+		_bgm_ContextNew() and frees it. No thread may still be using it, and
+		it must be called before bgm_Close(). */
+void _bgm_ContextFree( BGM_CONTEXT *ctx );
+
+/*	_bgm_Thread() -
+		Internal function that returns the calling thread's BGM_THREAD,
+		making it the first time the thread asks. */
+BGM_THREAD* _bgm_Thread( );
+
+/*	_bgm_ThreadUse() -
+		Internal function that has the calling thread keep its errors and
+		strings in another thread's BGM_THREAD, while that thread waits for
+		it, or in its own again.
+		Returns the BGM_THREAD it was using before. */
+BGM_THREAD* _bgm_ThreadUse( BGM_THREAD *thread );
+
+/*	_bgm_ThreadFree() -
+		Internal function that frees the calling thread's BGM_THREAD. Threads
+		BGM starts call it before they end; others may if they're done with
+		BGM for good, and will get a fresh one if they aren't. */
+void _bgm_ThreadFree( );
+
+/*	_bgm_TmpStr() -
+		Internal function that returns the calling thread's current return
+		string buffer (bgm_tmpStr). */
+char* _bgm_TmpStr( );
+
+/*	_bgm_TmpStrNext() -
+		Internal function that moves bgm_tmpStr on to the calling thread's
+		next buffer. DLL functions returning a string call it once, before
+		anything is written, so the strings they returned before are left
+		alone. */
+void _bgm_TmpStrNext( );
+
 /******************************************************************************
  * Local includes
  *****************************************************************************/
 #include "bgm_error.h"
+#include "bgm_fx.h"
+#include "bgm_bus.h"
+#include "bgm_spec.h"
+#include "bgm_meter.h"
+#include "bgm_analyze.h"
+#include "bgm_beat.h"
+#include "bgm_wave.h"
+#include "bgm_loud.h"
+#include "bgm_pcm.h"
+#include "bgm_io.h"
+#include "bgm_net.h"
+#include "bgm_dsp.h"
 #include "bgm_load.h"
 #include "bgm_play.h"
+#include "bgm_voice.h"
+#include "bgm_coalesce.h"
+#include "bgm_virt.h"
+#include "bgm_mem.h"
+#include "bgm_lazy.h"
+#include "bgm_qpcache.h"
 #include "bgm_attr.h"
+#include "bgm_render.h"
+#include "bgm_cmd.h"
 
 #endif // BGM_H
 /* END OF FILE */
@@ -0,0 +1,502 @@
+/******************************************************************************
+ *
+ *	bgm_analyze.c -
+ *		Implementation of BGM's offline analysis: the worker thread, the
+ *		table of results and the sidecar files they are saved in.
+ *
+ *	The worker decodes each file once for everything that was asked of it,
+ *	feeding every analysis from the same pass. It never touches SONGs or
+ *	the error system, since songs can be freed and errors reported from GM
+ *	while it runs; it only works on ANALYSIS entries, which live until
+ *	bgm_Close().
+ *
+ *	A sidecar is fname + an extension per analysis, and starts with
+ *		magic, BGM_CACHE_VERSION, CACHEKEY
+ *	as DWORDs, followed by the analysis' own data.
+ *
+ *****************************************************************************/
+
+#include "bgm.h"
+
+/******************************************************************************
+ * Globals
+ *****************************************************************************/
+
+CRITICAL_SECTION bgm_anLock;	// Guards the list and everything in it
+ANALYSIS *bgm_anList = NULL;	// Every file analysed or asked about
+HANDLE bgm_anThread = NULL;		// Worker thread, once started
+HANDLE bgm_anEvent = NULL;		// Set when there is new work
+volatile BOOL bgm_anQuit;		// Tells the worker to stop
+
+/******************************************************************************
+ * Function implementations
+ *****************************************************************************/
+
+/*	_bgm_AnalyzeInit() -
+		Internal function that sets up the analysis state. Called from
+		bgm_Init(). */
+void _bgm_AnalyzeInit( )
+{
+	InitializeCriticalSection(&bgm_anLock);
+	bgm_anList = NULL;
+	bgm_anThread = NULL;
+	bgm_anEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	bgm_anQuit = FALSE;
+}
+
+/*	_bgm_AnalyzeFree() -
+		Internal function that stops the worker thread and frees every
+		result. Called from bgm_Close() before BASS is freed. */
+void _bgm_AnalyzeFree( )
+{
+	ANALYSIS *entry;
+
+	// The worker checks bgm_anQuit between blocks, so this doesn't wait
+	// for a whole file to finish decoding
+	if (bgm_anThread) {
+		bgm_anQuit = TRUE;
+		SetEvent(bgm_anEvent);
+		WaitForSingleObject(bgm_anThread, INFINITE);
+		CloseHandle(bgm_anThread);
+		bgm_anThread = NULL;
+	}
+
+	while (bgm_anList) {
+		entry = bgm_anList;
+		bgm_anList = entry->next;
+		_bgm_BeatFree(entry->beats);
+		_bgm_WaveFree(entry->wave);
+		_bgm_PcmRowsFree(entry->rows);
+		free(entry);
+	}
+
+	CloseHandle(bgm_anEvent);
+	DeleteCriticalSection(&bgm_anLock);
+}
+
+/*	_bgm_AnalyzeFind() -
+		Internal function that finds the analysis entry for a file, making
+		one if create is TRUE. Must be called with bgm_anLock held. */
+ANALYSIS* _bgm_AnalyzeFind( const char *fname,
+                            BOOL       create )
+{
+	ANALYSIS *entry;
+
+	for (entry = bgm_anList; entry; entry = entry->next)
+		if (strcmp(entry->fname, fname)==0)
+			return entry;
+	if (!create)
+		return NULL;
+
+	entry = NEW(ANALYSIS,1);
+	if (!entry)
+		return NULL;
+	memset(entry, 0, sizeof(ANALYSIS));
+	strcpy(entry->fname, fname);
+	entry->next = bgm_anList;
+	bgm_anList = entry;
+	return entry;
+}
+
+/*	_bgm_AnalyzeGet() -
+		Internal function that returns the analysis entry for a song's file,
+		asking the worker for the analyses in what that aren't done yet.
+		Returns NULL (with an error set) if the song can't be analysed. */
+ANALYSIS* _bgm_AnalyzeGet( SONG  *song,
+                           DWORD what )
+{
+	ANALYSIS *entry;
+	BOOL wake = FALSE;
+	DWORD threadId;
+
+	ERROR_CONTEXT("Failed to analyse song");
+
+	/* ERROR HANDLER */
+	if (!song) {
+		BGM_ERROR("Invalid song ID or filename.");
+		return NULL;
+	}
+	if (song->id==0) {
+		BGM_ERROR("No Quick Play song loaded.");
+		return NULL;
+	}
+	if (strstr(song->fname, "://")) {
+		BGM_ERROR("Only songs loaded from files can be analysed.");
+		return NULL;
+	}
+
+	EnterCriticalSection(&bgm_anLock);
+
+	entry = _bgm_AnalyzeFind(song->fname, TRUE);
+	/* ERROR HANDLER */
+	if (!entry) {
+		LeaveCriticalSection(&bgm_anLock);
+		BGM_ERROR("Out of memory.");
+		return NULL;
+	}
+
+	// Queue whatever hasn't been asked for yet
+	what &= ~(entry->want | entry->done | entry->failed | entry->running);
+	if (what) {
+		entry->want |= what;
+		wake = TRUE;
+	}
+
+	LeaveCriticalSection(&bgm_anLock);
+
+	if (wake) {
+		// Start the worker the first time there's something for it
+		if (!bgm_anThread) {
+			bgm_anThread = CreateThread(NULL, 0, _bgm_AnalyzeThread, NULL, 0,
+			                            &threadId);
+			/* ERROR HANDLER */
+			if (!bgm_anThread) {
+				BGM_ERROR("Could not start the analysis thread.");
+				return NULL;
+			}
+		}
+		SetEvent(bgm_anEvent);
+	}
+
+	return entry;
+}
+
+/*	_bgm_CacheKey() -
+		Internal function that works out the cache key of a file.
+		Returns FALSE if the file can't be read. */
+BOOL _bgm_CacheKey( const char *fname,
+                    CACHEKEY   *key )
+{
+	struct stat st;
+	FILE *f;
+	BYTE buf[4096];
+	DWORD hash = 2166136261u, i, n, left;
+
+	if (stat(fname, &st) != 0)
+		return FALSE;
+	key->size = (DWORD)st.st_size;
+	key->mtime = (DWORD)st.st_mtime;
+
+	// The size and mtime catch almost every change; hashing the first and
+	// last 64KB (where the headers and tags are) catches files that were
+	// copied around with their times reset, without reading whole songs.
+	f = fopen(fname, "rb");
+	if (!f)
+		return FALSE;
+	for (i=0; i<4; i++) {
+		hash ^= (key->size >> (i*8)) & 0xFF;
+		hash *= 16777619u;
+	}
+	for (left = 65536; left && (n = fread(buf, 1, sizeof(buf), f)); left -= n)
+		for (i=0; i<n; i++) {
+			hash ^= buf[i];
+			hash *= 16777619u;
+		}
+	if (key->size > 131072) {
+		fseek(f, -65536, SEEK_END);
+		while ((n = fread(buf, 1, sizeof(buf), f)))
+			for (i=0; i<n; i++) {
+				hash ^= buf[i];
+				hash *= 16777619u;
+			}
+	}
+	fclose(f);
+
+	key->hash = hash;
+	return TRUE;
+}
+
+/*	_bgm_CacheOpen() -
+		Internal function that opens the sidecar of a file for reading.
+		Returns NULL if there is none or if it is out of date. */
+FILE* _bgm_CacheOpen( const char     *fname,
+                      const char     *ext,
+                      DWORD          magic,
+                      const CACHEKEY *key )
+{
+	char path[512+32];
+	DWORD head[5];
+	FILE *f;
+
+	sprintf(path, "%s%s", fname, ext);
+	f = fopen(path, "rb");
+	if (!f)
+		return NULL;
+
+	if (fread(head, sizeof(DWORD), 5, f) != 5 ||
+	    head[0] != magic || head[1] != BGM_CACHE_VERSION ||
+	    head[2] != key->size || head[3] != key->mtime ||
+	    head[4] != key->hash) {
+		fclose(f);
+		return NULL;
+	}
+
+	return f;
+}
+
+/*	_bgm_CacheLeft() -
+		Internal function that returns how many bytes of a sidecar are left
+		to read. */
+DWORD _bgm_CacheLeft( FILE *f )
+{
+	long here, end;
+
+	here = ftell(f);
+	if (here < 0 || fseek(f, 0, SEEK_END) != 0)
+		return 0;
+	end = ftell(f);
+	fseek(f, here, SEEK_SET);
+
+	return end > here ? (DWORD)(end - here) : 0;
+}
+
+/*	_bgm_CacheCreate() -
+		Internal function that creates the sidecar of a file and writes its
+		header. Returns NULL if it can't be written. */
+FILE* _bgm_CacheCreate( const char     *fname,
+                        const char     *ext,
+                        DWORD          magic,
+                        const CACHEKEY *key )
+{
+	char path[512+32];
+	DWORD head[5];
+	FILE *f;
+
+	sprintf(path, "%s%s", fname, ext);
+	f = fopen(path, "wb");
+	if (!f)
+		return NULL;
+
+	head[0] = magic;
+	head[1] = BGM_CACHE_VERSION;
+	head[2] = key->size;
+	head[3] = key->mtime;
+	head[4] = key->hash;
+	fwrite(head, sizeof(DWORD), 5, f);
+
+	return f;
+}
+
+/*	_bgm_AnalyzeFile() -
+		Internal function, run on the worker thread, that does the analyses
+		in work for the entry: from the sidecars where they are up to date,
+		otherwise with one decoding pass that feeds all of them. */
+void _bgm_AnalyzeFile( ANALYSIS *entry,
+                       DWORD    work )
+{
+	CACHEKEY key;
+	BEATINDEX *beats = NULL;
+	BEATSTATE *beatState = NULL;
+	WAVEPYRAMID *wave = NULL;
+	WAVESTATE *waveState = NULL;
+	LOUDSTATE *loudState = NULL;
+	PCMSTATE *pcmState = NULL;
+	PCMROWS *rows = NULL;
+	float lufs = 0.0f;
+	BASS_CHANNELINFO info;
+	DWORD done = 0, todo, chan, n, want, frames, f, c;
+	float buf[8192], mono[8192], sum;
+
+	if (!_bgm_CacheKey(entry->fname, &key))
+		goto finish;
+
+	// Anything saved last time?
+	if (work & AN_BEATS) {
+		beats = _bgm_BeatLoad(entry->fname, &key);
+		if (beats) done |= AN_BEATS;
+	}
+	if (work & AN_WAVE) {
+		wave = _bgm_WaveLoad(entry->fname, &key);
+		if (wave) done |= AN_WAVE;
+	}
+	if (work & AN_LOUD) {
+		if (_bgm_LoudLoad(entry->fname, &key, &lufs))
+			done |= AN_LOUD;
+	}
+	if (work & AN_PCM) {
+		if (_bgm_PcmValid(entry->fname, &key)) {
+			rows = _bgm_PcmRowsLoad(entry->fname);
+			done |= AN_PCM;
+		}
+	}
+
+	todo = work & ~done;
+	if (!todo)
+		goto finish;
+
+	// Open the file for decoding, as a stream or failing that as a module
+	chan = BASS_StreamCreateFile(FALSE, entry->fname, 0, 0,
+	                             BASS_STREAM_DECODE|BASS_SAMPLE_FLOAT);
+	if (!chan)
+		chan = BASS_MusicLoad(FALSE, entry->fname, 0, 0,
+		                      BASS_MUSIC_DECODE|BASS_SAMPLE_FLOAT|
+		                      BASS_MUSIC_STOPBACK, 0);
+	if (!chan)
+		goto finish;
+	BASS_ChannelGetInfo(chan, &info);
+	if (!info.chans) info.chans = 1;
+
+	// Get every analysis that needs the decoder ready
+	if (todo & AN_BEATS) {
+		beatState = NEW(BEATSTATE,1);
+		if (beatState && !_bgm_BeatStart(beatState, info.freq)) {
+			free(beatState);
+			beatState = NULL;
+		}
+	}
+	if (todo & AN_WAVE) {
+		waveState = NEW(WAVESTATE,1);
+		if (waveState && !_bgm_WaveStart(waveState, info.freq)) {
+			free(waveState);
+			waveState = NULL;
+		}
+	}
+	if (todo & AN_LOUD) {
+		loudState = NEW(LOUDSTATE,1);
+		if (loudState && !_bgm_LoudStart(loudState, info.freq, info.chans)) {
+			free(loudState);
+			loudState = NULL;
+		}
+	}
+	if (todo & AN_PCM) {
+		pcmState = NEW(PCMSTATE,1);
+		if (pcmState && !_bgm_PcmStart(pcmState, entry->fname, info.freq,
+		                               info.chans, bgm_config.use32Bit)) {
+			free(pcmState);
+			pcmState = NULL;
+		}
+	}
+
+	// A module's PCM cache notes where its rows start, which is only as
+	// close as the blocks it is decoded in
+	want = sizeof(buf);
+	if (pcmState && (info.ctype & BASS_CTYPE_MUSIC_MOD)) {
+		want = info.freq*BGM_PCM_ROWBLOCK/1000*info.chans*sizeof(float);
+		if (want == 0 || want > sizeof(buf))
+			want = sizeof(buf);
+	}
+
+	// Decode the whole file, as fast as it goes
+	while (!bgm_anQuit) {
+		n = BASS_ChannelGetData(chan, buf, want);
+		if (n == (DWORD)-1 || n == 0)
+			break;
+		frames = n/sizeof(float)/info.chans;
+
+		// Loudness and the PCM cache work per channel...
+		if (loudState)
+			_bgm_LoudFeed(loudState, buf, frames);
+		if (pcmState) {
+			_bgm_PcmFeed(pcmState, buf, frames);
+			if (info.ctype & BASS_CTYPE_MUSIC_MOD)
+				_bgm_PcmMark(pcmState, BASS_MusicGetOrderPosition(chan));
+		}
+
+		// ...the others work in mono
+		for (f=0; f<frames; f++) {
+			sum = 0.0f;
+			for (c=0; c<info.chans; c++)
+				sum += buf[f*info.chans+c];
+			mono[f] = sum/info.chans;
+		}
+
+		if (beatState)
+			_bgm_BeatFeed(beatState, mono, frames);
+		if (waveState)
+			_bgm_WaveFeed(waveState, mono, frames);
+	}
+
+	if (!BASS_StreamFree(chan))
+		BASS_MusicFree(chan);
+
+	// Finish off and save whatever wasn't cut short
+	if (beatState) {
+		beats = _bgm_BeatFinish(beatState);
+		free(beatState);
+		if (bgm_anQuit) {
+			_bgm_BeatFree(beats);
+			beats = NULL;
+		}
+		if (beats) {
+			_bgm_BeatSave(entry->fname, &key, beats);
+			done |= AN_BEATS;
+		}
+	}
+	if (waveState) {
+		wave = _bgm_WaveFinish(waveState);
+		free(waveState);
+		if (bgm_anQuit) {
+			_bgm_WaveFree(wave);
+			wave = NULL;
+		}
+		if (wave) {
+			_bgm_WaveSave(entry->fname, &key, wave);
+			done |= AN_WAVE;
+		}
+	}
+	if (loudState) {
+		lufs = _bgm_LoudFinish(loudState);
+		free(loudState);
+		if (!bgm_anQuit) {
+			_bgm_LoudSave(entry->fname, &key, lufs);
+			done |= AN_LOUD;
+		}
+	}
+	if (pcmState) {
+		if (_bgm_PcmFinish(pcmState, entry->fname, &key, !bgm_anQuit)) {
+			rows = pcmState->rows;
+			done |= AN_PCM;
+		}
+		else
+			_bgm_PcmRowsFree(pcmState->rows);
+		free(pcmState);
+	}
+
+finish:
+	EnterCriticalSection(&bgm_anLock);
+	if (done & AN_BEATS)
+		entry->beats = beats;
+	if (done & AN_WAVE)
+		entry->wave = wave;
+	if (done & AN_LOUD)
+		entry->lufs = lufs;
+	if (done & AN_PCM) {
+		_bgm_PcmRowsFree(entry->rows);
+		entry->rows = rows;
+	}
+	entry->done |= done;
+	entry->failed |= work & ~done;
+	entry->running &= ~work;
+	LeaveCriticalSection(&bgm_anLock);
+}
+
+/*	_bgm_AnalyzeThread() -
+		The worker thread. Waits for entries with work to do and does it. */
+DWORD WINAPI _bgm_AnalyzeThread( void *param )
+{
+	ANALYSIS *entry;
+	DWORD work = 0;
+
+	while (!bgm_anQuit) {
+		// Take the work from the first entry that has some
+		EnterCriticalSection(&bgm_anLock);
+		for (entry = bgm_anList; entry; entry = entry->next)
+			if (entry->want)
+				break;
+		if (entry) {
+			work = entry->want;
+			entry->running |= work;
+			entry->want = 0;
+		}
+		LeaveCriticalSection(&bgm_anLock);
+
+		if (entry)
+			_bgm_AnalyzeFile(entry, work);
+		else
+			WaitForSingleObject(bgm_anEvent, INFINITE);
+	}
+
+	return 0;
+}
+
+/* END OF FILE */
@@ -0,0 +1,147 @@
+/******************************************************************************
+ *
+ *	bgm_analyze.h -
+ *		Prototypes and types for BGM's offline analysis. Songs are analysed on
+ *		a worker thread from their own decoding channel (BASS_STREAM_DECODE),
+ *		as fast as the file decodes, and the results are kept in memory by
+ *		filename and saved in sidecar files next to the song so that they
+ *		only ever have to be worked out once.
+ *
+ *****************************************************************************/
+
+#ifndef BGM_ANALYZE_H
+#define BGM_ANALYZE_H
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// Analysis types, used as bit flags
+#define AN_BEATS 0x1 /* Onsets, tempo and beat positions (bgm_beat.c) */
+#define AN_WAVE  0x2 /* Waveform min/max pyramid (bgm_wave.c) */
+#define AN_LOUD  0x4 /* Integrated loudness (bgm_loud.c) */
+#define AN_PCM   0x8 /* Module rendered to a PCM cache (bgm_pcm.c) */
+
+// Version of the sidecar file layouts. Bump it when an analysis changes so
+// that old results are thrown away.
+#define BGM_CACHE_VERSION 1
+
+/******************************************************************************
+ * Typedefs, structs, etc.
+ *****************************************************************************/
+
+/*	CACHEKEY -
+		Identifies one version of a file. A sidecar is only trusted if the
+		key stored in it matches the file's current key.
+*/
+typedef struct ctagCACHEKEY {
+	DWORD	size;	// File size in bytes
+	DWORD	mtime;	// Last modification time
+	DWORD	hash;	// FNV-1a hash of the size and the start and end of the
+					// file
+} CACHEKEY;
+
+/*	ANALYSIS -
+		Everything known about one file. Entries are only ever added, and
+		are only freed by bgm_Close(), so pointers to them stay valid. The
+		flags and results are guarded by bgm_anLock.
+*/
+typedef struct ctagANALYSIS {
+	char		fname[512];	// File the analysis is for
+	DWORD		want;		// AN_* flags asked for but not done yet
+	DWORD		done;		// AN_* flags whose results are ready
+	DWORD		failed;		// AN_* flags that couldn't be worked out
+	DWORD		running;	// AN_* flags the worker is busy with
+	struct
+	ctagBEATINDEX *beats;	// AN_BEATS result
+	struct
+	ctagWAVEPYRAMID *wave;	// AN_WAVE result
+	float		lufs;		// AN_LOUD result
+	struct
+	ctagPCMROWS	*rows;		// Row table of the AN_PCM result, if there is
+							// one
+	struct
+	ctagANALYSIS *next;
+} ANALYSIS;
+
+/******************************************************************************
+ * Global externs
+ *****************************************************************************/
+
+extern CRITICAL_SECTION bgm_anLock;
+
+/******************************************************************************
+ * Function prototypes
+ *****************************************************************************/
+
+/*	_bgm_AnalyzeInit() -
+		Internal function that sets up the analysis state. Called from
+		bgm_Init(). The worker thread is only started once there is work. */
+void _bgm_AnalyzeInit( );
+
+/*	_bgm_AnalyzeFree() -
+		Internal function that stops the worker thread and frees every
+		result. Called from bgm_Close() before BASS is freed. */
+void _bgm_AnalyzeFree( );
+
+/*	_bgm_AnalyzeFind() -
+		Internal function that finds the analysis entry for a file, making
+		one if create is TRUE. Must be called with bgm_anLock held.
+		Returns NULL if there is none (or if out of memory). */
+ANALYSIS* _bgm_AnalyzeFind( const char *fname,
+                            BOOL       create );
+
+/*	_bgm_AnalyzeGet() -
+		Internal function that returns the analysis entry for a song's file,
+		asking the worker for the analyses in what that aren't done yet.
+		Returns NULL (with an error set) if the song can't be analysed. The
+		caller checks entry->done (with bgm_anLock held) to see what is
+		ready. */
+ANALYSIS* _bgm_AnalyzeGet( SONG  *song,
+                           DWORD what );
+
+/*	_bgm_CacheKey() -
+		Internal function that works out the cache key of a file.
+		Returns FALSE if the file can't be read. */
+BOOL _bgm_CacheKey( const char *fname,
+                    CACHEKEY   *key );
+
+/*	_bgm_CacheOpen() -
+		Internal function that opens the sidecar of a file (fname + ext) for
+		reading. Returns NULL if there is none or if it is for a different
+		version of the file or of BGM; otherwise the file is left just past
+		the header. */
+FILE* _bgm_CacheOpen( const char     *fname,
+                      const char     *ext,
+                      DWORD          magic,
+                      const CACHEKEY *key );
+
+/*	_bgm_CacheLeft() -
+		Internal function that returns how many bytes of a sidecar are left
+		to read, so that counts read from it can be checked before anything
+		is allocated for them. */
+DWORD _bgm_CacheLeft( FILE *f );
+
+/*	_bgm_CacheCreate() -
+		Internal function that creates the sidecar of a file and writes its
+		header. Returns NULL if it can't be written (a read-only folder, for
+		example), in which case the result just isn't saved. */
+FILE* _bgm_CacheCreate( const char     *fname,
+                        const char     *ext,
+                        DWORD          magic,
+                        const CACHEKEY *key );
+
+/*	_bgm_AnalyzeFile() -
+		Internal function, run on the worker thread, that does the analyses
+		in work for the entry: from the sidecars where they are up to date,
+		otherwise with one decoding pass that feeds all of them. */
+void _bgm_AnalyzeFile( ANALYSIS *entry,
+                       DWORD    work );
+
+/*	_bgm_AnalyzeThread() -
+		The worker thread. Waits for entries with work to do and does it. */
+DWORD WINAPI _bgm_AnalyzeThread( void *param );
+
+#endif // BGM_ANALYZE_H
+
+/* END OF FILE */
@@ -15,12 +15,19 @@ BEGIN_ATTRIBUTE_LIST
 	DEFINE_ATTR(amplify,     0)
 	DEFINE_ATTR(bpm,         0)
 	DEFINE_ATTR(cfreq,       AT_QPSAFE)
+	DEFINE_ATTR(coalesce,    0)
 	DEFINE_ATTR(cpanning,    AT_QPSAFE)
 	DEFINE_ATTR(cvolume,     AT_QPSAFE)
 	DEFINE_ATTR(filename,    0)
+	DEFINE_ATTR(fx,          0)
+	DEFINE_ATTR(fxcount,     0)
+	DEFINE_ATTR(group,       AT_QPSAFE)
 	DEFINE_ATTR(id,          0)
+	DEFINE_ATTR(iofill,      0)
+	DEFINE_ATTR(iounderruns, 0)
 	DEFINE_ATTR(ivolume,     0)
 	DEFINE_ATTR(loop,        0)
+	DEFINE_ATTR(memory,      AT_PEEK)
 	DEFINE_ATTR(minstrument, 0)
 	DEFINE_ATTR(mmessage,    0)
 	DEFINE_ATTR(msample,     0)
@@ -30,17 +37,35 @@ BEGIN_ATTRIBUTE_LIST
 	DEFINE_ATTR(speed,       0)
 	DEFINE_ATTR(tvolume,     0)
 	DEFINE_ATTR(type,        0)
+	DEFINE_ATTR(vcooldown,   0)
+	DEFINE_ATTR(vpriority,   0)
 
-	DEFINE_ATTR(stream,   AT_GLOBAL)
-	DEFINE_ATTR(volume,   AT_GLOBAL)
+	DEFINE_ATTR(async,         AT_GLOBAL)
+	DEFINE_ATTR(coalescecap,   AT_GLOBAL)
+	DEFINE_ATTR(coalesced,     AT_GLOBAL)
+	DEFINE_ATTR(evictions,     AT_GLOBAL)
+	DEFINE_ATTR(idletime,      AT_GLOBAL)
+	DEFINE_ATTR(limiter,       AT_GLOBAL)
+	DEFINE_ATTR(limreduction,  AT_GLOBAL)
+	DEFINE_ATTR(limrelease,    AT_GLOBAL)
+	DEFINE_ATTR(limthreshold,  AT_GLOBAL)
+	DEFINE_ATTR(membudget,     AT_GLOBAL)
+	DEFINE_ATTR(memtotal,      AT_GLOBAL)
+	DEFINE_ATTR(meters,        AT_GLOBAL)
+	DEFINE_ATTR(modcache,      AT_GLOBAL)
+	DEFINE_ATTR(netcache,      AT_GLOBAL)
+	DEFINE_ATTR(normalize,     AT_GLOBAL)
+	DEFINE_ATTR(primedstop,    AT_GLOBAL)
+	DEFINE_ATTR(qpwarm,        AT_GLOBAL)
+	DEFINE_ATTR(readahead,     AT_GLOBAL)
+	DEFINE_ATTR(stream,        AT_GLOBAL)
+	DEFINE_ATTR(virtual,       AT_GLOBAL)
+	DEFINE_ATTR(voicebudget,   AT_GLOBAL)
+	DEFINE_ATTR(voicesdropped, AT_GLOBAL)
+	DEFINE_ATTR(voicesstolen,  AT_GLOBAL)
+	DEFINE_ATTR(volume,        AT_GLOBAL)
 END_ATTRIBUTE_LIST;
 
-/******************************************************************************
- * Globals
- *****************************************************************************/
-
-GM_REAL bgm_attrTypeLast = -1;
-
 /******************************************************************************
  * Function implementations
  *****************************************************************************/
@@ -128,6 +153,8 @@ const BGM_ATTRIBUTE* _bgm_AccessAttr(SONG *song, char *name, DWORD *n)
 		with the given ID.
 		The type of the return value is stored in the global var
 		bgm_lastAttrType.
+		The string stays valid until the calling thread has had
+		BGM_TMPSTR_COUNT more back from BGM.
 		Returns "-1000000" on error. */
 DLL_FUNC
 GM_STRING bgm_GetAttrById( GM_REAL		songId,
@@ -137,11 +164,19 @@ GM_STRING bgm_GetAttrById( GM_REAL		songId,
 	DWORD n;
 	const BGM_ATTRIBUTE *attr;
 	
-	song = _bgm_GetSongById(songId);
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdCallStr(BGM_CMD_GETATTRBYID, "rs", songId, name);
+	
+	_bgm_TmpStrNext();
+	song = _bgm_PeekSongById(songId);
 	attr = _bgm_AccessAttr(song, name, &n);
 	if (!attr)
 		/* ERROR HANDLER */
 		return BGM_ATTR_GET_FAIL;
+	// Most attributes need the song's channel, so an evicted song has to
+	// be loaded again for them (see bgm_mem.c)
+	if (!(attr->flags & (AT_GLOBAL|AT_PEEK)))
+		_bgm_MemTouch(song);
 	return attr->Get(song,n);
 }
 // END bgm_GetAttrById()
@@ -151,6 +186,7 @@ GM_STRING bgm_GetAttrById( GM_REAL		songId,
 		that was loaded from the given filename or URL. If the attribute is
 		global, fname is ignored.
 		The type is stored in the global var bgm_lastAttrType.
+		The string stays valid as with bgm_GetAttrById().
 		Returns "-1000000" on error. */
 DLL_FUNC
 GM_STRING bgm_GetAttrByFname( GM_STRING	fname,
@@ -160,11 +196,19 @@ GM_STRING bgm_GetAttrByFname( GM_STRING	fname,
 	DWORD n;
 	const BGM_ATTRIBUTE *attr;
 	
-	song = _bgm_GetSongByFname(fname);
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdCallStr(BGM_CMD_GETATTRBYFNAME, "ss", fname, name);
+	
+	_bgm_TmpStrNext();
+	song = _bgm_PeekSongByFname(fname);
 	attr = _bgm_AccessAttr(song, name, &n);
 	if (!attr)
 		/* ERROR HANDLER */
 		return BGM_ATTR_GET_FAIL;
+	// Most attributes need the song's channel, so an evicted song has to
+	// be loaded again for them (see bgm_mem.c)
+	if (!(attr->flags & (AT_GLOBAL|AT_PEEK)))
+		_bgm_MemTouch(song);
 	return attr->Get(song,n);
 }
 // END bgm_GetAttrById()
@@ -194,6 +238,17 @@ GM_REAL bgm_SetAttrById( GM_REAL	songId,
 	DWORD n;
 	const BGM_ATTRIBUTE *attr;
 	
+	// Leaving async mode has to wait, or the calls made after it could
+	// overtake the ones still queued
+	if (BGM_CMD_ASYNC) {
+		if (_bgm_CmdIsAsyncAttr(name))
+			return _bgm_CmdCall(BGM_CMD_SETATTRBYID, "rss", songId, name,
+			                    value);
+		return _bgm_CmdPost(BGM_CMD_SETATTRBYID, "rss", songId, name, value);
+	}
+	
+	_bgm_VirtPoll();
+	
 	song = _bgm_GetSongById(songId);
 	attr = _bgm_AccessAttr(song, name, &n);
 	if (!attr)
@@ -216,6 +271,18 @@ GM_REAL bgm_SetAttrByFname( GM_STRING	fname,
 	DWORD n;
 	const BGM_ATTRIBUTE *attr;
 	
+	// Leaving async mode has to wait, or the calls made after it could
+	// overtake the ones still queued
+	if (BGM_CMD_ASYNC) {
+		if (_bgm_CmdIsAsyncAttr(name))
+			return _bgm_CmdCall(BGM_CMD_SETATTRBYFNAME, "sss", fname, name,
+			                    value);
+		return _bgm_CmdPost(BGM_CMD_SETATTRBYFNAME, "sss", fname, name,
+		                    value);
+	}
+	
+	_bgm_VirtPoll();
+	
 	song = _bgm_GetSongByFname(fname);
 	attr = _bgm_AccessAttr(song, name, &n);
 	if (!attr)
@@ -238,7 +305,7 @@ char* _bgm_GetModAttr( SONG        *song,
 	ERROR_CONTEXT(err);
 	
 	// Make sure the song is a mod
-	BASS_ChannelGetInfo(song->id,&info);
+	BASS_ChannelGetInfo(_bgm_PcmModHandle(song),&info);
 	if (info.ctype & BASS_CTYPE_MUSIC_MOD == 0) {
 		/* ERROR HANDLER */
 		BGM_ERROR("Song is not a module.");
@@ -246,7 +313,7 @@ char* _bgm_GetModAttr( SONG        *song,
 	}
 	
 	// Try to get the value
-	ret = BASS_MusicGetAttribute(song->id, attr);
+	ret = BASS_MusicGetAttribute(_bgm_PcmModHandle(song), attr);
 	if (ret == -1) {
 		/* ERROR HANDLER */
 		BGM_ERROR("Invalid attribute number?");
@@ -275,7 +342,7 @@ BOOL _bgm_SetModAttr( SONG       *song,
 	ERROR_CONTEXT(err);
 	
 	// Get the song's channel info
-	BASS_ChannelGetInfo(song->id, &info);
+	BASS_ChannelGetInfo(_bgm_PcmModHandle(song), &info);
 	
 	// Fail if the song is not a module
 	/* ERROR HANDLER */
@@ -294,6 +361,15 @@ BOOL _bgm_SetModAttr( SONG       *song,
 		return FALSE;
 	}
 	
+	// The PCM cache is rendered with the attributes as they were, so a
+	// change means going back to the module itself, and never using the
+	// cache if the song isn't on it yet
+	if (BASS_MusicGetAttribute(_bgm_PcmModHandle(song), attr) == valnum)
+		return TRUE;
+	song->modDirty = TRUE;
+	if (song->music)
+		_bgm_PcmGoLive(song);
+	
 	// Try to set the attribute
 	if (BASS_MusicSetAttribute(song->id, attr, valnum) == -1) {
 		/* ERROR HANDLER */
@@ -313,7 +389,7 @@ const char* _bgm_GetSongTag( SONG        *song,
 {
 	const char *str;
 	ERROR_CONTEXT(err);
-	str = BASS_ChannelGetTags(song->id, tag);
+	str = BASS_ChannelGetTags(_bgm_PcmModHandle(song), tag);
 	/* ERROR HANDLER */
 	if (!str) {
 		BGM_ERROR("Data not available.");
@@ -344,8 +420,23 @@ BOOL _bgm_FadeVol(SONG *song, int vol, DWORD msec)
 		return FALSE;
 	}
 	
-	// Start the sliding
+	// Start the sliding, to the level the cvolume attribute would set
+	// (turned down to the normalised loudness)
+	if (vol >= 0) {
+		song->userVol = vol;
+		vol = (int)(vol*song->normGain + 0.5f);
+	}
 	BASS_ChannelSlideAttributes(song->id, -1, vol, -101, msec);
+	song->fadeEnd = GetTickCount() + msec;
+	
+	// A virtual song fading up to where it would be heard plays again now,
+	// as it would if cvolume were set there, rather than when a sweep
+	// catches up with the fade
+	if (song->virt && vol >= 0 &&
+	    _bgm_VirtGainAt(song, vol) >= bgm_config.virtualGain*BGM_VIRT_HYSTERESIS)
+		_bgm_VirtEnd(song, GetTickCount(), TRUE);
+	else
+		_bgm_VirtCheck(song, GetTickCount());
 	
 	return TRUE;
 }
@@ -357,6 +448,8 @@ GM_REAL bgm_FadeVolById( GM_REAL songId,
                          GM_REAL vol,
                          GM_REAL msec )
 {
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdPost(BGM_CMD_FADEVOLBYID, "rrr", songId, vol, msec);
 	return _bgm_FadeVol(_bgm_GetSongById(songId), (int)vol, (DWORD)msec);
 }
 
@@ -367,6 +460,8 @@ GM_REAL bgm_FadeVolByFname( GM_STRING fname,
                             GM_REAL   vol,
                             GM_REAL   msec )
 {
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdPost(BGM_CMD_FADEVOLBYFNAME, "srr", fname, vol, msec);
 	return _bgm_FadeVol(_bgm_GetSongByFname(fname), (int)vol, (DWORD)msec);
 }
 
@@ -380,6 +475,11 @@ BOOL _bgm_VolIsFading(SONG *song)
 		return FALSE;
 	}
 	
+	// An evicted song's fade went with its channel; one looked up in the
+	// async snapshot has when its fade ends instead (see bgm_cmd.c)
+	if (song->evicted)
+		return song->fadeEnd && (int)(song->fadeEnd - GetTickCount()) > 0;
+	
 	// Return false if the QP song was accessed but none is loaded
 	if (song->id==0)
 		return FALSE;
@@ -393,6 +493,10 @@ BOOL _bgm_VolIsFading(SONG *song)
 DLL_FUNC
 GM_REAL bgm_VolIsFadingById( GM_REAL songId )
 {
+	SONG stub;
+	
+	if (BGM_CMD_ASYNC)
+		return _bgm_VolIsFading(_bgm_CmdSnapFind(songId, NULL, &stub));
 	return _bgm_VolIsFading(_bgm_GetSongById(songId));
 }
 
@@ -401,6 +505,10 @@ GM_REAL bgm_VolIsFadingById( GM_REAL songId )
 DLL_FUNC
 GM_REAL bgm_VolIsFadingByFname( GM_STRING fname )
 {
+	SONG stub;
+	
+	if (BGM_CMD_ASYNC)
+		return _bgm_VolIsFading(_bgm_CmdSnapFind(0, fname, &stub));
 	return _bgm_VolIsFading(_bgm_GetSongByFname(fname));
 }
 
@@ -454,6 +562,29 @@ ATTR_IMPLEMENT_S(cfreq) {
 	return TRUE;
 }
 
+// coalesce - Window plays of the song are merged in, in ms, or 0 to not
+// merge them (see bgm_coalesce.c)
+ATTR_IMPLEMENT_G(coalesce) {
+	sprintf(bgm_tmpStr, "%u", song->coalesce ? song->coalesce->window : 0);
+	bgm_attrTypeLast = TY_REAL;
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(coalesce) {
+	int ms = atoi(value);
+	ERROR_CONTEXT("Failed to set coalescing window");
+	/* ERROR HANDLER */
+	if (ms < 0 || ms > 1000) {
+		BGM_ERROR("Value (%i) is not between 0 and 1000.", ms);
+		return FALSE;
+	}
+	/* ERROR HANDLER */
+	if (!_bgm_CoalesceSet(song, ms)) {
+		BGM_ERROR("Out of memory.");
+		return FALSE;
+	}
+	return TRUE;
+}
+
 // cpanning - Channel panning
 ATTR_IMPLEMENT_G(cpanning) { 
 	int pan;
@@ -480,13 +611,13 @@ ATTR_IMPLEMENT_S(cpanning) {
 	return TRUE;
 }
 
-// cvolume - Channel volume
+// cvolume - Channel volume (while a fade runs, the level it is heading to)
 ATTR_IMPLEMENT_G(cvolume) {
 	DWORD vol;
 	if (song->id==0)
 		vol = ((CHANDATA*)song->extData)->vol;
 	else
-		BASS_ChannelGetAttributes(song->id, NULL, &vol, NULL);
+		vol = song->userVol;
 	sprintf(bgm_tmpStr, "%i", vol);
 	bgm_attrTypeLast = TY_REAL;
 	return bgm_tmpStr;
@@ -501,8 +632,12 @@ ATTR_IMPLEMENT_S(cvolume) {
 	}
 	if (song->id==0)
 		((CHANDATA*)song->extData)->vol = vol;
-	else
-		BASS_ChannelSetAttributes(song->id, -1, vol, -101);
+	else {
+		song->userVol = vol;
+		BASS_ChannelSetAttributes(song->id, -1,
+		                          (int)(vol*song->normGain + 0.5f), -101);
+		_bgm_VirtCheck(song, GetTickCount());
+	}
 	return TRUE;
 }
 
@@ -517,9 +652,69 @@ ATTR_IMPLEMENT_S(filename) {
 	return FALSE;
 }
 
+// fx[n] - Type and parameters of the n-th effect in the song's chain
+ATTR_IMPLEMENT_G(fx) {
+	BGM_FX *fx;
+	ERROR_CONTEXT("Failed to get effect");
+	/* ERROR HANDLER */
+	if (!song->dsp || n >= song->dsp->fx.count) {
+		BGM_ERROR("Song has no effect %i.", n);
+		bgm_attrTypeLast = TY_REAL;
+		return BGM_ATTR_GET_FAIL;
+	}
+	fx = &song->dsp->fx.fx[n];
+	sprintf(bgm_tmpStr, "%s,%g,%g", bgm_fxNames[fx->type], fx->param[0],
+	        fx->param[1]);
+	bgm_attrTypeLast = TY_STRING;
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(fx) {
+	ERROR_CONTEXT("Failed to set effect parameters");
+	/* ERROR HANDLER */
+	if (!song->dsp || n >= song->dsp->fx.count) {
+		BGM_ERROR("Song has no effect %i.", n);
+		return FALSE;
+	}
+	EnterCriticalSection(&song->dsp->lock);
+	_bgm_FxSetParams(&song->dsp->fx.fx[n], value, song->dsp->freq);
+	LeaveCriticalSection(&song->dsp->lock);
+	_bgm_Reprime(song);
+	return TRUE;
+}
+
+// fxcount - Number of effects in the song's chain
+ATTR_IMPLEMENT_G(fxcount) {
+	sprintf(bgm_tmpStr, "%i", song->dsp ? song->dsp->fx.count : 0);
+	bgm_attrTypeLast = TY_REAL;
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(fxcount) {
+	ERROR_CONTEXT("Cannot change effect count");
+	BGM_ERROR("Attribute is read-only.");
+	return FALSE;
+}
+
+// group - Group the song is in, for ducking (see bgm_DuckSet())
+ATTR_IMPLEMENT_G(group) {
+	sprintf(bgm_tmpStr, "%i", song->group);
+	bgm_attrTypeLast = TY_REAL;
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(group) {
+	ERROR_CONTEXT("Failed to set song group");
+	int group = atoi(value);
+	/* ERROR HANDLER */
+	if (group < 0 || group >= BGM_MAX_GROUPS) {
+		BGM_ERROR("Value (%i) not between 0 and %i.", group, BGM_MAX_GROUPS-1);
+		return FALSE;
+	}
+	_bgm_BusSetGroup(song, group);
+	return TRUE;
+}
+
 // id - ID number that is associated with a song
 ATTR_IMPLEMENT_G(id) {
-	sprintf(bgm_tmpStr, "%i", song->id);
+	sprintf(bgm_tmpStr, "%i", song->ref);
 	bgm_attrTypeLast = TY_REAL;
 	return bgm_tmpStr;
 }
@@ -529,6 +724,38 @@ ATTR_IMPLEMENT_S(id) {
 	return FALSE;
 }
 
+// iofill - How full the song's read-ahead buffer is, in percent, or -1 if
+// the song isn't read ahead (see bgm_io.c)
+ATTR_IMPLEMENT_G(iofill) {
+	IOSTREAM *io = song->io;
+	int fill = -1;
+	if (io) {
+		EnterCriticalSection(&io->lock);
+		fill = (int)((double)io->fill*100.0/io->size + 0.5);
+		LeaveCriticalSection(&io->lock);
+	}
+	sprintf(bgm_tmpStr, "%i", fill);
+	bgm_attrTypeLast = TY_REAL;
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(iofill) {
+	ERROR_CONTEXT("Cannot change read-ahead fill level");
+	BGM_ERROR("Attribute is read-only.");
+	return FALSE;
+}
+
+// iounderruns - Times the song's read-ahead buffer ran dry while playing
+ATTR_IMPLEMENT_G(iounderruns) {
+	sprintf(bgm_tmpStr, "%u", song->io ? song->io->underruns : 0);
+	bgm_attrTypeLast = TY_REAL;
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(iounderruns) {
+	ERROR_CONTEXT("Cannot change read-ahead underrun count");
+	BGM_ERROR("Attribute is read-only.");
+	return FALSE;
+}
+
 // ivolume[n] - Module instrument n volume
 ATTR_IMPLEMENT_G(ivolume) {
 	return _bgm_GetModAttr(song, BASS_MUSIC_ATTRIB_VOL_INST+n,
@@ -559,6 +786,19 @@ ATTR_IMPLEMENT_S(loop) {
 	return TRUE;
 }
 
+// memory - Memory the song holds, in bytes, as far as BGM can tell (see
+// bgm_mem.c)
+ATTR_IMPLEMENT_G(memory) {
+	sprintf(bgm_tmpStr, "%u", _bgm_MemBytes(song));
+	bgm_attrTypeLast = TY_REAL;
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(memory) {
+	ERROR_CONTEXT("Cannot change song memory");
+	BGM_ERROR("Attribute is read-only.");
+	return FALSE;
+}
+
 // minstrument[n] - Module instruments' names
 ATTR_IMPLEMENT_G(minstrument) {
 	return (GM_STRING)_bgm_GetSongTag(song, BASS_TAG_MUSIC_INST+n, 
@@ -647,7 +887,7 @@ ATTR_IMPLEMENT_S(tvolume) {
 ATTR_IMPLEMENT_G(type) {
 	BASS_CHANNELINFO info;
 	int type;
-	BASS_ChannelGetInfo(song->id, &info);
+	BASS_ChannelGetInfo(_bgm_PcmModHandle(song), &info);
 	if (info.ctype == BASS_CTYPE_SAMPLE)
 		type = 0;
 	else if (info.ctype & BASS_CTYPE_STREAM)
@@ -666,10 +906,360 @@ ATTR_IMPLEMENT_S(type) {
 	return FALSE;
 }
 
+// vcooldown - Least time between two voices of a song, in ms (see
+// bgm_voice.c)
+ATTR_IMPLEMENT_G(vcooldown) {
+	ERROR_CONTEXT("Failed to get voice cooldown");
+	/* ERROR HANDLER */
+	if (!song->voices) {
+		BGM_ERROR("Song was not loaded with bgm_LoadSampleVoices().");
+		bgm_attrTypeLast = TY_REAL;
+		return BGM_ATTR_GET_FAIL;
+	}
+	sprintf(bgm_tmpStr, "%u", song->voices->cooldown);
+	bgm_attrTypeLast = TY_REAL;
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(vcooldown) {
+	int ms = atoi(value);
+	ERROR_CONTEXT("Failed to set voice cooldown");
+	/* ERROR HANDLER */
+	if (!song->voices) {
+		BGM_ERROR("Song was not loaded with bgm_LoadSampleVoices().");
+		return FALSE;
+	}
+	/* ERROR HANDLER */
+	if (ms < 0 || ms > 60000) {
+		BGM_ERROR("Value (%i) is not between 0 and 60000.", ms);
+		return FALSE;
+	}
+	song->voices->cooldown = ms;
+	return TRUE;
+}
+
+// vpriority - Priority of a song's voices when voices are stolen
+ATTR_IMPLEMENT_G(vpriority) {
+	ERROR_CONTEXT("Failed to get voice priority");
+	/* ERROR HANDLER */
+	if (!song->voices) {
+		BGM_ERROR("Song was not loaded with bgm_LoadSampleVoices().");
+		bgm_attrTypeLast = TY_REAL;
+		return BGM_ATTR_GET_FAIL;
+	}
+	sprintf(bgm_tmpStr, "%u", song->voices->priority);
+	bgm_attrTypeLast = TY_REAL;
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(vpriority) {
+	int prio = atoi(value);
+	ERROR_CONTEXT("Failed to set voice priority");
+	/* ERROR HANDLER */
+	if (!song->voices) {
+		BGM_ERROR("Song was not loaded with bgm_LoadSampleVoices().");
+		return FALSE;
+	}
+	/* ERROR HANDLER */
+	if (prio < 0 || prio > 100) {
+		BGM_ERROR("Value (%i) is not between 0 and 100.", prio);
+		return FALSE;
+	}
+	song->voices->priority = prio;
+	return TRUE;
+}
+
 /******************************************************************************
  * Global Attribute Function Implementation
  *****************************************************************************/
 
+// async - hand calls to the control thread (see bgm_cmd.c)
+ATTR_IMPLEMENT_G(async) {
+	bgm_attrTypeLast = TY_REAL;
+	sprintf(bgm_tmpStr, "%i", bgm_config.async);
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(async) {
+	BOOL on = (atoi(value) != FALSE);
+	ERROR_CONTEXT("Failed to set async mode");
+	/* ERROR HANDLER */
+	if (on && !_bgm_CmdStart())
+		return FALSE;
+	bgm_config.async = on;
+	return TRUE;
+}
+
+// coalescecap - Most a coalesced play is boosted, in percent of its volume
+ATTR_IMPLEMENT_G(coalescecap) {
+	bgm_attrTypeLast = TY_REAL;
+	sprintf(bgm_tmpStr, "%u", bgm_config.coalesceCap);
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(coalescecap) {
+	int cap = atoi(value);
+	ERROR_CONTEXT("Failed to set coalescing cap");
+	/* ERROR HANDLER */
+	if (cap < 100 || cap > 1000) {
+		BGM_ERROR("Value (%i) is not between 100 and 1000.", cap);
+		return FALSE;
+	}
+	bgm_config.coalesceCap = cap;
+	return TRUE;
+}
+
+// coalesced - Plays merged into one already playing. Setting it starts the
+// count again.
+ATTR_IMPLEMENT_G(coalesced) {
+	bgm_attrTypeLast = TY_REAL;
+	sprintf(bgm_tmpStr, "%u", _bgm_Context()->coalesced);
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(coalesced) {
+	_bgm_Context()->coalesced = atoi(value);
+	return TRUE;
+}
+
+// evictions - Songs evicted to keep to the memory budget, or unloaded for
+// being idle. Setting it starts the count again.
+ATTR_IMPLEMENT_G(evictions) {
+	bgm_attrTypeLast = TY_REAL;
+	sprintf(bgm_tmpStr, "%u", _bgm_Context()->evictions);
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(evictions) {
+	_bgm_Context()->evictions = atoi(value);
+	return TRUE;
+}
+
+// idletime - How long registered songs are kept loaded unused, in ms, or 0
+// for ever (see bgm_lazy.c)
+ATTR_IMPLEMENT_G(idletime) {
+	bgm_attrTypeLast = TY_REAL;
+	sprintf(bgm_tmpStr, "%u", bgm_config.idleTime);
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(idletime) {
+	double ms = atof(value);
+	ERROR_CONTEXT("Failed to set idle time");
+	/* ERROR HANDLER */
+	if (ms < 0 || ms > 86400000.0) {
+		BGM_ERROR("Value (%g) is not between 0 and 86400000.", ms);
+		return FALSE;
+	}
+	bgm_config.idleTime = (DWORD)ms;
+	return TRUE;
+}
+
+// limiter - master bus limiter on/off
+ATTR_IMPLEMENT_G(limiter) {
+	bgm_attrTypeLast = TY_REAL;
+	sprintf(bgm_tmpStr, "%i", bgm_bus.limiter);
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(limiter) {
+	bgm_bus.limiter = (atoi(value) != FALSE);
+	// Every song has to run through the bus from now on
+	if (bgm_bus.limiter)
+		_bgm_DspAttachAll();
+	return TRUE;
+}
+
+// limreduction - gain reduction the limiter applied in the last update, dB,
+// or 0 once nothing has played through it for a couple of updates
+ATTR_IMPLEMENT_G(limreduction) {
+	bgm_attrTypeLast = TY_REAL;
+	sprintf(bgm_tmpStr, "%g", bgm_bus.limiter ? _bgm_BusReduction() : 0.0f);
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(limreduction) {
+	ERROR_CONTEXT("Cannot change limiter gain reduction");
+	BGM_ERROR("Attribute is read-only.");
+	return FALSE;
+}
+
+// limrelease - limiter release time in milliseconds
+ATTR_IMPLEMENT_G(limrelease) {
+	bgm_attrTypeLast = TY_REAL;
+	sprintf(bgm_tmpStr, "%g", bgm_bus.releaseMs);
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(limrelease) {
+	float ms = (float)atof(value);
+	ERROR_CONTEXT("Failed to set limiter release");
+	/* ERROR HANDLER */
+	if (ms < 1.0f || ms > 5000.0f) {
+		BGM_ERROR("Value (%g) is not between 1 and 5000.", ms);
+		return FALSE;
+	}
+	EnterCriticalSection(&bgm_bus.lock);
+	bgm_bus.releaseMs = ms;
+	LeaveCriticalSection(&bgm_bus.lock);
+	return TRUE;
+}
+
+// limthreshold - limiter ceiling in dBFS
+ATTR_IMPLEMENT_G(limthreshold) {
+	bgm_attrTypeLast = TY_REAL;
+	sprintf(bgm_tmpStr, "%g", bgm_bus.thresholdDb);
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(limthreshold) {
+	float db = (float)atof(value);
+	ERROR_CONTEXT("Failed to set limiter threshold");
+	/* ERROR HANDLER */
+	if (db < -40.0f || db > 0.0f) {
+		BGM_ERROR("Value (%g) is not between -40 and 0.", db);
+		return FALSE;
+	}
+	EnterCriticalSection(&bgm_bus.lock);
+	bgm_bus.thresholdDb = db;
+	bgm_bus.threshold = (float)pow(10.0, db/20.0);
+	LeaveCriticalSection(&bgm_bus.lock);
+	return TRUE;
+}
+
+// membudget - Most memory songs can hold, in bytes, or 0 for no limit (see
+// bgm_mem.c)
+ATTR_IMPLEMENT_G(membudget) {
+	bgm_attrTypeLast = TY_REAL;
+	sprintf(bgm_tmpStr, "%u", bgm_config.memBudget);
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(membudget) {
+	return bgm_SetMemoryBudget(atof(value));
+}
+
+// memtotal - Memory all the songs hold, in bytes
+ATTR_IMPLEMENT_G(memtotal) {
+	bgm_attrTypeLast = TY_REAL;
+	sprintf(bgm_tmpStr, "%u", _bgm_MemTotal());
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(memtotal) {
+	ERROR_CONTEXT("Cannot change total memory");
+	BGM_ERROR("Attribute is read-only.");
+	return FALSE;
+}
+
+// meters - Whether or not songs' levels are measured for bgm_MetersRead().
+// Reading the meters turns them on, and they go off again once they haven't
+// been read for BGM_METER_LAPSE ms.
+ATTR_IMPLEMENT_G(meters) {
+	bgm_attrTypeLast = TY_REAL;
+	sprintf(bgm_tmpStr, "%i", bgm_meterOn);
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(meters) {
+	if (atoi(value) != FALSE)
+		_bgm_MeterStart();
+	else
+		bgm_meterOn = FALSE;
+	return TRUE;
+}
+
+// modcache - play modules from pre-rendered PCM caches (see bgm_pcm.c)
+ATTR_IMPLEMENT_G(modcache) {
+	bgm_attrTypeLast = TY_REAL;
+	sprintf(bgm_tmpStr, "%i", bgm_config.modCache);
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(modcache) {
+	bgm_config.modCache = (atoi(value) != FALSE);
+	return TRUE;
+}
+
+// netcache - Folder internet streams are cached in, or "" for none (see
+// bgm_net.c)
+ATTR_IMPLEMENT_G(netcache) {
+	bgm_attrTypeLast = TY_STRING;
+	return bgm_config.netCache;
+}
+ATTR_IMPLEMENT_S(netcache) {
+	DWORD attrs, len = strlen(value);
+	ERROR_CONTEXT("Failed to set internet stream cache folder");
+	/* ERROR HANDLER */
+	if (len >= sizeof(bgm_config.netCache)) {
+		BGM_ERROR("Folder name is too long.");
+		return FALSE;
+	}
+	if (len) {
+		attrs = GetFileAttributes(value);
+		/* ERROR HANDLER */
+		if (attrs == INVALID_FILE_ATTRIBUTES ||
+		    !(attrs & FILE_ATTRIBUTE_DIRECTORY)) {
+			BGM_ERROR("\"%s\" is not a folder.", value);
+			return FALSE;
+		}
+	}
+	strcpy(bgm_config.netCache, value);
+	// Paths are made with a backslash of their own
+	if (len && (value[len-1] == '\\' || value[len-1] == '/'))
+		bgm_config.netCache[len-1] = 0;
+	return TRUE;
+}
+
+// normalize - loudness normalisation flag
+ATTR_IMPLEMENT_G(normalize) {
+	bgm_attrTypeLast = TY_REAL;
+	sprintf(bgm_tmpStr, "%i", bgm_config.normalize);
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(normalize) {
+	bgm_config.normalize = (atoi(value) != FALSE);
+	_bgm_LoudApplyAll();
+	return TRUE;
+}
+
+// primedstop - Whether or not stopping a stream or module rewinds it and
+// fills its buffer, ready to be heard again at once (see bgm_Prime())
+ATTR_IMPLEMENT_G(primedstop) {
+	bgm_attrTypeLast = TY_REAL;
+	sprintf(bgm_tmpStr, "%i", bgm_config.primedStop);
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(primedstop) {
+	bgm_config.primedStop = (atoi(value) != FALSE);
+	return TRUE;
+}
+
+// qpwarm - Most songs kept loaded after leaving Quick Play, or 0 to unload
+// them straight away (see bgm_qpcache.c)
+ATTR_IMPLEMENT_G(qpwarm) {
+	bgm_attrTypeLast = TY_REAL;
+	sprintf(bgm_tmpStr, "%u", bgm_config.qpWarm);
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(qpwarm) {
+	int count = atoi(value);
+	ERROR_CONTEXT("Failed to set Quick Play warm cache size");
+	/* ERROR HANDLER */
+	if (count < 0 || count > BGM_QP_WARM_MAX) {
+		BGM_ERROR("Value (%i) is not between 0 and %i.", count,
+		          BGM_QP_WARM_MAX);
+		return FALSE;
+	}
+	bgm_config.qpWarm = (DWORD)count;
+	_bgm_QpTrim(bgm_config.qpWarm);
+	return TRUE;
+}
+
+// readahead - Read-ahead buffer for file streams loaded from now on, in KB,
+// or 0 to have BASS read the files itself (see bgm_io.c)
+ATTR_IMPLEMENT_G(readahead) {
+	bgm_attrTypeLast = TY_REAL;
+	sprintf(bgm_tmpStr, "%u", bgm_config.readAhead);
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(readahead) {
+	int kb = atoi(value);
+	ERROR_CONTEXT("Failed to set read-ahead buffer size");
+	/* ERROR HANDLER */
+	if (kb < 0 || kb > 65536) {
+		BGM_ERROR("Value (%i) is not between 0 and 65536.", kb);
+		return FALSE;
+	}
+	bgm_config.readAhead = kb;
+	return TRUE;
+}
+
 // stream - stream-by-default flag
 ATTR_IMPLEMENT_G(stream) {
 	bgm_attrTypeLast = TY_REAL;
@@ -681,6 +1271,70 @@ ATTR_IMPLEMENT_S(stream) {
 	return TRUE;
 }
 
+// virtual - Level (dB) below which songs go virtual, or 0 for never (see
+// bgm_virt.c)
+ATTR_IMPLEMENT_G(virtual) {
+	bgm_attrTypeLast = TY_REAL;
+	sprintf(bgm_tmpStr, "%g", bgm_config.virtualDb);
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(virtual) {
+	float db = (float)atof(value);
+	ERROR_CONTEXT("Failed to set virtual level");
+	/* ERROR HANDLER */
+	if (db < -120.0f || db > 0.0f) {
+		BGM_ERROR("Value (%g) is not between -120 and 0.", db);
+		return FALSE;
+	}
+	bgm_config.virtualDb = db;
+	bgm_config.virtualGain = (float)pow(10.0, db/20.0);
+	// Songs already too quiet go now, and with it off all come back
+	_bgm_VirtCheckAll();
+	return TRUE;
+}
+
+// voicebudget - Most voices that can play at once, or 0 for no limit
+ATTR_IMPLEMENT_G(voicebudget) {
+	bgm_attrTypeLast = TY_REAL;
+	sprintf(bgm_tmpStr, "%u", bgm_config.voiceBudget);
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(voicebudget) {
+	int count = atoi(value);
+	ERROR_CONTEXT("Failed to set voice budget");
+	/* ERROR HANDLER */
+	if (count < 0 || count > 4096) {
+		BGM_ERROR("Value (%i) is not between 0 and 4096.", count);
+		return FALSE;
+	}
+	bgm_config.voiceBudget = count;
+	return TRUE;
+}
+
+// voicesdropped - Voices not played for want of one to steal, or for
+// coming within their cooldown. Setting it starts the count again.
+ATTR_IMPLEMENT_G(voicesdropped) {
+	bgm_attrTypeLast = TY_REAL;
+	sprintf(bgm_tmpStr, "%u", _bgm_Context()->voicesDropped);
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(voicesdropped) {
+	_bgm_Context()->voicesDropped = atoi(value);
+	return TRUE;
+}
+
+// voicesstolen - Voices cut off for another to play. Setting it starts
+// the count again.
+ATTR_IMPLEMENT_G(voicesstolen) {
+	bgm_attrTypeLast = TY_REAL;
+	sprintf(bgm_tmpStr, "%u", _bgm_Context()->voicesStolen);
+	return bgm_tmpStr;
+}
+ATTR_IMPLEMENT_S(voicesstolen) {
+	_bgm_Context()->voicesStolen = atoi(value);
+	return TRUE;
+}
+
 // volume - global volume for all songs
 ATTR_IMPLEMENT_G(volume) {
 	int vol;
@@ -700,6 +1354,8 @@ ATTR_IMPLEMENT_S(volume) {
 	BASS_SetConfig(BASS_CONFIG_GVOL_MUSIC, vol);
 	BASS_SetConfig(BASS_CONFIG_GVOL_SAMPLE, vol);
 	BASS_SetConfig(BASS_CONFIG_GVOL_STREAM, vol);
+	bgm_bus.gvol = vol/100.0f; // The bus needs it to know how loud songs are
+	_bgm_VirtCheckAll();
 	return TRUE;
 }
 
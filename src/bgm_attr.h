@@ -37,6 +37,7 @@
 // Attribute flags
 #define AT_GLOBAL 0x1 /* Attribute is global */
 #define AT_QPSAFE 0x2 /* Attr can be accessed from QP when QP not loaded */
+#define AT_PEEK   0x4 /* Reading it doesn't count as using the song */
 
 /******************************************************************************
  * Typedefs, structs, etc.
@@ -61,7 +62,9 @@ typedef struct ctagBGM_ATTRIBUTE {
  *****************************************************************************/
 
 extern const BGM_ATTRIBUTE bgm_attr[];
-extern GM_REAL bgm_attrTypeLast;
+
+// Type of the last attribute value returned to the calling thread
+#define bgm_attrTypeLast (_bgm_Thread()->attrTypeLast)
 
 /******************************************************************************
  * Function prototypes
@@ -179,12 +182,19 @@ GM_REAL bgm_FadeVolByFname( GM_STRING fname,
 ATTR_PROTOTYPE(amplify)
 ATTR_PROTOTYPE(bpm)
 ATTR_PROTOTYPE(cfreq)
+ATTR_PROTOTYPE(coalesce)
 ATTR_PROTOTYPE(cpanning)
 ATTR_PROTOTYPE(cvolume)
 ATTR_PROTOTYPE(filename)
+ATTR_PROTOTYPE(fx)
+ATTR_PROTOTYPE(fxcount)
+ATTR_PROTOTYPE(group)
 ATTR_PROTOTYPE(id)
+ATTR_PROTOTYPE(iofill)
+ATTR_PROTOTYPE(iounderruns)
 ATTR_PROTOTYPE(ivolume)
 ATTR_PROTOTYPE(loop)
+ATTR_PROTOTYPE(memory)
 ATTR_PROTOTYPE(minstrument)
 ATTR_PROTOTYPE(mmessage)
 ATTR_PROTOTYPE(msample)
@@ -194,9 +204,33 @@ ATTR_PROTOTYPE(pansep)
 ATTR_PROTOTYPE(speed)
 ATTR_PROTOTYPE(tvolume)
 ATTR_PROTOTYPE(type)
+ATTR_PROTOTYPE(vcooldown)
+ATTR_PROTOTYPE(vpriority)
 
 // Global attributes
+ATTR_PROTOTYPE(async)
+ATTR_PROTOTYPE(coalescecap)
+ATTR_PROTOTYPE(coalesced)
+ATTR_PROTOTYPE(evictions)
+ATTR_PROTOTYPE(idletime)
+ATTR_PROTOTYPE(limiter)
+ATTR_PROTOTYPE(limreduction)
+ATTR_PROTOTYPE(limrelease)
+ATTR_PROTOTYPE(limthreshold)
+ATTR_PROTOTYPE(membudget)
+ATTR_PROTOTYPE(memtotal)
+ATTR_PROTOTYPE(meters)
+ATTR_PROTOTYPE(modcache)
+ATTR_PROTOTYPE(netcache)
+ATTR_PROTOTYPE(normalize)
+ATTR_PROTOTYPE(primedstop)
+ATTR_PROTOTYPE(qpwarm)
+ATTR_PROTOTYPE(readahead)
 ATTR_PROTOTYPE(stream)
+ATTR_PROTOTYPE(virtual)
+ATTR_PROTOTYPE(voicebudget)
+ATTR_PROTOTYPE(voicesdropped)
+ATTR_PROTOTYPE(voicesstolen)
 ATTR_PROTOTYPE(volume)
 
 #endif // BGM_ATTR_H
@@ -0,0 +1,399 @@
+/******************************************************************************
+ *
+ *	bgm_beat.c -
+ *		Implementation of BGM's beat analysis and the beat lookups.
+ *
+ *	Onset detection: every BGM_BEAT_HOP samples the last BGM_BEAT_FFT
+ *	samples are windowed and transformed, and the spectral flux (how much
+ *	the log magnitudes rose since the last frame, summed over all bins) is
+ *	appended to an envelope. Subtracting a moving average leaves the onset
+ *	strength, which peaks wherever a note starts.
+ *
+ *	Tempo: the onset strength is autocorrelated over the lags that match
+ *	BGM_BEAT_MINBPM to BGM_BEAT_MAXBPM, weighted towards 120 BPM so that a
+ *	song isn't read at half or double its tempo too easily.
+ *
+ *	Beats: the phase that lines a grid at that tempo up with the most onset
+ *	strength gives the first beat. From there each beat is predicted one
+ *	period on and moved onto the strongest onset within a tenth of a period
+ *	of it, so that the beats follow small tempo drifts.
+ *
+ *	Sidecar layout (after the cache header): bpm (float), count, then count
+ *	beat positions in ms, all 32-bit.
+ *
+ *****************************************************************************/
+
+#include "bgm.h"
+
+/******************************************************************************
+ * Function implementations
+ *****************************************************************************/
+
+/*	_bgm_BeatStart() -
+		Internal function that gets a BEATSTATE ready for a file with the
+		given sample rate. Returns FALSE if out of memory. */
+BOOL _bgm_BeatStart( BEATSTATE *state,
+                     DWORD     freq )
+{
+	DWORD i;
+
+	memset(state, 0, sizeof(BEATSTATE));
+	state->freq = freq ? freq : 44100;
+
+	for (i=0; i<BGM_BEAT_FFT; i++)
+		state->window[i] = (float)(0.5 - 0.5*cos(2.0*3.14159265358979*i
+		                                         /BGM_BEAT_FFT));
+	_bgm_DspFFTTable(state->twRe, state->twIm, BGM_BEAT_FFT);
+
+	// Room for about 5 minutes to start with
+	state->envMax = 300*state->freq/BGM_BEAT_HOP;
+	state->env = NEW(float,state->envMax);
+	return state->env != NULL;
+}
+
+/*	_bgm_BeatFeed() -
+		Internal function that runs frames mono samples through the onset
+		detector. */
+void _bgm_BeatFeed( BEATSTATE   *state,
+                    const float *mono,
+                    DWORD       frames )
+{
+	float re[BGM_BEAT_FFT], im[BGM_BEAT_FFT], *grown;
+	float mag, flux;
+	DWORD i, n;
+
+	while (frames) {
+		// Fill the frame up
+		n = BGM_BEAT_FFT - state->fill;
+		if (n > frames) n = frames;
+		memcpy(state->frame + state->fill, mono, sizeof(float)*n);
+		state->fill += n;
+		mono += n;
+		frames -= n;
+		if (state->fill < BGM_BEAT_FFT)
+			break;
+
+		// Spectral flux of the frame
+		for (i=0; i<BGM_BEAT_FFT; i++) {
+			re[i] = state->frame[i]*state->window[i];
+			im[i] = 0.0f;
+		}
+		_bgm_DspFFT(re, im, BGM_BEAT_FFT, state->twRe, state->twIm);
+		flux = 0.0f;
+		for (i=1; i<BGM_BEAT_FFT/2; i++) {
+			mag = (float)log(1.0 + 100.0*sqrt(re[i]*re[i] + im[i]*im[i]));
+			if (mag > state->prev[i])
+				flux += mag - state->prev[i];
+			state->prev[i] = mag;
+		}
+
+		// Append it to the envelope, growing it if needed
+		if (state->envLen == state->envMax) {
+			grown = (float*)realloc(state->env, sizeof(float)*state->envMax*2);
+			if (!grown)
+				return;
+			state->env = grown;
+			state->envMax *= 2;
+		}
+		state->env[state->envLen++] = flux;
+
+		// Move along one hop
+		memmove(state->frame, state->frame + BGM_BEAT_HOP,
+		        sizeof(float)*(BGM_BEAT_FFT-BGM_BEAT_HOP));
+		state->fill = BGM_BEAT_FFT-BGM_BEAT_HOP;
+	}
+}
+
+/*	_bgm_BeatFinish() -
+		Internal function that works out the tempo and beats from everything
+		fed in and frees the state's memory.
+		Returns the new BEATINDEX, or NULL if out of memory. */
+BEATINDEX* _bgm_BeatFinish( BEATSTATE *state )
+{
+	BEATINDEX *beats;
+	float *env = state->env, *onset;
+	DWORD len = state->envLen, i, j, lag, minLag, maxLag, best, lo, hi, max;
+	double hop = (double)BGM_BEAT_HOP/state->freq, sum, score, bestScore;
+	double bpm, weight, period, phase, t, y0, y1, y2, d;
+
+	beats = NEW(BEATINDEX,1);
+	onset = NEW(float,len+1);
+	if (!beats || !onset) {
+		free(beats);
+		free(onset);
+		free(env);
+		return NULL;
+	}
+	beats->bpm = 0.0f;
+	beats->count = 0;
+	beats->ms = NULL;
+
+	// Onset strength: flux above its local average (about 0.2s each way)
+	for (i=0; i<len; i++) {
+		lo = (i > 8) ? i-8 : 0;
+		hi = (i+8 < len) ? i+8 : len-1;
+		sum = 0.0;
+		for (j=lo; j<=hi; j++)
+			sum += env[j];
+		sum /= hi-lo+1;
+		onset[i] = (env[i] > sum) ? (float)(env[i]-sum) : 0.0f;
+	}
+	free(env);
+	state->env = NULL;
+
+	// Tempo from the autocorrelation, over the lags that fit the range
+	minLag = (DWORD)(60.0/BGM_BEAT_MAXBPM/hop);
+	maxLag = (DWORD)(60.0/BGM_BEAT_MINBPM/hop)+1;
+	if (minLag < 1) minLag = 1;
+	if (maxLag+1 > len/2) {
+		// Too short to say anything
+		free(onset);
+		return beats;
+	}
+	best = 0;
+	bestScore = 0.0;
+	for (lag=minLag; lag<=maxLag; lag++) {
+		sum = 0.0;
+		for (i=0; i+lag<len; i++)
+			sum += onset[i]*onset[i+lag];
+		sum /= len-lag;
+		bpm = 60.0/(lag*hop);
+		d = log(bpm/120.0)/log(2.0);
+		weight = exp(-0.5*d*d);
+		if (sum*weight > bestScore) {
+			bestScore = sum*weight;
+			best = lag;
+		}
+	}
+	if (best == 0) {
+		// Nothing but silence
+		free(onset);
+		return beats;
+	}
+
+	// Refine the lag between its neighbours (parabolic interpolation)
+	period = best;
+	if (best > minLag && best < maxLag) {
+		for (i=0, y0=y1=y2=0.0; i+best+1<len; i++) {
+			y0 += onset[i]*onset[i+best-1];
+			y1 += onset[i]*onset[i+best];
+			y2 += onset[i]*onset[i+best+1];
+		}
+		d = y0 - 2.0*y1 + y2;
+		if (d < 0.0)
+			period += 0.5*(y0-y2)/d;
+	}
+	beats->bpm = (float)(60.0/(period*hop));
+
+	// Phase of the grid that catches the most onset strength
+	phase = 0.0;
+	bestScore = -1.0;
+	for (i=0; i<(DWORD)period; i++) {
+		score = 0.0;
+		for (t=i; t<len; t+=period)
+			score += onset[(DWORD)(t+0.5) < len ? (DWORD)(t+0.5) : len-1];
+		if (score > bestScore) {
+			bestScore = score;
+			phase = i;
+		}
+	}
+
+	// Snapping can pull beats in by up to a tenth of a period each
+	beats->ms = NEW(DWORD,(DWORD)(len/(period*0.9))+2);
+	if (!beats->ms) {
+		free(onset);
+		free(beats);
+		return NULL;
+	}
+
+	// Walk the song, pulling each beat onto the strongest onset near it
+	for (t=phase; t<len; t+=period) {
+		lo = (t > period*0.1) ? (DWORD)(t-period*0.1) : 0;
+		hi = (DWORD)(t+period*0.1);
+		if (hi >= len) hi = len-1;
+		max = ((DWORD)t < len) ? (DWORD)t : len-1;
+		for (j=lo; j<=hi; j++)
+			if (onset[j] > onset[max])
+				max = j;
+		if (onset[max] > 0.0f)
+			t = max;
+		// Frame t is centred BGM_BEAT_FFT/2 samples after its start
+		beats->ms[beats->count++] =
+			(DWORD)((t*BGM_BEAT_HOP + BGM_BEAT_FFT/2)*1000.0/state->freq);
+	}
+
+	free(onset);
+	return beats;
+}
+
+/*	_bgm_BeatFree() -
+		Internal function that frees a BEATINDEX. */
+void _bgm_BeatFree( BEATINDEX *beats )
+{
+	if (!beats)
+		return;
+	free(beats->ms);
+	free(beats);
+}
+
+/*	_bgm_BeatLoad() -
+		Internal function that loads a file's beats from its sidecar.
+		Returns NULL if there is no up to date sidecar. */
+BEATINDEX* _bgm_BeatLoad( const char     *fname,
+                          const CACHEKEY *key )
+{
+	FILE *f;
+	BEATINDEX *beats;
+
+	f = _bgm_CacheOpen(fname, BGM_BEAT_EXT, BGM_BEAT_MAGIC, key);
+	if (!f)
+		return NULL;
+
+	beats = NEW(BEATINDEX,1);
+	if (!beats) {
+		fclose(f);
+		return NULL;
+	}
+	beats->ms = NULL;
+	// A damaged sidecar can't ask for more beats than it holds
+	if (fread(&beats->bpm, sizeof(float), 1, f) != 1 ||
+	    fread(&beats->count, sizeof(DWORD), 1, f) != 1 ||
+	    beats->count > _bgm_CacheLeft(f)/sizeof(DWORD) ||
+	    !(beats->ms = NEW(DWORD,beats->count+1)) ||
+	    fread(beats->ms, sizeof(DWORD), beats->count, f) != beats->count) {
+		_bgm_BeatFree(beats);
+		beats = NULL;
+	}
+
+	fclose(f);
+	return beats;
+}
+
+/*	_bgm_BeatSave() -
+		Internal function that saves a file's beats to its sidecar. */
+void _bgm_BeatSave( const char      *fname,
+                    const CACHEKEY  *key,
+                    const BEATINDEX *beats )
+{
+	FILE *f;
+
+	f = _bgm_CacheCreate(fname, BGM_BEAT_EXT, BGM_BEAT_MAGIC, key);
+	if (!f)
+		return;
+
+	fwrite(&beats->bpm, sizeof(float), 1, f);
+	fwrite(&beats->count, sizeof(DWORD), 1, f);
+	fwrite(beats->ms, sizeof(DWORD), beats->count, f);
+	fclose(f);
+}
+
+/*	_bgm_BeatFind() -
+		Internal function that finds the beats either side of the song's
+		current position.
+		Returns FALSE if the beats aren't known (yet). */
+BOOL _bgm_BeatFind( SONG   *song,
+                    double *pos,
+                    double *prev,
+                    double *next )
+{
+	ANALYSIS *entry;
+	BEATINDEX *beats;
+	DWORD lo, hi, mid;
+	double period;
+	BOOL failed;
+
+	entry = _bgm_AnalyzeGet(song, AN_BEATS);
+	/* ERROR HANDLER */
+	if (!entry)
+		return FALSE;
+
+	*pos = BASS_ChannelBytes2Seconds(song->id,
+	                                 BASS_ChannelGetPosition(song->id))*1000.0;
+
+	EnterCriticalSection(&bgm_anLock);
+	beats = (entry->done & AN_BEATS) ? entry->beats : NULL;
+	failed = entry->failed & AN_BEATS;
+	if (!beats || beats->count == 0 || beats->bpm <= 0.0f) {
+		LeaveCriticalSection(&bgm_anLock);
+		/* ERROR HANDLER */
+		if (failed) {
+			BGM_ERROR("Song could not be decoded for analysis.");
+		}
+		else if (beats) {
+			BGM_ERROR("Song has no beat to find.");
+		}
+		// Otherwise the analysis just isn't done yet
+		return FALSE;
+	}
+
+	// Binary search for the first beat after pos
+	lo = 0;
+	hi = beats->count;
+	while (lo < hi) {
+		mid = (lo+hi)/2;
+		if (beats->ms[mid] <= *pos)
+			lo = mid+1;
+		else
+			hi = mid;
+	}
+
+	// Carry the grid on past either end
+	period = 60000.0/beats->bpm;
+	if (lo == 0) {
+		*next = beats->ms[0];
+		*prev = *next - period;
+	}
+	else if (lo == beats->count) {
+		*prev = beats->ms[lo-1];
+		*next = *prev + period;
+		while (*next <= *pos) {
+			*prev = *next;
+			*next += period;
+		}
+	}
+	else {
+		*prev = beats->ms[lo-1];
+		*next = beats->ms[lo];
+	}
+
+	LeaveCriticalSection(&bgm_anLock);
+	return TRUE;
+}
+
+/*	bgm_BeatNext() -
+		Returns the position, in milliseconds, of the next beat of the song
+		with the given ID, or -1 if it isn't known yet. */
+DLL_FUNC
+GM_REAL bgm_BeatNext( GM_REAL songId )
+{
+	double pos, prev, next;
+
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdCall(BGM_CMD_BEATNEXT, "r", songId);
+
+	ERROR_CONTEXT("Failed to find next beat");
+	if (!_bgm_BeatFind(_bgm_GetSongById(songId), &pos, &prev, &next))
+		return -1;
+	return next;
+}
+
+/*	bgm_BeatPhase() -
+		Returns how far the song with the given ID is between its last beat
+		and its next one (0-1), or -1 if the beats aren't known yet. */
+DLL_FUNC
+GM_REAL bgm_BeatPhase( GM_REAL songId )
+{
+	double pos, prev, next;
+
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdCall(BGM_CMD_BEATPHASE, "r", songId);
+
+	ERROR_CONTEXT("Failed to find beat phase");
+	if (!_bgm_BeatFind(_bgm_GetSongById(songId), &pos, &prev, &next))
+		return -1;
+	if (pos < prev)
+		return 0;
+	return (pos-prev)/(next-prev);
+}
+
+/* END OF FILE */
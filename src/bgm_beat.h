@@ -0,0 +1,124 @@
+/******************************************************************************
+ *
+ *	bgm_beat.h -
+ *		Prototypes and types for BGM's beat analysis. Onsets are found with
+ *		spectral flux, the tempo from the autocorrelation of the onset
+ *		strength, and the beats by following that tempo through the song,
+ *		pulling each beat onto the strongest onset near it.
+ *
+ *****************************************************************************/
+
+#ifndef BGM_BEAT_H
+#define BGM_BEAT_H
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// FFT size and hop of the onset detector, in samples
+#define BGM_BEAT_FFT 1024
+#define BGM_BEAT_HOP 512
+
+// Tempo range searched, in BPM
+#define BGM_BEAT_MINBPM 60.0
+#define BGM_BEAT_MAXBPM 180.0
+
+// Sidecar extension and magic number
+#define BGM_BEAT_EXT   ".beats"
+#define BGM_BEAT_MAGIC 0x54414542 /* "BEAT" */
+
+/******************************************************************************
+ * Typedefs, structs, etc.
+ *****************************************************************************/
+
+/*	BEATINDEX -
+		The beats of one file.
+*/
+typedef struct ctagBEATINDEX {
+	float	bpm;	// Tempo, or 0 if none could be found
+	DWORD	count;	// Number of beats
+	DWORD	*ms;	// Beat positions in milliseconds, in order
+} BEATINDEX;
+
+/*	BEATSTATE -
+		Working state of the onset detector while a file is decoded.
+*/
+typedef struct ctagBEATSTATE {
+	DWORD	freq;						// Sample rate of the file
+	float	frame[BGM_BEAT_FFT];		// Newest samples, oldest first
+	DWORD	fill;						// Samples in frame
+	float	prev[BGM_BEAT_FFT/2];		// Log magnitudes of the last frame
+	float	window[BGM_BEAT_FFT];		// Hann window
+	float	twRe[BGM_BEAT_FFT],			// FFT twiddles
+			twIm[BGM_BEAT_FFT];
+	float	*env;						// Spectral flux, one per hop
+	DWORD	envLen, envMax;
+} BEATSTATE;
+
+/******************************************************************************
+ * Function prototypes
+ *****************************************************************************/
+
+/*	_bgm_BeatStart() -
+		Internal function that gets a BEATSTATE ready for a file with the
+		given sample rate. Returns FALSE if out of memory. */
+BOOL _bgm_BeatStart( BEATSTATE *state,
+                     DWORD     freq );
+
+/*	_bgm_BeatFeed() -
+		Internal function that runs frames mono samples through the onset
+		detector. */
+void _bgm_BeatFeed( BEATSTATE   *state,
+                    const float *mono,
+                    DWORD       frames );
+
+/*	_bgm_BeatFinish() -
+		Internal function that works out the tempo and beats from everything
+		fed in and frees the state's memory.
+		Returns the new BEATINDEX, or NULL if out of memory. */
+BEATINDEX* _bgm_BeatFinish( BEATSTATE *state );
+
+/*	_bgm_BeatFree() -
+		Internal function that frees a BEATINDEX. */
+void _bgm_BeatFree( BEATINDEX *beats );
+
+/*	_bgm_BeatLoad() -
+		Internal function that loads a file's beats from its sidecar.
+		Returns NULL if there is no up to date sidecar. */
+BEATINDEX* _bgm_BeatLoad( const char     *fname,
+                          const CACHEKEY *key );
+
+/*	_bgm_BeatSave() -
+		Internal function that saves a file's beats to its sidecar. */
+void _bgm_BeatSave( const char      *fname,
+                    const CACHEKEY  *key,
+                    const BEATINDEX *beats );
+
+/*	_bgm_BeatFind() -
+		Internal function that finds the beats either side of the song's
+		current position. prev and next are set in milliseconds; beyond the
+		first or last beat they are carried on at the song's tempo.
+		Returns FALSE if the beats aren't known (yet). */
+BOOL _bgm_BeatFind( SONG   *song,
+                    double *pos,
+                    double *prev,
+                    double *next );
+
+/*	bgm_BeatNext() -
+		Returns the position, in milliseconds, of the next beat of the song
+		with the given ID. The first call for a file starts analysing it in
+		the background (or loads the result saved last time); until that is
+		done this returns -1. */
+DLL_FUNC
+GM_REAL bgm_BeatNext( GM_REAL songId );
+
+/*	bgm_BeatPhase() -
+		Returns how far the song with the given ID is between its last beat
+		and its next one, from 0 (on the beat) to just under 1. Returns -1
+		until the song has been analysed (see bgm_BeatNext()). */
+DLL_FUNC
+GM_REAL bgm_BeatPhase( GM_REAL songId );
+
+#endif // BGM_BEAT_H
+
+/* END OF FILE */
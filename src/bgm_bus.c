@@ -0,0 +1,425 @@
+/******************************************************************************
+ *
+ *	bgm_bus.c -
+ *		Implementation of BGM's master bus processing.
+ *
+ *	Limiter -
+ *	Every song delays its audio by BGM_LIMIT_LOOKAHEAD ms and works out its
+ *	gain one look-ahead block at a time. The level it compares against the
+ *	threshold is its own peak over the block about to come out (scaled by
+ *	channel and global volume) plus the peaks every other song reported in
+ *	the last mixer update. Gain drops within one block, which the delay
+ *	hides, and recovers exponentially with the release time. Since every
+ *	song sees the same bus level the gains stay close together, so the
+ *	balance of the mix is kept while the sum stays under the ceiling.
+ *
+ *	Ducking -
+ *	Songs also report their peaks per group. A song in the target group of a
+ *	duck rule looks at the level its trigger group reached and eases its own
+ *	gain towards the rule's depth with the attack and release times, one
+ *	look-ahead block at a time. Ducking comes before the limiter, so the
+ *	limiter sees the mix as it will actually be heard.
+ *
+ *	BASS calls the DSPs of all playing channels once per mixer update, so a
+ *	song reporting twice is taken to mean that a new update has started.
+ *
+ *****************************************************************************/
+
+#include "bgm.h"
+
+/******************************************************************************
+ * Globals
+ *****************************************************************************/
+
+BGM_BUS bgm_bus; // Global master bus state
+
+/******************************************************************************
+ * Function implementations
+ *****************************************************************************/
+
+/*	_bgm_BusInit() -
+		Internal function that sets the master bus to its defaults. Called
+		from bgm_Init(). */
+void _bgm_BusInit( )
+{
+	InitializeCriticalSection(&bgm_bus.lock);
+	bgm_bus.limiter = FALSE;
+	bgm_bus.thresholdDb = -1.0f;
+	bgm_bus.threshold = (float)pow(10.0, bgm_bus.thresholdDb/20.0);
+	bgm_bus.releaseMs = 100.0f;
+	bgm_bus.gvol = 1.0f;
+	bgm_bus.seq = 1;
+	bgm_bus.peakSum = 0.0f;
+	bgm_bus.peakLast = 0.0f;
+	bgm_bus.gainMin = 1.0f;
+	bgm_bus.reduction = 0.0f;
+	bgm_bus.tapTick = GetTickCount();
+	memset(bgm_bus.groupSum, 0, sizeof(bgm_bus.groupSum));
+	memset(bgm_bus.groupLast, 0, sizeof(bgm_bus.groupLast));
+	bgm_bus.duckCount = 0;
+}
+
+/*	_bgm_BusFree() -
+		Internal function that frees the master bus. Called from
+		bgm_Close(). */
+void _bgm_BusFree( )
+{
+	DeleteCriticalSection(&bgm_bus.lock);
+}
+
+/*	_bgm_BusActive() -
+		Internal function that returns whether any bus processing is turned
+		on, in which case every song needs a DSP. */
+BOOL _bgm_BusActive( )
+{
+	return bgm_bus.limiter || bgm_bus.duckCount;
+}
+
+/*	_bgm_BusIdle() -
+		Internal function that forgets the bus totals once it has gone
+		idle. */
+void _bgm_BusIdle( DWORD now )
+{
+	if (now - bgm_bus.tapTick <=
+	    BGM_BUS_IDLE*BASS_GetConfig(BASS_CONFIG_UPDATEPERIOD))
+		return;
+
+	// Start the next update afresh, so a song coming in on its own isn't
+	// limited or ducked for what was playing before
+	bgm_bus.peakSum = bgm_bus.peakLast = 0.0f;
+	memset(bgm_bus.groupSum, 0, sizeof(bgm_bus.groupSum));
+	memset(bgm_bus.groupLast, 0, sizeof(bgm_bus.groupLast));
+	bgm_bus.gainMin = 1.0f;
+	bgm_bus.reduction = 0.0f;
+	bgm_bus.seq++;
+	bgm_bus.tapTick = now;
+}
+
+/*	_bgm_BusReduction() -
+		Internal function that returns the limiter's latest gain
+		reduction. */
+float _bgm_BusReduction( )
+{
+	float ret;
+
+	EnterCriticalSection(&bgm_bus.lock);
+	_bgm_BusIdle(GetTickCount());
+	ret = bgm_bus.reduction;
+	LeaveCriticalSection(&bgm_bus.lock);
+	return ret;
+}
+
+/*	_bgm_BusInitTap() -
+		Internal function that sets up a song's bus tap for the given
+		format. Returns FALSE if out of memory. */
+BOOL _bgm_BusInitTap( BUSTAP *tap,
+                      DWORD  chans,
+                      DWORD  freq )
+{
+	tap->delayLen = freq*BGM_LIMIT_LOOKAHEAD/1000;
+	if (tap->delayLen == 0)
+		tap->delayLen = 1;
+	tap->delay = NEW(float, tap->delayLen*chans);
+	if (!tap->delay)
+		return FALSE;
+	tap->delayPos = 0;
+	tap->limiting = FALSE;
+	tap->gain = 1.0f;
+	tap->prevPeak = 0.0f;
+	tap->busPeak = 0.0f;
+	tap->seq = 0;
+	tap->group = 0;
+	tap->duckGain = 1.0f;
+	return TRUE;
+}
+
+/*	_bgm_BusFreeTap() -
+		Internal function that frees a song's bus tap. */
+void _bgm_BusFreeTap( BUSTAP *tap )
+{
+	free(tap->delay);
+	tap->delay = NULL;
+}
+
+/*	_bgm_BusSetGroup() -
+		Internal function that moves a song into a group, keeping its bus tap
+		in step. */
+void _bgm_BusSetGroup( SONG  *song,
+                       DWORD group )
+{
+	song->group = group;
+	if (song->dsp) {
+		EnterCriticalSection(&song->dsp->lock);
+		song->dsp->bus.group = group;
+		LeaveCriticalSection(&song->dsp->lock);
+	}
+}
+
+/*	bgm_DuckSet() -
+		Sets up a rule that turns the songs in targetGroup down by depth dB
+		(a negative number) whenever songs in triggerGroup are sounding. The
+		level of the trigger group is followed at mix time and the gain moves
+		with the given attack and release times in milliseconds. Calling it
+		again for the same two groups changes the rule; a depth of 0 removes
+		it.
+		Returns 1 on success, 0 on failure. */
+DLL_FUNC
+GM_REAL bgm_DuckSet( GM_REAL targetGroup,
+                     GM_REAL triggerGroup,
+                     GM_REAL depth,
+                     GM_REAL attackMs,
+                     GM_REAL releaseMs )
+{
+	DWORD target = (DWORD)targetGroup, trigger = (DWORD)triggerGroup, i;
+	DUCKRULE *rule;
+	
+	ERROR_CONTEXT("Failed to set duck rule");
+	
+	/* ERROR HANDLER */
+	if (targetGroup < 0 || target >= BGM_MAX_GROUPS ||
+	    triggerGroup < 0 || trigger >= BGM_MAX_GROUPS) {
+		BGM_ERROR("Groups must be between 0 and %i.", BGM_MAX_GROUPS-1);
+		return FALSE;
+	}
+	if (target == trigger) {
+		BGM_ERROR("A group can't duck itself.");
+		return FALSE;
+	}
+	if (depth < -96 || depth > 0) {
+		BGM_ERROR("Depth (%g) is not between -96 and 0.", depth);
+		return FALSE;
+	}
+	
+	EnterCriticalSection(&bgm_bus.lock);
+	
+	// Find the existing rule for these groups, if any
+	for (i=0; i<bgm_bus.duckCount; i++)
+		if (bgm_bus.duck[i].target == target &&
+		    bgm_bus.duck[i].trigger == trigger)
+			break;
+	
+	// A depth of 0 removes the rule
+	if (depth == 0) {
+		if (i < bgm_bus.duckCount) {
+			bgm_bus.duck[i] = bgm_bus.duck[bgm_bus.duckCount-1];
+			bgm_bus.duckCount--;
+		}
+		LeaveCriticalSection(&bgm_bus.lock);
+		return TRUE;
+	}
+	
+	/* ERROR HANDLER */
+	if (i == BGM_MAX_DUCKS) {
+		LeaveCriticalSection(&bgm_bus.lock);
+		BGM_ERROR("Already %i duck rules set.", BGM_MAX_DUCKS);
+		return FALSE;
+	}
+	
+	rule = &bgm_bus.duck[i];
+	rule->target = target;
+	rule->trigger = trigger;
+	rule->depthDb = (float)depth;
+	rule->depth = (float)pow(10.0, depth/20.0);
+	rule->attackMs = (attackMs < 1) ? 1.0f : (float)attackMs;
+	rule->releaseMs = (releaseMs < 1) ? 1.0f : (float)releaseMs;
+	if (i == bgm_bus.duckCount)
+		bgm_bus.duckCount++;
+	
+	LeaveCriticalSection(&bgm_bus.lock);
+	
+	// Every song has to report its level from now on
+	_bgm_DspAttachAll();
+	
+	return TRUE;
+}
+
+/*	_bgm_BusDelay() -
+		Internal function that swaps count samples through the tap's delay
+		line, so that buf comes out holding the audio from one look-ahead
+		block ago. size is the length of the delay line in samples. */
+void _bgm_BusDelay( BUSTAP *tap,
+                    float  *buf,
+                    DWORD  count,
+                    DWORD  size )
+{
+	DWORD i;
+	float t;
+
+	for (i=0; i<count; i++) {
+		t = tap->delay[tap->delayPos];
+		tap->delay[tap->delayPos] = buf[i];
+		buf[i] = t;
+		if (++tap->delayPos == size)
+			tap->delayPos = 0;
+	}
+}
+
+/*	_bgm_BusDuckTarget() -
+		Internal function that works out the gain the duck rules want for a
+		group. */
+float _bgm_BusDuckTarget( DWORD group,
+                          float *attackMs,
+                          float *releaseMs )
+{
+	float target = 1.0f, att = 0.0f, rel = 0.0f, level, amount, d;
+	DWORD i;
+
+	// The strongest rule decides the attack and release
+	for (i=0; i<bgm_bus.duckCount; i++) {
+		DUCKRULE *rule = &bgm_bus.duck[i];
+		if (rule->target != group)
+			continue;
+		level = bgm_bus.groupLast[rule->trigger];
+		if (bgm_bus.groupSum[rule->trigger] > level)
+			level = bgm_bus.groupSum[rule->trigger];
+		amount = level/BGM_DUCK_KNEE;
+		if (amount > 1.0f) amount = 1.0f;
+		d = 1.0f - (1.0f-rule->depth)*amount;
+		if (d < target || rel == 0.0f) {
+			if (d < target) target = d;
+			att = rule->attackMs;
+			rel = rule->releaseMs;
+		}
+	}
+
+	if (attackMs) *attackMs = att;
+	if (releaseMs) *releaseMs = rel;
+	return target;
+}
+
+/*	_bgm_BusProcess() -
+		Internal function that runs the bus stage over one block of a song's
+		DSP. vol is the song's channel volume (0-1). */
+void _bgm_BusProcess( BUSTAP *tap,
+                      float  *buf,
+                      DWORD  count,
+                      DWORD  chans,
+                      DWORD  freq,
+                      float  vol )
+{
+	DWORD frames = count/chans, pos, n, g, now;
+	BOOL limiter;
+	float others, threshold, scale, rel, peak, inPeak, outPeak = 0.0f;
+	float level, target, g0, g1, gainMin = 1.0f;
+	float duckTarget, duckAtt, duckRel, d;
+	float *p;
+
+	// Check in with the bus
+	EnterCriticalSection(&bgm_bus.lock);
+	now = GetTickCount();
+	_bgm_BusIdle(now);
+	bgm_bus.tapTick = now;
+	if (tap->seq == bgm_bus.seq) {
+		// This song has already reported in this update, so a new one has
+		// started. Publish the totals of the one that just ended.
+		bgm_bus.peakLast = bgm_bus.peakSum;
+		bgm_bus.peakSum = 0.0f;
+		for (g=0; g<BGM_MAX_GROUPS; g++) {
+			bgm_bus.groupLast[g] = bgm_bus.groupSum[g];
+			bgm_bus.groupSum[g] = 0.0f;
+		}
+		bgm_bus.reduction = (float)(-20.0*log10(bgm_bus.gainMin));
+		bgm_bus.gainMin = 1.0f;
+		bgm_bus.seq++;
+	}
+	tap->seq = bgm_bus.seq;
+	others = bgm_bus.peakLast - tap->busPeak;
+	if (others < 0.0f) others = 0.0f;
+	limiter = bgm_bus.limiter;
+	threshold = bgm_bus.threshold;
+	rel = bgm_bus.releaseMs;
+	scale = vol*bgm_bus.gvol;
+
+	// Work out where the duck rules aimed at this song's group want its
+	// gain to be
+	duckTarget = _bgm_BusDuckTarget(tap->group, &duckAtt, &duckRel);
+	LeaveCriticalSection(&bgm_bus.lock);
+
+	// Songs whose rule was removed mid-duck come back up at the limiter's
+	// release speed
+	if (duckRel == 0.0f)
+		duckAtt = duckRel = rel;
+
+	// What the song sounds like before the bus touches it
+	inPeak = _bgm_DspPeak(buf, count);
+
+	// Ducking
+	if (duckTarget < 1.0f || tap->duckGain < 1.0f) {
+		for (pos=0; pos<frames; pos+=n) {
+			n = frames-pos;
+			if (n > tap->delayLen)
+				n = tap->delayLen;
+			g0 = tap->duckGain;
+			d = (duckTarget < g0) ? duckAtt : duckRel;
+			g1 = duckTarget
+			     + (g0-duckTarget)*(float)exp(-(double)n/(freq*d/1000.0));
+			// Snap back to unity instead of creeping towards it forever
+			if (g1 > 0.999f && duckTarget == 1.0f)
+				g1 = 1.0f;
+			_bgm_DspGainRamp(buf + pos*chans, n, chans, g0, g1);
+			tap->duckGain = g1;
+		}
+		outPeak = _bgm_DspPeak(buf, count);
+	}
+	else
+		outPeak = inPeak;
+
+	// Limiter
+	if (!limiter)
+		tap->limiting = FALSE;
+	else {
+		// Start from a clean delay line if the limiter was just turned on
+		if (!tap->limiting) {
+			memset(tap->delay, 0, sizeof(float)*tap->delayLen*chans);
+			tap->delayPos = 0;
+			tap->gain = 1.0f;
+			tap->prevPeak = 0.0f;
+			tap->limiting = TRUE;
+		}
+
+		// Release coefficient per look-ahead block
+		rel = (float)exp(-(double)tap->delayLen/(freq*rel/1000.0));
+
+		outPeak = 0.0f;
+		for (pos=0; pos<frames; pos+=n) {
+			n = frames-pos;
+			if (n > tap->delayLen)
+				n = tap->delayLen;
+			p = buf + pos*chans;
+
+			// Peak of the audio about to go into the delay line, and the
+			// level the bus will be at while this block comes out of it
+			peak = _bgm_DspPeak(p, n*chans);
+			if (peak > outPeak) outPeak = peak;
+			level = (peak > tap->prevPeak ? peak : tap->prevPeak)*scale
+			        + others;
+			tap->prevPeak = peak;
+
+			// Instant attack (the delay hides it), exponential release
+			target = (level > threshold) ? threshold/level : 1.0f;
+			g0 = tap->gain;
+			if (target < g0)
+				g1 = target;
+			else
+				g1 = target + (g0-target)*rel;
+
+			_bgm_BusDelay(tap, p, n*chans, tap->delayLen*chans);
+			_bgm_DspGainRamp(p, n, chans, g0, g1);
+
+			tap->gain = g1;
+			if (g1 < gainMin) gainMin = g1;
+		}
+	}
+
+	// Report back to the bus
+	EnterCriticalSection(&bgm_bus.lock);
+	tap->busPeak = outPeak*scale;
+	bgm_bus.peakSum += tap->busPeak;
+	if (tap->group < BGM_MAX_GROUPS)
+		bgm_bus.groupSum[tap->group] += inPeak*scale;
+	if (gainMin < bgm_bus.gainMin)
+		bgm_bus.gainMin = gainMin;
+	LeaveCriticalSection(&bgm_bus.lock);
+}
+
+/* END OF FILE */
@@ -0,0 +1,185 @@
+/******************************************************************************
+ *
+ *	bgm_bus.h -
+ *		Prototypes and types for BGM's master bus processing.
+ *
+ *	BASS 2.3 has no hook on the final mix, so the "bus" is made up of a small
+ *	stage at the end of every song's DSP. The stages share one set of bus
+ *	statistics (BGM_BUS), so together they behave as one processor on the
+ *	sum of all songs.
+ *
+ *****************************************************************************/
+
+#ifndef BGM_BUS_H
+#define BGM_BUS_H
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// Limiter look-ahead in milliseconds. This is also the block size the
+// limiter's and ducker's gains are computed at.
+#define BGM_LIMIT_LOOKAHEAD 5
+
+// Number of song groups (see the "group" attribute)
+#define BGM_MAX_GROUPS 16
+
+// Most duck rules that can be set at once
+#define BGM_MAX_DUCKS 16
+
+// Trigger level (linear, about -30dBFS) at which a duck rule reaches its
+// full depth. Quieter triggers duck proportionally less.
+#define BGM_DUCK_KNEE 0.0316f
+
+// Mixer updates (BASS_CONFIG_UPDATEPERIOD) without a song reporting in
+// after which the bus is taken to be idle. Songs report in once an update
+// each, but not on the tick, hence more than one.
+#define BGM_BUS_IDLE 2
+
+/******************************************************************************
+ * Typedefs, structs, etc.
+ *****************************************************************************/
+
+/*	BUSTAP -
+		The part of the master bus that lives in one song's DSP.
+*/
+typedef struct ctagBUSTAP {
+	float	*delay;		// Look-ahead delay line (delayLen frames)
+	DWORD	delayLen;	// Length of the delay line in frames
+	DWORD	delayPos;	// Read/write position in the delay line, in samples
+	BOOL	limiting;	// Was the limiter on for the last block?
+	float	gain;		// Limiter gain at the end of the last block
+	float	prevPeak;	// Input peak of the last look-ahead block
+	float	busPeak;	// This song's contribution to the bus peak in the
+						// last mixer update
+	DWORD	seq;		// Mixer update the contribution was made in
+	DWORD	group;		// Group the song is in
+	float	duckGain;	// Ducking gain at the end of the last block
+} BUSTAP;
+
+/*	DUCKRULE -
+		Turns the songs in one group down while another group is sounding.
+*/
+typedef struct ctagDUCKRULE {
+	DWORD	target;		// Group that gets turned down
+	DWORD	trigger;	// Group whose level does the turning
+	float	depthDb;	// How far down at full trigger level, in dB
+	float	depth;		// ... and as a linear gain
+	float	attackMs;	// Time to duck
+	float	releaseMs;	// Time to come back up
+} DUCKRULE;
+
+/*	BGM_BUS -
+		Global master bus state. Only one instance of this should be defined.
+*/
+typedef struct ctagBGM_BUS {
+	CRITICAL_SECTION	lock;
+	BOOL	limiter;		// Limiter on?
+	float	thresholdDb;	// Limiter ceiling in dBFS
+	float	threshold;		// ... and as a linear level
+	float	releaseMs;		// Limiter release time
+	float	gvol;			// Global volume (0-1) as last set through BGM
+	DWORD	seq;			// Counts mixer updates
+	float	peakSum;		// Sum of song peaks so far in this update
+	float	peakLast;		// Sum of song peaks in the last full update
+	float	gainMin;		// Lowest limiter gain so far in this update
+	float	reduction;		// Gain reduction of the last full update, dB
+	DWORD	tapTick;		// When a song last reported in
+	float	groupSum[BGM_MAX_GROUPS];	// Per-group peakSum
+	float	groupLast[BGM_MAX_GROUPS];	// Per-group peakLast
+	DUCKRULE duck[BGM_MAX_DUCKS];		// Duck rules in use
+	DWORD	duckCount;
+} BGM_BUS;
+
+/******************************************************************************
+ * Global externs
+ *****************************************************************************/
+
+extern BGM_BUS bgm_bus;
+
+/******************************************************************************
+ * Function prototypes
+ *****************************************************************************/
+
+/*	_bgm_BusInit() -
+		Internal function that sets the master bus to its defaults. Called
+		from bgm_Init(). */
+void _bgm_BusInit( );
+
+/*	_bgm_BusFree() -
+		Internal function that frees the master bus. Called from
+		bgm_Close(). */
+void _bgm_BusFree( );
+
+/*	_bgm_BusActive() -
+		Internal function that returns whether any bus processing is turned
+		on, in which case every song needs a DSP. */
+BOOL _bgm_BusActive( );
+
+/*	_bgm_BusIdle() -
+		Internal function that forgets the last update's totals if no song
+		has reported in for longer than BGM_BUS_IDLE mixer updates, as
+		nothing has gone through the bus since. Called with the bus lock
+		held. */
+void _bgm_BusIdle( DWORD now );
+
+/*	_bgm_BusReduction() -
+		Internal function that returns the limiter's gain reduction in the
+		last update, in dB, or 0 if nothing has played through it lately. */
+float _bgm_BusReduction( );
+
+/*	_bgm_BusInitTap() -
+		Internal function that sets up a song's bus tap for the given
+		format. Returns FALSE if out of memory. */
+BOOL _bgm_BusInitTap( BUSTAP *tap,
+                      DWORD  chans,
+                      DWORD  freq );
+
+/*	_bgm_BusFreeTap() -
+		Internal function that frees a song's bus tap. */
+void _bgm_BusFreeTap( BUSTAP *tap );
+
+/*	_bgm_BusSetGroup() -
+		Internal function that moves a song into a group, keeping its bus tap
+		in step. */
+void _bgm_BusSetGroup( SONG  *song,
+                       DWORD group );
+
+/*	bgm_DuckSet() -
+		Sets up a rule that turns the songs in targetGroup down by depth dB
+		(a negative number) whenever songs in triggerGroup are sounding. The
+		level of the trigger group is followed at mix time and the gain moves
+		with the given attack and release times in milliseconds. Calling it
+		again for the same two groups changes the rule; a depth of 0 removes
+		it.
+		Returns 1 on success, 0 on failure. */
+DLL_FUNC
+GM_REAL bgm_DuckSet( GM_REAL targetGroup,
+                     GM_REAL triggerGroup,
+                     GM_REAL depth,
+                     GM_REAL attackMs,
+                     GM_REAL releaseMs );
+
+/*	_bgm_BusDuckTarget() -
+		Internal function that works out the gain (0-1) the duck rules aimed
+		at a group want it to have right now, and the attack and release
+		times of the strongest, if attackMs and releaseMs aren't NULL. Both
+		are 0 if no rule is aimed at the group. The caller must hold
+		bgm_bus.lock. */
+float _bgm_BusDuckTarget( DWORD group,
+                          float *attackMs,
+                          float *releaseMs );
+
+/*	_bgm_BusProcess() -
+		Internal function that runs the bus stage over one block of a song's
+		DSP. vol is the song's channel volume (0-1). */
+void _bgm_BusProcess( BUSTAP *tap,
+                      float  *buf,
+                      DWORD  count,
+                      DWORD  chans,
+                      DWORD  freq,
+                      float  vol );
+
+#endif // BGM_BUS_H
+
+/* END OF FILE */
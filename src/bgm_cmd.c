@@ -0,0 +1,806 @@
+/******************************************************************************
+ *
+ *	bgm_cmd.c -
+ *		Implementation of BGM's asynchronous mode.
+ *
+ *	The queue is a lock-free stack: callers push commands onto bgm_cmdHead
+ *	with a compare-and-swap, and the control thread takes the whole stack
+ *	at once by swapping in NULL, then turns it round so that commands run
+ *	in the order they were made. Nothing is ever taken off the stack but by
+ *	the control thread, and it only ever takes everything, so a push can't
+ *	be confused by a node coming back (the ABA problem). Commands run in
+ *	the context they were made in, by calling the same DLL function the
+ *	caller did, which on the control thread does the work itself.
+ *
+ *	Each context in async mode has a snapshot of its song list (see
+ *	CMDSNAP). It's kept up to date wherever a song is added or removed or
+ *	moves to another channel, by whichever thread is doing so; in async
+ *	mode that's always the control thread.
+ *
+ *	A command that's waited for runs with the waiting thread's BGM_THREAD,
+ *	so its errors and returned strings are that thread's, as if it had
+ *	made the call itself. Errors from commands nobody waits for are
+ *	reported as usual, but stay with the control thread.
+ *
+ *****************************************************************************/
+
+#include "bgm.h"
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// Stops the compiler moving memory accesses across it. x86 keeps loads in
+// order by itself, which is all the snapshot's readers need.
+#define BGM_CMD_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+/******************************************************************************
+ * Globals
+ *****************************************************************************/
+
+CRITICAL_SECTION bgm_cmdLock;		// Guards starting the control thread
+BGMCMD * volatile bgm_cmdHead;		// Queued commands, newest first
+HANDLE bgm_cmdThread = NULL;		// Control thread, once started
+DWORD bgm_cmdThreadId = 0;			// Its ID
+HANDLE bgm_cmdEvent = NULL;			// Set when a command is queued
+volatile BOOL bgm_cmdQuit;			// Tells the control thread to stop
+
+/******************************************************************************
+ * Function implementations
+ *****************************************************************************/
+
+/*	_bgm_CmdInit() -
+		Internal function that sets up the command queue. Called from
+		bgm_Init(). */
+void _bgm_CmdInit( )
+{
+	InitializeCriticalSection(&bgm_cmdLock);
+	bgm_cmdHead = NULL;
+	bgm_cmdThread = NULL;
+	bgm_cmdThreadId = 0;
+	bgm_cmdEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	bgm_cmdQuit = FALSE;
+}
+
+/*	_bgm_CmdShutdown() -
+		Internal function that runs whatever is still queued, then stops the
+		control thread. Called from bgm_Close(). */
+void _bgm_CmdShutdown( )
+{
+	if (bgm_cmdThread) {
+		bgm_cmdQuit = TRUE;
+		SetEvent(bgm_cmdEvent);
+		WaitForSingleObject(bgm_cmdThread, INFINITE);
+		CloseHandle(bgm_cmdThread);
+		bgm_cmdThread = NULL;
+		bgm_cmdThreadId = 0;
+	}
+
+	CloseHandle(bgm_cmdEvent);
+	DeleteCriticalSection(&bgm_cmdLock);
+}
+
+/*	_bgm_CmdStart() -
+		Internal function that starts the control thread if it isn't running
+		yet, and gives the calling thread's context a snapshot.
+		Returns TRUE on success, FALSE on failure. */
+BOOL _bgm_CmdStart( )
+{
+	DWORD threadId;
+	BOOL ok = TRUE;
+
+	/* ERROR HANDLER */
+	if (!_bgm_Context()->snap && !_bgm_CmdSnapBuild()) {
+		BGM_ERROR("Out of memory.");
+		return FALSE;
+	}
+
+	// Two contexts may go async at once
+	EnterCriticalSection(&bgm_cmdLock);
+	if (!bgm_cmdThread) {
+		bgm_cmdThread = CreateThread(NULL, 0, _bgm_CmdThread, NULL, 0,
+		                             &threadId);
+		/* ERROR HANDLER */
+		if (!bgm_cmdThread) {
+			BGM_ERROR("Could not start the control thread.");
+			ok = FALSE;
+		}
+		else {
+			bgm_cmdThreadId = threadId;
+			// It only ever sleeps or talks to BASS for the game, so it
+			// shouldn't queue behind the game's own threads
+			SetThreadPriority(bgm_cmdThread, THREAD_PRIORITY_ABOVE_NORMAL);
+		}
+	}
+	LeaveCriticalSection(&bgm_cmdLock);
+
+	return ok;
+}
+
+/*	_bgm_CmdSync() -
+		Internal function that waits until everything queued so far has
+		run. */
+void _bgm_CmdSync( )
+{
+	if (bgm_cmdThread && GetCurrentThreadId() != bgm_cmdThreadId)
+		_bgm_CmdCall(BGM_CMD_NOP, "");
+}
+
+/*	_bgm_CmdMake() -
+		Internal function that makes a command from _bgm_CmdPost()-style
+		arguments.
+		Returns NULL (with an error set) if it's out of memory. */
+BGMCMD* _bgm_CmdMake( DWORD      type,
+                      const char *args,
+                      va_list    ap )
+{
+	BGMCMD *cmd;
+	char *str;
+	size_t size = sizeof(BGMCMD);
+	DWORD i;
+
+	cmd = (BGMCMD*)malloc(size);
+	/* ERROR HANDLER */
+	if (!cmd) {
+		BGM_ERROR("Out of memory.");
+		return NULL;
+	}
+	memset(cmd, 0, sizeof(BGMCMD));
+	cmd->type = type;
+	cmd->ctx = _bgm_Context();
+	cmd->thread = _bgm_Thread();
+
+	// Take the arguments, and find out how much room the strings need
+	for (i=0; args[i] && i<BGM_CMD_MAXARGS; i++) {
+		if (args[i] == 'r')
+			cmd->arg[i].r = va_arg(ap, GM_REAL);
+		else {
+			cmd->arg[i].s = va_arg(ap, char*);
+			if (args[i] == 's')
+				size += strlen(cmd->arg[i].s)+1;
+		}
+	}
+	if (size == sizeof(BGMCMD))
+		return cmd;
+
+	// Then copy them to just after the struct
+	str = (char*)realloc(cmd, size);
+	/* ERROR HANDLER */
+	if (!str) {
+		BGM_ERROR("Out of memory.");
+		free(cmd);
+		return NULL;
+	}
+	cmd = (BGMCMD*)str;
+	str += sizeof(BGMCMD);
+	for (i=0; args[i] && i<BGM_CMD_MAXARGS; i++)
+		if (args[i] == 's') {
+			strcpy(str, cmd->arg[i].s);
+			cmd->arg[i].s = str;
+			str += strlen(str)+1;
+		}
+
+	return cmd;
+}
+
+/*	_bgm_CmdPush() -
+		Internal function that puts a command on the queue and wakes the
+		control thread. */
+void _bgm_CmdPush( BGMCMD *cmd )
+{
+	BGMCMD *head;
+
+	do {
+		head = bgm_cmdHead;
+		cmd->next = head;
+	} while (InterlockedCompareExchangePointer((PVOID*)&bgm_cmdHead, cmd,
+	                                           head) != head);
+
+	SetEvent(bgm_cmdEvent);
+}
+
+/*	_bgm_CmdWait() -
+		Internal function that queues a command and waits for it to run.
+		Returns FALSE (with an error set) if it couldn't, and frees the
+		command if so. */
+BOOL _bgm_CmdWait( BGMCMD *cmd )
+{
+	cmd->done = CreateEvent(NULL, FALSE, FALSE, NULL);
+	/* ERROR HANDLER */
+	if (!cmd->done) {
+		BGM_ERROR("Could not wait for the control thread.");
+		free(cmd);
+		return FALSE;
+	}
+
+	_bgm_CmdPush(cmd);
+	WaitForSingleObject(cmd->done, INFINITE);
+	CloseHandle(cmd->done);
+	return TRUE;
+}
+
+/*	_bgm_CmdPost() -
+		Internal function that queues a command for the control thread and
+		returns straight away.
+		Returns TRUE, or FALSE if the command couldn't be queued. */
+GM_REAL _bgm_CmdPost( DWORD      type,
+                      const char *args,
+                      ... )
+{
+	BGMCMD *cmd;
+	va_list ap;
+
+	va_start(ap, args);
+	cmd = _bgm_CmdMake(type, args, ap);
+	va_end(ap);
+	/* ERROR HANDLER */
+	if (!cmd)
+		return FALSE;
+
+	_bgm_CmdPush(cmd);
+	return TRUE;
+}
+
+/*	_bgm_CmdCall() -
+		Internal function that queues a command, then waits for it to run.
+		Returns what it returned. */
+GM_REAL _bgm_CmdCall( DWORD      type,
+                      const char *args,
+                      ... )
+{
+	BGMCMD *cmd;
+	GM_REAL ret;
+	va_list ap;
+
+	va_start(ap, args);
+	cmd = _bgm_CmdMake(type, args, ap);
+	va_end(ap);
+	/* ERROR HANDLER */
+	if (!cmd || !_bgm_CmdWait(cmd))
+		return FALSE;
+
+	ret = cmd->ret;
+	free(cmd);
+	return ret;
+}
+
+/*	_bgm_CmdCallStr() -
+		Internal function that runs a command returning a string on the
+		control thread.
+		Returns the string, or the error value of bgm_GetAttr*(). */
+GM_STRING _bgm_CmdCallStr( DWORD      type,
+                           const char *args,
+                           ... )
+{
+	BGMCMD *cmd;
+	GM_STRING ret;
+	va_list ap;
+
+	va_start(ap, args);
+	cmd = _bgm_CmdMake(type, args, ap);
+	va_end(ap);
+	/* ERROR HANDLER */
+	if (!cmd || !_bgm_CmdWait(cmd)) {
+		bgm_attrTypeLast = TY_REAL;
+		return BGM_ATTR_GET_FAIL;
+	}
+
+	ret = cmd->retStr;
+	free(cmd);
+	return ret;
+}
+
+/*	_bgm_CmdIsAsyncAttr() -
+		Internal function that returns whether an attribute name is that of
+		the "async" attribute. */
+BOOL _bgm_CmdIsAsyncAttr( const char *name )
+{
+	const char *async = "async";
+	
+	while (*async && tolower(*name) == *async) {
+		name++;
+		async++;
+	}
+	
+	return (*async == 0 && *name == 0);
+}
+
+/*	_bgm_CmdRun() -
+		Internal function, run on the control thread in the command's
+		context, that carries a command out. */
+void _bgm_CmdRun( BGMCMD *cmd )
+{
+	switch (cmd->type) {
+		case BGM_CMD_NOP:
+			cmd->ret = TRUE;
+		break;
+
+		// Playback
+		case BGM_CMD_PLAYBYID:
+			cmd->ret = bgm_PlayById(cmd->arg[0].r, cmd->arg[1].r);
+		break;
+		case BGM_CMD_PLAYBYFNAME:
+			cmd->ret = bgm_PlayByFname(cmd->arg[0].s, cmd->arg[1].r);
+		break;
+		case BGM_CMD_STOPBYID:
+			cmd->ret = bgm_StopById(cmd->arg[0].r);
+		break;
+		case BGM_CMD_STOPBYFNAME:
+			cmd->ret = bgm_StopByFname(cmd->arg[0].s);
+		break;
+		case BGM_CMD_PRIME:
+			cmd->ret = bgm_Prime(cmd->arg[0].r);
+		break;
+		case BGM_CMD_PAUSEBYID:
+			cmd->ret = bgm_PauseById(cmd->arg[0].r);
+		break;
+		case BGM_CMD_PAUSEBYFNAME:
+			cmd->ret = bgm_PauseByFname(cmd->arg[0].s);
+		break;
+		case BGM_CMD_UNPAUSEBYID:
+			cmd->ret = bgm_UnpauseById(cmd->arg[0].r);
+		break;
+		case BGM_CMD_UNPAUSEBYFNAME:
+			cmd->ret = bgm_UnpauseByFname(cmd->arg[0].s);
+		break;
+		case BGM_CMD_GETORDERBYID:
+			cmd->ret = bgm_GetOrderById(cmd->arg[0].r);
+		break;
+		case BGM_CMD_GETORDERBYFNAME:
+			cmd->ret = bgm_GetOrderByFname(cmd->arg[0].s);
+		break;
+		case BGM_CMD_GETROWBYID:
+			cmd->ret = bgm_GetRowById(cmd->arg[0].r);
+		break;
+		case BGM_CMD_GETROWBYFNAME:
+			cmd->ret = bgm_GetRowByFname(cmd->arg[0].s);
+		break;
+
+		// Loading
+		case BGM_CMD_LOAD:
+			cmd->ret = bgm_Load(cmd->arg[0].s, cmd->arg[1].r, cmd->arg[2].r);
+		break;
+		case BGM_CMD_LOADMOD:
+			cmd->ret = bgm_LoadMod(cmd->arg[0].s, cmd->arg[1].r);
+		break;
+		case BGM_CMD_LOADSAMPLE:
+			cmd->ret = bgm_LoadSample(cmd->arg[0].s, cmd->arg[1].r);
+		break;
+		case BGM_CMD_LOADSTREAM:
+			cmd->ret = bgm_LoadStream(cmd->arg[0].s, cmd->arg[1].r);
+		break;
+		case BGM_CMD_LOADNETSTREAM:
+			cmd->ret = bgm_LoadNetStream(cmd->arg[0].s, cmd->arg[1].r);
+		break;
+		case BGM_CMD_UNLOADBYID:
+			cmd->ret = bgm_UnloadById(cmd->arg[0].r);
+		break;
+		case BGM_CMD_UNLOADBYFNAME:
+			cmd->ret = bgm_UnloadByFname(cmd->arg[0].s);
+		break;
+
+		// Attributes
+		case BGM_CMD_GETATTRBYID:
+			cmd->retStr = bgm_GetAttrById(cmd->arg[0].r, cmd->arg[1].s);
+		break;
+		case BGM_CMD_GETATTRBYFNAME:
+			cmd->retStr = bgm_GetAttrByFname(cmd->arg[0].s, cmd->arg[1].s);
+		break;
+		case BGM_CMD_SETATTRBYID:
+			cmd->ret = bgm_SetAttrById(cmd->arg[0].r, cmd->arg[1].s,
+			                           cmd->arg[2].s);
+		break;
+		case BGM_CMD_SETATTRBYFNAME:
+			cmd->ret = bgm_SetAttrByFname(cmd->arg[0].s, cmd->arg[1].s,
+			                              cmd->arg[2].s);
+		break;
+		case BGM_CMD_FADEVOLBYID:
+			cmd->ret = bgm_FadeVolById(cmd->arg[0].r, cmd->arg[1].r,
+			                           cmd->arg[2].r);
+		break;
+		case BGM_CMD_FADEVOLBYFNAME:
+			cmd->ret = bgm_FadeVolByFname(cmd->arg[0].s, cmd->arg[1].r,
+			                              cmd->arg[2].r);
+		break;
+
+		// Effects
+		case BGM_CMD_FXADDBYID:
+			cmd->ret = bgm_FxAddById(cmd->arg[0].r, cmd->arg[1].s,
+			                         cmd->arg[2].s);
+		break;
+		case BGM_CMD_FXADDBYFNAME:
+			cmd->ret = bgm_FxAddByFname(cmd->arg[0].s, cmd->arg[1].s,
+			                            cmd->arg[2].s);
+		break;
+		case BGM_CMD_FXREMOVEBYID:
+			cmd->ret = bgm_FxRemoveById(cmd->arg[0].r, cmd->arg[1].r);
+		break;
+		case BGM_CMD_FXREMOVEBYFNAME:
+			cmd->ret = bgm_FxRemoveByFname(cmd->arg[0].s, cmd->arg[1].r);
+		break;
+		case BGM_CMD_FXCLEARBYID:
+			cmd->ret = bgm_FxClearById(cmd->arg[0].r);
+		break;
+		case BGM_CMD_FXCLEARBYFNAME:
+			cmd->ret = bgm_FxClearByFname(cmd->arg[0].s);
+		break;
+
+		// Voices
+		case BGM_CMD_LOADSAMPLEVOICES:
+			cmd->ret = bgm_LoadSampleVoices(cmd->arg[0].s, cmd->arg[1].r);
+		break;
+		case BGM_CMD_PLAYVOICE:
+			cmd->ret = bgm_PlayVoice(cmd->arg[0].r);
+		break;
+		case BGM_CMD_STOPVOICE:
+			cmd->ret = bgm_StopVoice(cmd->arg[0].r);
+		break;
+		case BGM_CMD_SETVOICEVOL:
+			cmd->ret = bgm_SetVoiceVol(cmd->arg[0].r, cmd->arg[1].r);
+		break;
+		case BGM_CMD_SETVOICEPAN:
+			cmd->ret = bgm_SetVoicePan(cmd->arg[0].r, cmd->arg[1].r);
+		break;
+
+		// Memory
+		case BGM_CMD_SETMEMORYBUDGET:
+			cmd->ret = bgm_SetMemoryBudget(cmd->arg[0].r);
+		break;
+		case BGM_CMD_REGISTER:
+			cmd->ret = bgm_Register(cmd->arg[0].s, cmd->arg[1].r);
+		break;
+		case BGM_CMD_PREFETCH:
+			cmd->ret = bgm_Prefetch(cmd->arg[0].r);
+		break;
+
+		// Analysis
+		case BGM_CMD_BEATNEXT:
+			cmd->ret = bgm_BeatNext(cmd->arg[0].r);
+		break;
+		case BGM_CMD_BEATPHASE:
+			cmd->ret = bgm_BeatPhase(cmd->arg[0].r);
+		break;
+		case BGM_CMD_SPECTRUMBYID:
+			cmd->ret = bgm_SpectrumById(cmd->arg[0].r, cmd->arg[1].r,
+			                            cmd->arg[2].s);
+		break;
+		case BGM_CMD_SPECTRUMBYFNAME:
+			cmd->ret = bgm_SpectrumByFname(cmd->arg[0].s, cmd->arg[1].r,
+			                               cmd->arg[2].s);
+		break;
+		case BGM_CMD_WAVEFORMREAD:
+			cmd->ret = bgm_WaveformRead(cmd->arg[0].r, cmd->arg[1].r,
+			                            cmd->arg[2].r, cmd->arg[3].r,
+			                            cmd->arg[4].s, cmd->arg[5].r);
+		break;
+		case BGM_CMD_METERSREAD:
+			cmd->ret = bgm_MetersRead(cmd->arg[0].s, cmd->arg[1].r);
+		break;
+	}
+	// END switch (cmd->type)
+}
+
+/*	_bgm_CmdThread() -
+		The control thread. */
+DWORD WINAPI _bgm_CmdThread( void *param )
+{
+	BGMCMD *batch, *queue, *cmd, *next;
+	BGM_THREAD *own;
+
+	for (;;) {
+		WaitForSingleObject(bgm_cmdEvent, INFINITE);
+
+		// Take everything queued, newest first, and turn it round
+		do {
+			batch = bgm_cmdHead;
+		} while (InterlockedCompareExchangePointer((PVOID*)&bgm_cmdHead,
+		                                           NULL, batch) != batch);
+		queue = NULL;
+		while (batch) {
+			next = batch->next;
+			batch->next = queue;
+			queue = batch;
+			batch = next;
+		}
+
+		for (cmd = queue; cmd; cmd = next) {
+			next = cmd->next;
+			_bgm_ContextUse(cmd->ctx);
+			if (cmd->done) {
+				// Errors, attribute types and strings go straight to the
+				// thread waiting for them. Whoever's waiting frees it.
+				own = _bgm_ThreadUse(cmd->thread);
+				_bgm_CmdRun(cmd);
+				_bgm_ThreadUse(own);
+				_bgm_CmdSnapRefresh();
+				SetEvent(cmd->done);
+			}
+			else {
+				_bgm_CmdRun(cmd);
+				_bgm_CmdSnapRefresh();
+				free(cmd);
+			}
+		}
+
+		if (bgm_cmdQuit && !bgm_cmdHead)
+			break;
+	}
+
+	_bgm_ContextUse(NULL);
+	_bgm_ThreadFree();
+	return 0;
+}
+
+/*	_bgm_CmdSnapBuild() -
+		Internal function that gives the calling thread's context a snapshot
+		of its whole song list.
+		Returns FALSE if it's out of memory. */
+BOOL _bgm_CmdSnapBuild( )
+{
+	BGM_CONTEXT *ctx = _bgm_Context();
+	SONG *node;
+
+	ctx->snap = NEW(CMDSNAP,1);
+	if (!ctx->snap)
+		return FALSE;
+	memset(ctx->snap, 0, sizeof(CMDSNAP));
+
+	for (node = bgm_song; node; node = node->next)
+		if (!_bgm_CmdSnapSong(node)) {
+			_bgm_CmdSnapFree(ctx);
+			return FALSE;
+		}
+
+	return TRUE;
+}
+
+/*	_bgm_CmdSnapFree() -
+		Internal function that frees a context's snapshot. */
+void _bgm_CmdSnapFree( BGM_CONTEXT *ctx )
+{
+	CMDSNAP *snap = ctx->snap;
+	void *old;
+
+	if (!snap)
+		return;
+
+	while (snap->retired) {
+		old = snap->retired;
+		snap->retired = *(void**)old;
+		free(old);
+	}
+	free(snap->songs);
+	free(snap->owner);
+	free(snap);
+	ctx->snap = NULL;
+}
+
+/*	_bgm_CmdSnapGrow() -
+		Internal function that makes room for more songs in a snapshot.
+		Returns FALSE if it's out of memory. */
+BOOL _bgm_CmdSnapGrow( CMDSNAP *snap )
+{
+	SNAPSONG *songs;
+	SONG **owner;
+	DWORD room = snap->room ? snap->room*2 : 64;
+
+	owner = RESIZE(snap->owner, SONG*, room);
+	if (!owner)
+		return FALSE;
+	snap->owner = owner;
+	songs = NEW(SNAPSONG,room);
+	if (!songs)
+		return FALSE;
+	if (snap->count)
+		memcpy(songs, snap->songs, sizeof(SNAPSONG)*snap->count);
+
+	// A reader may still be in the old array, so it's kept. Linking it in
+	// overwrites its first entry, which is why it's done with seq odd.
+	InterlockedIncrement(&snap->seq);
+	if (snap->songs) {
+		*(void**)snap->songs = snap->retired;
+		snap->retired = snap->songs;
+	}
+	snap->songs = songs;
+	snap->room = room;
+	InterlockedIncrement(&snap->seq);
+
+	return TRUE;
+}
+
+/*	_bgm_CmdSnapSong() -
+		Internal function that adds a song to the snapshot, or brings its
+		entry up to date. */
+BOOL _bgm_CmdSnapSong( SONG *song )
+{
+	CMDSNAP *snap = _bgm_Context()->snap;
+	SNAPSONG *entry;
+	BASS_CHANNELINFO info;
+	DWORD i, active, now, freq, fadeEnd;
+	float pos, len, rate;
+	BOOL loop;
+
+	if (!snap)
+		return TRUE;
+
+	for (i=0; i<snap->count; i++)
+		if (snap->owner[i] == song)
+			break;
+	if (i == snap->room && !_bgm_CmdSnapGrow(snap))
+		return FALSE;
+
+	// Find out what the channel is doing before taking the entry, so
+	// readers aren't kept waiting on BASS
+	now = GetTickCount();
+	pos = len = rate = 0.0f;
+	loop = FALSE;
+	fadeEnd = 0;
+	if (song->evicted) {
+		active = song->evictActive;
+		pos = song->evictPos;
+		len = song->evictLen;
+		loop = (song->evictLoop != 0);
+	}
+	else if (song->id == 0)
+		active = BASS_ACTIVE_STOPPED;
+	else {
+		BASS_ChannelGetInfo(song->id, &info);
+		BASS_ChannelGetAttributes(song->id, &freq, NULL, NULL);
+		if (!freq)
+			freq = info.freq;
+		loop = (info.flags & BASS_SAMPLE_LOOP) != 0;
+		len = BASS_ChannelBytes2Seconds(song->id,
+		                                BASS_ChannelGetLength(song->id));
+		if (BASS_ChannelIsSliding(song->id) & BASS_SLIDE_VOL)
+			fadeEnd = song->fadeEnd;
+
+		// A virtual song moves on by its clock
+		if (song->virt) {
+			active = BASS_ACTIVE_PLAYING;
+			pos = BASS_ChannelBytes2Seconds(song->id, song->virtPos);
+			now = song->virtStart;
+		}
+		else {
+			active = BASS_ChannelIsActive(song->id);
+			pos = BASS_ChannelBytes2Seconds(song->id,
+			                                BASS_ChannelGetPosition(song->id));
+		}
+		if (active == BASS_ACTIVE_PLAYING)
+			rate = (float)freq/info.freq/1000.0f;
+	}
+
+	InterlockedIncrement(&snap->seq);
+	entry = &snap->songs[i];
+	entry->ref = song->ref;
+	entry->id = song->id;
+	strcpy(entry->fname, song->fname);
+	entry->active = active;
+	entry->pos = pos;
+	entry->posTick = now;
+	entry->posRate = rate;
+	entry->len = len;
+	entry->loop = loop;
+	entry->fadeEnd = fadeEnd;
+	snap->owner[i] = song;
+	if (i == snap->count)
+		snap->count++;
+	InterlockedIncrement(&snap->seq);
+
+	return TRUE;
+}
+
+/*	_bgm_CmdSnapDrop() -
+		Internal function that takes a song out of the snapshot. The rest
+		move up to keep the list's order, as lookups by filename find the
+		first song loaded from it. */
+void _bgm_CmdSnapDrop( SONG *song )
+{
+	CMDSNAP *snap = _bgm_Context()->snap;
+	DWORD i;
+
+	if (!snap)
+		return;
+
+	for (i=0; i<snap->count; i++)
+		if (snap->owner[i] == song)
+			break;
+	if (i == snap->count)
+		return;
+
+	InterlockedIncrement(&snap->seq);
+	memmove(&snap->songs[i], &snap->songs[i+1],
+	        sizeof(SNAPSONG)*(snap->count-i-1));
+	memmove(&snap->owner[i], &snap->owner[i+1],
+	        sizeof(SONG*)*(snap->count-i-1));
+	snap->count--;
+	InterlockedIncrement(&snap->seq);
+}
+
+/*	_bgm_CmdSnapRefresh() -
+		Internal function that publishes every song in the snapshot again. */
+void _bgm_CmdSnapRefresh( )
+{
+	CMDSNAP *snap = _bgm_Context()->snap;
+	DWORD i;
+
+	if (!snap)
+		return;
+
+	for (i=0; i<snap->count; i++)
+		_bgm_CmdSnapSong(snap->owner[i]);
+}
+
+/*	_bgm_CmdSnapFind() -
+		Internal function that looks a song up in the snapshot by ID, or by
+		filename if fname isn't NULL, and fills in stub from its entry as if
+		the song were evicted, with a playing song's position carried
+		forward to now.
+		Returns stub, or NULL if there is no such song. */
+SONG* _bgm_CmdSnapFind( DWORD      ref,
+                        const char *fname,
+                        SONG       *stub )
+{
+	CMDSNAP *snap = _bgm_Context()->snap;
+	SNAPSONG *songs, entry;
+	DWORD count, i, now, active;
+	LONG seq;
+	BOOL found;
+	float pos;
+
+	if (!snap)
+		return NULL;
+
+	// Copy the entry out, and start again if it was being changed
+	do {
+		seq = snap->seq;
+		BGM_CMD_BARRIER();
+		songs = snap->songs;
+		count = snap->count;
+		found = FALSE;
+		i = 0;
+		if (!(seq & 1)) {
+			// The Quick Play song comes first, as in the list
+			found = count && (fname ? fname[0] == 0 : ref == 0);
+			while (!found && i < count) {
+				if (fname ? strncmp(songs[i].fname, fname,
+				                    sizeof(songs[i].fname)) == 0
+				          : songs[i].ref == ref)
+					found = TRUE;
+				else
+					i++;
+			}
+			if (found)
+				entry = songs[i];
+		}
+		BGM_CMD_BARRIER();
+	} while ((seq & 1) || seq != snap->seq);
+
+	if (!found)
+		return NULL;
+
+	// Carry the position forward from when it was published
+	now = GetTickCount();
+	active = entry.active;
+	pos = entry.pos + entry.posRate*(now - entry.posTick);
+	if (entry.posRate > 0.0f && entry.len > 0.0f && pos >= entry.len) {
+		if (entry.loop)
+			pos = (float)fmod(pos, entry.len);
+		else {
+			pos = entry.len;
+			active = BASS_ACTIVE_STOPPED;
+		}
+	}
+
+	stub->ref = entry.ref;
+	stub->id = entry.id;
+	stub->virt = FALSE;
+	stub->evicted = TRUE;
+	stub->evictActive = active;
+	stub->evictPos = pos;
+	stub->evictLen = entry.len;
+	stub->fadeEnd = entry.fadeEnd;
+
+	return stub;
+}
+
+/* END OF FILE */
@@ -0,0 +1,297 @@
+/******************************************************************************
+ *
+ *	bgm_cmd.h -
+ *		Prototypes and types for BGM's asynchronous mode. With the "async"
+ *		global attribute set, calls that change songs don't touch the song
+ *		list at all: they go into a lock-free queue and return at once, and
+ *		a BGM control thread runs them in the order they were made. Calls
+ *		that only ask after a song's channel (whether it is loaded or
+ *		playing, its length and position, whether it is fading) are
+ *		answered from a snapshot of the song list the control thread
+ *		publishes, so neither kind ever waits for BASS or for another thread.
+ *		Anything that has to hand back something new (loads, attribute
+ *		values, effects, analysis buffers) is run on the control thread too,
+ *		and waits for it.
+ *
+ *****************************************************************************/
+
+#ifndef BGM_CMD_H
+#define BGM_CMD_H
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// Most arguments a command takes
+#define BGM_CMD_MAXARGS 6
+
+// Commands. The DLL functions behind the first group return as soon as
+// they're queued; the callers of the rest (from BGM_CMD_LOAD on) wait for
+// the result.
+enum {
+	BGM_CMD_NOP,
+	BGM_CMD_PLAYBYID,
+	BGM_CMD_PLAYBYFNAME,
+	BGM_CMD_STOPBYID,
+	BGM_CMD_STOPBYFNAME,
+	BGM_CMD_PAUSEBYID,
+	BGM_CMD_PAUSEBYFNAME,
+	BGM_CMD_UNPAUSEBYID,
+	BGM_CMD_UNPAUSEBYFNAME,
+	BGM_CMD_UNLOADBYID,
+	BGM_CMD_UNLOADBYFNAME,
+	BGM_CMD_SETATTRBYID,
+	BGM_CMD_SETATTRBYFNAME,
+	BGM_CMD_FADEVOLBYID,
+	BGM_CMD_FADEVOLBYFNAME,
+	BGM_CMD_FXREMOVEBYID,
+	BGM_CMD_FXREMOVEBYFNAME,
+	BGM_CMD_FXCLEARBYID,
+	BGM_CMD_FXCLEARBYFNAME,
+	BGM_CMD_STOPVOICE,
+	BGM_CMD_SETVOICEVOL,
+	BGM_CMD_SETVOICEPAN,
+	BGM_CMD_SETMEMORYBUDGET,
+	BGM_CMD_PREFETCH,
+	BGM_CMD_PRIME,
+
+	BGM_CMD_LOAD,
+	BGM_CMD_LOADMOD,
+	BGM_CMD_LOADSAMPLE,
+	BGM_CMD_LOADSTREAM,
+	BGM_CMD_LOADNETSTREAM,
+	BGM_CMD_LOADSAMPLEVOICES,
+	BGM_CMD_PLAYVOICE,
+	BGM_CMD_REGISTER,
+	BGM_CMD_GETATTRBYID,
+	BGM_CMD_GETATTRBYFNAME,
+	BGM_CMD_FXADDBYID,
+	BGM_CMD_FXADDBYFNAME,
+	BGM_CMD_GETORDERBYID,
+	BGM_CMD_GETORDERBYFNAME,
+	BGM_CMD_GETROWBYID,
+	BGM_CMD_GETROWBYFNAME,
+	BGM_CMD_BEATNEXT,
+	BGM_CMD_BEATPHASE,
+	BGM_CMD_SPECTRUMBYID,
+	BGM_CMD_SPECTRUMBYFNAME,
+	BGM_CMD_WAVEFORMREAD,
+	BGM_CMD_METERSREAD
+};
+
+// Whether a DLL function should hand its work to the control thread: the
+// calling thread's context is in async mode, and this isn't the control
+// thread running it
+#define BGM_CMD_ASYNC \
+	(bgm_config.async && GetCurrentThreadId() != bgm_cmdThreadId)
+
+/******************************************************************************
+ * Typedefs, structs, etc.
+ *****************************************************************************/
+
+/*	BGMCMD -
+		One call for the control thread. Strings are copied to just after
+		the struct, except the addresses of GM buffers, which are only used
+		while the caller waits.
+*/
+typedef struct ctagBGMCMD {
+	DWORD		type;			// BGM_CMD_*
+	BGM_CONTEXT	*ctx;			// Context it was made in
+	BGM_THREAD	*thread;		// State of the thread that made it
+	union {
+		GM_REAL	r;
+		char	*s;
+	}			arg[BGM_CMD_MAXARGS];
+	GM_REAL		ret;			// What it returned...
+	GM_STRING	retStr;			// ...or this, for attribute values
+	HANDLE		done;			// Set when it has run, if anyone's waiting
+	struct
+	ctagBGMCMD	*next;			// Next in the queue
+} BGMCMD;
+
+/*	SNAPSONG -
+		What the snapshot knows about a song: enough to find it the way
+		_bgm_GetSongById() and _bgm_GetSongByFname() do, and what its
+		channel was doing when the entry was published, so that readers
+		never have to ask BASS about a handle that may be gone by then.
+		A playing song's position is published with the tick it was read
+		at and how fast it moves, for readers to carry forward; a virtual
+		song's (see bgm_virt.c) comes from its clock the same way, and an
+		evicted song's (see bgm_mem.c) is what was kept of it.
+*/
+typedef struct ctagSNAPSONG {
+	DWORD		ref;
+	DWORD		id;
+	char		fname[512];
+	DWORD		active;		// BASS_ACTIVE_xxx, as _bgm_IsPlaying() has it
+	float		pos;		// Position, in seconds...
+	DWORD		posTick;	// ...at this tick...
+	float		posRate;	// ...and seconds it moves a ms, 0 if it doesn't
+	float		len;		// Length, in seconds
+	BOOL		loop;		// Goes back to the start when it gets to len
+	DWORD		fadeEnd;	// When the volume fade on it ends, or 0 if none
+} SNAPSONG;
+
+/*	CMDSNAP -
+		A context's song snapshot, in the same order as its song list. Only
+		the thread changing the song list writes it, bumping seq before and
+		after so that it is odd while a change is half made; readers copy
+		what they need and try again if seq moved under them. Arrays it has
+		outgrown are kept on retired until the snapshot is freed, as a
+		reader may still be looking at one.
+*/
+typedef struct ctagCMDSNAP {
+	volatile LONG	seq;
+	SNAPSONG * volatile songs;
+	volatile DWORD	count;
+	DWORD			room;
+	SONG			**owner;	// The SONG each entry is for (writer only)
+	void			*retired;	// Outgrown arrays, each linked through its
+								// first pointer
+} CMDSNAP;
+
+/******************************************************************************
+ * Global externs
+ *****************************************************************************/
+
+extern DWORD bgm_cmdThreadId;
+
+/******************************************************************************
+ * Function prototypes
+ *****************************************************************************/
+
+/*	_bgm_CmdInit() -
+		Internal function that sets up the command queue. Called from
+		bgm_Init(). The control thread is only started when a context first
+		goes into async mode. */
+void _bgm_CmdInit( );
+
+/*	_bgm_CmdShutdown() -
+		Internal function that runs whatever is still queued, then stops the
+		control thread. Called from bgm_Close() before anything is
+		unloaded. */
+void _bgm_CmdShutdown( );
+
+/*	_bgm_CmdStart() -
+		Internal function that starts the control thread if it isn't running
+		yet, and makes the calling thread's context a snapshot if it has
+		none.
+		Returns TRUE on success, FALSE (with an error set) on failure. */
+BOOL _bgm_CmdStart( );
+
+/*	_bgm_CmdSync() -
+		Internal function that waits until everything queued so far has
+		run. */
+void _bgm_CmdSync( );
+
+/*	_bgm_CmdMake() -
+		Internal function that makes a command from _bgm_CmdPost()-style
+		arguments.
+		Returns NULL (with an error set) if it's out of memory. */
+BGMCMD* _bgm_CmdMake( DWORD      type,
+                      const char *args,
+                      va_list    ap );
+
+/*	_bgm_CmdPush() -
+		Internal function that puts a command on the queue and wakes the
+		control thread. Never waits. */
+void _bgm_CmdPush( BGMCMD *cmd );
+
+/*	_bgm_CmdWait() -
+		Internal function that queues a command and waits for it to run.
+		Returns FALSE (with an error set, and the command freed) if it
+		couldn't. */
+BOOL _bgm_CmdWait( BGMCMD *cmd );
+
+/*	_bgm_CmdPost() -
+		Internal function that queues a command for the control thread and
+		returns straight away. args has a letter for each argument that
+		follows: 'r' for a GM_REAL, 's' for a string to copy, 'p' for a
+		buffer address.
+		Returns TRUE, or FALSE if the command couldn't be queued. */
+GM_REAL _bgm_CmdPost( DWORD      type,
+                      const char *args,
+                      ... );
+
+/*	_bgm_CmdCall() -
+		Internal function that queues a command like _bgm_CmdPost(), then
+		waits for it to run.
+		Returns what it returned. */
+GM_REAL _bgm_CmdCall( DWORD      type,
+                      const char *args,
+                      ... );
+
+/*	_bgm_CmdCallStr() -
+		Internal function that runs a command returning a string on the
+		control thread, like _bgm_CmdCall().
+		Returns the string, or the error value of bgm_GetAttr*(). */
+GM_STRING _bgm_CmdCallStr( DWORD      type,
+                           const char *args,
+                           ... );
+
+/*	_bgm_CmdIsAsyncAttr() -
+		Internal function that returns whether an attribute name is that of
+		the "async" attribute, which any case will do for. */
+BOOL _bgm_CmdIsAsyncAttr( const char *name );
+
+/*	_bgm_CmdRun() -
+		Internal function, run on the control thread in the command's
+		context, that carries a command out. */
+void _bgm_CmdRun( BGMCMD *cmd );
+
+/*	_bgm_CmdThread() -
+		The control thread. Takes everything queued at once and runs it in
+		the order it was queued, then sleeps until there's more. */
+DWORD WINAPI _bgm_CmdThread( void *param );
+
+/*	_bgm_CmdSnapBuild() -
+		Internal function that makes the calling thread's context a
+		snapshot of its whole song list.
+		Returns FALSE if it's out of memory. */
+BOOL _bgm_CmdSnapBuild( );
+
+/*	_bgm_CmdSnapFree() -
+		Internal function that frees a context's snapshot. Safe to call on
+		contexts without one. */
+void _bgm_CmdSnapFree( BGM_CONTEXT *ctx );
+
+/*	_bgm_CmdSnapGrow() -
+		Internal function that makes room for more songs in a snapshot.
+		Returns FALSE if it's out of memory. */
+BOOL _bgm_CmdSnapGrow( CMDSNAP *snap );
+
+/*	_bgm_CmdSnapSong() -
+		Internal function that adds a song to the calling thread's context's
+		snapshot, or brings its entry up to date. Called wherever a song
+		gets a new channel. Does nothing if the context has no snapshot.
+		Returns FALSE if it's out of memory. */
+BOOL _bgm_CmdSnapSong( SONG *song );
+
+/*	_bgm_CmdSnapDrop() -
+		Internal function that takes a song out of the snapshot, before it's
+		deleted. */
+void _bgm_CmdSnapDrop( SONG *song );
+
+/*	_bgm_CmdSnapRefresh() -
+		Internal function that publishes every song in the calling thread's
+		context's snapshot again. The control thread calls it after each
+		command, as any of them may have started, stopped, moved or faded a
+		song. Does nothing if the context has no snapshot. */
+void _bgm_CmdSnapRefresh( );
+
+/*	_bgm_CmdSnapFind() -
+		Internal function that looks a song up in the calling thread's
+		context's snapshot by ID, or by filename if fname isn't NULL, and
+		fills in stub with its ID and channel, and with its state carried
+		forward to now as if it were evicted, so _bgm_IsPlaying(),
+		_bgm_GetPos(), _bgm_GetLen() and _bgm_VolIsFading() answer from it
+		without calling BASS. Other members of stub are left as they are,
+		so only pass the result to functions that look at nothing else.
+		Returns stub, or NULL if there is no such song. */
+SONG* _bgm_CmdSnapFind( DWORD      ref,
+                        const char *fname,
+                        SONG       *stub );
+
+#endif // BGM_CMD_H
+
+/* END OF FILE */
@@ -0,0 +1,110 @@
+/******************************************************************************
+ *
+ *	bgm_coalesce.c -
+ *		Implementation of trigger coalescing.
+ *
+ *	A merged play costs a tick count, a compare and at most one
+ *	BASS_ChannelSetAttributes(), where playing it would restart a channel
+ *	(or steal a voice) and leave one more for the mixer. A boost can't take
+ *	a channel past BASS's volume of 100, so sounds that are meant to
+ *	coalesce loudly need headroom below that.
+ *
+ *****************************************************************************/
+
+#include "bgm.h"
+
+/******************************************************************************
+ * Function implementations
+ *****************************************************************************/
+
+/*	_bgm_CoalesceSet() -
+		Internal function that sets a song's coalescing window. */
+BOOL _bgm_CoalesceSet( SONG  *song,
+                       DWORD window )
+{
+	if (!window) {
+		_bgm_CoalesceFree(song);
+		return TRUE;
+	}
+
+	if (!song->coalesce) {
+		song->coalesce = NEW(COALESCE,1);
+		if (!song->coalesce)
+			return FALSE;
+		memset(song->coalesce, 0, sizeof(COALESCE));
+	}
+	song->coalesce->window = window;
+
+	return TRUE;
+}
+
+/*	_bgm_CoalesceFree() -
+		Internal function that frees a song's COALESCE. */
+void _bgm_CoalesceFree( SONG *song )
+{
+	free(song->coalesce);
+	song->coalesce = NULL;
+}
+
+/*	_bgm_CoalesceMerge() -
+		Internal function that merges a play into the song's open window. */
+HCHANNEL _bgm_CoalesceMerge( SONG  *song,
+                             DWORD now )
+{
+	COALESCE *co = song->coalesce;
+	float boost;
+	DWORD vol;
+
+	if (!co || !co->count || now - co->start >= co->window)
+		return 0;
+	// A channel that has finished (or been stolen) can't be made louder
+	if (BASS_ChannelIsActive(co->chan) != BASS_ACTIVE_PLAYING)
+		return 0;
+
+	co->count++;
+	_bgm_Context()->coalesced++;
+
+	boost = sqrtf((float)co->count);
+	if (boost > bgm_config.coalesceCap/100.0f)
+		boost = bgm_config.coalesceCap/100.0f;
+	vol = (DWORD)(co->vol*boost + 0.5f);
+	if (vol > 100)
+		vol = 100;
+
+	// Past the cap or the top of the range, there's nothing for BASS to do
+	if (vol != co->boosted) {
+		BASS_ChannelSetAttributes(co->chan, -1, vol, -101);
+		co->boosted = vol;
+	}
+
+	return co->chan;
+}
+
+/*	_bgm_CoalesceOpen() -
+		Internal function that opens a window for a play. */
+void _bgm_CoalesceOpen( SONG     *song,
+                        HCHANNEL chan,
+                        DWORD    now )
+{
+	COALESCE *co = song->coalesce;
+	DWORD vol;
+
+	if (!co)
+		return;
+
+	BASS_ChannelGetAttributes(chan, NULL, &vol, NULL);
+	// Still as the last window left it, so it was boosted; anything else
+	// was set since and is the volume to keep
+	if (co->count > 1 && chan == co->chan && vol == co->boosted) {
+		vol = co->vol;
+		BASS_ChannelSetAttributes(chan, -1, vol, -101);
+	}
+
+	co->start = now;
+	co->count = 1;
+	co->chan = chan;
+	co->vol = vol;
+	co->boosted = vol;
+}
+
+/* END OF FILE */
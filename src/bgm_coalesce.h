@@ -0,0 +1,70 @@
+/******************************************************************************
+ *
+ *	bgm_coalesce.h -
+ *		Prototypes and types for trigger coalescing. A song with the
+ *		"coalesce" attribute set to a window in ms doesn't start again when
+ *		it's played within that long of the play that opened the window:
+ *		the channel that play started is turned up instead, as the sound
+ *		of that many copies at once would be. The boost goes with the
+ *		square root of the count (copies that don't line up add in power,
+ *		not amplitude) and stops at the "coalescecap" global attribute.
+ *		Both bgm_PlayById() and bgm_PlayVoice() coalesce.
+ *
+ *****************************************************************************/
+
+#ifndef BGM_COALESCE_H
+#define BGM_COALESCE_H
+
+/******************************************************************************
+ * Typedefs, structs, etc.
+ *****************************************************************************/
+
+/*	COALESCE -
+		A song's coalescing window, and the play that opened it.
+*/
+typedef struct ctagCOALESCE {
+	DWORD		window;		// How long plays are merged for (ms)
+	DWORD		start;		// When the window opened
+	DWORD		count;		// Plays merged into it, counting the first, or
+							// 0 if none is open
+	HCHANNEL	chan;		// Channel the first play started
+	DWORD		vol;		// Its volume before any boost
+	DWORD		boosted;	// Volume the last boost gave it
+} COALESCE;
+
+/******************************************************************************
+ * Function prototypes
+ *****************************************************************************/
+
+/*	_bgm_CoalesceSet() -
+		Internal function that sets a song's coalescing window, in ms, or
+		turns coalescing off for it if window is 0.
+		Returns FALSE if it's out of memory. */
+BOOL _bgm_CoalesceSet( SONG  *song,
+                       DWORD window );
+
+/*	_bgm_CoalesceFree() -
+		Internal function that frees a song's COALESCE. Safe to call on
+		songs without one. */
+void _bgm_CoalesceFree( SONG *song );
+
+/*	_bgm_CoalesceMerge() -
+		Internal function that merges a play of the song into its open
+		window, if there is one and its channel is still playing, by
+		turning that channel up.
+		Returns the channel, or 0 if the song should play as usual. */
+HCHANNEL _bgm_CoalesceMerge( SONG  *song,
+                             DWORD now );
+
+/*	_bgm_CoalesceOpen() -
+		Internal function that opens a window for a play that is about to
+		start the given channel, first taking back any boost the channel
+		still has from the last one. Does nothing if the song doesn't
+		coalesce. */
+void _bgm_CoalesceOpen( SONG     *song,
+                        HCHANNEL chan,
+                        DWORD    now );
+
+#endif // BGM_COALESCE_H
+
+/* END OF FILE */
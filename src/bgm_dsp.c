@@ -0,0 +1,499 @@
+/******************************************************************************
+ *
+ *	bgm_dsp.c -
+ *		Implementation of the per-song DSP hook and the sample kernels it
+ *		uses.
+ *
+ *	BGM turns on BASS_CONFIG_FLOATDSP at init time, so every buffer handed
+ *	to _bgm_SongDSP() holds interleaved 32-bit floats no matter what format
+ *	the song was loaded in.
+ *
+ *****************************************************************************/
+
+#include "bgm.h"
+
+/******************************************************************************
+ * Function implementations
+ *****************************************************************************/
+
+/*	_bgm_DspAttach() -
+		Internal function that makes sure the given song has a SONGDSP set
+		on its channel, creating one if needed.
+		Returns the SONGDSP, or NULL on failure. */
+SONGDSP* _bgm_DspAttach( SONG *song )
+{
+	SONGDSP *dsp;
+	BASS_CHANNELINFO info;
+
+	// Already attached?
+	if (song->dsp)
+		return song->dsp;
+
+	/* ERROR HANDLER */
+	if (!BASS_ChannelGetInfo(song->id, &info)) {
+		BGM_ERROR("Invalid song ID.");
+		return NULL;
+	}
+
+	dsp = NEW(SONGDSP,1);
+	/* ERROR HANDLER */
+	if (!dsp) {
+		BGM_ERROR("Out of memory.");
+		return NULL;
+	}
+
+	// Initialize the DSP state
+	dsp->chan = song->id;
+	dsp->chans = info.chans ? info.chans : 1;
+	dsp->freq = info.freq ? info.freq : 44100;
+	dsp->fx.count = 0;
+	dsp->spec = NULL;
+	memset(&dsp->meter, 0, sizeof(METERTAP));
+	/* ERROR HANDLER */
+	if (!_bgm_BusInitTap(&dsp->bus, dsp->chans, dsp->freq)) {
+		BGM_ERROR("Out of memory.");
+		free(dsp);
+		return NULL;
+	}
+	dsp->bus.group = song->group;
+	dsp->user = _bgm_UserNew(dsp);
+	/* ERROR HANDLER */
+	if (!dsp->user) {
+		BGM_ERROR("Too many songs with effects.");
+		_bgm_BusFreeTap(&dsp->bus);
+		free(dsp);
+		return NULL;
+	}
+	InitializeCriticalSection(&dsp->lock);
+
+	// Hook it into the channel
+	dsp->handle = BASS_ChannelSetDSP(song->id, _bgm_SongDSP, dsp->user, 0);
+	/* ERROR HANDLER */
+	if (!dsp->handle) {
+		BGM_ERROR("Could not set DSP on channel.");
+		_bgm_UserFree(dsp->user);
+		DeleteCriticalSection(&dsp->lock);
+		_bgm_BusFreeTap(&dsp->bus);
+		free(dsp);
+		return NULL;
+	}
+
+	song->dsp = dsp;
+	return dsp;
+}
+
+/*	_bgm_DspAttachAll() -
+		Internal function that attaches a SONGDSP to every loaded song. Used
+		when something that needs to see every song (like the master bus) is
+		turned on. */
+void _bgm_DspAttachAll( )
+{
+	SONG *node;
+
+	for (node = bgm_song; node; node = node->next)
+		if (node->id)
+			_bgm_DspAttach(node);
+}
+
+/*	_bgm_DspDetach() -
+		Internal function that removes the song's SONGDSP from its channel
+		and frees it. Safe to call on songs without one. */
+void _bgm_DspDetach( SONG *song )
+{
+	SONGDSP *dsp = song->dsp;
+
+	if (!dsp)
+		return;
+
+	// Once this returns BASS won't call _bgm_SongDSP() for it again
+	BASS_ChannelRemoveDSP(dsp->chan, dsp->handle);
+
+	_bgm_UserFree(dsp->user);
+	DeleteCriticalSection(&dsp->lock);
+	_bgm_BusFreeTap(&dsp->bus);
+	if (dsp->spec)
+		free(dsp->spec);
+	free(dsp);
+	song->dsp = NULL;
+}
+
+/*	_bgm_DspMove() -
+		Internal function that moves the song's SONGDSP onto another channel
+		with the same format. Safe to call on songs without one. */
+void _bgm_DspMove( SONG  *song,
+                   DWORD chan )
+{
+	SONGDSP *dsp = song->dsp;
+
+	if (!dsp)
+		return;
+
+	BASS_ChannelRemoveDSP(dsp->chan, dsp->handle);
+	dsp->chan = chan;
+	dsp->handle = BASS_ChannelSetDSP(chan, _bgm_SongDSP, dsp->user, 0);
+}
+
+/*	_bgm_SongDSP() -
+		The DSPPROC given to BASS for every song with a SONGDSP. "user"
+		stands for the SONGDSP. */
+void CALLBACK _bgm_SongDSP( HDSP  handle,
+                            DWORD channel,
+                            void  *buffer,
+                            DWORD length,
+                            DWORD user )
+{
+	SONGDSP *dsp = (SONGDSP*)_bgm_UserGet(user);
+	DWORD vol = 100;
+	float scale;
+
+	EnterCriticalSection(&dsp->lock);
+
+	// The song's own effects come first...
+	_bgm_FxProcess(&dsp->fx, (float*)buffer, length/sizeof(float),
+	               dsp->chans);
+
+	// A song being primed (see _bgm_Prime()) isn't in the mix yet, so what
+	// it buffers stays out of the bus, the meters and the spectrum. That
+	// first buffer is heard without ducking or limiting.
+	if (BASS_ChannelIsActive(channel) != BASS_ACTIVE_PLAYING) {
+		LeaveCriticalSection(&dsp->lock);
+		return;
+	}
+
+	// ...then the master bus, which needs to know how loud the song will
+	// actually be in the mix
+	_bgm_MeterLapse();
+	if (_bgm_BusActive() || bgm_meterOn)
+		BASS_ChannelGetAttributes(channel, NULL, &vol, NULL);
+	_bgm_BusProcess(&dsp->bus, (float*)buffer, length/sizeof(float),
+	                dsp->chans, dsp->freq, vol/100.0f);
+
+	// Levels as they will be heard
+	if (bgm_meterOn) {
+		scale = vol/100.0f*bgm_bus.gvol;
+		_bgm_MeterProcess(&dsp->meter, (float*)buffer, length/sizeof(float),
+		                  dsp->chans, dsp->freq, scale);
+	}
+
+	// Keep what came out for anyone who wants to look at it
+	if (dsp->spec)
+		_bgm_SpecCapture(dsp->spec, (float*)buffer, length/sizeof(float),
+		                 dsp->chans);
+
+	LeaveCriticalSection(&dsp->lock);
+}
+
+/*	_bgm_DspGain() -
+		Multiplies count samples by gain. */
+void _bgm_DspGain( float *buf,
+                   DWORD count,
+                   float gain )
+{
+	DWORD i = 0;
+
+#ifdef __SSE__
+	__m128 g = _mm_set1_ps(gain);
+	for (; i+4 <= count; i += 4)
+		_mm_storeu_ps(buf+i, _mm_mul_ps(_mm_loadu_ps(buf+i), g));
+#endif
+
+	// Whatever is left over (or everything, without SSE)
+	for (; i < count; i++)
+		buf[i] *= gain;
+}
+
+/*	_bgm_DspSoftClip() -
+		Applies drive to count samples and then saturates them smoothly into
+		the -1 to 1 range with a rational tanh approximation. */
+void _bgm_DspSoftClip( float *buf,
+                       DWORD count,
+                       float drive )
+{
+	DWORD i = 0;
+	float x;
+
+	// y = x(27 + x^2) / (27 + 9x^2), which reaches exactly +-1 at x = +-3,
+	// so the input is clamped there first.
+
+#ifdef __SSE__
+	__m128 d = _mm_set1_ps(drive);
+	__m128 lo = _mm_set1_ps(-3.0f), hi = _mm_set1_ps(3.0f);
+	__m128 k27 = _mm_set1_ps(27.0f), k9 = _mm_set1_ps(9.0f);
+	__m128 v, v2;
+	for (; i+4 <= count; i += 4) {
+		v = _mm_mul_ps(_mm_loadu_ps(buf+i), d);
+		v = _mm_min_ps(_mm_max_ps(v, lo), hi);
+		v2 = _mm_mul_ps(v, v);
+		v = _mm_div_ps(_mm_mul_ps(v, _mm_add_ps(k27, v2)),
+		               _mm_add_ps(k27, _mm_mul_ps(k9, v2)));
+		_mm_storeu_ps(buf+i, v);
+	}
+#endif
+
+	for (; i < count; i++) {
+		x = buf[i] * drive;
+		if (x < -3.0f) x = -3.0f;
+		else if (x > 3.0f) x = 3.0f;
+		buf[i] = x * (27.0f + x*x) / (27.0f + 9.0f*x*x);
+	}
+}
+
+/*	_bgm_DspGainRamp() -
+		Multiplies frames interleaved frames of chans channels by a gain that
+		moves linearly from g0 to g1 over the block. */
+void _bgm_DspGainRamp( float *buf,
+                       DWORD frames,
+                       DWORD chans,
+                       float g0,
+                       float g1 )
+{
+	DWORD f = 0, c;
+	float step, g;
+
+	if (frames == 0)
+		return;
+	step = (g1-g0)/frames;
+
+#ifdef __SSE__
+	// Mono and stereo can be done 4 samples at a time with a gain vector
+	// that steps along with them
+	if (chans == 1 || chans == 2) {
+		__m128 vg, vstep;
+		DWORD per = 4/chans; // Frames per vector
+		if (chans == 1)
+			vg = _mm_setr_ps(g0, g0+step, g0+2*step, g0+3*step);
+		else
+			vg = _mm_setr_ps(g0, g0, g0+step, g0+step);
+		vstep = _mm_set1_ps(step*per);
+		for (; f+per <= frames; f += per) {
+			_mm_storeu_ps(buf+f*chans,
+			              _mm_mul_ps(_mm_loadu_ps(buf+f*chans), vg));
+			vg = _mm_add_ps(vg, vstep);
+		}
+	}
+#endif
+
+	for (; f < frames; f++) {
+		g = g0 + step*f;
+		for (c=0; c<chans; c++)
+			buf[f*chans+c] *= g;
+	}
+}
+
+/*	_bgm_DspPeak() -
+		Returns the largest absolute value among count samples. */
+float _bgm_DspPeak( const float *buf,
+                    DWORD       count )
+{
+	DWORD i = 0;
+	float peak = 0.0f, a;
+
+#ifdef __SSE__
+	__m128 zero = _mm_setzero_ps(), vmax = zero, v;
+	float tmp[4];
+	for (; i+4 <= count; i += 4) {
+		v = _mm_loadu_ps(buf+i);
+		vmax = _mm_max_ps(vmax, _mm_max_ps(v, _mm_sub_ps(zero, v))); // |v|
+	}
+	_mm_storeu_ps(tmp, vmax);
+	peak = tmp[0];
+	if (tmp[1] > peak) peak = tmp[1];
+	if (tmp[2] > peak) peak = tmp[2];
+	if (tmp[3] > peak) peak = tmp[3];
+#endif
+
+	for (; i < count; i++) {
+		a = (float)fabs(buf[i]);
+		if (a > peak) peak = a;
+	}
+
+	return peak;
+}
+
+/*	_bgm_DspSumSquares() -
+		Returns the sum of the squares of count samples. */
+float _bgm_DspSumSquares( const float *buf,
+                          DWORD       count )
+{
+	DWORD i = 0;
+	float sum = 0.0f;
+
+#ifdef __SSE__
+	__m128 vsum = _mm_setzero_ps(), v;
+	float tmp[4];
+	for (; i+4 <= count; i += 4) {
+		v = _mm_loadu_ps(buf+i);
+		vsum = _mm_add_ps(vsum, _mm_mul_ps(v, v));
+	}
+	_mm_storeu_ps(tmp, vsum);
+	sum = tmp[0] + tmp[1] + tmp[2] + tmp[3];
+#endif
+
+	for (; i < count; i++)
+		sum += buf[i]*buf[i];
+
+	return sum;
+}
+
+/*	_bgm_DspBiquad() -
+		Runs a transposed direct form II biquad over frames interleaved frames
+		of chans channels. coef is { b0, b1, b2, a1, a2 } (a0 normalised to 1)
+		and z1/z2 hold one state value per channel.
+		The recursion can't be vectorised along time, so with SSE the
+		channels of a frame are run side by side in the lanes of one
+		register instead. */
+void _bgm_DspBiquad( float       *buf,
+                     DWORD       frames,
+                     DWORD       chans,
+                     const float *coef,
+                     float       *z1,
+                     float       *z2 )
+{
+	DWORD f, c;
+	float x, y;
+
+#ifdef __SSE__
+	if (chans <= 4) {
+		__m128 b0 = _mm_set1_ps(coef[0]), b1 = _mm_set1_ps(coef[1]),
+		       b2 = _mm_set1_ps(coef[2]), a1 = _mm_set1_ps(coef[3]),
+		       a2 = _mm_set1_ps(coef[4]);
+		__m128 s1, s2, vx, vy;
+		float tmp[4] = {0,0,0,0}, t1[4] = {0,0,0,0}, t2[4] = {0,0,0,0};
+
+		// Load the filter state into lanes
+		for (c=0; c<chans; c++) {
+			t1[c] = z1[c];
+			t2[c] = z2[c];
+		}
+		s1 = _mm_loadu_ps(t1);
+		s2 = _mm_loadu_ps(t2);
+
+		for (f=0; f<frames; f++, buf += chans) {
+			// Load one frame
+			if (chans == 2)
+				vx = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*)buf);
+			else if (chans == 1)
+				vx = _mm_load_ss(buf);
+			else {
+				for (c=0; c<chans; c++) tmp[c] = buf[c];
+				vx = _mm_loadu_ps(tmp);
+			}
+
+			vy = _mm_add_ps(_mm_mul_ps(b0, vx), s1);
+			s1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1, vx), _mm_mul_ps(a1, vy)),
+			                s2);
+			s2 = _mm_sub_ps(_mm_mul_ps(b2, vx), _mm_mul_ps(a2, vy));
+
+			// Store it back
+			if (chans == 2)
+				_mm_storel_pi((__m64*)buf, vy);
+			else if (chans == 1)
+				_mm_store_ss(buf, vy);
+			else {
+				_mm_storeu_ps(tmp, vy);
+				for (c=0; c<chans; c++) buf[c] = tmp[c];
+			}
+		}
+
+		// Save the filter state
+		_mm_storeu_ps(t1, s1);
+		_mm_storeu_ps(t2, s2);
+		for (c=0; c<chans; c++) {
+			z1[c] = t1[c];
+			z2[c] = t2[c];
+		}
+		return;
+	}
+#endif
+
+	for (f=0; f<frames; f++, buf += chans) {
+		for (c=0; c<chans && c<BGM_DSP_MAXCHANS; c++) {
+			x = buf[c];
+			y = coef[0]*x + z1[c];
+			z1[c] = coef[1]*x - coef[3]*y + z2[c];
+			z2[c] = coef[2]*x - coef[4]*y;
+			buf[c] = y;
+		}
+	}
+}
+
+/*	_bgm_DspFFT() -
+		In-place radix-2 complex FFT of n points (a power of two) held as
+		separate real and imaginary arrays. The twiddles of each stage are
+		stored next to each other, so with SSE four butterflies of a group can
+		be done at once from straight loads. */
+void _bgm_DspFFT( float       *re,
+                  float       *im,
+                  DWORD       n,
+                  const float *twRe,
+                  const float *twIm )
+{
+	DWORD i, j, k, h, bit;
+	float t, wr, wi, xr, xi;
+	float *ar, *ai, *br, *bi;
+
+	// Bit reversed reordering
+	for (i=1, j=0; i<n; i++) {
+		for (bit = n>>1; j & bit; bit >>= 1)
+			j ^= bit;
+		j |= bit;
+		if (i < j) {
+			t = re[i]; re[i] = re[j]; re[j] = t;
+			t = im[i]; im[i] = im[j]; im[j] = t;
+		}
+	}
+
+	// Butterflies, h apart in each stage
+	for (h=1; h<n; h<<=1) {
+		for (i=0; i<n; i += h<<1) {
+			ar = re+i; ai = im+i;
+			br = re+i+h; bi = im+i+h;
+			k = 0;
+#ifdef __SSE__
+			for (; k+4 <= h; k += 4) {
+				__m128 vwr = _mm_loadu_ps(twRe+h+k), vwi = _mm_loadu_ps(twIm+h+k);
+				__m128 vbr = _mm_loadu_ps(br+k), vbi = _mm_loadu_ps(bi+k);
+				__m128 var = _mm_loadu_ps(ar+k), vai = _mm_loadu_ps(ai+k);
+				__m128 vxr = _mm_sub_ps(_mm_mul_ps(vbr, vwr),
+				                        _mm_mul_ps(vbi, vwi));
+				__m128 vxi = _mm_add_ps(_mm_mul_ps(vbr, vwi),
+				                        _mm_mul_ps(vbi, vwr));
+				_mm_storeu_ps(br+k, _mm_sub_ps(var, vxr));
+				_mm_storeu_ps(bi+k, _mm_sub_ps(vai, vxi));
+				_mm_storeu_ps(ar+k, _mm_add_ps(var, vxr));
+				_mm_storeu_ps(ai+k, _mm_add_ps(vai, vxi));
+			}
+#endif
+			for (; k<h; k++) {
+				wr = twRe[h+k];
+				wi = twIm[h+k];
+				xr = br[k]*wr - bi[k]*wi;
+				xi = br[k]*wi + bi[k]*wr;
+				br[k] = ar[k] - xr;
+				bi[k] = ai[k] - xi;
+				ar[k] += xr;
+				ai[k] += xi;
+			}
+		}
+	}
+}
+
+/*	_bgm_DspFFTTable() -
+		Fills the n-entry twiddle tables used by _bgm_DspFFT() for an n-point
+		transform. */
+void _bgm_DspFFTTable( float *twRe,
+                       float *twIm,
+                       DWORD n )
+{
+	DWORD h, k;
+
+	twRe[0] = 1.0f;
+	twIm[0] = 0.0f;
+	for (h=1; h<n; h<<=1)
+		for (k=0; k<h; k++) {
+			twRe[h+k] = (float)cos(-3.14159265358979*k/h);
+			twIm[h+k] = (float)sin(-3.14159265358979*k/h);
+		}
+}
+
+/* END OF FILE */
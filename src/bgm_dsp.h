@@ -0,0 +1,143 @@
+/******************************************************************************
+ *
+ *	bgm_dsp.h -
+ *		Prototypes for BGM's DSP plumbing: the per-song DSP hook that BASS
+ *		calls at mix time and the sample kernels used by the effects. The
+ *		kernels use SSE when the compiler has it enabled (-msse) and fall back
+ *		to plain C otherwise.
+ *
+ *****************************************************************************/
+
+#ifndef BGM_DSP_H
+#define BGM_DSP_H
+
+#ifdef __SSE__
+	#include <xmmintrin.h>
+#endif
+
+/******************************************************************************
+ * Typedefs, structs, etc.
+ *****************************************************************************/
+
+/*	SONGDSP -
+		Everything BGM attaches to a song's BASS channel at mix time. One of
+		these is created the first time a song needs processing and lives
+		until the song is cleared. BASS calls _bgm_SongDSP() from its mixing
+		thread, so anything in here that is changed from GM must be changed
+		with the lock held.
+*/
+typedef struct ctagSONGDSP {
+	HDSP				handle;	// DSP handle given by BASS
+	DWORD				chan;	// Channel the DSP is set on
+	DWORD				chans;	// Channel count of the song
+	DWORD				freq;	// Sample rate of the song
+	DWORD				user;	// What BASS passes _bgm_SongDSP() for it
+	CRITICAL_SECTION	lock;	// Guards everything below
+	FXCHAIN				fx;		// The song's effect chain
+	BUSTAP				bus;	// The song's part of the master bus
+	METERTAP			meter;	// The song's levels
+	SPECTAP				*spec;	// Spectrum capture, or NULL if the song's
+								// spectrum has never been asked for
+} SONGDSP;
+
+/******************************************************************************
+ * Function prototypes
+ *****************************************************************************/
+
+/*	_bgm_DspAttach() -
+		Internal function that makes sure the given song has a SONGDSP set
+		on its channel, creating one if needed.
+		Returns the SONGDSP, or NULL on failure. */
+SONGDSP* _bgm_DspAttach( SONG *song );
+
+/*	_bgm_DspAttachAll() -
+		Internal function that attaches a SONGDSP to every loaded song. Used
+		when something that needs to see every song (like the master bus) is
+		turned on. */
+void _bgm_DspAttachAll( );
+
+/*	_bgm_DspDetach() -
+		Internal function that removes the song's SONGDSP from its channel
+		and frees it. Safe to call on songs without one. */
+void _bgm_DspDetach( SONG *song );
+
+/*	_bgm_DspMove() -
+		Internal function that moves the song's SONGDSP, effects, meters and
+		all, onto another channel with the same format. Safe to call on
+		songs without one. */
+void _bgm_DspMove( SONG  *song,
+                   DWORD chan );
+
+/*	_bgm_SongDSP() -
+		The DSPPROC given to BASS for every song with a SONGDSP. "user"
+		stands for the SONGDSP (see _bgm_UserNew()). */
+void CALLBACK _bgm_SongDSP( HDSP  handle,
+                            DWORD channel,
+                            void  *buffer,
+                            DWORD length,
+                            DWORD user );
+
+/*	_bgm_DspGain() -
+		Multiplies count samples by gain. */
+void _bgm_DspGain( float *buf,
+                   DWORD count,
+                   float gain );
+
+/*	_bgm_DspSoftClip() -
+		Applies drive to count samples and then saturates them smoothly into
+		the -1 to 1 range with a rational tanh approximation. */
+void _bgm_DspSoftClip( float *buf,
+                       DWORD count,
+                       float drive );
+
+/*	_bgm_DspGainRamp() -
+		Multiplies frames interleaved frames of chans channels by a gain that
+		moves linearly from g0 to g1 over the block. */
+void _bgm_DspGainRamp( float *buf,
+                       DWORD frames,
+                       DWORD chans,
+                       float g0,
+                       float g1 );
+
+/*	_bgm_DspPeak() -
+		Returns the largest absolute value among count samples. */
+float _bgm_DspPeak( const float *buf,
+                    DWORD       count );
+
+/*	_bgm_DspSumSquares() -
+		Returns the sum of the squares of count samples. */
+float _bgm_DspSumSquares( const float *buf,
+                          DWORD       count );
+
+/*	_bgm_DspBiquad() -
+		Runs a transposed direct form II biquad over frames interleaved frames
+		of chans channels. coef is { b0, b1, b2, a1, a2 } (a0 normalised to 1)
+		and z1/z2 hold one state value per channel. */
+void _bgm_DspBiquad( float       *buf,
+                     DWORD       frames,
+                     DWORD       chans,
+                     const float *coef,
+                     float       *z1,
+                     float       *z2 );
+
+/*	_bgm_DspFFT() -
+		In-place radix-2 complex FFT of n points (a power of two) held as
+		separate real and imaginary arrays. tw holds the twiddle factors per
+		stage as made by _bgm_DspFFTTable(): the h twiddles of the stage with
+		butterflies h apart start at twRe+h and twIm+h. */
+void _bgm_DspFFT( float       *re,
+                  float       *im,
+                  DWORD       n,
+                  const float *twRe,
+                  const float *twIm );
+
+/*	_bgm_DspFFTTable() -
+		Fills the n-entry twiddle tables used by _bgm_DspFFT() for an n-point
+		transform. */
+void _bgm_DspFFTTable( float *twRe,
+                       float *twIm,
+                       DWORD n );
+
+#endif // BGM_DSP_H
+
+/* END OF FILE */
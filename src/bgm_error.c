@@ -37,16 +37,6 @@ BUILD DATE: %s\n\
 --- End of Report ------";
 
 
-/******************************************************************************
- * Globals
- *****************************************************************************/
-
-char	bgm_errorContext[128]; // Holds a small description of the context in
-                               // which any errors will occur. This string will
-							   // be prepended to all error messages outputed.
-char	bgm_errorMsg[1024]; // Contains a description of the last error that
-                            // occured.
-                            
 /******************************************************************************
  * Function implementations
  *****************************************************************************/
@@ -56,6 +46,7 @@ char	bgm_errorMsg[1024]; // Contains a description of the last error that
 DLL_FUNC
 GM_STRING bgm_Error()
 {
+	_bgm_TmpStrNext();
 	sprintf(bgm_tmpStr, "%s - %s", bgm_errorContext, bgm_errorMsg);
 	sprintf(bgm_errorMsg,"");
 	return bgm_tmpStr;
@@ -25,8 +25,10 @@ _bgm_ErrorReport(__FILE__,__LINE__)
  *****************************************************************************/
 
 extern const char	bgm_errorReportStr[];
-extern char			bgm_errorContext[128];
-extern char			bgm_errorMsg[1024];
+
+// Both belong to the calling thread (see BGM_THREAD)
+#define bgm_errorContext	(_bgm_Thread()->errorContext)
+#define bgm_errorMsg		(_bgm_Thread()->errorMsg)
 
 /******************************************************************************
  * Function Prototypes
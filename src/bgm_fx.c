@@ -0,0 +1,327 @@
+/******************************************************************************
+ *
+ *	bgm_fx.c -
+ *		Implementation of the built-in per-song effect chain.
+ *
+ *	Filters are the usual "Audio EQ Cookbook" biquads. The effects in a chain
+ *	are run one after the other over each block BASS hands to the song's DSP;
+ *	the sample loops themselves live in bgm_dsp.c.
+ *
+ *****************************************************************************/
+
+#include "bgm.h"
+
+/******************************************************************************
+ * Globals
+ *****************************************************************************/
+
+// Effect names, indexed by FX_* type
+const char *bgm_fxNames[] = {
+	"gain",
+	"lowpass",
+	"highpass",
+	"bandpass",
+	"softclip"
+};
+
+/******************************************************************************
+ * Function implementations
+ *****************************************************************************/
+
+/*	_bgm_FxSetParams() -
+		Internal function that parses a "p1,p2" parameter string into the
+		effect and recalculates its coefficients for the given sample rate.
+		Missing parameters keep their current values. Filter state is kept so
+		that parameters can be changed while playing without clicks. */
+void _bgm_FxSetParams( BGM_FX     *fx,
+                       const char *params,
+                       DWORD      freq )
+{
+	double w0, cosw, alpha, a0, f, q;
+
+	// Read whatever parameters were given
+	if (params)
+		sscanf(params, "%f,%f", &fx->param[0], &fx->param[1]);
+
+	switch (fx->type) {
+		case FX_GAIN:
+		case FX_SOFTCLIP:
+			// Both just need the dB value as a linear factor
+			fx->coef[0] = (float)pow(10.0, fx->param[0]/20.0);
+		break;
+
+		case FX_LOWPASS:
+		case FX_HIGHPASS:
+		case FX_BANDPASS:
+			// Keep the cutoff below Nyquist and Q sane
+			f = fx->param[0];
+			if (f < 10.0) f = 10.0;
+			if (f > freq*0.49) f = freq*0.49;
+			q = fx->param[1];
+			if (q < 0.1) q = 0.1;
+			if (q > 20.0) q = 20.0;
+
+			w0 = 2.0*3.14159265358979*f/freq;
+			cosw = cos(w0);
+			alpha = sin(w0)/(2.0*q);
+			a0 = 1.0 + alpha;
+
+			if (fx->type == FX_LOWPASS) {
+				fx->coef[0] = (float)((1.0-cosw)/2.0/a0);
+				fx->coef[1] = (float)((1.0-cosw)/a0);
+				fx->coef[2] = fx->coef[0];
+			}
+			else if (fx->type == FX_HIGHPASS) {
+				fx->coef[0] = (float)((1.0+cosw)/2.0/a0);
+				fx->coef[1] = (float)(-(1.0+cosw)/a0);
+				fx->coef[2] = fx->coef[0];
+			}
+			else { // FX_BANDPASS, 0dB peak gain
+				fx->coef[0] = (float)(alpha/a0);
+				fx->coef[1] = 0.0f;
+				fx->coef[2] = -fx->coef[0];
+			}
+			fx->coef[3] = (float)(-2.0*cosw/a0);
+			fx->coef[4] = (float)((1.0-alpha)/a0);
+		break;
+	}
+}
+
+/*	_bgm_FxProcess() -
+		Internal function that runs every effect in the chain over count
+		interleaved float samples of chans channels. Called from the song's
+		DSP with the lock held. */
+void _bgm_FxProcess( FXCHAIN *chain,
+                     float   *buf,
+                     DWORD   count,
+                     DWORD   chans )
+{
+	DWORD i;
+	BGM_FX *fx;
+
+	for (i=0; i<chain->count; i++) {
+		fx = &chain->fx[i];
+		switch (fx->type) {
+			case FX_GAIN:
+				_bgm_DspGain(buf, count, fx->coef[0]);
+			break;
+
+			case FX_SOFTCLIP:
+				_bgm_DspSoftClip(buf, count, fx->coef[0]);
+			break;
+
+			default: // Filters
+				_bgm_DspBiquad(buf, count/chans, chans, fx->coef, fx->z1,
+				               fx->z2);
+			break;
+		}
+	}
+}
+
+/*	_bgm_FxAdd() -
+		Internal function that appends an effect to a song's chain.
+		Returns the effect's position in the chain, or -1 on failure. */
+int _bgm_FxAdd( SONG       *song,
+                const char *type,
+                const char *params )
+{
+	SONGDSP *dsp;
+	BGM_FX *fx;
+	DWORD t;
+	int n;
+	char iType[16];
+
+	ERROR_CONTEXT("Failed to add effect");
+
+	/* ERROR HANDLER */
+	if (!song) {
+		BGM_ERROR("Invalid song ID or filename.");
+		return -1;
+	}
+	if (song->id==0) {
+		BGM_ERROR("No Quick Play song loaded.");
+		return -1;
+	}
+
+	// Look the effect type up, case-insensitively
+	for (t=0; t<sizeof(iType)-1 && type[t]; t++)
+		iType[t] = (char)tolower(type[t]);
+	iType[t] = 0;
+	for (t=0; t<FX_NUMTYPES; t++)
+		if (strcmp(iType, bgm_fxNames[t])==0)
+			break;
+	/* ERROR HANDLER */
+	if (t==FX_NUMTYPES) {
+		BGM_ERROR("\"%s\" is not a valid effect type.", type);
+		return -1;
+	}
+
+	// Make sure the song has a DSP to run the chain in
+	dsp = _bgm_DspAttach(song);
+	/* ERROR HANDLER */
+	if (!dsp)
+		return -1;
+
+	EnterCriticalSection(&dsp->lock);
+
+	/* ERROR HANDLER */
+	if (dsp->fx.count == BGM_FX_MAX) {
+		LeaveCriticalSection(&dsp->lock);
+		BGM_ERROR("Song already has %i effects.", BGM_FX_MAX);
+		return -1;
+	}
+
+	// Fill in the new effect with defaults, then the user's parameters
+	fx = &dsp->fx.fx[dsp->fx.count];
+	memset(fx, 0, sizeof(BGM_FX));
+	fx->type = t;
+	if (t==FX_GAIN || t==FX_SOFTCLIP) {
+		fx->param[0] = 0.0f;
+	}
+	else {
+		fx->param[0] = 1000.0f;
+		fx->param[1] = 0.7071f;
+	}
+	_bgm_FxSetParams(fx, params, dsp->freq);
+
+	n = dsp->fx.count++;
+
+	LeaveCriticalSection(&dsp->lock);
+
+	// A primed song's buffer went through the chain as it was
+	_bgm_Reprime(song);
+
+	return n;
+}
+
+/*	bgm_FxAddById() -
+		Adds an effect to the end of the chain of the song with the given ID.
+		Returns the effect's position in the chain, or -1 on failure. */
+DLL_FUNC
+GM_REAL bgm_FxAddById( GM_REAL   songId,
+                       GM_STRING type,
+                       GM_STRING params )
+{
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdCall(BGM_CMD_FXADDBYID, "rss", songId, type, params);
+	return _bgm_FxAdd(_bgm_GetSongById(songId), type, params);
+}
+
+/*	bgm_FxAddByFname() -
+		Same as bgm_FxAddById() but uses the song's filename. */
+DLL_FUNC
+GM_REAL bgm_FxAddByFname( GM_STRING fname,
+                          GM_STRING type,
+                          GM_STRING params )
+{
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdCall(BGM_CMD_FXADDBYFNAME, "sss", fname, type, params);
+	return _bgm_FxAdd(_bgm_GetSongByFname(fname), type, params);
+}
+
+/*	_bgm_FxRemove() -
+		Internal function that removes the n-th effect from a song's chain,
+		moving the ones after it up. */
+BOOL _bgm_FxRemove( SONG  *song,
+                    DWORD n )
+{
+	SONGDSP *dsp;
+
+	ERROR_CONTEXT("Failed to remove effect");
+
+	/* ERROR HANDLER */
+	if (!song) {
+		BGM_ERROR("Invalid song ID or filename.");
+		return FALSE;
+	}
+
+	dsp = song->dsp;
+	/* ERROR HANDLER */
+	if (!dsp || n >= dsp->fx.count) {
+		BGM_ERROR("Song has no effect %i.", n);
+		return FALSE;
+	}
+
+	EnterCriticalSection(&dsp->lock);
+	memmove(&dsp->fx.fx[n], &dsp->fx.fx[n+1],
+	        sizeof(BGM_FX)*(dsp->fx.count-n-1));
+	dsp->fx.count--;
+	LeaveCriticalSection(&dsp->lock);
+
+	_bgm_Reprime(song);
+
+	return TRUE;
+}
+
+/*	bgm_FxRemoveById() -
+		Removes the n-th effect from the song with the given ID.
+		Returns 1 on success, 0 on failure. */
+DLL_FUNC
+GM_REAL bgm_FxRemoveById( GM_REAL songId,
+                          GM_REAL n )
+{
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdPost(BGM_CMD_FXREMOVEBYID, "rr", songId, n);
+	return _bgm_FxRemove(_bgm_GetSongById(songId), (DWORD)n);
+}
+
+/*	bgm_FxRemoveByFname() -
+		Removes the n-th effect from the song loaded with the given filename.
+		Returns 1 on success, 0 on failure. */
+DLL_FUNC
+GM_REAL bgm_FxRemoveByFname( GM_STRING fname,
+                             GM_REAL   n )
+{
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdPost(BGM_CMD_FXREMOVEBYFNAME, "sr", fname, n);
+	return _bgm_FxRemove(_bgm_GetSongByFname(fname), (DWORD)n);
+}
+
+/*	_bgm_FxClear() -
+		Internal function that removes every effect from a song's chain. */
+BOOL _bgm_FxClear( SONG *song )
+{
+	ERROR_CONTEXT("Failed to clear effects");
+
+	/* ERROR HANDLER */
+	if (!song) {
+		BGM_ERROR("Invalid song ID or filename.");
+		return FALSE;
+	}
+
+	// Nothing to do if the song never had any effects
+	if (!song->dsp)
+		return TRUE;
+
+	EnterCriticalSection(&song->dsp->lock);
+	song->dsp->fx.count = 0;
+	LeaveCriticalSection(&song->dsp->lock);
+
+	_bgm_Reprime(song);
+
+	return TRUE;
+}
+
+/*	bgm_FxClearById() -
+		Removes all effects from the song with the given ID.
+		Returns 1 on success, 0 on failure. */
+DLL_FUNC
+GM_REAL bgm_FxClearById( GM_REAL songId )
+{
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdPost(BGM_CMD_FXCLEARBYID, "r", songId);
+	return _bgm_FxClear(_bgm_GetSongById(songId));
+}
+
+/*	bgm_FxClearByFname() -
+		Removes all effects from the song loaded with the given filename.
+		Returns 1 on success, 0 on failure. */
+DLL_FUNC
+GM_REAL bgm_FxClearByFname( GM_STRING fname )
+{
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdPost(BGM_CMD_FXCLEARBYFNAME, "s", fname);
+	return _bgm_FxClear(_bgm_GetSongByFname(fname));
+}
+
+/* END OF FILE */
@@ -0,0 +1,142 @@
+/******************************************************************************
+ *
+ *	bgm_fx.h -
+ *		Prototypes and types for BGM's built-in per-song effect chain. The
+ *		effects run inside the song's DSP (see bgm_dsp.h) rather than through
+ *		BASS_ChannelSetFX(), so they don't need DirectX 8 and cost a lot less.
+ *
+ *****************************************************************************/
+
+#ifndef BGM_FX_H
+#define BGM_FX_H
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// Most effects that can be in one song's chain
+#define BGM_FX_MAX 8
+
+// Effect types
+#define FX_GAIN      0 /* params: gain in dB */
+#define FX_LOWPASS   1 /* params: cutoff Hz, Q */
+#define FX_HIGHPASS  2 /* params: cutoff Hz, Q */
+#define FX_BANDPASS  3 /* params: center Hz, Q */
+#define FX_SOFTCLIP  4 /* params: drive in dB */
+#define FX_NUMTYPES  5
+
+/******************************************************************************
+ * Typedefs, structs, etc.
+ *****************************************************************************/
+
+/*	BGM_FX -
+		One effect in a song's chain.
+*/
+typedef struct ctagBGM_FX {
+	DWORD	type;					// One of the FX_* constants
+	float	param[2];				// Parameters as the user gave them
+	float	coef[5];				// Derived coefficients (b0 b1 b2 a1 a2
+									// for filters, linear gain otherwise)
+	float	z1[BGM_DSP_MAXCHANS],	// Filter state, one per channel
+			z2[BGM_DSP_MAXCHANS];
+} BGM_FX;
+
+/*	FXCHAIN -
+		The effects applied to one song, in processing order.
+*/
+typedef struct ctagFXCHAIN {
+	DWORD	count;				// Number of effects in use
+	BGM_FX	fx[BGM_FX_MAX];
+} FXCHAIN;
+
+/******************************************************************************
+ * Global externs
+ *****************************************************************************/
+
+extern const char *bgm_fxNames[];
+
+/******************************************************************************
+ * Function prototypes
+ *****************************************************************************/
+
+/*	_bgm_FxSetParams() -
+		Internal function that parses a "p1,p2" parameter string into the
+		effect and recalculates its coefficients for the given sample rate.
+		Missing parameters keep their current values. Filter state is kept so
+		that parameters can be changed while playing without clicks. */
+void _bgm_FxSetParams( BGM_FX     *fx,
+                       const char *params,
+                       DWORD      freq );
+
+/*	_bgm_FxProcess() -
+		Internal function that runs every effect in the chain over count
+		interleaved float samples of chans channels. Called from the song's
+		DSP with the lock held. */
+void _bgm_FxProcess( FXCHAIN *chain,
+                     float   *buf,
+                     DWORD   count,
+                     DWORD   chans );
+
+/*	_bgm_FxAdd() -
+		Internal function that appends an effect to a song's chain.
+		Returns the effect's position in the chain, or -1 on failure. */
+int _bgm_FxAdd( SONG       *song,
+                const char *type,
+                const char *params );
+
+/*	bgm_FxAddById() -
+		Adds an effect to the end of the chain of the song with the given ID.
+		type is one of "gain", "lowpass", "highpass", "bandpass" or
+		"softclip" and params is a comma seperated list of its parameters.
+		Returns the effect's position in the chain, or -1 on failure. */
+DLL_FUNC
+GM_REAL bgm_FxAddById( GM_REAL   songId,
+                       GM_STRING type,
+                       GM_STRING params );
+
+/*	bgm_FxAddByFname() -
+		Same as bgm_FxAddById() but uses the song's filename. */
+DLL_FUNC
+GM_REAL bgm_FxAddByFname( GM_STRING fname,
+                          GM_STRING type,
+                          GM_STRING params );
+
+/*	_bgm_FxRemove() -
+		Internal function that removes the n-th effect from a song's chain,
+		moving the ones after it up. */
+BOOL _bgm_FxRemove( SONG  *song,
+                    DWORD n );
+
+/*	bgm_FxRemoveById() -
+		Removes the n-th effect from the song with the given ID.
+		Returns 1 on success, 0 on failure. */
+DLL_FUNC
+GM_REAL bgm_FxRemoveById( GM_REAL songId,
+                          GM_REAL n );
+
+/*	bgm_FxRemoveByFname() -
+		Removes the n-th effect from the song loaded with the given filename.
+		Returns 1 on success, 0 on failure. */
+DLL_FUNC
+GM_REAL bgm_FxRemoveByFname( GM_STRING fname,
+                             GM_REAL   n );
+
+/*	_bgm_FxClear() -
+		Internal function that removes every effect from a song's chain. */
+BOOL _bgm_FxClear( SONG *song );
+
+/*	bgm_FxClearById() -
+		Removes all effects from the song with the given ID.
+		Returns 1 on success, 0 on failure. */
+DLL_FUNC
+GM_REAL bgm_FxClearById( GM_REAL songId );
+
+/*	bgm_FxClearByFname() -
+		Removes all effects from the song loaded with the given filename.
+		Returns 1 on success, 0 on failure. */
+DLL_FUNC
+GM_REAL bgm_FxClearByFname( GM_STRING fname );
+
+#endif // BGM_FX_H
+
+/* END OF FILE */
@@ -0,0 +1,372 @@
+/******************************************************************************
+ *
+ *	bgm_io.c -
+ *		Implementation of BGM's read-ahead file streams.
+ *
+ *	One I/O thread serves every read-ahead stream, always topping up the
+ *	emptiest ring first, BGM_IO_CHUNK bytes at a time. BASS reads through
+ *	_bgm_IoFileProc(), which copies out of the ring and only waits for the
+ *	I/O thread if the ring is empty. Seeks inside what is buffered just
+ *	move the read position; seeks anywhere else throw the ring away and
+ *	wait for the new place to be read, except seeks into the first chunk,
+ *	which is kept for songs that loop.
+ *
+ *	The I/O thread holds bgm_ioLock for each read it does, so a stream's
+ *	file can't be closed under it; BASS's own reads only take the stream's
+ *	lock, which is never held across disk access. The ring itself is only
+ *	ever changed with the stream's lock held.
+ *
+ *****************************************************************************/
+
+#include "bgm.h"
+
+/******************************************************************************
+ * Globals
+ *****************************************************************************/
+
+CRITICAL_SECTION bgm_ioLock;	// Guards the list and each stream's file
+IOSTREAM *bgm_ioList = NULL;	// Every read-ahead stream
+HANDLE bgm_ioThread = NULL;		// I/O thread, once started
+HANDLE bgm_ioEvent = NULL;		// Set when a ring has room
+volatile BOOL bgm_ioQuit;		// Tells the I/O thread to stop
+BYTE bgm_ioBuf[BGM_IO_CHUNK];	// Where the I/O thread reads to
+
+/******************************************************************************
+ * Function implementations
+ *****************************************************************************/
+
+/*	_bgm_IoInit() -
+		Internal function that sets up the read-ahead state. Called from
+		bgm_Init(). */
+void _bgm_IoInit( )
+{
+	InitializeCriticalSection(&bgm_ioLock);
+	bgm_ioList = NULL;
+	bgm_ioThread = NULL;
+	bgm_ioEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	bgm_ioQuit = FALSE;
+}
+
+/*	_bgm_IoShutdown() -
+		Internal function that stops the I/O thread and frees every stream
+		left. Called from bgm_Close() after BASS is freed. */
+void _bgm_IoShutdown( )
+{
+	if (bgm_ioThread) {
+		bgm_ioQuit = TRUE;
+		SetEvent(bgm_ioEvent);
+		WaitForSingleObject(bgm_ioThread, INFINITE);
+		CloseHandle(bgm_ioThread);
+		bgm_ioThread = NULL;
+	}
+
+	while (bgm_ioList)
+		_bgm_IoFree(bgm_ioList);
+
+	CloseHandle(bgm_ioEvent);
+	DeleteCriticalSection(&bgm_ioLock);
+}
+
+/*	_bgm_IoOpen() -
+		Internal function that opens a file for reading ahead.
+		Returns the IOSTREAM, or NULL (with an error set) on failure. */
+IOSTREAM* _bgm_IoOpen( const char *fname,
+                       DWORD      size )
+{
+	IOSTREAM *io;
+	struct stat st;
+	DWORD threadId;
+
+	// Whole chunks only, so a chunk never has to wrap around the ring
+	if (size < BGM_IO_MINSIZE)
+		size = BGM_IO_MINSIZE;
+	size = (size + BGM_IO_CHUNK-1) / BGM_IO_CHUNK * BGM_IO_CHUNK;
+
+	/* ERROR HANDLER */
+	if (stat(fname, &st) != 0) {
+		BGM_ERROR("Could not open file.");
+		return NULL;
+	}
+
+	io = NEW(IOSTREAM,1);
+	/* ERROR HANDLER */
+	if (!io) {
+		BGM_ERROR("Out of memory.");
+		return NULL;
+	}
+	memset(io, 0, sizeof(IOSTREAM));
+	io->len = (DWORD)st.st_size;
+	io->size = size;
+	io->ring = NEW(BYTE,size);
+	io->start = NEW(BYTE,BGM_IO_CHUNK);
+	/* ERROR HANDLER */
+	if (!io->ring || !io->start) {
+		BGM_ERROR("Out of memory.");
+		free(io->ring);
+		free(io->start);
+		free(io);
+		return NULL;
+	}
+
+	io->f = fopen(fname, "rb");
+	/* ERROR HANDLER */
+	if (!io->f) {
+		BGM_ERROR("Could not open file.");
+		free(io->ring);
+		free(io->start);
+		free(io);
+		return NULL;
+	}
+	// The ring is the buffer; stdio's would only copy everything twice
+	setvbuf(io->f, NULL, _IONBF, 0);
+
+	// The first chunk is read here, so BASS has the header to look at
+	// straight away and the start is there to loop back to
+	io->startLen = fread(io->start, 1, BGM_IO_CHUNK, io->f);
+	memcpy(io->ring, io->start, io->startLen);
+	io->head = io->startLen % size;
+	io->fill = io->startLen;
+	io->diskPos = io->startLen;
+	io->eof = (io->startLen >= io->len);
+
+	io->user = _bgm_UserNew(io);
+	/* ERROR HANDLER */
+	if (!io->user) {
+		BGM_ERROR("Too many streams open.");
+		fclose(io->f);
+		free(io->ring);
+		free(io->start);
+		free(io);
+		return NULL;
+	}
+	InitializeCriticalSection(&io->lock);
+	io->ready = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+	EnterCriticalSection(&bgm_ioLock);
+	io->next = bgm_ioList;
+	bgm_ioList = io;
+	LeaveCriticalSection(&bgm_ioLock);
+
+	// Start the I/O thread with the first stream. It's only ever asleep or
+	// reading, so it can run above the game without getting in its way.
+	if (!bgm_ioThread) {
+		bgm_ioThread = CreateThread(NULL, 0, _bgm_IoThread, NULL, 0,
+		                            &threadId);
+		/* ERROR HANDLER */
+		if (!bgm_ioThread) {
+			BGM_ERROR("Could not start the I/O thread.");
+			_bgm_IoFree(io);
+			return NULL;
+		}
+		SetThreadPriority(bgm_ioThread, THREAD_PRIORITY_ABOVE_NORMAL);
+	}
+	SetEvent(bgm_ioEvent);
+
+	return io;
+}
+
+/*	_bgm_IoFree() -
+		Internal function that frees an IOSTREAM once BASS is done with it.
+		Safe to call with NULL. */
+void _bgm_IoFree( IOSTREAM *io )
+{
+	IOSTREAM **link;
+
+	if (!io)
+		return;
+
+	// BASS normally closes the file itself, but not if the stream couldn't
+	// be made
+	EnterCriticalSection(&bgm_ioLock);
+	for (link = &bgm_ioList; *link; link = &(*link)->next)
+		if (*link == io) {
+			*link = io->next;
+			break;
+		}
+	if (io->f)
+		fclose(io->f);
+	io->f = NULL;
+	LeaveCriticalSection(&bgm_ioLock);
+
+	_bgm_UserFree(io->user);
+	DeleteCriticalSection(&io->lock);
+	CloseHandle(io->ready);
+	free(io->ring);
+	free(io->start);
+	free(io);
+}
+
+/*	_bgm_IoFileProc() -
+		The STREAMFILEPROC given to BASS for read-ahead streams. */
+DWORD CALLBACK _bgm_IoFileProc( DWORD action,
+                                DWORD param1,
+                                DWORD param2,
+                                DWORD user )
+{
+	IOSTREAM *io = (IOSTREAM*)_bgm_UserGet(user);
+	BYTE *buf;
+	DWORD done, n;
+	BOOL waited, room;
+
+	switch (action) {
+		case BASS_FILE_CLOSE:
+			EnterCriticalSection(&bgm_ioLock);
+			if (io->f)
+				fclose(io->f);
+			io->f = NULL;
+			LeaveCriticalSection(&bgm_ioLock);
+			return 0;
+
+		case BASS_FILE_LEN:
+			return io->len;
+
+		case BASS_FILE_READ:
+			// BASS 2.3 hands the buffer over as a DWORD, which only holds a
+			// pointer on 32-bit builds (the only kind it comes in)
+			buf = (BYTE*)(size_t)param2;
+			done = 0;
+			waited = FALSE;
+			for (;;) {
+				EnterCriticalSection(&io->lock);
+				while (done < param1 && io->fill) {
+					n = param1 - done;
+					if (n > io->fill) n = io->fill;
+					if (n > io->size - io->tail) n = io->size - io->tail;
+					memcpy(buf+done, io->ring+io->tail, n);
+					io->tail = (io->tail + n) % io->size;
+					io->fill -= n;
+					io->pos += n;
+					done += n;
+				}
+				if (done == param1 || io->eof || !io->f) {
+					if (done == param1)
+						io->seeked = FALSE;
+					room = (io->size - io->fill >= BGM_IO_CHUNK);
+					LeaveCriticalSection(&io->lock);
+					break;
+				}
+				// Ran dry. That's expected straight after a seek, but
+				// anywhere else the disk isn't keeping up.
+				if (!waited && !io->seeked)
+					io->underruns++;
+				waited = TRUE;
+				LeaveCriticalSection(&io->lock);
+
+				SetEvent(bgm_ioEvent);
+				WaitForSingleObject(io->ready, INFINITE);
+			}
+			if (room)
+				SetEvent(bgm_ioEvent);
+			return done;
+
+		case BASS_FILE_SEEK:
+			if (param1 > io->len)
+				return FALSE;
+			EnterCriticalSection(&io->lock);
+			if (param1 >= io->pos && param1 <= io->pos + io->fill) {
+				// Already read; skip to it
+				n = param1 - io->pos;
+				io->tail = (io->tail + n) % io->size;
+				io->fill -= n;
+				io->pos = param1;
+			}
+			else {
+				// Anywhere else means starting over. Anything the I/O
+				// thread is reading now is for the old place, so bump gen.
+				io->gen++;
+				io->pos = param1;
+				io->tail = 0;
+				if (param1 < io->startLen) {
+					memcpy(io->ring, io->start, io->startLen);
+					io->tail = param1;
+					io->head = io->startLen % io->size;
+					io->fill = io->startLen - param1;
+					io->eof = (io->startLen >= io->len);
+				}
+				else {
+					io->head = 0;
+					io->fill = 0;
+					io->eof = (param1 >= io->len);
+					io->seeked = TRUE;
+				}
+			}
+			LeaveCriticalSection(&io->lock);
+			SetEvent(bgm_ioEvent);
+			return TRUE;
+	}
+
+	return 0;
+}
+
+/*	_bgm_IoFill() -
+		Internal function, run on the I/O thread with bgm_ioLock held, that
+		reads the next chunk into the stream's ring if there is room.
+		Returns TRUE if it read anything. */
+BOOL _bgm_IoFill( IOSTREAM *io )
+{
+	DWORD at, gen, got;
+
+	EnterCriticalSection(&io->lock);
+	if (io->eof || !io->f || io->size - io->fill < BGM_IO_CHUNK) {
+		LeaveCriticalSection(&io->lock);
+		return FALSE;
+	}
+	at = io->pos + io->fill;
+	gen = io->gen;
+	LeaveCriticalSection(&io->lock);
+
+	// Read without the lock, into bgm_ioBuf rather than the ring, since a
+	// seek can hand that part of the ring to the reader in the meantime
+	if (io->diskPos != at)
+		fseek(io->f, at, SEEK_SET);
+	got = fread(bgm_ioBuf, 1, BGM_IO_CHUNK, io->f);
+	io->diskPos = at + got;
+
+	EnterCriticalSection(&io->lock);
+	if (io->gen == gen) {
+		// Whole chunks from the start of the ring, so this never wraps
+		memcpy(io->ring+io->head, bgm_ioBuf, got);
+		io->head = (io->head + got) % io->size;
+		io->fill += got;
+		// A short read is the end of the file, or as good as
+		io->eof = (got < BGM_IO_CHUNK || at + got >= io->len);
+	}
+	LeaveCriticalSection(&io->lock);
+
+	SetEvent(io->ready);
+	return TRUE;
+}
+
+/*	_bgm_IoThread() -
+		The I/O thread. Tops up every stream's ring, emptiest first, and
+		sleeps while they are all full. */
+DWORD WINAPI _bgm_IoThread( void *param )
+{
+	IOSTREAM *io, *best;
+	DWORD bestFill;
+	BOOL busy;
+
+	while (!bgm_ioQuit) {
+		EnterCriticalSection(&bgm_ioLock);
+		best = NULL;
+		bestFill = 0;
+		for (io = bgm_ioList; io; io = io->next) {
+			EnterCriticalSection(&io->lock);
+			if (io->f && !io->eof && io->size - io->fill >= BGM_IO_CHUNK &&
+			    (!best || io->fill < bestFill)) {
+				best = io;
+				bestFill = io->fill;
+			}
+			LeaveCriticalSection(&io->lock);
+		}
+		busy = best && _bgm_IoFill(best);
+		LeaveCriticalSection(&bgm_ioLock);
+
+		if (!busy)
+			WaitForSingleObject(bgm_ioEvent, INFINITE);
+	}
+
+	return 0;
+}
+
+/* END OF FILE */
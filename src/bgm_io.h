@@ -0,0 +1,117 @@
+/******************************************************************************
+ *
+ *	bgm_io.h -
+ *		Prototypes and types for BGM's read-ahead file streams. A plain file
+ *		stream is read by BASS on its mixing thread, so a slow disk or a
+ *		network drive makes the song stall. With the "readahead" global
+ *		attribute set, file streams are made with BASS_StreamCreateFileUser()
+ *		instead, and a BGM thread keeps a ring buffer per stream topped up
+ *		with large sequential reads, so the mixer only ever copies from
+ *		memory.
+ *
+ *****************************************************************************/
+
+#ifndef BGM_IO_H
+#define BGM_IO_H
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// Bytes the I/O thread reads at a time
+#define BGM_IO_CHUNK 65536
+
+// Smallest ring buffer, in bytes
+#define BGM_IO_MINSIZE (BGM_IO_CHUNK*2)
+
+/******************************************************************************
+ * Typedefs, structs, etc.
+ *****************************************************************************/
+
+/*	IOSTREAM -
+		A file being read ahead. The ring holds the fill bytes of the file
+		from pos onwards, starting at index tail; the I/O thread writes at
+		head. Everything but the file and the ring's free space is guarded
+		by lock.
+*/
+typedef struct ctagIOSTREAM {
+	FILE		*f;			// The file, or NULL once BASS has closed it
+	DWORD		len;		// Its length
+	BYTE		*ring;		// Ring buffer...
+	DWORD		size;		// ...its size...
+	DWORD		head, tail;	// ...where the next write and read go...
+	DWORD		fill;		// ...and how much is in it
+	DWORD		pos;		// File position of the byte at tail
+	DWORD		diskPos;	// Where the file itself is at
+	BOOL		eof;		// The ring reaches the end of the file
+	BYTE		*start;		// The first chunk of the file, kept so that
+	DWORD		startLen;	// looping back to the start needn't wait
+	DWORD		gen;		// Bumped on every seek outside the ring, so that
+							// a read started before it is thrown away
+	BOOL		seeked;		// Waiting after a seek, which isn't an underrun
+	DWORD		underruns;	// Reads that had to wait for the disk
+	CRITICAL_SECTION lock;
+	HANDLE		ready;		// Set when the I/O thread adds data
+	DWORD		user;		// What to give BASS as _bgm_IoFileProc's user
+	struct
+	ctagIOSTREAM *next;		// Next in bgm_ioList
+} IOSTREAM;
+
+/******************************************************************************
+ * Global externs
+ *****************************************************************************/
+
+extern CRITICAL_SECTION bgm_ioLock;
+
+/******************************************************************************
+ * Function prototypes
+ *****************************************************************************/
+
+/*	_bgm_IoInit() -
+		Internal function that sets up the read-ahead state. Called from
+		bgm_Init(). The I/O thread is only started with the first stream. */
+void _bgm_IoInit( );
+
+/*	_bgm_IoShutdown() -
+		Internal function that stops the I/O thread and frees every stream
+		left. Called from bgm_Close() after BASS is freed (which closes the
+		streams' files). */
+void _bgm_IoShutdown( );
+
+/*	_bgm_IoOpen() -
+		Internal function that opens a file for reading ahead with a ring of
+		the given size, for BASS_StreamCreateFileUser() with _bgm_IoFileProc
+		and the IOSTREAM's user value.
+		Returns the IOSTREAM, or NULL (with an error set) on failure. */
+IOSTREAM* _bgm_IoOpen( const char *fname,
+                       DWORD      size );
+
+/*	_bgm_IoFree() -
+		Internal function that frees an IOSTREAM once BASS is done with it
+		(after BASS_StreamFree(), or if the stream couldn't be made). Safe
+		to call with NULL. */
+void _bgm_IoFree( IOSTREAM *io );
+
+/*	_bgm_IoFileProc() -
+		The STREAMFILEPROC given to BASS for read-ahead streams. Runs on
+		whatever thread BASS reads from, and only waits for the disk when
+		the ring has run dry (an underrun). */
+DWORD CALLBACK _bgm_IoFileProc( DWORD action,
+                                DWORD param1,
+                                DWORD param2,
+                                DWORD user );
+
+/*	_bgm_IoFill() -
+		Internal function, run on the I/O thread with bgm_ioLock held, that
+		reads the next chunk into the stream's ring if there is room.
+		Returns TRUE if it read anything. */
+BOOL _bgm_IoFill( IOSTREAM *io );
+
+/*	_bgm_IoThread() -
+		The I/O thread. Tops up every stream's ring, and sleeps while they
+		are all full. */
+DWORD WINAPI _bgm_IoThread( void *param );
+
+#endif // BGM_IO_H
+
+/* END OF FILE */
@@ -0,0 +1,147 @@
+/******************************************************************************
+ *
+ *	bgm_lazy.c -
+ *		Implementation of lazily loaded songs.
+ *
+ *	A registered song is made as if it had been loaded and evicted straight
+ *	away (see bgm_mem.c), with nothing kept but its filename and how to
+ *	load it, so registering costs a SONG and a look at the extension. It
+ *	starts stopped, at 0, with the default attributes; bgm_GetLen*() says
+ *	0 until it has been loaded once.
+ *
+ *	Idle songs are only looked for when a song is used, as that is the
+ *	only time BGM is sure to be called: a song can be left loaded a while
+ *	past its idle time if nothing is used in between.
+ *
+ *****************************************************************************/
+
+#include "bgm.h"
+
+/******************************************************************************
+ * Function implementations
+ *****************************************************************************/
+
+/*	bgm_Register() -
+		Registers a song to be loaded when it is first used. */
+DLL_FUNC
+GM_REAL bgm_Register( GM_STRING fname,
+                      GM_REAL   options )
+{
+	BGM_CONTEXT *ctx = _bgm_Context();
+	SONG *song;
+	DWORD type, opts = (DWORD)options;
+
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdCall(BGM_CMD_REGISTER, "sr", fname, options);
+
+	ERROR_CONTEXT("Failed to register song");
+
+	// Already there, whether it was registered or loaded. The Quick Play
+	// song isn't, as it can be replaced at any time.
+	song = _bgm_PeekSongByFname(fname);
+	if (song && song != bgm_song)
+		return song->ref;
+
+	/* ERROR HANDLER */
+	if (_bgm_FnameIsUrl(fname)) {
+		BGM_ERROR("Internet streams can't be registered.");
+		return 0;
+	}
+	type = _bgm_GetFileType(fname);
+	/* ERROR HANDLER */
+	if (type == -1) {
+		BGM_ERROR("Unknown file extension.");
+		return 0;
+	}
+
+	song = _bgm_NewSong(0, fname, NULL, 0);
+	/* ERROR HANDLER */
+	if (!song) {
+		BGM_ERROR("Out of memory.");
+		return 0;
+	}
+
+	// How it's to be loaded...
+	if (type == BASS_CTYPE_MUSIC_MOD)
+		song->evictType = BASS_CTYPE_MUSIC_MOD;
+	else if (opts & BGM_LAZY_STREAM)
+		song->evictType = BASS_CTYPE_STREAM;
+	else
+		song->evictType = BASS_CTYPE_SAMPLE;
+
+	// ...and what it starts out as
+	song->evictAttrs.freq = 0;
+	song->evictAttrs.vol = 100;
+	song->evictAttrs.pan = 0;
+	song->evictLoop = 0;
+	song->evictActive = BASS_ACTIVE_STOPPED;
+	song->evictPos = 0.0f;
+	song->evictLen = 0.0f;
+	song->evicted = TRUE;
+	song->pending = TRUE;
+	song->lazy = !(opts & BGM_LAZY_KEEP);
+
+	song->ref = ctx->lazyRef++;
+	_bgm_MemFreeRef(song);
+	_bgm_CmdSnapSong(song);
+
+	if (opts & BGM_LAZY_PREFETCH)
+		_bgm_MemTouch(song);
+
+	return song->ref;
+}
+
+/*	bgm_Prefetch() -
+		Loads the song with the given ID now. */
+DLL_FUNC
+GM_REAL bgm_Prefetch( GM_REAL songId )
+{
+	SONG *song;
+
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdPost(BGM_CMD_PREFETCH, "r", songId);
+
+	ERROR_CONTEXT("Failed to prefetch song");
+
+	song = _bgm_PeekSongById(songId);
+	/* ERROR HANDLER */
+	if (!song || (song == bgm_song && !song->id)) {
+		BGM_ERROR("Invalid song ID.");
+		return FALSE;
+	}
+
+	_bgm_MemTouch(song);
+	/* ERROR HANDLER */
+	if (!song->id) {
+		BGM_ERROR("Could not load \"%s\".", song->fname);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*	_bgm_LazyIdle() -
+		Internal function that unloads registered songs that have gone
+		unused. */
+void _bgm_LazyIdle( SONG *except )
+{
+	BGM_CONTEXT *ctx = _bgm_Context();
+	SONG *node;
+	DWORD now;
+
+	if (!bgm_config.idleTime)
+		return;
+	now = GetTickCount();
+	if (now - ctx->lazyPoll < BGM_LAZY_INTERVAL)
+		return;
+	ctx->lazyPoll = now;
+
+	for (node = ctx->song; node; node = node->next) {
+		if (node != except && node->lazy &&
+		    now - node->lastUse >= bgm_config.idleTime &&
+		    _bgm_MemEvictable(node))
+			_bgm_MemEvict(node);
+	}
+}
+
+/* END OF FILE */
@@ -0,0 +1,64 @@
+/******************************************************************************
+ *
+ *	bgm_lazy.h -
+ *		Prototypes for lazily loaded songs. bgm_Register() gives a song an
+ *		ID without loading it; it is loaded the first time it is used, or
+ *		by bgm_Prefetch(), just as an evicted song is loaded again (see
+ *		bgm_mem.h). A registered song that has gone unused for the
+ *		"idletime" global attribute (in ms) and isn't playing is unloaded
+ *		again, keeping its ID, until it is next used.
+ *
+ *****************************************************************************/
+
+#ifndef BGM_LAZY_H
+#define BGM_LAZY_H
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// bgm_Register() options, added together
+#define BGM_LAZY_STREAM		1	// Stream a sampled song rather than load
+								// it all at once
+#define BGM_LAZY_KEEP		2	// Never unload it for being idle
+#define BGM_LAZY_PREFETCH	4	// Load it straight away
+
+// Least time between two looks for idle songs, in ms
+#define BGM_LAZY_INTERVAL 250
+
+// First ID handed out to registered songs. BASS hands its handles out
+// from far lower, and a song loaded on one that is taken gets another
+// anyway (see _bgm_MemFreeRef()).
+#define BGM_LAZY_REFBASE 0x40000000
+
+/******************************************************************************
+ * Function prototypes
+ *****************************************************************************/
+
+/*	bgm_Register() -
+		Registers a song to be loaded from the given filename when it is
+		first used. options is a sum of BGM_LAZY_xxx. Registering a
+		filename that already has a song returns that song's ID. Internet
+		streams can't be registered.
+		Returns the ID of the song on success, 0 on failure. */
+DLL_FUNC
+GM_REAL bgm_Register( GM_STRING fname,
+                      GM_REAL   options );
+
+/*	bgm_Prefetch() -
+		Loads the song with the given ID now, if it was registered and
+		hasn't been loaded yet or has been unloaded (or evicted) since.
+		Returns 1 if the song is loaded, 0 on failure. */
+DLL_FUNC
+GM_REAL bgm_Prefetch( GM_REAL songId );
+
+/*	_bgm_LazyIdle() -
+		Internal function that unloads registered songs that have gone
+		unused for longer than the "idletime" global attribute, at most
+		every BGM_LAZY_INTERVAL ms. except, which may be NULL, is left
+		alone. */
+void _bgm_LazyIdle( SONG *except );
+
+#endif // BGM_LAZY_H
+
+/* END OF FILE */
@@ -23,7 +23,14 @@ GM_REAL bgm_Load( GM_STRING fname,
 	DWORD	type;
 	BOOL	isUrl;
 	
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdCall(BGM_CMD_LOAD, "srr", fname, stream, qp);
+	
 	ERROR_CONTEXT("Failed to load song");	
+	
+	// A song played as Quick Play not long ago may still be loaded
+	if (qp && _bgm_QpUnpark(fname))
+		return bgm_song->ref;
 		
 	// Get some info about the filename
 	type = _bgm_GetFileType(fname);
@@ -80,8 +87,10 @@ SONG* _bgm_Load_Part1( char  *fname,
 	if (qp) {
 		// If there is a song loaded at QP
 		if (bgm_song->id) {
-			// Try to unload the previous song
-			if (!bgm_UnloadByFname(bgm_song->fname))
+			// Keep the previous song warm (see bgm_qpcache.c), unless it's
+			// the one being loaded again, or else try to unload it
+			if ((!strcmp(bgm_song->fname, fname) || !_bgm_QpPark()) &&
+			    !bgm_UnloadByFname(bgm_song->fname))
 				/* ERROR HANDLER */
 				return NULL;
 		}
@@ -105,6 +114,42 @@ SONG* _bgm_Load_Part1( char  *fname,
 	return song;
 }
 
+/*	_bgm_Load_Part2() -
+		This is the 2nd part of the loading process for all song types. It
+		goes at the end of each bgm_Load*() function, once the song's channel
+		has been created. */
+void _bgm_Load_Part2( SONG *song,
+                      BOOL qp )
+{
+	// The channel the song starts on gives it its ID, unless an evicted
+	// song had the same one
+	song->ref = song->id;
+	_bgm_MemFreeRef(song);
+	song->lastUse = GetTickCount();
+	song->music = 0;
+	song->modDirty = FALSE;
+	
+	// Load channel attributes (for the QP song only)
+	if (qp) _bgm_LoadQpAttrs();
+	
+	// Turn the song down to the normalised loudness, if known
+	song->normGain = 1.0f;
+	if (bgm_config.normalize) {
+		_bgm_LoudPrepare(song);
+		_bgm_LoudApply(song);
+	}
+	
+	// The master bus and the meters have to see every song while they're on
+	if (_bgm_BusActive() || bgm_meterOn)
+		_bgm_DspAttach(song);
+	
+	// Async callers can find it from now on
+	_bgm_CmdSnapSong(song);
+	
+	// Make room for it, if it took the songs over the memory budget
+	_bgm_MemEnforce(song);
+}
+
 /*	_bgm_LoadQpAttrs() -
 		Internal function to load the QP song's channel attributes from the
 		QP node into the actual channel.  */
@@ -114,6 +159,7 @@ void _bgm_LoadQpAttrs( )
 	  ((CHANDATA*)bgm_song->extData)->freq,
 	  ((CHANDATA*)bgm_song->extData)->vol,
 	  ((CHANDATA*)bgm_song->extData)->pan);
+	bgm_song->userVol = ((CHANDATA*)bgm_song->extData)->vol;
 }
 
 /*	bgm_LoadMod() -
@@ -126,6 +172,9 @@ GM_REAL bgm_LoadMod( GM_STRING fname,
 	SONG *song=NULL;
 	DWORD flags;
 	
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdCall(BGM_CMD_LOADMOD, "sr", fname, qp);
+	
 	// Do the first part of the loading process
 	song = _bgm_Load_Part1(fname, qp, "Failed to load module");
 	/* ERROR HANDLER */
@@ -156,10 +205,14 @@ GM_REAL bgm_LoadMod( GM_STRING fname,
 			return 0;
 		}
 	
-	// Load channel attributes (for the QP song only)
-	if (qp) _bgm_LoadQpAttrs();
-		
-	return song->id;
+	// Finish loading
+	_bgm_Load_Part2(song, qp);
+	
+	// Play it from its PCM cache if there is one (or have one made)
+	if (bgm_config.modCache)
+		_bgm_PcmPrepare(song);
+	
+	return song->ref;
 }
 
 /*	bgm_LoadSample() -
@@ -173,14 +226,36 @@ GM_REAL bgm_LoadSample( GM_STRING fname,
 {
 	SONG *song=NULL;
 	
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdCall(BGM_CMD_LOADSAMPLE, "sr", fname, qp);
+	
+	song = _bgm_LoadSample(fname, qp, 1, "Failed to load sample");
+	/* ERROR HANDLER */
+	if (!song)
+		return 0;
+	
+	return song->ref;
+}
+
+/*	_bgm_LoadSample() -
+		Internal function that does the work of bgm_LoadSample(), loading
+		the sample so that it can play on up to max channels at once. */
+SONG* _bgm_LoadSample( char  *fname,
+                       BOOL  qp,
+                       DWORD max,
+                       char  *errContext )
+{
+	SONG *song=NULL;
+	
 	// Do the first part of the loading process
-	song = _bgm_Load_Part1(fname, qp, "Failed to load sample");
+	song = _bgm_Load_Part1(fname, qp, errContext);
 	/* ERROR HANDLER */
 	if (!song)
-		return FALSE;
+		return NULL;
 		
-	// Try to load the sample
-	song->sample = BASS_SampleLoad(FALSE, fname, FALSE, 0, 1, 0);
+	// Try to load the sample. Which channel gives way when they're all
+	// busy is up to BGM (see bgm_voice.c), not BASS.
+	song->sample = BASS_SampleLoad(FALSE, fname, FALSE, 0, max, 0);
 	
 	/* ERROR HANDLER */
 	if (!song->sample) {
@@ -197,7 +272,7 @@ GM_REAL bgm_LoadSample( GM_STRING fname,
 			case BASS_ERROR_UNKNOWN: BGM_ERROR("Unknown error occured."); break;
 		}
 		_bgm_DeleteSong(song);
-		return 0;
+		return NULL;
 	}
 	
 	// Try to create a channel for the sample
@@ -208,13 +283,13 @@ GM_REAL bgm_LoadSample( GM_STRING fname,
 		BGM_ERROR("Could not create new channel.");
 		BASS_SampleFree(song->sample);
 		_bgm_DeleteSong(song);
-		return 0;
+		return NULL;
 	}
 	
-	// Load channel attributes (for the QP song only)
-	if (qp) _bgm_LoadQpAttrs();			
-		
-	return song->id;
+	// Finish loading
+	_bgm_Load_Part2(song, qp);
+	
+	return song;
 }
 
 /*	bgm_LoadStream() -
@@ -227,6 +302,9 @@ GM_REAL bgm_LoadStream( GM_STRING fname,
 {
 	SONG *song=NULL;
 	
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdCall(BGM_CMD_LOADSTREAM, "sr", fname, qp);
+	
 	// Do the first part of the loading process
 	song = _bgm_Load_Part1(fname, qp, "Failed to create file stream");
 	/* ERROR HANDLER */
@@ -234,10 +312,12 @@ GM_REAL bgm_LoadStream( GM_STRING fname,
 		return FALSE;
 	
 	// Attempt to create the stream
-	song->id = BASS_StreamCreateFile(FALSE, fname, 0, 0, 0);
+	song->id = _bgm_CreateFileStream(song, fname);
 					
 	/* ERROR HANDLERS */
 	if (!song->id) {
+		// A read-ahead buffer that couldn't be set up has said why already
+		if (!bgm_config.readAhead || song->io)
 		switch (BASS_ErrorGetCode()) {
 			case BASS_ERROR_INIT: BGM_ERROR("BASS not initialized."); break; 
 			case BASS_ERROR_NOTAVAIL: BGM_ERROR("BASS_ERROR_NOTAVAIL occured."); break; 
@@ -251,15 +331,41 @@ GM_REAL bgm_LoadStream( GM_STRING fname,
 			case BASS_ERROR_NO3D: BGM_ERROR("3D support  initialization failed."); break;
 			case BASS_ERROR_UNKNOWN: BGM_ERROR("Unknown error occured."); break; 
 		}
+		_bgm_IoFree(song->io);
+		song->io = NULL;
 		_bgm_DeleteSong(song);
 		return 0;
 	}
 	// END ERROR HANDLER
 	
-	// Load channel attributes (for the QP song only)
-	if (qp) _bgm_LoadQpAttrs();
+	// Finish loading
+	_bgm_Load_Part2(song, qp);
+	
+	return song->ref;
+}
+
+/*	_bgm_CreateFileStream() -
+		Internal function that creates the stream of a song from the file at
+		path, fed from a read-ahead buffer if one has been asked for (see
+		bgm_io.c). Returns the stream, or 0 on failure. If the read-ahead
+		buffer was the problem, song->io is NULL and a BGM error is set;
+		otherwise see BASS_ErrorGetCode(). */
+DWORD _bgm_CreateFileStream( SONG       *song,
+                             const char *path )
+{
+	DWORD stream;
+	
+	if (!bgm_config.readAhead)
+		return BASS_StreamCreateFile(FALSE, (void*)path, 0, 0, 0);
 	
-	return song->id;
+	song->io = _bgm_IoOpen(path, bgm_config.readAhead*1024);
+	if (!song->io)
+		return 0;
+	stream = BASS_StreamCreateFileUser(FALSE, 0, _bgm_IoFileProc,
+	                                   song->io->user);
+	// BASS's look at the header doesn't count against the buffer
+	song->io->underruns = 0;
+	return stream;
 }
 
 /*	bgm_LoadNetStream() -
@@ -271,6 +377,10 @@ GM_REAL bgm_LoadNetStream( GM_STRING url,
                            GM_REAL   qp )
 {
 	SONG *song=NULL;
+	char path[512+32];
+	
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdCall(BGM_CMD_LOADNETSTREAM, "sr", url, qp);
 	
 	// Do the first part of the loading process
 	song = _bgm_Load_Part1(url, qp, "Failed to create internet stream");
@@ -278,8 +388,22 @@ GM_REAL bgm_LoadNetStream( GM_STRING url,
 	if (!song)
 		return FALSE;
 	
-	// Attempt to create the stream
-	song->id = BASS_StreamCreateURL(url, 0, 0, NULL, 0);
+	// Play it from disk if it's been downloaded before (see bgm_net.c),
+	// and download it otherwise, caching it on the way if asked to
+	if (bgm_config.netCache[0] && _bgm_NetValid(url, path)) {
+		song->id = _bgm_CreateFileStream(song, path);
+		if (!song->id) {
+			_bgm_IoFree(song->io);
+			song->io = NULL;
+		}
+	}
+	if (!song->id) {
+		if (bgm_config.netCache[0])
+			song->net = _bgm_NetStart(url);
+		song->id = BASS_StreamCreateURL(url, 0, 0,
+		                                song->net ? _bgm_NetDownloadProc : NULL,
+		                                song->net ? song->net->user : 0);
+	}
 					
 	/* ERROR HANDLERS */
 	if (!song->id) {
@@ -298,15 +422,20 @@ GM_REAL bgm_LoadNetStream( GM_STRING url,
 			case BASS_ERROR_NO3D: BGM_ERROR("3D support  initialization failed."); break;
 			case BASS_ERROR_UNKNOWN: BGM_ERROR("Unknown error occured.");
 		}
+		_bgm_NetFree(song->net);
+		song->net = NULL;
 		_bgm_DeleteSong(song);
 		return 0;
 	}
 	// END ERROR HANDLER
 	
-	// Load channel attributes (for the QP song only)
-	if (qp) _bgm_LoadQpAttrs();
+	if (song->net)
+		_bgm_NetAttach(song->net, song->id);
 	
-	return song->id;
+	// Finish loading
+	_bgm_Load_Part2(song, qp);
+	
+	return song->ref;
 }
 
 /*	_bgm_SaveQpAttrs() -
@@ -316,8 +445,11 @@ void _bgm_SaveQpAttrs( )
 {
 	BASS_ChannelGetAttributes(bgm_song->id,
 	  &((CHANDATA*)bgm_song->extData)->freq,
-	  &((CHANDATA*)bgm_song->extData)->vol,
+	  NULL,
 	  &((CHANDATA*)bgm_song->extData)->pan);
+	
+	// Keep the volume the user set, not the normalised one
+	((CHANDATA*)bgm_song->extData)->vol = bgm_song->userVol;
 }
 
 /*	_bgm_Clear() -
@@ -328,11 +460,17 @@ BOOL _bgm_Clear(SONG *song)
 {
 	BASS_CHANNELINFO info;
 	
+	// An evicted song's channel is gone already (see bgm_mem.c)
+	if (song->evicted)
+		info.ctype = 0;
 	// Try to get channel info
-	if (!BASS_ChannelGetInfo(song->id, &info))
+	else if (!BASS_ChannelGetInfo(song->id, &info))
 		// If the info couldn't be gathered, fail now
 		return FALSE;
 		
+	// Take BGM's DSP off the channel before it goes away
+	_bgm_DspDetach(song);
+		
 	// Unload based on the song's (channel's) type
 	
 	// Samples
@@ -344,6 +482,10 @@ BOOL _bgm_Clear(SONG *song)
 	// Streams
 	if (info.ctype & BASS_CTYPE_STREAM) {
 		BASS_StreamFree(song->id);
+		_bgm_IoFree(song->io);
+		_bgm_NetFree(song->net);
+		song->io = NULL;
+		song->net = NULL;
 	}
 		
 	// Modules
@@ -353,10 +495,27 @@ BOOL _bgm_Clear(SONG *song)
 	
 	// END unload based on song's type
 	
+	// A module playing from its PCM cache is still loaded underneath
+	if (song->music)
+		BASS_MusicFree(song->music);
+	
+	// The voices went with the sample
+	_bgm_VoicesFree(song);
+	
+	// Like the channel's own attributes, coalescing starts over with the
+	// next song loaded in its place
+	_bgm_CoalesceFree(song);
+	
 	// Nullify values (Except extData; it's impossible to tell what kind of
 	// information it will hold, though it's probably CHANDATA.)
 	song->id = 0;
+	song->ref = 0;
+	song->music = 0;
+	song->modDirty = FALSE;
 	song->sample = 0;		
+	song->virt = FALSE;
+	song->evicted = FALSE;
+	song->primed = FALSE;
 	
 	return TRUE;
 }
@@ -376,7 +535,7 @@ BOOL _bgm_Unload(SONG *song) {
 	}
 	
 	// If this is the QP song and it is already unloaded
-	if (song->id == 0)
+	if (song->id == 0 && !song->evicted)
 		// Just silently skip the request
 		return TRUE;
 	
@@ -385,6 +544,7 @@ BOOL _bgm_Unload(SONG *song) {
 		// Save the channel attributes of the QP song, then clear it
 		_bgm_SaveQpAttrs();
 		_bgm_Clear(song);
+		_bgm_CmdSnapSong(song);
 	}
 	// If this is not the QP song
 	else {
@@ -402,7 +562,9 @@ BOOL _bgm_Unload(SONG *song) {
 DLL_FUNC
 GM_REAL bgm_UnloadById( GM_REAL songId )
 {
-	return _bgm_Unload(_bgm_GetSongById(songId));
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdPost(BGM_CMD_UNLOADBYID, "r", songId);
+	return _bgm_Unload(_bgm_PeekSongById(songId));
 }
 
 /*	bgm_UnloadByFname() -
@@ -412,7 +574,9 @@ GM_REAL bgm_UnloadById( GM_REAL songId )
 DLL_FUNC
 GM_REAL bgm_UnloadByFname( GM_STRING fname )
 {
-	return _bgm_Unload(_bgm_GetSongByFname(fname));
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdPost(BGM_CMD_UNLOADBYFNAME, "s", fname);
+	return _bgm_Unload(_bgm_PeekSongByFname(fname));
 }
 
 /*	bgm_IsLoadedById() -
@@ -421,7 +585,11 @@ GM_REAL bgm_UnloadByFname( GM_STRING fname )
 DLL_FUNC
 GM_REAL bgm_IsLoadedById( GM_REAL id )
 {
-	return (_bgm_GetSongById(id) != NULL);
+	SONG stub;
+	
+	if (BGM_CMD_ASYNC)
+		return (_bgm_CmdSnapFind(id, NULL, &stub) != NULL);
+	return (_bgm_PeekSongById(id) != NULL);
 }
 
 /*	bgm_IsLoadedByFname() -
@@ -429,7 +597,11 @@ GM_REAL bgm_IsLoadedById( GM_REAL id )
 DLL_FUNC
 GM_REAL bgm_IsLoadedByFname( GM_STRING fname )
 {
-	return (_bgm_GetSongByFname(fname) != NULL);
+	SONG stub;
+	
+	if (BGM_CMD_ASYNC)
+		return (_bgm_CmdSnapFind(0, fname, &stub) != NULL);
+	return (_bgm_PeekSongByFname(fname) != NULL);
 }
 
 /* END OF FILE */
@@ -36,6 +36,13 @@ SONG* _bgm_Load_Part1( char  *fname,
                        BOOL  qp,
                        char  *errContext );
 
+/*	_bgm_Load_Part2() -
+		This is the 2nd part of the loading process for all song types. It
+		goes at the end of each bgm_Load*() function, once the song's channel
+		has been created. */
+void _bgm_Load_Part2( SONG *song,
+                      BOOL qp );
+
 /*	_bgm_LoadQpAttrs() -
 		Internal function to load the QP song's channel attributes from the
 		QP node into the actual channel.  */
@@ -57,6 +64,15 @@ DLL_FUNC
 GM_REAL bgm_LoadSample( GM_STRING fname,
                         GM_REAL   qp );
 
+/*	_bgm_LoadSample() -
+		Internal function that does the work of bgm_LoadSample(), loading
+		the sample so that it can play on up to max channels at once.
+		Returns the new song, or NULL on failure. */
+SONG* _bgm_LoadSample( char  *fname,
+                       BOOL  qp,
+                       DWORD max,
+                       char  *errContext );
+
 /*	bgm_LoadStream() -
 		Loads a sampled song as a stream from the given filename URL.
 		Faster than bgm_Load() because it's specialized for sampled streams.
@@ -65,6 +81,15 @@ DLL_FUNC
 GM_REAL bgm_LoadStream( GM_STRING fname,
                         GM_REAL   qp );
 
+/*	_bgm_CreateFileStream() -
+		Internal function that creates the stream of a song from the file at
+		path, fed from a read-ahead buffer if the "readahead" attribute is
+		set. Returns the stream, or 0 on failure. If the read-ahead buffer
+		was the problem, song->io is NULL and a BGM error is set; otherwise
+		see BASS_ErrorGetCode(). */
+DWORD _bgm_CreateFileStream( SONG       *song,
+                             const char *path );
+
 /*	bgm_LoadNetStream() -
 		Loads a sampled song as a stream from the given internet URL.
 		Faster than bgm_Load() because it's specialize for internet streaming.
@@ -0,0 +1,276 @@
+/******************************************************************************
+ *
+ *	bgm_loud.c -
+ *		Implementation of BGM's loudness measurement and normalisation.
+ *
+ *	Measurement follows ITU-R BS.1770: every channel goes through the two
+ *	K-weighting biquads (run with the SSE biquad kernel, channels side by
+ *	side), mean squares are taken over 100ms segments, and the integrated
+ *	loudness is the average of the 400ms blocks (4 segments, 75% overlap)
+ *	that pass the absolute -70 LUFS gate and the relative -10 LU gate.
+ *
+ *	The normalisation gain is folded into the channel volume BASS holds.
+ *	SONG.normGain remembers how much of it there is and SONG.userVol the
+ *	volume the user chose, which the cvolume attribute shows and sets; the
+ *	channel's rounded volume is never divided back out.
+ *
+ *	Sidecar layout (after the cache header): integrated loudness in LUFS
+ *	(float).
+ *
+ *****************************************************************************/
+
+#include "bgm.h"
+
+/******************************************************************************
+ * Function implementations
+ *****************************************************************************/
+
+/*	_bgm_LoudStart() -
+		Internal function that gets a LOUDSTATE ready for a file with the
+		given format. Returns FALSE if out of memory. */
+BOOL _bgm_LoudStart( LOUDSTATE *state,
+                     DWORD     freq,
+                     DWORD     chans )
+{
+	double k, q, vh, vb, a0;
+
+	if (!freq) freq = 44100;
+	memset(state, 0, sizeof(LOUDSTATE));
+	state->stride = chans;
+	state->chans = (chans > BGM_DSP_MAXCHANS) ? BGM_DSP_MAXCHANS : chans;
+	state->segLen = freq/10;
+
+	// Stage 1: high shelf, +4dB above about 1.5kHz (the head)
+	k = tan(3.14159265358979*1681.974450955533/freq);
+	q = 0.7071752369554196;
+	vh = pow(10.0, 3.999843853973347/20.0);
+	vb = pow(vh, 0.4996667741545416);
+	a0 = 1.0 + k/q + k*k;
+	state->shelf[0] = (float)((vh + vb*k/q + k*k)/a0);
+	state->shelf[1] = (float)(2.0*(k*k - vh)/a0);
+	state->shelf[2] = (float)((vh - vb*k/q + k*k)/a0);
+	state->shelf[3] = (float)(2.0*(k*k - 1.0)/a0);
+	state->shelf[4] = (float)((1.0 - k/q + k*k)/a0);
+
+	// Stage 2: high pass at about 38Hz (RLB weighting)
+	k = tan(3.14159265358979*38.13547087602444/freq);
+	q = 0.5003270373238773;
+	a0 = 1.0 + k/q + k*k;
+	state->hp[0] = 1.0f;
+	state->hp[1] = -2.0f;
+	state->hp[2] = 1.0f;
+	state->hp[3] = (float)(2.0*(k*k - 1.0)/a0);
+	state->hp[4] = (float)((1.0 - k/q + k*k)/a0);
+
+	// Room for about 5 minutes to start with
+	state->room = 3000;
+	state->segs = NEW(float,state->room);
+	return state->segs != NULL;
+}
+
+/*	_bgm_LoudFeed() -
+		Internal function that measures frames interleaved frames. */
+void _bgm_LoudFeed( LOUDSTATE   *state,
+                    const float *buf,
+                    DWORD       frames )
+{
+	float tmp[4096], *grown;
+	DWORD chans = state->chans, n, pos, i, c;
+
+	while (frames) {
+		// Copy a chunk out and K-weight it
+		n = sizeof(tmp)/sizeof(float)/chans;
+		if (n > frames) n = frames;
+		for (i=0; i<n; i++)
+			for (c=0; c<chans; c++)
+				tmp[i*chans+c] = buf[i*state->stride+c];
+		_bgm_DspBiquad(tmp, n, chans, state->shelf, state->z[0], state->z[1]);
+		_bgm_DspBiquad(tmp, n, chans, state->hp, state->z[2], state->z[3]);
+		buf += n*state->stride;
+		frames -= n;
+
+		// Add it to the segments it falls in
+		for (pos=0; pos<n; pos+=i) {
+			i = state->segLen - state->fill;
+			if (i > n-pos) i = n-pos;
+			state->sum += _bgm_DspSumSquares(tmp + pos*chans, i*chans);
+			state->fill += i;
+			if (state->fill < state->segLen)
+				continue;
+
+			if (state->count == state->room) {
+				grown = (float*)realloc(state->segs,
+				                        sizeof(float)*state->room*2);
+				if (!grown)
+					return;
+				state->segs = grown;
+				state->room *= 2;
+			}
+			state->segs[state->count++] = (float)(state->sum/state->segLen);
+			state->sum = 0.0;
+			state->fill = 0;
+		}
+	}
+}
+
+/*	_bgm_LoudFinish() -
+		Internal function that works out the integrated loudness, in LUFS,
+		of everything fed in and frees the state's memory. */
+float _bgm_LoudFinish( LOUDSTATE *state )
+{
+	DWORD i, n;
+	double z, sum, gate, lufs = -70.0;
+	float *segs = state->segs;
+
+	// Block loudness is -0.691 + 10log10(z), so the -70 LUFS gate is
+	double absGate = pow(10.0, (-70.0+0.691)/10.0);
+
+	// Pass 1: average of the blocks above the absolute gate
+	sum = 0.0;
+	n = 0;
+	for (i=0; i+4<=state->count; i++) {
+		z = (segs[i] + segs[i+1] + segs[i+2] + segs[i+3])/4.0;
+		if (z > absGate) {
+			sum += z;
+			n++;
+		}
+	}
+
+	// Pass 2: average of the blocks above both gates
+	if (n) {
+		// 10 LU under that average, i.e. a tenth of its power
+		gate = sum/n * 0.1;
+		if (gate < absGate)
+			gate = absGate;
+		sum = 0.0;
+		n = 0;
+		for (i=0; i+4<=state->count; i++) {
+			z = (segs[i] + segs[i+1] + segs[i+2] + segs[i+3])/4.0;
+			if (z > gate) {
+				sum += z;
+				n++;
+			}
+		}
+		if (n)
+			lufs = -0.691 + 10.0*log10(sum/n);
+	}
+
+	free(segs);
+	state->segs = NULL;
+	return (float)lufs;
+}
+
+/*	_bgm_LoudLoad() -
+		Internal function that loads a file's loudness from its sidecar.
+		Returns FALSE if there is no up to date sidecar. */
+BOOL _bgm_LoudLoad( const char     *fname,
+                    const CACHEKEY *key,
+                    float          *lufs )
+{
+	FILE *f;
+	BOOL ok;
+
+	f = _bgm_CacheOpen(fname, BGM_LOUD_EXT, BGM_LOUD_MAGIC, key);
+	if (!f)
+		return FALSE;
+	ok = (fread(lufs, sizeof(float), 1, f) == 1);
+	fclose(f);
+	return ok;
+}
+
+/*	_bgm_LoudSave() -
+		Internal function that saves a file's loudness to its sidecar. */
+void _bgm_LoudSave( const char     *fname,
+                    const CACHEKEY *key,
+                    float          lufs )
+{
+	FILE *f;
+
+	f = _bgm_CacheCreate(fname, BGM_LOUD_EXT, BGM_LOUD_MAGIC, key);
+	if (!f)
+		return;
+	fwrite(&lufs, sizeof(float), 1, f);
+	fclose(f);
+}
+
+/*	_bgm_LoudPrepare() -
+		Internal function, called when a song is loaded with normalisation
+		on, that makes sure its loudness is known or on its way. */
+void _bgm_LoudPrepare( SONG *song )
+{
+	ANALYSIS *entry;
+	CACHEKEY key;
+	float lufs;
+	BOOL known;
+
+	// Only files can be measured
+	if (!song->id || strstr(song->fname, "://"))
+		return;
+
+	EnterCriticalSection(&bgm_anLock);
+	entry = _bgm_AnalyzeFind(song->fname, TRUE);
+	known = !entry || ((entry->want | entry->done | entry->failed |
+	                    entry->running) & AN_LOUD);
+	LeaveCriticalSection(&bgm_anLock);
+	if (known)
+		return;
+
+	// Measured before? Then read it now rather than wait for the worker
+	if (_bgm_CacheKey(song->fname, &key) &&
+	    _bgm_LoudLoad(song->fname, &key, &lufs)) {
+		EnterCriticalSection(&bgm_anLock);
+		entry->lufs = lufs;
+		entry->done |= AN_LOUD;
+		LeaveCriticalSection(&bgm_anLock);
+	}
+	else
+		_bgm_AnalyzeGet(song, AN_LOUD);
+}
+
+/*	_bgm_LoudApply() -
+		Internal function that brings the song's channel volume in line with
+		its normalisation gain. */
+void _bgm_LoudApply( SONG *song )
+{
+	ANALYSIS *entry;
+	float gain = 1.0f;
+
+	if (!song || !song->id)
+		return;
+
+	if (bgm_config.normalize) {
+		EnterCriticalSection(&bgm_anLock);
+		entry = _bgm_AnalyzeFind(song->fname, FALSE);
+		if (entry && (entry->done & AN_LOUD) && entry->lufs > -70.0f)
+			gain = (float)pow(10.0, (BGM_LOUD_TARGET-entry->lufs)/20.0);
+		LeaveCriticalSection(&bgm_anLock);
+		if (gain > 1.0f)
+			gain = 1.0f;
+	}
+
+	if (gain == song->normGain)
+		return;
+
+	// The volume the user set, turned down by the new gain
+	BASS_ChannelSetAttributes(song->id, -1,
+	                          (int)(song->userVol*gain + 0.5f), -101);
+	song->normGain = gain;
+}
+
+/*	_bgm_LoudApplyAll() -
+		Internal function that calls _bgm_LoudPrepare() (if normalisation is
+		on) and _bgm_LoudApply() for every loaded song. */
+void _bgm_LoudApplyAll( )
+{
+	SONG *node;
+
+	for (node = bgm_song; node; node = node->next) {
+		if (!node->id)
+			continue;
+		if (bgm_config.normalize)
+			_bgm_LoudPrepare(node);
+		_bgm_LoudApply(node);
+	}
+}
+
+/* END OF FILE */
@@ -0,0 +1,103 @@
+/******************************************************************************
+ *
+ *	bgm_loud.h -
+ *		Prototypes and types for BGM's loudness normalisation. The integrated
+ *		loudness of each file is measured once, the way EBU R128 / ITU-R
+ *		BS.1770 does it (K-weighting and gated 400ms blocks), and while the
+ *		"normalize" global attribute is on songs are turned down through
+ *		their channel volume to meet BGM_LOUD_TARGET.
+ *
+ *****************************************************************************/
+
+#ifndef BGM_LOUD_H
+#define BGM_LOUD_H
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// Loudness songs are normalised to, in LUFS. Channel volume can only turn
+// songs down, so this is on the quiet side to leave room for most music.
+#define BGM_LOUD_TARGET -18.0
+
+// Sidecar extension and magic number
+#define BGM_LOUD_EXT   ".loud"
+#define BGM_LOUD_MAGIC 0x44554F4C /* "LOUD" */
+
+/******************************************************************************
+ * Typedefs, structs, etc.
+ *****************************************************************************/
+
+/*	LOUDSTATE -
+		Working state of the loudness meter while a file is decoded.
+*/
+typedef struct ctagLOUDSTATE {
+	DWORD	stride;						// Channels in the file
+	DWORD	chans;						// Channels measured (the first
+										// BGM_DSP_MAXCHANS)
+	float	shelf[5], hp[5];			// K-weighting biquads
+	float	z[4][BGM_DSP_MAXCHANS];		// Their state, per channel
+	DWORD	segLen;						// Samples per 100ms segment
+	DWORD	fill;						// Samples in the current segment
+	double	sum;						// Its sum of squares so far
+	float	*segs;						// Mean square of every segment
+	DWORD	count, room;
+} LOUDSTATE;
+
+/******************************************************************************
+ * Function prototypes
+ *****************************************************************************/
+
+/*	_bgm_LoudStart() -
+		Internal function that gets a LOUDSTATE ready for a file with the
+		given format. Returns FALSE if out of memory. */
+BOOL _bgm_LoudStart( LOUDSTATE *state,
+                     DWORD     freq,
+                     DWORD     chans );
+
+/*	_bgm_LoudFeed() -
+		Internal function that measures frames interleaved frames. */
+void _bgm_LoudFeed( LOUDSTATE   *state,
+                    const float *buf,
+                    DWORD       frames );
+
+/*	_bgm_LoudFinish() -
+		Internal function that works out the integrated loudness, in LUFS,
+		of everything fed in and frees the state's memory. Silence reads
+		-70. */
+float _bgm_LoudFinish( LOUDSTATE *state );
+
+/*	_bgm_LoudLoad() -
+		Internal function that loads a file's loudness from its sidecar.
+		Returns FALSE if there is no up to date sidecar. */
+BOOL _bgm_LoudLoad( const char     *fname,
+                    const CACHEKEY *key,
+                    float          *lufs );
+
+/*	_bgm_LoudSave() -
+		Internal function that saves a file's loudness to its sidecar. */
+void _bgm_LoudSave( const char     *fname,
+                    const CACHEKEY *key,
+                    float          lufs );
+
+/*	_bgm_LoudPrepare() -
+		Internal function, called when a song is loaded with normalisation
+		on, that makes sure its loudness is known or on its way. A saved
+		result is read straight away, so repeat loads come out at the right
+		volume; otherwise the file is queued for analysis. */
+void _bgm_LoudPrepare( SONG *song );
+
+/*	_bgm_LoudApply() -
+		Internal function that brings the song's channel volume in line with
+		its normalisation gain: the gain for its loudness while normalisation
+		is on and the loudness is known, 1 otherwise. */
+void _bgm_LoudApply( SONG *song );
+
+/*	_bgm_LoudApplyAll() -
+		Internal function that calls _bgm_LoudPrepare() (if normalisation is
+		on) and _bgm_LoudApply() for every loaded song. */
+void _bgm_LoudApplyAll( );
+
+#endif // BGM_LOUD_H
+
+/* END OF FILE */
@@ -0,0 +1,336 @@
+/******************************************************************************
+ *
+ *	bgm_mem.c -
+ *		Implementation of the memory budget.
+ *
+ *	The figures are estimates: BASS doesn't say what it has allocated, so
+ *	each song is counted from what it was made of. A sample holds its
+ *	decoded data, which BASS_SampleGetInfo() gives the length of. A module
+ *	holds about its file. A stream holds its playback buffer
+ *	(BASS_CONFIG_BUFFER ms of decoded audio), an internet stream also its
+ *	download buffer (BASS_CONFIG_NET_BUFFER ms, counted as decoded audio,
+ *	so too high), and a file stream read ahead also that buffer. A module
+ *	playing from its PCM cache holds both. Nothing is counted for the
+ *	SONG, its effects or its analyses, which are small next to the audio.
+ *
+ *	The budget is only looked at when a song is loaded, loaded again or the
+ *	budget is changed, as nothing else makes the total grow. Songs that
+ *	aren't playing are only evicted then, so going over the budget while
+ *	they all play is allowed, and lasts until the next load.
+ *
+ *	A freed channel handle can be handed out again by BASS. Song IDs are
+ *	the handles songs were loaded on, so a song loaded on one an evicted
+ *	song had is given the next free ID instead (see _bgm_MemFreeRef()).
+ *
+ *****************************************************************************/
+
+#include "bgm.h"
+
+/******************************************************************************
+ * Function implementations
+ *****************************************************************************/
+
+/*	bgm_SetMemoryBudget() -
+		Sets the most memory the songs are to hold between them. */
+DLL_FUNC
+GM_REAL bgm_SetMemoryBudget( GM_REAL bytes )
+{
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdPost(BGM_CMD_SETMEMORYBUDGET, "r", bytes);
+
+	ERROR_CONTEXT("Failed to set memory budget");
+
+	/* ERROR HANDLER */
+	if (bytes < 0 || bytes > 4294967295.0) {
+		BGM_ERROR("Value (%g) is not between 0 and 4294967295.", bytes);
+		return FALSE;
+	}
+
+	bgm_config.memBudget = (DWORD)bytes;
+	_bgm_MemEnforce(NULL);
+
+	return TRUE;
+}
+
+/*	_bgm_MemBytes() -
+		Internal function that estimates the memory a song holds. */
+DWORD _bgm_MemBytes( SONG *song )
+{
+	BASS_CHANNELINFO info;
+	BASS_SAMPLE sample;
+	struct stat st;
+	DWORD bytes = 0, ms;
+
+	if (!song->id)
+		return 0;
+
+	if (song->sample) {
+		if (BASS_SampleGetInfo(song->sample, &sample))
+			bytes = sample.length;
+		return bytes;
+	}
+
+	BASS_ChannelGetInfo(song->id, &info);
+	if (song->music || (info.ctype & BASS_CTYPE_MUSIC_MOD)) {
+		if (stat(song->fname, &st) == 0)
+			bytes = (DWORD)st.st_size;
+		if (!song->music)
+			return bytes;
+	}
+
+	// What's left is a stream, the PCM cache of a module included
+	ms = BASS_GetConfig(BASS_CONFIG_BUFFER);
+	if (song->net || _bgm_FnameIsUrl(song->fname))
+		ms += BASS_GetConfig(BASS_CONFIG_NET_BUFFER);
+	bytes += (DWORD)BASS_ChannelSeconds2Bytes(song->id, ms/1000.0f);
+	if (song->io)
+		bytes += song->io->size;
+
+	return bytes;
+}
+
+/*	_bgm_MemTotal() -
+		Internal function that adds up the memory every song holds. */
+DWORD _bgm_MemTotal( )
+{
+	SONG *node;
+	DWORD total = 0;
+
+	for (node = _bgm_Context()->song; node; node = node->next)
+		total += _bgm_MemBytes(node);
+
+	return total + _bgm_QpBytes();
+}
+
+/*	_bgm_MemEnforce() -
+		Internal function that evicts songs until the total fits the
+		budget. */
+void _bgm_MemEnforce( SONG *except )
+{
+	SONG *node, *lru;
+	DWORD total, now;
+
+	if (!bgm_config.memBudget)
+		return;
+
+	total = _bgm_MemTotal();
+	now = GetTickCount();
+
+	// Songs parked from Quick Play go first, as nothing is using them
+	while (total > bgm_config.memBudget && _bgm_Context()->qpWarm)
+		total -= _bgm_QpDrop();
+
+	while (total > bgm_config.memBudget) {
+		lru = NULL;
+		for (node = bgm_song; node; node = node->next) {
+			if (node == except || !_bgm_MemEvictable(node))
+				continue;
+			if (!lru || now - node->lastUse > now - lru->lastUse)
+				lru = node;
+		}
+		if (!lru)
+			break;
+
+		total -= _bgm_MemBytes(lru);
+		_bgm_MemEvict(lru);
+	}
+}
+
+/*	_bgm_MemEvictable() -
+		Internal function that returns whether a song can be evicted. */
+BOOL _bgm_MemEvictable( SONG *song )
+{
+	DWORD active;
+
+	if (song == bgm_song || !song->id || song->evicted)
+		return FALSE;
+
+	// Voice IDs and module attributes would be lost with the channel, and
+	// an internet stream would have to be downloaded again
+	if (song->voices || song->modDirty || song->net ||
+	    _bgm_FnameIsUrl(song->fname))
+		return FALSE;
+
+	// A virtual song is playing, as far as anyone can tell
+	active = BASS_ChannelIsActive(song->id);
+	if (song->virt || active == BASS_ACTIVE_PLAYING ||
+	    active == BASS_ACTIVE_STALLED)
+		return FALSE;
+
+	// A fade on a paused song would be cut short
+	if (BASS_ChannelIsSliding(song->id))
+		return FALSE;
+
+	return (_bgm_MemBytes(song) != 0);
+}
+
+/*	_bgm_MemEvict() -
+		Internal function that frees a song's BASS channel. */
+void _bgm_MemEvict( SONG *song )
+{
+	BASS_CHANNELINFO info;
+
+	// What it takes to put the next channel back where this one is
+	BASS_ChannelGetInfo(song->id, &info);
+	BASS_ChannelGetAttributes(song->id, &song->evictAttrs.freq,
+	                          &song->evictAttrs.vol, &song->evictAttrs.pan);
+	song->evictLoop = info.flags & BASS_SAMPLE_LOOP;
+	song->evictActive = BASS_ChannelIsActive(song->id);
+	song->evictPos = BASS_ChannelBytes2Seconds(song->id,
+	                                           BASS_ChannelGetPosition(song->id));
+	song->evictLen = BASS_ChannelBytes2Seconds(song->id,
+	                                           BASS_ChannelGetLength(song->id));
+	song->fadeEnd = 0;
+
+	// The SONGDSP stays with the song, effects and all, for the next
+	// channel
+	if (song->dsp) {
+		BASS_ChannelRemoveDSP(song->dsp->chan, song->dsp->handle);
+		song->dsp->chan = 0;
+	}
+
+	if (song->sample) {
+		song->evictType = BASS_CTYPE_SAMPLE;
+		BASS_SampleFree(song->sample);
+		song->sample = 0;
+	}
+	else if (song->music || (info.ctype & BASS_CTYPE_MUSIC_MOD)) {
+		song->evictType = BASS_CTYPE_MUSIC_MOD;
+		if (song->music) {
+			BASS_StreamFree(song->id);
+			BASS_MusicFree(song->music);
+			song->music = 0;
+		}
+		else
+			BASS_MusicFree(song->id);
+	}
+	else {
+		song->evictType = BASS_CTYPE_STREAM;
+		BASS_StreamFree(song->id);
+		_bgm_IoFree(song->io);
+		song->io = NULL;
+	}
+
+	song->id = 0;
+	song->evicted = TRUE;
+	song->primed = FALSE;
+	_bgm_Context()->evictions++;
+
+	_bgm_CmdSnapSong(song);
+}
+
+/*	_bgm_MemReload() -
+		Internal function that loads an evicted song again. */
+BOOL _bgm_MemReload( SONG *song )
+{
+	BASS_CHANNELINFO info;
+	HSAMPLE sample = 0;
+	DWORD chan = 0;
+	BOOL first = song->pending;
+
+	// The same way it was loaded the first time, or would have been if it
+	// was registered (see bgm_lazy.c)
+	switch (song->evictType) {
+		case BASS_CTYPE_SAMPLE:
+			sample = BASS_SampleLoad(FALSE, song->fname, FALSE, 0, 1, 0);
+			if (sample) {
+				chan = BASS_SampleGetChannel(sample, FALSE);
+				if (!chan)
+					BASS_SampleFree(sample);
+			}
+		break;
+		case BASS_CTYPE_MUSIC_MOD:
+			chan = BASS_MusicLoad(FALSE, song->fname, 0, 0,
+			                      BASS_MUSIC_PRESCAN |
+			                      (bgm_config.use32Bit ? BASS_SAMPLE_FLOAT : 0),
+			                      0);
+		break;
+		default:
+			chan = _bgm_CreateFileStream(song, song->fname);
+			if (!chan) {
+				_bgm_IoFree(song->io);
+				song->io = NULL;
+			}
+	}
+	if (!chan)
+		return FALSE;
+
+	song->id = chan;
+	song->sample = sample;
+	song->evicted = FALSE;
+	song->pending = FALSE;
+
+	// Its attributes, loop flag and effects, as they were
+	BASS_ChannelSetAttributes(chan, song->evictAttrs.freq,
+	                          song->evictAttrs.vol, song->evictAttrs.pan);
+	BASS_ChannelGetInfo(chan, &info);
+	BASS_ChannelSetFlags(chan, (info.flags & ~BASS_SAMPLE_LOOP) |
+	                           song->evictLoop);
+	_bgm_DspMove(song, chan);
+	if (_bgm_BusActive() || bgm_meterOn)
+		_bgm_DspAttach(song);
+
+	// And where it was, as _bgm_PcmSwap() puts a song
+	if (!BASS_ChannelSetPosition(chan, BASS_ChannelSeconds2Bytes(chan,
+	                                                   song->evictPos)))
+		BASS_ChannelSetPosition(chan, MAKELONG((WORD)song->evictPos, 0xFFFF));
+	if (song->evictActive == BASS_ACTIVE_PAUSED) {
+		BASS_ChannelPlay(chan, FALSE);
+		BASS_ChannelPause(chan);
+	}
+
+	// A registered song is turned down to its normalised loudness the
+	// first time, as _bgm_Load_Part2() does; after that the gain is in the
+	// volume that was kept
+	if (first && bgm_config.normalize) {
+		_bgm_LoudPrepare(song);
+		_bgm_LoudApply(song);
+	}
+
+	_bgm_CmdSnapSong(song);
+
+	// Back onto its PCM cache, if it was on one, or have one made
+	if (song->evictType == BASS_CTYPE_MUSIC_MOD && bgm_config.modCache) {
+		if (first)
+			_bgm_PcmPrepare(song);
+		else
+			_bgm_PcmUse(song);
+	}
+
+	return TRUE;
+}
+
+/*	_bgm_MemTouch() -
+		Internal function that marks a song as just used. */
+void _bgm_MemTouch( SONG *song )
+{
+	if (!song)
+		return;
+
+	_bgm_LazyIdle(song);
+
+	song->lastUse = GetTickCount();
+	if (song->evicted && _bgm_MemReload(song))
+		_bgm_MemEnforce(song);
+}
+
+/*	_bgm_MemFreeRef() -
+		Internal function that moves a song's ID on from a taken one. */
+void _bgm_MemFreeRef( SONG *song )
+{
+	SONG *node;
+	BOOL taken;
+
+	do {
+		taken = FALSE;
+		for (node = bgm_song; node; node = node->next) {
+			if (node != song && node->ref == song->ref) {
+				taken = TRUE;
+				song->ref++;
+				break;
+			}
+		}
+	} while (taken);
+}
+
+/* END OF FILE */
@@ -0,0 +1,84 @@
+/******************************************************************************
+ *
+ *	bgm_mem.h -
+ *		Prototypes for the memory budget. BGM keeps an estimate of the
+ *		memory each song holds (the "memory" attribute, in bytes) and of all
+ *		of them together ("memtotal"). With a budget set, by
+ *		bgm_SetMemoryBudget() or the "membudget" global attribute, loading
+ *		a song that takes the total over it evicts songs that aren't
+ *		playing, the one used longest ago first, until it fits again.
+ *
+ *		An evicted song keeps its ID, filename, effects and attributes, but
+ *		its BASS channel and everything under it is freed. The next time it
+ *		is used it is loaded again, where it was and as it was, before the
+ *		call goes on. Anything that looks a song up counts as using it,
+ *		except bgm_IsLoaded*(), bgm_IsPlaying*(), bgm_GetPos*(),
+ *		bgm_GetLen*(), bgm_Unload*() and reading the "memory" attribute, so
+ *		that keeping an eye on songs doesn't bring them all back.
+ *
+ *****************************************************************************/
+
+#ifndef BGM_MEM_H
+#define BGM_MEM_H
+
+/******************************************************************************
+ * Function prototypes
+ *****************************************************************************/
+
+/*	bgm_SetMemoryBudget() -
+		Sets the most memory, in bytes, the songs are to hold between them,
+		or 0 for no limit, and evicts songs until they fit.
+		Returns 1 on success, 0 on failure. */
+DLL_FUNC
+GM_REAL bgm_SetMemoryBudget( GM_REAL bytes );
+
+/*	_bgm_MemBytes() -
+		Internal function that estimates the memory a song holds, in bytes:
+		a sample's decoded data, a module's file (which is about what BASS
+		keeps of it) and the buffers of a stream, its read-ahead buffer
+		included. Evicted songs hold none. */
+DWORD _bgm_MemBytes( SONG *song );
+
+/*	_bgm_MemTotal() -
+		Internal function that adds up the memory every song in the calling
+		thread's context holds. */
+DWORD _bgm_MemTotal( );
+
+/*	_bgm_MemEnforce() -
+		Internal function that evicts songs until the total fits the budget,
+		the one used longest ago first. except is never evicted; it may be
+		NULL. Does nothing if there is no budget. */
+void _bgm_MemEnforce( SONG *except );
+
+/*	_bgm_MemEvictable() -
+		Internal function that returns whether a song can be evicted. The
+		Quick Play song can't, nor can internet streams, samples with
+		voices, modules whose attributes have been changed, and songs that
+		are playing, virtual or sliding. */
+BOOL _bgm_MemEvictable( SONG *song );
+
+/*	_bgm_MemEvict() -
+		Internal function that frees a song's BASS channel, keeping what is
+		needed to load it again. */
+void _bgm_MemEvict( SONG *song );
+
+/*	_bgm_MemReload() -
+		Internal function that loads an evicted song again and puts it back
+		as it was.
+		Returns FALSE if it couldn't be, in which case it stays evicted. */
+BOOL _bgm_MemReload( SONG *song );
+
+/*	_bgm_MemTouch() -
+		Internal function that marks a song as just used, loading it again
+		first if it was evicted. Safe to call with NULL. */
+void _bgm_MemTouch( SONG *song );
+
+/*	_bgm_MemFreeRef() -
+		Internal function that moves a song's ID on from its channel handle
+		if an evicted song was given the same one: BASS may hand out a freed
+		handle again. */
+void _bgm_MemFreeRef( SONG *song );
+
+#endif // BGM_MEM_H
+
+/* END OF FILE */
@@ -0,0 +1,174 @@
+/******************************************************************************
+ *
+ *	bgm_meter.c -
+ *		Implementation of BGM's level meters.
+ *
+ *	BASS 2.3 can't be asked for the level of the final mix, so the master
+ *	levels are put together from the songs' own when they are read: peaks
+ *	add up (which is what the limiter assumes too) and RMS levels add up as
+ *	power, as they would for unrelated sounds.
+ *
+ *****************************************************************************/
+
+#include "bgm.h"
+
+/******************************************************************************
+ * Globals
+ *****************************************************************************/
+
+BOOL bgm_meterOn = FALSE;		// Do song DSPs measure levels?
+float bgm_meterHold = 0.0f;		// Master peak-hold level...
+DWORD bgm_meterTick = 0;		// ...and when the meters were last read
+
+/******************************************************************************
+ * Function implementations
+ *****************************************************************************/
+
+/*	_bgm_MeterProcess() -
+		Internal function that measures count interleaved samples of chans
+		channels into the song's meter. Called from the song's DSP with the
+		lock held. */
+void _bgm_MeterProcess( METERTAP    *meter,
+                        const float *buf,
+                        DWORD       count,
+                        DWORD       chans,
+                        DWORD       freq,
+                        float       scale )
+{
+	float fall;
+
+	if (count == 0)
+		return;
+
+	meter->peak = _bgm_DspPeak(buf, count)*scale;
+	meter->rms = (float)sqrt(_bgm_DspSumSquares(buf, count)/count)*scale;
+
+	// Let the hold fall for as long as this block lasted
+	fall = (float)pow(10.0, -BGM_METER_FALL/20.0*(count/chans)/freq);
+	meter->hold *= fall;
+	if (meter->peak > meter->hold)
+		meter->hold = meter->peak;
+	meter->fresh = TRUE;
+}
+
+/*	_bgm_MeterStart() -
+		Internal function that turns metering on. */
+void _bgm_MeterStart( )
+{
+	SONG *node;
+
+	bgm_meterTick = GetTickCount();
+	if (bgm_meterOn)
+		return;
+
+	// Whatever was measured before it went off is long out of date
+	for (node = bgm_song; node; node = node->next) {
+		if (!node->dsp)
+			continue;
+		EnterCriticalSection(&node->dsp->lock);
+		memset(&node->dsp->meter, 0, sizeof(METERTAP));
+		LeaveCriticalSection(&node->dsp->lock);
+	}
+	bgm_meterHold = 0.0f;
+
+	// Songs need a DSP to be measured in
+	bgm_meterOn = TRUE;
+	_bgm_DspAttachAll();
+}
+
+/*	_bgm_MeterLapse() -
+		Internal function that turns metering off once nothing reads it. */
+void _bgm_MeterLapse( )
+{
+	if (bgm_meterOn && GetTickCount() - bgm_meterTick > BGM_METER_LAPSE)
+		bgm_meterOn = FALSE;
+}
+
+/*	bgm_MetersRead() -
+		Writes the levels of the master output and of every loaded song into
+		a GM buffer as 64-bit floats.
+		Returns the number of songs written, or -1 on failure. */
+DLL_FUNC
+GM_REAL bgm_MetersRead( GM_STRING bufferAddress,
+                        GM_REAL   size )
+{
+	double *out = (double*)bufferAddress, *entry;
+	DWORD max, n = 0, tick, active;
+	float peak = 0.0f, power = 0.0f, fall;
+	SONG *node;
+	SONGDSP *dsp;
+
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdCall(BGM_CMD_METERSREAD, "pr", bufferAddress, size);
+
+	ERROR_CONTEXT("Failed to read meters");
+
+	/* ERROR HANDLER */
+	if (!out) {
+		BGM_ERROR("Invalid buffer address.");
+		return -1;
+	}
+	if (size < sizeof(double)*BGM_METER_STRIDE) {
+		BGM_ERROR("Buffer is too small (needs at least %i bytes).",
+		          (int)(sizeof(double)*BGM_METER_STRIDE));
+		return -1;
+	}
+	max = (DWORD)size/(sizeof(double)*BGM_METER_STRIDE) - 1;
+
+	// Levels fall in real time between reads wherever nothing new has
+	// been measured
+	tick = GetTickCount();
+	fall = (float)pow(10.0, -BGM_METER_FALL/20.0*(tick-bgm_meterTick)/1000.0);
+
+	// Reading them keeps them on, or turns them on again
+	_bgm_MeterStart();
+
+	// One pass over the songs for both their own entries and the master
+	for (node = bgm_song; node; node = node->next) {
+		dsp = node->dsp;
+		if (!node->id || !dsp)
+			continue;
+		active = BASS_ChannelIsActive(node->id);
+
+		EnterCriticalSection(&dsp->lock);
+		// The DSP only runs while the song plays, so a stopped or paused
+		// song has no level, and one it hasn't run for since the last read
+		// is falling
+		if (active != BASS_ACTIVE_PLAYING) {
+			dsp->meter.peak = 0.0f;
+			dsp->meter.rms = 0.0f;
+			dsp->meter.hold *= fall;
+		}
+		else if (!dsp->meter.fresh) {
+			dsp->meter.peak *= fall;
+			dsp->meter.rms *= fall;
+			dsp->meter.hold *= fall;
+		}
+		dsp->meter.fresh = FALSE;
+		peak += dsp->meter.peak;
+		power += dsp->meter.rms*dsp->meter.rms;
+		if (n < max) {
+			entry = out + (n+1)*BGM_METER_STRIDE;
+			entry[0] = node->ref;
+			entry[1] = dsp->meter.peak;
+			entry[2] = dsp->meter.rms;
+			entry[3] = dsp->meter.hold;
+			n++;
+		}
+		LeaveCriticalSection(&dsp->lock);
+	}
+
+	// The master hold falls the same way
+	bgm_meterHold *= fall;
+	if (peak > bgm_meterHold)
+		bgm_meterHold = peak;
+
+	out[0] = n;
+	out[1] = peak;
+	out[2] = sqrt(power);
+	out[3] = bgm_meterHold;
+
+	return n;
+}
+
+/* END OF FILE */
@@ -0,0 +1,95 @@
+/******************************************************************************
+ *
+ *	bgm_meter.h -
+ *		Prototypes and types for BGM's level meters. Every song's DSP keeps
+ *		its own peak, RMS and peak-hold levels, and bgm_MetersRead() hands
+ *		all of them (plus the master output) to GM in one go.
+ *
+ *****************************************************************************/
+
+#ifndef BGM_METER_H
+#define BGM_METER_H
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// How fast the peak-hold levels fall, in dB per second
+#define BGM_METER_FALL 20.0
+
+// Values written per entry in the meter buffer (see bgm_MetersRead())
+#define BGM_METER_STRIDE 4
+
+// How long (ms) songs keep being measured after the meters were last read
+#define BGM_METER_LAPSE 1000
+
+/******************************************************************************
+ * Typedefs, structs, etc.
+ *****************************************************************************/
+
+/*	METERTAP -
+		Levels of one song over its last DSP block, as heard (after its
+		effects, the bus and its volume). Written by the song's DSP with its
+		lock held.
+*/
+typedef struct ctagMETERTAP {
+	float	peak;	// Peak level
+	float	rms;	// RMS level
+	float	hold;	// Peak level, falling at BGM_METER_FALL
+	BOOL	fresh;	// Measured since the levels were last read
+} METERTAP;
+
+/******************************************************************************
+ * Global externs
+ *****************************************************************************/
+
+extern BOOL bgm_meterOn;
+extern DWORD bgm_meterTick;
+
+/******************************************************************************
+ * Function prototypes
+ *****************************************************************************/
+
+/*	_bgm_MeterProcess() -
+		Internal function that measures count interleaved samples of chans
+		channels into the song's meter. scale is how much the song is turned
+		down after its DSP (channel and global volume). Called from the
+		song's DSP with the lock held. */
+void _bgm_MeterProcess( METERTAP    *meter,
+                        const float *buf,
+                        DWORD       count,
+                        DWORD       chans,
+                        DWORD       freq,
+                        float       scale );
+
+/*	_bgm_MeterStart() -
+		Internal function that turns metering on, with every song's levels
+		starting from 0. Does nothing if it's on already. */
+void _bgm_MeterStart( );
+
+/*	_bgm_MeterLapse() -
+		Internal function that turns metering off if the meters haven't been
+		read for BGM_METER_LAPSE ms. Called from songs' DSPs. */
+void _bgm_MeterLapse( );
+
+/*	bgm_MetersRead() -
+		Writes the levels of the master output and of every loaded song into
+		a GM buffer as 64-bit floats (buffer_f64). bufferAddress is what
+		buffer_get_address() gives and size is the buffer's size in bytes.
+		The layout is
+			song count, master peak, master RMS, master peak-hold,
+		followed by one
+			song ID, peak, RMS, peak-hold
+		for each song that fits. Levels are linear, 1 being full scale.
+		The first call turns metering on, so levels read 0 until songs have
+		played on for a moment, and it stays on for as long as the meters
+		are read at least every BGM_METER_LAPSE ms (or until the "meters"
+		global attribute is set to 0).
+		Returns the number of songs written, or -1 on failure. */
+DLL_FUNC
+GM_REAL bgm_MetersRead( GM_STRING bufferAddress,
+                        GM_REAL   size );
+
+#endif // BGM_METER_H
+
+/* END OF FILE */
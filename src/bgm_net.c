@@ -0,0 +1,212 @@
+/******************************************************************************
+ *
+ *	bgm_net.c -
+ *		Implementation of BGM's internet stream cache.
+ *
+ *	A URL's cache is "<folder>\<hash>.net", where hash is the FNV-1a hash
+ *	of the URL, and holds exactly the bytes the server sent. Next to it,
+ *	"<hash>.net.key" holds BGM_NET_MAGIC, BGM_CACHE_VERSION and the length
+ *	of the cache as DWORDs, followed by the URL itself, so that a hash
+ *	collision or a cache cut short is never played. The key is written
+ *	last, so a cache without one is never used.
+ *
+ *	The cache only checks that a download is complete, not that the file
+ *	on the server hasn't changed since; empty the folder to start over.
+ *
+ *****************************************************************************/
+
+#include "bgm.h"
+
+/******************************************************************************
+ * Function implementations
+ *****************************************************************************/
+
+/*	_bgm_NetPath() -
+		Internal function that puts the path of a URL's cache file in
+		path. */
+void _bgm_NetPath( const char *url,
+                   char       *path )
+{
+	DWORD hash = 2166136261u;
+	const char *c;
+
+	for (c = url; *c; c++) {
+		hash ^= (BYTE)*c;
+		hash *= 16777619u;
+	}
+	sprintf(path, "%s\\%08X%s", bgm_config.netCache, hash, BGM_NET_EXT);
+}
+
+/*	_bgm_NetValid() -
+		Internal function that checks whether a URL has a complete cache
+		file. Returns TRUE if it can be played from there. */
+BOOL _bgm_NetValid( const char *url,
+                    char       *path )
+{
+	char keyPath[512+32+4], keyUrl[512];
+	DWORD head[3];
+	struct stat st;
+	FILE *f;
+	size_t n;
+	BOOL ok;
+
+	_bgm_NetPath(url, path);
+	sprintf(keyPath, "%s.key", path);
+
+	f = fopen(keyPath, "rb");
+	if (!f)
+		return FALSE;
+	ok = fread(head, sizeof(DWORD), 3, f) == 3 &&
+	     head[0] == BGM_NET_MAGIC && head[1] == BGM_CACHE_VERSION;
+	n = fread(keyUrl, 1, sizeof(keyUrl)-1, f);
+	keyUrl[n] = 0;
+	fclose(f);
+
+	return ok && strcmp(keyUrl, url) == 0 &&
+	       stat(path, &st) == 0 && (DWORD)st.st_size == head[2];
+}
+
+/*	_bgm_NetStart() -
+		Internal function that starts caching a download of the given URL.
+		Returns NULL if the cache can't be written. */
+NETCACHE* _bgm_NetStart( const char *url )
+{
+	NETCACHE *net;
+
+	net = NEW(NETCACHE,1);
+	if (!net)
+		return NULL;
+	memset(net, 0, sizeof(NETCACHE));
+	strcpy(net->url, url);
+	_bgm_NetPath(url, net->path);
+
+	// Named after the NETCACHE too, in case the URL is loaded twice at once
+	sprintf(net->part, "%s.%08X.part", net->path, (DWORD)(size_t)net);
+	net->user = _bgm_UserNew(net);
+	if (!net->user) {
+		free(net);
+		return NULL;
+	}
+	net->f = fopen(net->part, "wb");
+	if (!net->f) {
+		_bgm_UserFree(net->user);
+		free(net);
+		return NULL;
+	}
+
+	InitializeCriticalSection(&net->lock);
+	return net;
+}
+
+/*	_bgm_NetAttach() -
+		Internal function that tells the cache which stream is downloading
+		into it. */
+void _bgm_NetAttach( NETCACHE *net,
+                     DWORD    handle )
+{
+	EnterCriticalSection(&net->lock);
+	net->handle = handle;
+	// Small files can be done before BASS_StreamCreateURL() returns
+	if (net->complete && net->f)
+		_bgm_NetCommit(net);
+	LeaveCriticalSection(&net->lock);
+}
+
+/*	_bgm_NetDownloadProc() -
+		The DOWNLOADPROC given to BASS for cached internet streams. */
+void CALLBACK _bgm_NetDownloadProc( const void *buffer,
+                                    DWORD      length,
+                                    DWORD      user )
+{
+	NETCACHE *net = (NETCACHE*)_bgm_UserGet(user);
+
+	EnterCriticalSection(&net->lock);
+
+	if (net->f) {
+		// NULL means the download has finished
+		if (!buffer) {
+			net->complete = TRUE;
+			if (net->handle)
+				_bgm_NetCommit(net);
+		}
+		else if (net->bytes + length > BGM_NET_MAXSIZE ||
+		         fwrite(buffer, 1, length, net->f) != length) {
+			// Too big to keep, or the disk is full
+			fclose(net->f);
+			net->f = NULL;
+			remove(net->part);
+		}
+		else
+			net->bytes += length;
+	}
+
+	LeaveCriticalSection(&net->lock);
+}
+
+/*	_bgm_NetCommit() -
+		Internal function that checks the download and puts the cache and
+		its key in place. Returns TRUE if the cache was saved. */
+BOOL _bgm_NetCommit( NETCACHE *net )
+{
+	char keyPath[512+32+4];
+	DWORD head[3], len;
+	FILE *f;
+	BOOL ok;
+
+	sprintf(keyPath, "%s.key", net->path);
+	ok = !ferror(net->f);
+	fclose(net->f);
+	net->f = NULL;
+
+	// The server's length, if it gave one, has to match
+	len = BASS_StreamGetFilePosition(net->handle, BASS_FILEPOS_END);
+	if (len != (DWORD)-1 && len != net->bytes)
+		ok = FALSE;
+	if (!ok || net->bytes == 0) {
+		remove(net->part);
+		return FALSE;
+	}
+
+	// Old key first, so there's never a key for the wrong file
+	remove(keyPath);
+	remove(net->path);
+	if (rename(net->part, net->path) != 0) {
+		remove(net->part);
+		return FALSE;
+	}
+
+	f = fopen(keyPath, "wb");
+	if (!f)
+		return FALSE;
+	head[0] = BGM_NET_MAGIC;
+	head[1] = BGM_CACHE_VERSION;
+	head[2] = net->bytes;
+	fwrite(head, sizeof(DWORD), 3, f);
+	fwrite(net->url, 1, strlen(net->url), f);
+	ok = !ferror(f);
+	fclose(f);
+	if (!ok)
+		remove(keyPath);
+	return ok;
+}
+
+/*	_bgm_NetFree() -
+		Internal function that frees a NETCACHE once BASS is done with it.
+		Safe to call with NULL. */
+void _bgm_NetFree( NETCACHE *net )
+{
+	if (!net)
+		return;
+
+	// Unloaded before the download finished
+	if (net->f) {
+		fclose(net->f);
+		remove(net->part);
+	}
+
+	_bgm_UserFree(net->user);
+	DeleteCriticalSection(&net->lock);
+	free(net);
+}
+
+/* END OF FILE */
@@ -0,0 +1,101 @@
+/******************************************************************************
+ *
+ *	bgm_net.h -
+ *		Prototypes and types for BGM's internet stream cache. While the
+ *		"netcache" global attribute names a folder, every internet stream
+ *		writes what it downloads to a file in that folder, and once a
+ *		download has finished and checked out, later loads of the same URL
+ *		play the file from disk instead of downloading it again.
+ *
+ *****************************************************************************/
+
+#ifndef BGM_NET_H
+#define BGM_NET_H
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// Cache file extension (the key file adds ".key") and the key's magic number
+#define BGM_NET_EXT   ".net"
+#define BGM_NET_MAGIC 0x4E4D4742 /* "BGMN" */
+
+// Downloads bigger than this (radio stations, mostly) aren't cached
+#define BGM_NET_MAXSIZE (64*1024*1024)
+
+/******************************************************************************
+ * Typedefs, structs, etc.
+ *****************************************************************************/
+
+/*	NETCACHE -
+		A download being written to the cache. BASS calls the download
+		callback on a thread of its own, so everything here is guarded by
+		lock.
+*/
+typedef struct ctagNETCACHE {
+	FILE	*f;				// The cache being written (under a temporary
+							// name), or NULL once it is finished with
+	char	path[512+32];	// Where it goes once the download is complete
+	char	part[512+48];	// Where it is written until then
+	char	url[512];		// The URL being downloaded
+	DWORD	bytes;			// How much has been written
+	DWORD	handle;			// The stream, once BASS has returned it
+	BOOL	complete;		// The download has finished
+	DWORD	user;			// What to give BASS as the callback's user
+	CRITICAL_SECTION lock;
+} NETCACHE;
+
+/******************************************************************************
+ * Function prototypes
+ *****************************************************************************/
+
+/*	_bgm_NetPath() -
+		Internal function that puts the path of a URL's cache file in path,
+		which needs room for 512+32 characters. */
+void _bgm_NetPath( const char *url,
+                   char       *path );
+
+/*	_bgm_NetValid() -
+		Internal function that checks whether a URL has a complete cache file
+		and puts its path in path.
+		Returns TRUE if it can be played from there. */
+BOOL _bgm_NetValid( const char *url,
+                    char       *path );
+
+/*	_bgm_NetStart() -
+		Internal function that starts caching a download of the given URL,
+		for BASS_StreamCreateURL() with _bgm_NetDownloadProc and the
+		NETCACHE's user value.
+		Returns NULL if the cache can't be written. */
+NETCACHE* _bgm_NetStart( const char *url );
+
+/*	_bgm_NetAttach() -
+		Internal function that tells the cache which stream is downloading
+		into it, once BASS_StreamCreateURL() has returned. */
+void _bgm_NetAttach( NETCACHE *net,
+                     DWORD    handle );
+
+/*	_bgm_NetDownloadProc() -
+		The DOWNLOADPROC given to BASS for cached internet streams. Writes
+		what is downloaded through to the cache, and puts the cache in place
+		when the download finishes. */
+void CALLBACK _bgm_NetDownloadProc( const void *buffer,
+                                    DWORD      length,
+                                    DWORD      user );
+
+/*	_bgm_NetCommit() -
+		Internal function, called with the lock held once the download is
+		complete and the stream is known, that checks the download against
+		the length the server gave and puts the cache and its key in place.
+		Returns TRUE if the cache was saved. */
+BOOL _bgm_NetCommit( NETCACHE *net );
+
+/*	_bgm_NetFree() -
+		Internal function that frees a NETCACHE once BASS is done with it,
+		throwing away the download if it never finished. Safe to call with
+		NULL. */
+void _bgm_NetFree( NETCACHE *net );
+
+#endif // BGM_NET_H
+
+/* END OF FILE */
@@ -0,0 +1,442 @@
+/******************************************************************************
+ *
+ *	bgm_pcm.c -
+ *		Implementation of BGM's module PCM cache.
+ *
+ *	The cache of "song.it" is "song.it.pcm.wav", an ordinary WAV file (so
+ *	BASS can stream it like any other) with a chunk after the audio that
+ *	holds BGM_PCM_MAGIC, BGM_CACHE_VERSION and the CACHEKEY of the module,
+ *	as DWORDs. It is rendered at the device's rate, in the sample format
+ *	modules are loaded with, with the module's own attribute values; like
+ *	the rest of the analysis, rendering stops at the first backward jump,
+ *	so a module that loops that way loops from the start when played from
+ *	its cache. After the key comes the row table (see PCMROWS): how many
+ *	rows, then the frame each starts at, then their order positions, all
+ *	DWORDs. Rows are noted between blocks of BGM_PCM_ROWBLOCK ms, so the
+ *	order and row read from the cache can be up to that late.
+ *
+ *	A song on its cache has the cache stream as its id and the module as
+ *	its music; the ID given to GM (ref) is the module's, so it doesn't
+ *	change when the song moves from one to the other.
+ *
+ *****************************************************************************/
+
+#include "bgm.h"
+
+/******************************************************************************
+ * Function implementations
+ *****************************************************************************/
+
+/*	_bgm_PcmValid() -
+		Internal function that checks whether a file's PCM cache is there
+		and was made from this version of the file. */
+BOOL _bgm_PcmValid( const char     *fname,
+                    const CACHEKEY *key )
+{
+	char path[512+32];
+	BYTE head[44];
+	DWORD chunk[7];
+	FILE *f;
+	BOOL ok;
+
+	sprintf(path, "%s%s", fname, BGM_PCM_EXT);
+	f = fopen(path, "rb");
+	if (!f)
+		return FALSE;
+
+	// The key chunk comes straight after the audio
+	ok = fread(head, 1, 44, f) == 44 &&
+	     memcmp(head, "RIFF", 4)==0 && memcmp(head+36, "data", 4)==0 &&
+	     fseek(f, 44 + *(DWORD*)(head+40), SEEK_SET) == 0 &&
+	     fread(chunk, sizeof(DWORD), 7, f) == 7 &&
+	     memcmp(chunk, "bgmk", 4)==0 && chunk[1] >= 6*sizeof(DWORD) &&
+	     chunk[2] == BGM_PCM_MAGIC &&
+	     chunk[3] == BGM_CACHE_VERSION && chunk[4] == key->size &&
+	     chunk[5] == key->mtime && chunk[6] == key->hash;
+
+	fclose(f);
+	return ok;
+}
+
+/*	_bgm_PcmStart() -
+		Internal function that starts writing a file's PCM cache.
+		Returns FALSE if the cache can't be written. */
+BOOL _bgm_PcmStart( PCMSTATE   *state,
+                    const char *fname,
+                    DWORD      freq,
+                    DWORD      chans,
+                    BOOL       useFloat )
+{
+	sprintf(state->path, "%s%s.part", fname, BGM_PCM_EXT);
+	state->f = fopen(state->path, "wb");
+	if (!state->f)
+		return FALSE;
+
+	state->freq = freq ? freq : 44100;
+	state->chans = chans ? chans : 1;
+	state->useFloat = useFloat;
+	state->dataBytes = 0;
+	state->frames = 0;
+	state->rows = NEW(PCMROWS,1);
+	if (state->rows)
+		memset(state->rows, 0, sizeof(PCMROWS));
+
+	// Sizes are filled in at the end
+	_bgm_RenderWavHeader(state->f, state->freq, state->chans, useFloat, 0, 0);
+	return TRUE;
+}
+
+/*	_bgm_PcmFeed() -
+		Internal function that adds frames interleaved float frames to the
+		cache. */
+void _bgm_PcmFeed( PCMSTATE    *state,
+                   const float *buf,
+                   DWORD       frames )
+{
+	short pcm[4096];
+	DWORD count = frames*state->chans, n, i;
+	float v;
+
+	state->frames += frames;
+
+	if (state->useFloat) {
+		fwrite(buf, sizeof(float), count, state->f);
+		state->dataBytes += count*sizeof(float);
+		return;
+	}
+
+	while (count) {
+		n = (count > 4096) ? 4096 : count;
+		for (i=0; i<n; i++) {
+			v = buf[i]*32767.0f;
+			if (v > 32767.0f) v = 32767.0f;
+			if (v < -32768.0f) v = -32768.0f;
+			pcm[i] = (short)floor(v+0.5f);
+		}
+		fwrite(pcm, sizeof(short), n, state->f);
+		state->dataBytes += n*sizeof(short);
+		buf += n;
+		count -= n;
+	}
+}
+
+/*	_bgm_PcmMark() -
+		Internal function that notes the order and row the module is at. */
+void _bgm_PcmMark( PCMSTATE *state,
+                   DWORD    orderPos )
+{
+	PCMROWS *rows = state->rows;
+	DWORD room, *frame, *pos;
+
+	if (!rows || orderPos == (DWORD)-1 ||
+	    (rows->count && rows->pos[rows->count-1] == orderPos))
+		return;
+
+	if (rows->count == rows->room) {
+		room = rows->room ? rows->room*2 : 256;
+		frame = RESIZE(rows->frame, DWORD, room);
+		if (frame)
+			rows->frame = frame;
+		pos = frame ? RESIZE(rows->pos, DWORD, room) : NULL;
+		if (pos)
+			rows->pos = pos;
+		// Without room for it the table would be wrong from here on, so
+		// there is none
+		if (!pos) {
+			_bgm_PcmRowsFree(rows);
+			state->rows = NULL;
+			return;
+		}
+		rows->room = room;
+	}
+
+	rows->frame[rows->count] = state->frames;
+	rows->pos[rows->count] = orderPos;
+	rows->count++;
+}
+
+/*	_bgm_PcmFinish() -
+		Internal function that finishes the cache and puts it in place, or
+		throws it away if keep is FALSE.
+		Returns TRUE if the cache was saved. */
+BOOL _bgm_PcmFinish( PCMSTATE       *state,
+                     const char     *fname,
+                     const CACHEKEY *key,
+                     BOOL           keep )
+{
+	char path[512+32];
+	DWORD chunk[8], count;
+
+	if (keep) {
+		count = state->rows ? state->rows->count : 0;
+		memcpy(chunk, "bgmk", 4);
+		chunk[1] = (6 + 2*count)*sizeof(DWORD);
+		chunk[2] = BGM_PCM_MAGIC;
+		chunk[3] = BGM_CACHE_VERSION;
+		chunk[4] = key->size;
+		chunk[5] = key->mtime;
+		chunk[6] = key->hash;
+		chunk[7] = count;
+		fwrite(chunk, sizeof(DWORD), 8, state->f);
+		if (count) {
+			fwrite(state->rows->frame, sizeof(DWORD), count, state->f);
+			fwrite(state->rows->pos, sizeof(DWORD), count, state->f);
+		}
+
+		fseek(state->f, 0, SEEK_SET);
+		_bgm_RenderWavHeader(state->f, state->freq, state->chans,
+		                     state->useFloat, state->dataBytes,
+		                     2*sizeof(DWORD) + chunk[1]);
+		keep = !ferror(state->f);
+	}
+	fclose(state->f);
+	state->f = NULL;
+
+	if (!keep) {
+		remove(state->path);
+		return FALSE;
+	}
+
+	// Put it in place of the old one (rename() won't replace files)
+	sprintf(path, "%s%s", fname, BGM_PCM_EXT);
+	remove(path);
+	if (rename(state->path, path) != 0) {
+		remove(state->path);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/*	_bgm_PcmPrepare() -
+		Internal function, called when a module is loaded with the cache on,
+		that moves the song onto its PCM cache or has one made. */
+void _bgm_PcmPrepare( SONG *song )
+{
+	ANALYSIS *entry;
+	CACHEKEY key;
+	PCMROWS *rows;
+	BOOL known;
+
+	if (!song->id || _bgm_FnameIsUrl(song->fname))
+		return;
+
+	EnterCriticalSection(&bgm_anLock);
+	entry = _bgm_AnalyzeFind(song->fname, TRUE);
+	known = !entry || ((entry->want | entry->done | entry->failed |
+	                    entry->running) & AN_PCM);
+	LeaveCriticalSection(&bgm_anLock);
+
+	// Made last time? Then check it now rather than wait for the worker
+	if (!known) {
+		if (_bgm_CacheKey(song->fname, &key) &&
+		    _bgm_PcmValid(song->fname, &key)) {
+			rows = _bgm_PcmRowsLoad(song->fname);
+			EnterCriticalSection(&bgm_anLock);
+			_bgm_PcmRowsFree(entry->rows);
+			entry->rows = rows;
+			entry->done |= AN_PCM;
+			LeaveCriticalSection(&bgm_anLock);
+		}
+		else
+			_bgm_AnalyzeGet(song, AN_PCM);
+	}
+
+	_bgm_PcmUse(song);
+}
+
+/*	_bgm_PcmUse() -
+		Internal function that moves a module onto its PCM cache if one has
+		been made and none of its module attributes have been changed.
+		Returns TRUE if the song is playing from its cache. */
+BOOL _bgm_PcmUse( SONG *song )
+{
+	BASS_CHANNELINFO info;
+	ANALYSIS *entry;
+	char path[512+32];
+	DWORD stream, music;
+	BOOL ready;
+
+	if (!song || !song->id || song->modDirty)
+		return FALSE;
+	if (song->music)
+		return TRUE;
+
+	// Only modules have caches
+	if (!BASS_ChannelGetInfo(song->id, &info) ||
+	    !(info.ctype & BASS_CTYPE_MUSIC_MOD))
+		return FALSE;
+
+	EnterCriticalSection(&bgm_anLock);
+	entry = _bgm_AnalyzeFind(song->fname, FALSE);
+	ready = entry && (entry->done & AN_PCM);
+	LeaveCriticalSection(&bgm_anLock);
+	if (!ready)
+		return FALSE;
+
+	sprintf(path, "%s%s", song->fname, BGM_PCM_EXT);
+	stream = BASS_StreamCreateFile(FALSE, path, 0, 0,
+	                               bgm_config.use32Bit ? BASS_SAMPLE_FLOAT : 0);
+	if (!stream)
+		return FALSE;
+
+	music = song->id;
+	_bgm_PcmSwap(song, stream);
+	song->music = music;
+	return TRUE;
+}
+
+/*	_bgm_PcmGoLive() -
+		Internal function that moves a song playing from its PCM cache back
+		onto the module, and keeps it there. Safe to call on any song. */
+void _bgm_PcmGoLive( SONG *song )
+{
+	DWORD stream;
+
+	if (!song || !song->music)
+		return;
+
+	stream = song->id;
+	_bgm_PcmSwap(song, song->music);
+	song->music = 0;
+	song->modDirty = TRUE;
+	BASS_StreamFree(stream);
+}
+
+/*	_bgm_PcmSwap() -
+		Internal function that moves a song from its channel to another one
+		that plays the same audio. */
+void _bgm_PcmSwap( SONG  *song,
+                   DWORD chan )
+{
+	BASS_CHANNELINFO info;
+	DWORD from = song->id, freq, vol, active, loop;
+	int pan;
+	float secs;
+
+	// Channel attributes and the loop flag
+	BASS_ChannelGetAttributes(from, &freq, &vol, &pan);
+	BASS_ChannelSetAttributes(chan, freq, vol, pan);
+	BASS_ChannelGetInfo(from, &info);
+	loop = info.flags & BASS_SAMPLE_LOOP;
+	BASS_ChannelGetInfo(chan, &info);
+	BASS_ChannelSetFlags(chan, (info.flags & ~BASS_SAMPLE_LOOP) | loop);
+
+	// Effects, meters and the rest
+	_bgm_DspMove(song, chan);
+	song->id = chan;
+	_bgm_CmdSnapSong(song);
+
+	// Pick up where the old channel is. Modules can also be given a
+	// position as MAKELONG(seconds,0xFFFF) if bytes don't work.
+	active = BASS_ChannelIsActive(from);
+	secs = BASS_ChannelBytes2Seconds(from, BASS_ChannelGetPosition(from));
+	if (!BASS_ChannelSetPosition(chan, BASS_ChannelSeconds2Bytes(chan, secs)))
+		BASS_ChannelSetPosition(chan, MAKELONG((WORD)secs, 0xFFFF));
+	if (active == BASS_ACTIVE_PLAYING || active == BASS_ACTIVE_STALLED)
+		BASS_ChannelPlay(chan, FALSE);
+	else if (active == BASS_ACTIVE_PAUSED) {
+		BASS_ChannelPlay(chan, FALSE);
+		BASS_ChannelPause(chan);
+	}
+	BASS_ChannelStop(from);
+}
+
+/*	_bgm_PcmRowsLoad() -
+		Internal function that reads the row table of a file's PCM cache.
+		Returns the table, or NULL if it can't be read. */
+PCMROWS* _bgm_PcmRowsLoad( const char *fname )
+{
+	char path[512+32];
+	BYTE head[44];
+	DWORD chunk[8];
+	PCMROWS *rows;
+	FILE *f;
+	BOOL ok;
+
+	sprintf(path, "%s%s", fname, BGM_PCM_EXT);
+	f = fopen(path, "rb");
+	if (!f)
+		return NULL;
+
+	// The count is checked against what is left before anything is
+	// allocated for it, as a sidecar's would be
+	ok = fread(head, 1, 44, f) == 44 &&
+	     fseek(f, 44 + *(DWORD*)(head+40), SEEK_SET) == 0 &&
+	     fread(chunk, sizeof(DWORD), 8, f) == 8 &&
+	     chunk[7] <= _bgm_CacheLeft(f)/(2*sizeof(DWORD));
+	rows = ok ? NEW(PCMROWS,1) : NULL;
+	if (!rows) {
+		fclose(f);
+		return NULL;
+	}
+	rows->count = rows->room = chunk[7];
+	rows->frame = NEW(DWORD, rows->count ? rows->count : 1);
+	rows->pos = NEW(DWORD, rows->count ? rows->count : 1);
+	ok = rows->frame && rows->pos &&
+	     fread(rows->frame, sizeof(DWORD), rows->count, f) == rows->count &&
+	     fread(rows->pos, sizeof(DWORD), rows->count, f) == rows->count;
+
+	fclose(f);
+	if (!ok) {
+		_bgm_PcmRowsFree(rows);
+		return NULL;
+	}
+	return rows;
+}
+
+/*	_bgm_PcmRowsFree() -
+		Internal function that frees a row table. */
+void _bgm_PcmRowsFree( PCMROWS *rows )
+{
+	if (!rows)
+		return;
+	free(rows->frame);
+	free(rows->pos);
+	free(rows);
+}
+
+/*	_bgm_PcmOrderPos() -
+		Internal function that works out the order and row a song playing
+		from its PCM cache is at. */
+DWORD _bgm_PcmOrderPos( SONG *song )
+{
+	BASS_CHANNELINFO info;
+	ANALYSIS *entry;
+	PCMROWS *rows;
+	DWORD frame, lo, hi, mid, ret = (DWORD)-1;
+
+	BASS_ChannelGetInfo(song->id, &info);
+	frame = (DWORD)(BASS_ChannelBytes2Seconds(song->id,
+	                BASS_ChannelGetPosition(song->id))*info.freq + 0.5f);
+
+	EnterCriticalSection(&bgm_anLock);
+	entry = _bgm_AnalyzeFind(song->fname, FALSE);
+	rows = entry ? entry->rows : NULL;
+	if (rows && rows->count) {
+		// The last row to start at or before the frame (or the first, if
+		// none has yet)
+		lo = 0;
+		hi = rows->count;
+		while (hi - lo > 1) {
+			mid = (lo + hi)/2;
+			if (rows->frame[mid] <= frame)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		ret = rows->pos[lo];
+	}
+	LeaveCriticalSection(&bgm_anLock);
+
+	return ret;
+}
+
+/*	_bgm_PcmModHandle() -
+		Internal function that returns the module handle of a song, whether
+		or not it is playing from its PCM cache. */
+DWORD _bgm_PcmModHandle( SONG *song )
+{
+	return song->music ? song->music : song->id;
+}
+
+/* END OF FILE */
@@ -0,0 +1,158 @@
+/******************************************************************************
+ *
+ *	bgm_pcm.h -
+ *		Prototypes and types for BGM's module PCM cache. Playing a module
+ *		means running BASS's tracker engine the whole time, which costs far
+ *		more CPU than streaming samples. While the "modcache" global
+ *		attribute is on, the first load of a module has it rendered to a WAV
+ *		file next to it in the background (by the analysis worker), and
+ *		later plays stream that instead. The module stays loaded underneath,
+ *		and the song goes back to it for good as soon as one of its module
+ *		attributes is changed. Where each row starts is noted as the cache
+ *		is rendered, so bgm_GetOrder*() and bgm_GetRow*() still work while
+ *		it is in use.
+ *
+ *****************************************************************************/
+
+#ifndef BGM_PCM_H
+#define BGM_PCM_H
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// Cache file extension and the magic number of its key chunk
+#define BGM_PCM_EXT   ".pcm.wav"
+#define BGM_PCM_MAGIC 0x4D435042 /* "BPCM" */
+
+// Most time (ms) decoded at once while a cache is rendered, which is how
+// late the order and row read from it can be
+#define BGM_PCM_ROWBLOCK 5
+
+/******************************************************************************
+ * Typedefs, structs, etc.
+ *****************************************************************************/
+
+/*	PCMROWS -
+		Where each row of a module starts in its PCM cache, in the order
+		they are played. Rows BASS_MusicGetOrderPosition() skipped over
+		between two decoded blocks aren't in it.
+*/
+typedef struct ctagPCMROWS {
+	DWORD	count;			// How many rows...
+	DWORD	room;			// ...and how many there is room for
+	DWORD	*frame;			// Sample frame each starts at
+	DWORD	*pos;			// Its MAKELONG(order,row)
+} PCMROWS;
+
+/*	PCMSTATE -
+		Working state of the cache writer while a module is decoded.
+*/
+typedef struct ctagPCMSTATE {
+	FILE	*f;				// The cache being written (under a temporary
+							// name, so it is never played half done)
+	char	path[512+32];	// That temporary name
+	DWORD	freq;			// Format of the audio...
+	DWORD	chans;
+	BOOL	useFloat;
+	DWORD	dataBytes;		// ...and how much has been written
+	DWORD	frames;			// The same in sample frames
+	PCMROWS	*rows;			// Rows seen so far, or NULL if out of memory
+} PCMSTATE;
+
+/******************************************************************************
+ * Function prototypes
+ *****************************************************************************/
+
+/*	_bgm_PcmValid() -
+		Internal function that checks whether a file's PCM cache is there
+		and was made from this version of the file. */
+BOOL _bgm_PcmValid( const char     *fname,
+                    const CACHEKEY *key );
+
+/*	_bgm_PcmStart() -
+		Internal function that starts writing a file's PCM cache, as 32-bit
+		float if useFloat is TRUE and 16-bit otherwise. Returns FALSE if the
+		cache can't be written (a read-only folder, for example). */
+BOOL _bgm_PcmStart( PCMSTATE   *state,
+                    const char *fname,
+                    DWORD      freq,
+                    DWORD      chans,
+                    BOOL       useFloat );
+
+/*	_bgm_PcmFeed() -
+		Internal function that adds frames interleaved float frames to the
+		cache. */
+void _bgm_PcmFeed( PCMSTATE    *state,
+                   const float *buf,
+                   DWORD       frames );
+
+/*	_bgm_PcmMark() -
+		Internal function that notes the order and row (as given by
+		BASS_MusicGetOrderPosition()) the module is at after the frames fed
+		so far. */
+void _bgm_PcmMark( PCMSTATE *state,
+                   DWORD    orderPos );
+
+/*	_bgm_PcmFinish() -
+		Internal function that finishes the cache, stamps it with the key of
+		the file and its row table and puts it in place, or throws it away
+		if keep is FALSE. The row table is left in state->rows for the
+		caller either way.
+		Returns TRUE if the cache was saved. */
+BOOL _bgm_PcmFinish( PCMSTATE       *state,
+                     const char     *fname,
+                     const CACHEKEY *key,
+                     BOOL           keep );
+
+/*	_bgm_PcmPrepare() -
+		Internal function, called when a module is loaded with the cache on,
+		that moves the song onto its PCM cache if there is an up to date one
+		and otherwise has the analysis worker make one. */
+void _bgm_PcmPrepare( SONG *song );
+
+/*	_bgm_PcmUse() -
+		Internal function, called before a song is played, that moves a
+		module onto its PCM cache if one has been made since it was loaded
+		and none of its module attributes have been changed.
+		Returns TRUE if the song is playing from its cache. */
+BOOL _bgm_PcmUse( SONG *song );
+
+/*	_bgm_PcmGoLive() -
+		Internal function that moves a song playing from its PCM cache back
+		onto the module, at the same place and in the same state, and keeps
+		it there. Safe to call on any song. */
+void _bgm_PcmGoLive( SONG *song );
+
+/*	_bgm_PcmSwap() -
+		Internal function that moves a song from its channel to another one
+		that plays the same audio, carrying over the position, channel
+		attributes, loop flag, DSP and whether it is playing or paused. */
+void _bgm_PcmSwap( SONG  *song,
+                   DWORD chan );
+
+/*	_bgm_PcmRowsLoad() -
+		Internal function that reads the row table of a file's PCM cache,
+		which must have been checked with _bgm_PcmValid().
+		Returns the table, or NULL if it can't be read. */
+PCMROWS* _bgm_PcmRowsLoad( const char *fname );
+
+/*	_bgm_PcmRowsFree() -
+		Internal function that frees a row table. Safe to call with NULL. */
+void _bgm_PcmRowsFree( PCMROWS *rows );
+
+/*	_bgm_PcmOrderPos() -
+		Internal function that works out the order and row a song playing
+		from its PCM cache is at, from the cache's row table.
+		Returns MAKELONG(order,row), or -1 if there is no table. */
+DWORD _bgm_PcmOrderPos( SONG *song );
+
+/*	_bgm_PcmModHandle() -
+		Internal function that returns the module handle of a song, for
+		reading module attributes and tags, whether or not it is playing
+		from its PCM cache. */
+DWORD _bgm_PcmModHandle( SONG *song );
+
+#endif // BGM_PCM_H
+
+/* END OF FILE */
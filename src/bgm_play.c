@@ -12,7 +12,7 @@
  *****************************************************************************/
 
 /*	bgm_PlayById() -
-		Plays the song with the given BASS id. If loop is true the song will
+		Plays the song with the given id. If loop is true the song will
 		loop when it gets to the end.
 		Returns 1 on success, 0 on failure. */
 DLL_FUNC
@@ -20,12 +20,35 @@ GM_REAL bgm_PlayById( GM_REAL songId,
                       GM_REAL loop )
 {
 	BASS_CHANNELINFO info;
+	SONG *song;
+	BOOL restart;
+	
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdPost(BGM_CMD_PLAYBYID, "rr", songId, loop);
 	
 	ERROR_CONTEXT("Failed to play song");
 	
+	_bgm_VirtPoll();
+	
+	// Find the song, and make sure it's loaded
+	song = _bgm_GetSongById(songId);
+	/* ERROR HANDLER */
+	if (!song || !song->id) {
+		BGM_ERROR("Invalid song ID.");
+		return FALSE;
+	}
+	
+	// Played again straight after it was started, it just gets louder
+	if (song->coalesce && _bgm_CoalesceMerge(song, GetTickCount()))
+		return TRUE;
+	
+	// Move a module onto its PCM cache if that has been made since loading
+	if (bgm_config.modCache)
+		_bgm_PcmUse(song);
+	
 	// Find out if the song should play looped,
 	// and whether or not the song ID is valid.
-	if (!BASS_ChannelGetInfo(songId, &info)) {
+	if (!BASS_ChannelGetInfo(song->id, &info)) {
 		/* ERROR HANDLER */
 		BGM_ERROR("Invalid song ID.");
 		return FALSE;
@@ -36,10 +59,30 @@ GM_REAL bgm_PlayById( GM_REAL songId,
 	else
 		info.flags &= ~BASS_SAMPLE_LOOP;
 	// Set the flags
-	BASS_ChannelSetFlags(songId, info.flags);
+	BASS_ChannelSetFlags(song->id, info.flags);
+	
+	// Catch up with a loudness measurement that finished since loading
+	if (bgm_config.normalize)
+		_bgm_LoudApply(song);
+	
+	// Plays that follow soon enough are merged into this one, from the
+	// volume it starts with now that the song is on its final channel
+	if (song->coalesce)
+		_bgm_CoalesceOpen(song, song->id, GetTickCount());
+	
+	// Starting over, so a virtual song's clock doesn't matter any more
+	if (song->virt) {
+		song->virt = FALSE;
+		_bgm_CmdSnapSong(song);
+	}
+	
+	// A primed song starts on what it has buffered, unless it has been
+	// moved since (restarting would throw the buffer away)
+	restart = !(song->primed && BASS_ChannelGetPosition(song->id) == 0);
+	song->primed = FALSE;
 	
 	// Play the song
-	if (!BASS_ChannelPlay(songId,TRUE)) {
+	if (!BASS_ChannelPlay(song->id,restart)) {
 		/* ERROR HANDLER */
 		switch (BASS_ErrorGetCode()) {
 			case BASS_ERROR_HANDLE: BGM_ERROR("Invalid song ID."); 
@@ -51,6 +94,9 @@ GM_REAL bgm_PlayById( GM_REAL songId,
 		return FALSE;
 	}
 	
+	// Too quiet to hear, it can go virtual straight away
+	_bgm_VirtCheck(song, GetTickCount());
+	
 	return TRUE;
 }
 // END bgm_PlayById()
@@ -66,21 +112,18 @@ GM_REAL bgm_PlayByFname( GM_STRING fname,
 {
 	SONG *song=NULL;
 	
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdPost(BGM_CMD_PLAYBYFNAME, "sr", fname, loop);
+	
 	ERROR_CONTEXT("Failed to play song");
 	
 	// Get the song associated with this filename
 	song = _bgm_GetSongByFname(fname);
 	
-	// If no song has been loaded with the filename
-	if (!song) {
-		goto PlayByFname_LoadAsQP;
-	}
-	// If a song is loaded with this filename and it is the QP's,
-	else if (song == bgm_song) {
-		
-		// Label for "This is the part that loads the song as Quick Play"
-		PlayByFname_LoadAsQP:
-		
+	// If no song has been loaded with the filename, or the QP song had it
+	// and has been unloaded since, load it as Quick Play (which may find it
+	// still warm). One that is at QP now just plays again.
+	if (!song || (song == bgm_song && !song->id)) {
 		// Try to load the song as QP
 		if (!bgm_Load(fname, bgm_config.stream, TRUE)) {
 			/* ERROR HANDLER */
@@ -90,7 +133,7 @@ GM_REAL bgm_PlayByFname( GM_STRING fname,
 	}
 	
 	// Play whetever song we have at this point and return the result.
-	return bgm_PlayById(song->id, loop);
+	return bgm_PlayById(song->ref, loop);
 }
 // END bgm_PlayByFname()
 
@@ -103,8 +146,9 @@ BOOL _bgm_Stop( SONG *song )
 	
 	// If the song is the QP song
 	if (song==bgm_song)
-		// Unload the song, thereby stopping it, and return the results
-		return bgm_UnloadById(song->id);
+		// Park or unload the song, thereby stopping it, and return the
+		// results
+		return _bgm_QpPark() || bgm_UnloadById(song->ref);
 	
 	// If the song is NOT the QP song...
 	
@@ -115,6 +159,12 @@ BOOL _bgm_Stop( SONG *song )
 		return FALSE;
 	}
 	
+	// A virtual song's channel is paused already, and it stops just the same
+	if (song->virt) {
+		song->virt = FALSE;
+		_bgm_CmdSnapSong(song);
+	}
+	
 	// If the song has a sample associated with it
 	if (song->sample != 0) {
 		// Pause the song (rather than stop it) and ignore any errors
@@ -128,6 +178,10 @@ BOOL _bgm_Stop( SONG *song )
 			BGM_ERROR("Song may have corrupt ID.");
 			return FALSE;
 		}
+		
+		// Have it ready to be heard again straight away, if asked to
+		if (bgm_config.primedStop)
+			_bgm_Prime(song);
 	}
 	
 	return TRUE;
@@ -139,6 +193,8 @@ BOOL _bgm_Stop( SONG *song )
 DLL_FUNC
 GM_REAL bgm_StopById( GM_REAL songId )
 {
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdPost(BGM_CMD_STOPBYID, "r", songId);
 	return _bgm_Stop(_bgm_GetSongById(songId));
 }
 // END bgm_StopById()
@@ -149,10 +205,89 @@ GM_REAL bgm_StopById( GM_REAL songId )
 DLL_FUNC
 GM_REAL bgm_StopByFname( GM_STRING fname )
 {
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdPost(BGM_CMD_STOPBYFNAME, "s", fname);
 	return _bgm_Stop(_bgm_GetSongByFname(fname));
 }
 // END bgm_StopByFname()
 
+/*	bgm_Prime() -
+		Gets a song that isn't playing ready to be heard as soon as it is
+		played. */
+DLL_FUNC
+GM_REAL bgm_Prime( GM_REAL songId )
+{
+	SONG *song;
+	DWORD active;
+	
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdPost(BGM_CMD_PRIME, "r", songId);
+	
+	ERROR_CONTEXT("Failed to prime song");
+	
+	song = _bgm_GetSongById(songId);
+	/* ERROR HANDLER */
+	if (!song || !song->id) {
+		BGM_ERROR("Invalid song ID.");
+		return FALSE;
+	}
+	
+	// A sample is in memory already, with nothing to decode
+	if (song->sample)
+		return TRUE;
+	
+	active = BASS_ChannelIsActive(song->id);
+	/* ERROR HANDLER */
+	if (song->virt || active == BASS_ACTIVE_PLAYING ||
+	    active == BASS_ACTIVE_STALLED) {
+		BGM_ERROR("Song is playing.");
+		return FALSE;
+	}
+	
+	// A paused song is stopped first, as it will start over
+	BASS_ChannelStop(song->id);
+	/* ERROR HANDLER */
+	if (!_bgm_Prime(song)) {
+		BGM_ERROR("BASS could not buffer the song (error %i).",
+		          BASS_ErrorGetCode());
+		return FALSE;
+	}
+	_bgm_CmdSnapSong(song);
+	
+	return TRUE;
+}
+
+/*	_bgm_Prime() -
+		Internal function that rewinds a stopped stream or module and fills
+		its playback buffer. */
+BOOL _bgm_Prime( SONG *song )
+{
+	BASS_CHANNELINFO info;
+	
+	BASS_ChannelSetPosition(song->id, 0);
+	
+	// Only restarting a module puts its tempo and global volume back, and
+	// that throws the buffer away, so one is only primed on its PCM cache
+	BASS_ChannelGetInfo(song->id, &info);
+	if (info.ctype & BASS_CTYPE_MUSIC_MOD) {
+		song->primed = FALSE;
+		return TRUE;
+	}
+	
+	song->primed = BASS_ChannelPreBuf(song->id, 0);
+	
+	return song->primed;
+}
+
+/*	_bgm_Reprime() -
+		Internal function that fills a primed song's buffer again. */
+void _bgm_Reprime( SONG *song )
+{
+	// Moved since, it won't be played from the buffer anyway
+	if (song->primed && BASS_ChannelGetPosition(song->id) == 0)
+		_bgm_Prime(song);
+}
+
 /*	_bgm_Pause() -
 		Internal function that does most of the work for the bgm_Pause*()
 		functions. */
@@ -172,6 +307,13 @@ BOOL _bgm_Pause(SONG *song)
 		return TRUE;
 	}
 	
+	// A virtual song is paused already; it just has to stop its clock and
+	// be where it would have been
+	if (song->virt) {
+		_bgm_VirtEnd(song, GetTickCount(), FALSE);
+		return TRUE;
+	}
+	
 	// Pause channel output, ignoring errors
 	BASS_ChannelPause(song->id);			
 	
@@ -185,6 +327,8 @@ BOOL _bgm_Pause(SONG *song)
 DLL_FUNC
 GM_REAL bgm_PauseById( GM_REAL songId )
 {
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdPost(BGM_CMD_PAUSEBYID, "r", songId);
 	return _bgm_Pause(_bgm_GetSongById(songId));
 }
 // END bgm_PauseById()
@@ -195,6 +339,8 @@ GM_REAL bgm_PauseById( GM_REAL songId )
 DLL_FUNC
 GM_REAL bgm_PauseByFname( GM_STRING fname )
 {
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdPost(BGM_CMD_PAUSEBYFNAME, "s", fname);
 	return _bgm_Pause(_bgm_GetSongByFname(fname));
 }
 // END bgm_PauseByFname()
@@ -218,9 +364,17 @@ BOOL _bgm_Unpause(SONG *song)
 		return TRUE;
 	}
 	
+	// A virtual song is playing already, as far as anyone can tell; its
+	// channel stays paused until it can be heard
+	if (song->virt)
+		return TRUE;
+	
 	// Unpause channel output, ignoring errors
 	BASS_ChannelPlay(song->id, FALSE);
 	
+	// It may be too quiet to hear
+	_bgm_VirtCheck(song, GetTickCount());
+	
 	return TRUE;
 }
 
@@ -230,6 +384,8 @@ BOOL _bgm_Unpause(SONG *song)
 DLL_FUNC
 GM_REAL bgm_UnpauseById( GM_REAL songId )
 {
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdPost(BGM_CMD_UNPAUSEBYID, "r", songId);
 	return _bgm_Unpause(_bgm_GetSongById(songId));
 }
 
@@ -239,6 +395,8 @@ GM_REAL bgm_UnpauseById( GM_REAL songId )
 DLL_FUNC
 GM_REAL bgm_UnpauseByFname( GM_STRING fname )
 {
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdPost(BGM_CMD_UNPAUSEBYFNAME, "s", fname);
 	return _bgm_Unpause(_bgm_GetSongByFname(fname));
 }
 
@@ -253,6 +411,7 @@ GM_REAL bgm_UnpauseByFname( GM_STRING fname )
 			-1 = Error occured. */
 DWORD _bgm_IsPlaying( SONG *song )
 {
+	BOOL ended;
 	ERROR_CONTEXT("Failed to get playing status of song");
 	
 	/* ERROR HANDLER */
@@ -261,6 +420,17 @@ DWORD _bgm_IsPlaying( SONG *song )
 		return -1;
 	}
 	
+	// An evicted song is as it was left (see bgm_mem.c)
+	if (song->evicted)
+		return song->evictActive;
+	
+	// A virtual song plays on, until a song that doesn't loop would have
+	// ended
+	if (song->virt) {
+		_bgm_VirtPos(song, GetTickCount(), &ended);
+		return ended ? BASS_ACTIVE_STOPPED : BASS_ACTIVE_PLAYING;
+	}
+	
 	// Return playing status of the song
 	return BASS_ChannelIsActive(song->id);
 }
@@ -271,7 +441,12 @@ DWORD _bgm_IsPlaying( SONG *song )
 DLL_FUNC
 GM_REAL bgm_IsPlayingById( GM_REAL songId )
 {
-	return _bgm_IsPlaying(_bgm_GetSongById(songId));
+	SONG stub;
+	
+	if (BGM_CMD_ASYNC)
+		return _bgm_IsPlaying(_bgm_CmdSnapFind(songId, NULL, &stub));
+	_bgm_VirtPoll();
+	return _bgm_IsPlaying(_bgm_PeekSongById(songId));
 }
 
 /*	bgm_IsPlayingByFname() -
@@ -280,7 +455,12 @@ GM_REAL bgm_IsPlayingById( GM_REAL songId )
 DLL_FUNC
 GM_REAL bgm_IsPlayingByFname( GM_STRING fname )
 {
-	return _bgm_IsPlaying(_bgm_GetSongByFname(fname));
+	SONG stub;
+	
+	if (BGM_CMD_ASYNC)
+		return _bgm_IsPlaying(_bgm_CmdSnapFind(0, fname, &stub));
+	_bgm_VirtPoll();
+	return _bgm_IsPlaying(_bgm_PeekSongByFname(fname));
 }
 
 /*	_bgm_GetLen() -
@@ -297,6 +477,10 @@ DWORD _bgm_GetLen( SONG *song )
 		return -1;
 	}
 	
+	// An evicted song's length was kept for it
+	if (song->evicted)
+		return (DWORD)song->evictLen;
+	
 	// Return 0 length for unloaded QP song
 	if (song->id==0) {
 		return 0;
@@ -319,7 +503,11 @@ DWORD _bgm_GetLen( SONG *song )
 DLL_FUNC
 GM_REAL bgm_GetLenById( GM_REAL songId )
 {
-	return _bgm_GetLen( _bgm_GetSongById(songId) );
+	SONG stub;
+	
+	if (BGM_CMD_ASYNC)
+		return _bgm_GetLen(_bgm_CmdSnapFind(songId, NULL, &stub));
+	return _bgm_GetLen( _bgm_PeekSongById(songId) );
 }
 
 /*	bgm_GetLenByFname() -
@@ -327,7 +515,11 @@ GM_REAL bgm_GetLenById( GM_REAL songId )
 DLL_FUNC
 GM_REAL bgm_GetLenByFname( GM_STRING fname )
 {
-	return _bgm_GetLen( _bgm_GetSongByFname(fname) );
+	SONG stub;
+	
+	if (BGM_CMD_ASYNC)
+		return _bgm_GetLen(_bgm_CmdSnapFind(0, fname, &stub));
+	return _bgm_GetLen( _bgm_PeekSongByFname(fname) );
 }
 
 /*	_bgm_GetPos() -
@@ -344,13 +536,21 @@ DWORD _bgm_GetPos( SONG *song )
 		return -1;
 	}
 	
+	// As was an evicted song's position
+	if (song->evicted)
+		return (DWORD)song->evictPos;
+	
 	// Return 0 for unloaded QP song
 	if (song->id==0) {
 		return 0;
 	}
 	
-	// Get song pos
-	ret = BASS_ChannelBytes2Seconds(song->id, BASS_ChannelGetPosition(song->id));
+	// Get song pos, from its clock if it's virtual
+	if (song->virt)
+		ret = BASS_ChannelBytes2Seconds(song->id,
+		                                _bgm_VirtPos(song, GetTickCount(), NULL));
+	else
+		ret = BASS_ChannelBytes2Seconds(song->id, BASS_ChannelGetPosition(song->id));
 	
 	/* ERROR HANDLER */
 	if (ret==-1) {
@@ -366,7 +566,12 @@ DWORD _bgm_GetPos( SONG *song )
 DLL_FUNC
 GM_REAL bgm_GetPosById( GM_REAL songId )
 {
-	return _bgm_GetPos( _bgm_GetSongById(songId) );
+	SONG stub;
+	
+	if (BGM_CMD_ASYNC)
+		return _bgm_GetPos(_bgm_CmdSnapFind(songId, NULL, &stub));
+	_bgm_VirtPoll();
+	return _bgm_GetPos( _bgm_PeekSongById(songId) );
 }
 
 /*	bgm_GetPosByFname() -
@@ -374,7 +579,12 @@ GM_REAL bgm_GetPosById( GM_REAL songId )
 DLL_FUNC
 GM_REAL bgm_GetPosByFname( GM_STRING fname )
 {
-	return _bgm_GetPos( _bgm_GetSongByFname(fname) );
+	SONG stub;
+	
+	if (BGM_CMD_ASYNC)
+		return _bgm_GetPos(_bgm_CmdSnapFind(0, fname, &stub));
+	_bgm_VirtPoll();
+	return _bgm_GetPos( _bgm_PeekSongByFname(fname) );
 }
 
 /*	_bgm_GetOrder() -
@@ -382,6 +592,7 @@ GM_REAL bgm_GetPosByFname( GM_STRING fname )
 DWORD _bgm_GetOrder( SONG *song )
 {
 	BASS_CHANNELINFO info;
+	DWORD pos;
 	ERROR_CONTEXT("Failed to get current module order");
 	
 	// Fail if no song was found
@@ -403,7 +614,16 @@ DWORD _bgm_GetOrder( SONG *song )
 		return -1;
 	}
 	
-	// Return the order
+	// Return the order, from the PCM cache's row table if the song is on it
+	if (song->music) {
+		pos = _bgm_PcmOrderPos(song);
+		/* ERROR HANDLER */
+		if (pos == (DWORD)-1) {
+			BGM_ERROR("Module cache has no row table.");
+			return -1;
+		}
+		return LOWORD(pos);
+	}
 	return LOWORD(BASS_MusicGetOrderPosition(song->id));
 }	
 
@@ -413,6 +633,8 @@ DWORD _bgm_GetOrder( SONG *song )
 DLL_FUNC
 GM_REAL bgm_GetOrderById( GM_REAL songId )
 {
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdCall(BGM_CMD_GETORDERBYID, "r", songId);
 	return _bgm_GetOrder(_bgm_GetSongById(songId));
 }
 
@@ -422,6 +644,8 @@ GM_REAL bgm_GetOrderById( GM_REAL songId )
 DLL_FUNC
 GM_REAL bgm_GetOrderByFname( GM_STRING fname )
 {
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdCall(BGM_CMD_GETORDERBYFNAME, "s", fname);
 	return _bgm_GetOrder(_bgm_GetSongByFname(fname));
 }
 
@@ -430,6 +654,7 @@ GM_REAL bgm_GetOrderByFname( GM_STRING fname )
 DWORD _bgm_GetRow( SONG *song )
 {
 	BASS_CHANNELINFO info;
+	DWORD pos;
 	ERROR_CONTEXT("Failed to get current module row");
 	
 	// Fail if no song was found
@@ -451,7 +676,16 @@ DWORD _bgm_GetRow( SONG *song )
 		return -1;
 	}
 	
-	// Return the row
+	// Return the row, from the PCM cache's row table if the song is on it
+	if (song->music) {
+		pos = _bgm_PcmOrderPos(song);
+		/* ERROR HANDLER */
+		if (pos == (DWORD)-1) {
+			BGM_ERROR("Module cache has no row table.");
+			return -1;
+		}
+		return HIWORD(pos);
+	}
 	return HIWORD(BASS_MusicGetOrderPosition(song->id));
 }	
 
@@ -461,7 +695,9 @@ DWORD _bgm_GetRow( SONG *song )
 DLL_FUNC
 GM_REAL bgm_GetRowById( GM_REAL songId )
 {
-	return _bgm_GetOrder(_bgm_GetSongById(songId));
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdCall(BGM_CMD_GETROWBYID, "r", songId);
+	return _bgm_GetRow(_bgm_GetSongById(songId));
 }
 
 /*	bgm_GetModOrderByFname() -
@@ -470,6 +706,8 @@ GM_REAL bgm_GetRowById( GM_REAL songId )
 DLL_FUNC
 GM_REAL bgm_GetRowByFname( GM_STRING fname )
 {
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdCall(BGM_CMD_GETROWBYFNAME, "s", fname);
 	return _bgm_GetRow(_bgm_GetSongByFname(fname));
 }
 
@@ -41,6 +41,37 @@ GM_REAL bgm_StopById( GM_REAL songId );
 DLL_FUNC
 GM_REAL bgm_StopByFname( GM_STRING fname );
 
+/*	bgm_Prime() -
+		Gets the song with the given id ready to be heard as soon as it is
+		played: it is rewound, and its playback buffer is filled. That is
+		what a stop does with the "primedstop" global attribute set; this is
+		for songs that haven't played yet. The next bgm_PlayById() starts
+		on that buffer unless the song is moved first. Samples are always
+		ready, so priming one does nothing, and a module not playing from
+		its PCM cache is only rewound, as it has to be restarted to reset
+		its tempo and global volume. A paused song is stopped.
+		What is buffered goes through the song's effects, and is filled
+		again if they are changed before it plays, but not through the
+		master bus or the meters, which only hear songs that are playing:
+		that first buffer is heard without ducking or limiting.
+		Returns 1 on success and 0 on failure, as when the song is
+		playing. */
+DLL_FUNC
+GM_REAL bgm_Prime( GM_REAL songId );
+
+/*	_bgm_Prime() -
+		Internal function that rewinds a stopped stream or module and fills
+		its playback buffer, marking the song primed. A module that isn't
+		on its PCM cache is rewound but not primed.
+		Returns FALSE if BASS couldn't fill it. */
+BOOL _bgm_Prime( SONG *song );
+
+/*	_bgm_Reprime() -
+		Internal function that fills a primed song's buffer again, so that
+		it is heard through effects that have changed since it was primed.
+		Does nothing if the song isn't primed or has been moved since. */
+void _bgm_Reprime( SONG *song );
+
 /*	_bgm_Pause() -
 		Internal function that does most of the work for the bgm_Pause*()
 		functions. */
@@ -127,21 +158,37 @@ GM_REAL bgm_GetPosById( GM_REAL songId );
 DLL_FUNC
 GM_REAL bgm_GetPosByFname( GM_STRING fname );
 
-/*	_bgm_GetModOrder() -
+/*	_bgm_GetOrder() -
 		Does most of the work for the next two functions. */
-DWORD _bgm_GetModOrder( SONG *song );
+DWORD _bgm_GetOrder( SONG *song );
 
-/*	bgm_GetModOrderById() -
+/*	bgm_GetOrderById() -
 		Returns the number of the order that the given mod is currently at,
 		or -1 on failure. */
 DLL_FUNC
-GM_REAL bgm_IsPlayingById( GM_REAL songId );
+GM_REAL bgm_GetOrderById( GM_REAL songId );
 
-/*	bgm_GetModOrderByFname() -
+/*	bgm_GetOrderByFname() -
 		Returns the number of the order that the given mod is currently at,
 		or -1 on failure. */
 DLL_FUNC
-GM_REAL bgm_IsPlayingByFname( GM_STRING fname );
+GM_REAL bgm_GetOrderByFname( GM_STRING fname );
+
+/*	_bgm_GetRow() -
+		Does most of the work for the next two functions. */
+DWORD _bgm_GetRow( SONG *song );
+
+/*	bgm_GetRowById() -
+		Returns the row that the given mod is currently at, or -1 on
+		failure. */
+DLL_FUNC
+GM_REAL bgm_GetRowById( GM_REAL songId );
+
+/*	bgm_GetRowByFname() -
+		Returns the row that the given mod is currently at, or -1 on
+		failure. */
+DLL_FUNC
+GM_REAL bgm_GetRowByFname( GM_STRING fname );
 
 #endif // BGM_PLAY_H
 
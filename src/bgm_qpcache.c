@@ -0,0 +1,251 @@
+/******************************************************************************
+ *
+ *	bgm_qpcache.c -
+ *		Implementation of the Quick Play warm cache.
+ *
+ *	Parked songs are SONGs of their own, kept off the song list so that
+ *	nothing can find them, in a list of their own from the context's
+ *	qpWarm, the one parked last first. Parking moves the channel out of
+ *	the Quick Play node into a new SONG, and unparking moves it back, so
+ *	the node itself, its CHANDATA included, never leaves the head of the
+ *	song list.
+ *
+ *	A parked song is stopped and rewound, but its effects stay on its
+ *	channel. Putting it back does what _bgm_Load_Part2() would have done:
+ *	the Quick Play slot's attributes go on the channel, it is turned down
+ *	to its normalised loudness and it joins the slot's group.
+ *
+ *****************************************************************************/
+
+#include "bgm.h"
+
+/******************************************************************************
+ * Function implementations
+ *****************************************************************************/
+
+/*	_bgm_QpPark() -
+		Internal function that moves the Quick Play song into the warm
+		cache. */
+BOOL _bgm_QpPark( )
+{
+	BGM_CONTEXT *ctx = _bgm_Context();
+	SONG *entry, *node;
+
+	if (!bgm_config.qpWarm || !bgm_song->id)
+		return FALSE;
+
+	// An internet stream would go on downloading
+	if (bgm_song->net || _bgm_FnameIsUrl(bgm_song->fname))
+		return FALSE;
+
+	entry = NEW(SONG,1);
+	if (!entry)
+		return FALSE;
+	memset(entry, 0, sizeof(SONG));
+
+	// The attributes stay with the slot, as when the song is unloaded
+	_bgm_SaveQpAttrs();
+
+	// Stopped as _bgm_Stop() would, a sample's channel paused so that it
+	// isn't freed, and back at the start for the next time (primed, if
+	// stops are)
+	if (bgm_song->sample)
+		BASS_ChannelPause(bgm_song->id);
+	else
+		BASS_ChannelStop(bgm_song->id);
+	if (bgm_song->sample || !bgm_config.primedStop)
+		BASS_ChannelSetPosition(bgm_song->id, 0);
+	else
+		_bgm_Prime(bgm_song);
+
+	_bgm_QpMove(entry, bgm_song);
+	entry->group = bgm_song->group;
+	_bgm_CmdSnapSong(bgm_song);
+
+	// Loading the same file as Quick Play twice leaves an older copy
+	for (node = ctx->qpWarm; node; node = node->next) {
+		if (!strcmp(node->fname, entry->fname)) {
+			if (node->prev)
+				node->prev->next = node->next;
+			else
+				ctx->qpWarm = node->next;
+			if (node->next)
+				node->next->prev = node->prev;
+			_bgm_Clear(node);
+			free(node);
+			break;
+		}
+	}
+
+	entry->prev = NULL;
+	entry->next = ctx->qpWarm;
+	if (ctx->qpWarm)
+		ctx->qpWarm->prev = entry;
+	ctx->qpWarm = entry;
+
+	_bgm_QpTrim(bgm_config.qpWarm);
+
+	return TRUE;
+}
+
+/*	_bgm_QpUnpark() -
+		Internal function that puts a parked song back into the Quick Play
+		slot. */
+BOOL _bgm_QpUnpark( const char *fname )
+{
+	BGM_CONTEXT *ctx = _bgm_Context();
+	SONG *entry;
+
+	for (entry = ctx->qpWarm; entry; entry = entry->next) {
+		if (!strcmp(entry->fname, fname))
+			break;
+	}
+	if (!entry)
+		return FALSE;
+
+	// Off the list first, so that parking the Quick Play song can't trim it
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		ctx->qpWarm = entry->next;
+	if (entry->next)
+		entry->next->prev = entry->prev;
+
+	// Whatever is at Quick Play makes way, as in _bgm_Load_Part1()
+	if (bgm_song->id && !_bgm_QpPark())
+		bgm_UnloadByFname(bgm_song->fname);
+
+	_bgm_QpMove(bgm_song, entry);
+	free(entry);
+
+	// Its ID may have been handed out to another song while it was parked
+	_bgm_MemFreeRef(bgm_song);
+	bgm_song->lastUse = GetTickCount();
+
+	// The rest is as _bgm_Load_Part2() does it
+	_bgm_LoadQpAttrs();
+	bgm_song->normGain = 1.0f;
+	if (bgm_config.normalize) {
+		_bgm_LoudPrepare(bgm_song);
+		_bgm_LoudApply(bgm_song);
+	}
+	_bgm_BusSetGroup(bgm_song, bgm_song->group);
+	if (_bgm_BusActive() || bgm_meterOn)
+		_bgm_DspAttach(bgm_song);
+	_bgm_CmdSnapSong(bgm_song);
+
+	return TRUE;
+}
+
+/*	_bgm_QpMove() -
+		Internal function that moves a loaded song's channel from one SONG
+		to another. */
+void _bgm_QpMove( SONG *to,
+                  SONG *from )
+{
+	to->id = from->id;
+	to->ref = from->ref;
+	strcpy(to->fname, from->fname);
+	to->sample = from->sample;
+	to->dsp = from->dsp;
+	to->normGain = from->normGain;
+	to->userVol = from->userVol;
+	to->fadeEnd = from->fadeEnd;
+	to->music = from->music;
+	to->modDirty = from->modDirty;
+	to->io = from->io;
+	to->net = from->net;
+	to->lastUse = from->lastUse;
+	to->primed = from->primed;
+	to->virt = FALSE;
+
+	// Coalescing starts over, as it does with each song loaded at Quick
+	// Play (see _bgm_Clear())
+	_bgm_CoalesceFree(from);
+
+	from->id = 0;
+	from->ref = 0;
+	from->sample = 0;
+	from->dsp = NULL;
+	from->normGain = 1.0f;
+	from->userVol = 100;
+	from->fadeEnd = 0;
+	from->music = 0;
+	from->modDirty = FALSE;
+	from->io = NULL;
+	from->net = NULL;
+	from->primed = FALSE;
+	from->virt = FALSE;
+}
+
+/*	_bgm_QpTrim() -
+		Internal function that unloads parked songs until no more than max
+		are left. */
+void _bgm_QpTrim( DWORD max )
+{
+	SONG *node;
+	DWORD count = 0;
+
+	for (node = _bgm_Context()->qpWarm; node; node = node->next)
+		count++;
+
+	while (count-- > max)
+		_bgm_QpDrop();
+}
+
+/*	_bgm_QpDrop() -
+		Internal function that unloads the song parked longest ago. */
+DWORD _bgm_QpDrop( )
+{
+	BGM_CONTEXT *ctx = _bgm_Context();
+	SONG *node;
+	DWORD bytes;
+
+	node = ctx->qpWarm;
+	if (!node)
+		return 0;
+	while (node->next)
+		node = node->next;
+
+	if (node->prev)
+		node->prev->next = NULL;
+	else
+		ctx->qpWarm = NULL;
+
+	bytes = _bgm_MemBytes(node);
+	_bgm_Clear(node);
+	free(node);
+
+	return bytes;
+}
+
+/*	_bgm_QpBytes() -
+		Internal function that adds up the memory parked songs hold. */
+DWORD _bgm_QpBytes( )
+{
+	SONG *node;
+	DWORD total = 0;
+
+	for (node = _bgm_Context()->qpWarm; node; node = node->next)
+		total += _bgm_MemBytes(node);
+
+	return total;
+}
+
+/*	_bgm_QpFree() -
+		Internal function that unloads every song parked in a context. */
+void _bgm_QpFree( BGM_CONTEXT *ctx )
+{
+	SONG *node, *prevNode;
+
+	node = ctx->qpWarm;
+	while (node) {
+		prevNode = node;
+		node = prevNode->next;
+		_bgm_Clear(prevNode);
+		free(prevNode);
+	}
+	ctx->qpWarm = NULL;
+}
+
+/* END OF FILE */
@@ -0,0 +1,79 @@
+/******************************************************************************
+ *
+ *	bgm_qpcache.h -
+ *		Prototypes for the Quick Play warm cache. When a song is loaded as
+ *		Quick Play, or the Quick Play song is stopped, the song it replaces
+ *		is kept loaded ("parked") instead of being unloaded, up to the
+ *		"qpwarm" global attribute of them, the one parked longest ago going
+ *		first. Loading a parked song as Quick Play again, or playing it with
+ *		bgm_PlayByFname(), just puts it back, so switching between a few
+ *		songs doesn't load them again each time.
+ *
+ *		A parked song can't be looked up, by its ID or its filename: as far
+ *		as anyone can tell it has been unloaded. The Quick Play slot's
+ *		attributes carry over to whichever song is in it, as they always
+ *		have.
+ *
+ *****************************************************************************/
+
+#ifndef BGM_QPCACHE_H
+#define BGM_QPCACHE_H
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#define BGM_QP_WARM_DEFAULT	2	// Songs kept parked unless told otherwise
+#define BGM_QP_WARM_MAX		16	// Most that can be kept parked
+
+/******************************************************************************
+ * Function prototypes
+ *****************************************************************************/
+
+/*	_bgm_QpPark() -
+		Internal function that stops the Quick Play song and moves it into
+		the warm cache, leaving the Quick Play slot empty.
+		Returns FALSE if it wasn't parked (there is no song at Quick Play,
+		the cache is off or the song is an internet stream), in which case
+		nothing has changed. */
+BOOL _bgm_QpPark( );
+
+/*	_bgm_QpUnpark() -
+		Internal function that puts the parked song with the given filename
+		back into the Quick Play slot, parking or unloading whatever is
+		there first.
+		Returns FALSE if no song with that filename is parked. */
+BOOL _bgm_QpUnpark( const char *fname );
+
+/*	_bgm_QpMove() -
+		Internal function that moves a loaded song's channel, and everything
+		that goes with it, from one SONG to another, leaving from empty. The
+		SONGs' extData and groups stay where they are. */
+void _bgm_QpMove( SONG *to,
+                  SONG *from );
+
+/*	_bgm_QpTrim() -
+		Internal function that unloads parked songs in the calling thread's
+		context, the one parked longest ago first, until no more than max
+		are left. */
+void _bgm_QpTrim( DWORD max );
+
+/*	_bgm_QpDrop() -
+		Internal function that unloads the song parked longest ago in the
+		calling thread's context.
+		Returns the memory it held (see _bgm_MemBytes()), or 0 if no song
+		is parked. */
+DWORD _bgm_QpDrop( );
+
+/*	_bgm_QpBytes() -
+		Internal function that adds up the memory parked songs hold (see
+		_bgm_MemBytes()). */
+DWORD _bgm_QpBytes( );
+
+/*	_bgm_QpFree() -
+		Internal function that unloads every song parked in a context. */
+void _bgm_QpFree( BGM_CONTEXT *ctx );
+
+#endif // BGM_QPCACHE_H
+
+/* END OF FILE */
@@ -0,0 +1,243 @@
+/******************************************************************************
+ *
+ *	bgm_render.c -
+ *		Implementation of BGM's offline renderer.
+ *
+ *	Songs are opened as decoding channels (BASS_MUSIC_DECODE or
+ *	BASS_STREAM_DECODE, always with floating-point samples) and pulled
+ *	through BASS_ChannelGetData() as fast as they'll go. Module attributes
+ *	and effects work on decoding channels just as on playing ones; channel
+ *	volume and panning don't, so they are read back and applied here.
+ *	Channel frequency (cfreq) is not applied.
+ *
+ *****************************************************************************/
+
+#include "bgm.h"
+
+/******************************************************************************
+ * Function implementations
+ *****************************************************************************/
+
+/*	_bgm_RenderOpen() -
+		Internal function that creates a decoding channel for the given file
+		in the job. Returns TRUE on success, FALSE on failure. */
+BOOL _bgm_RenderOpen( RENDERJOB  *job,
+                      const char *fname,
+                      DWORD      freq )
+{
+	BASS_CHANNELINFO info;
+	DWORD type;
+
+	ERROR_CONTEXT("Failed to open song for rendering");
+
+	memset(job, 0, sizeof(RENDERJOB));
+	strncpy(job->song.fname, fname, sizeof(job->song.fname)-1);
+	job->song.normGain = 1.0f;
+
+	type = _bgm_GetFileType(fname);
+	/* ERROR HANDLER */
+	if (type == -1) {
+		BGM_ERROR("Unknown file extension.");
+		return FALSE;
+	}
+
+	// A module that loops back on itself would never end, so it stops at
+	// the first backward jump, as the analysis worker's does
+	if (type == BASS_CTYPE_MUSIC_MOD)
+		job->song.id = BASS_MusicLoad(FALSE, (void*)fname, 0, 0,
+		                              BASS_MUSIC_DECODE | BASS_SAMPLE_FLOAT |
+		                              BASS_MUSIC_PRESCAN | BASS_MUSIC_STOPBACK,
+		                              freq);
+	else
+		job->song.id = BASS_StreamCreateFile(FALSE, (void*)fname, 0, 0,
+		                                     BASS_STREAM_DECODE |
+		                                     BASS_SAMPLE_FLOAT);
+
+	/* ERROR HANDLER */
+	if (!job->song.id) {
+		switch (BASS_ErrorGetCode()) {
+			case BASS_ERROR_INIT: BGM_ERROR("BASS not initialized."); break;
+			case BASS_ERROR_FILEOPEN: BGM_ERROR("Could not open file."); break;
+			case BASS_ERROR_FILEFORM: BGM_ERROR("Unknown file format."); break;
+			case BASS_ERROR_CODEC: BGM_ERROR("Codec not supported."); break;
+			case BASS_ERROR_MEM: BGM_ERROR("Out of memory."); break;
+			default: BGM_ERROR("Unknown error occured.");
+		}
+		return FALSE;
+	}
+
+	BASS_ChannelGetInfo(job->song.id, &info);
+	job->freq = info.freq ? info.freq : 44100;
+	job->chans = info.chans ? info.chans : 1;
+	return TRUE;
+}
+
+/*	_bgm_RenderAttr() -
+		Internal function that sets a BGM attribute on the job's song.
+		Returns TRUE on success, FALSE on failure. */
+BOOL _bgm_RenderAttr( RENDERJOB *job,
+                      char      *name,
+                      char      *value )
+{
+	const BGM_ATTRIBUTE *attr;
+	DWORD n;
+
+	attr = _bgm_AccessAttr(&job->song, name, &n);
+	/* ERROR HANDLER */
+	if (!attr)
+		return FALSE;
+	return attr->Set(&job->song, n, value);
+}
+
+/*	_bgm_RenderWavHeader() -
+		Internal function that writes a WAV header for dataBytes bytes of
+		audio in the given format at the current position of f. */
+void _bgm_RenderWavHeader( FILE  *f,
+                           DWORD freq,
+                           DWORD chans,
+                           BOOL  useFloat,
+                           DWORD dataBytes,
+                           DWORD extraBytes )
+{
+	DWORD dw;
+	WORD w, bits = useFloat ? 32 : 16;
+
+	fwrite("RIFF", 4, 1, f);
+	dw = 36 + dataBytes + extraBytes;	fwrite(&dw, 4, 1, f);
+	fwrite("WAVEfmt ", 8, 1, f);
+	dw = 16;						fwrite(&dw, 4, 1, f);
+	w = useFloat ? 3 : 1;			fwrite(&w, 2, 1, f);	// IEEE float/PCM
+	w = (WORD)chans;				fwrite(&w, 2, 1, f);
+	dw = freq;						fwrite(&dw, 4, 1, f);
+	dw = freq*chans*(bits/8);		fwrite(&dw, 4, 1, f);	// Bytes/second
+	w = (WORD)(chans*(bits/8));		fwrite(&w, 2, 1, f);	// Bytes/frame
+	fwrite(&bits, 2, 1, f);
+	fwrite("data", 4, 1, f);
+	fwrite(&dataBytes, 4, 1, f);
+}
+
+/*	_bgm_RenderRun() -
+		Internal function that decodes the whole song into a WAV file.
+		Returns TRUE on success, FALSE on failure (see job->error). */
+BOOL _bgm_RenderRun( RENDERJOB  *job,
+                     const char *outFname,
+                     BOOL       useFloat )
+{
+	LARGE_INTEGER tps, t0, t1;
+	FILE *f;
+	float *buf, gainL, gainR;
+	short *pcm = NULL;
+	DWORD chans = job->chans, got, count, i, vol, dataBytes = 0;
+	double frames = 0.0, v;
+	int pan;
+
+	strcpy(job->error, "");
+
+	buf = NEW(float,BGM_RENDER_BLOCK*chans);
+	if (!useFloat)
+		pcm = NEW(short,BGM_RENDER_BLOCK*chans);
+	if (!buf || (!useFloat && !pcm)) {
+		strcpy(job->error, "Out of memory.");
+		free(buf);
+		free(pcm);
+		return FALSE;
+	}
+
+	f = fopen(outFname, "wb");
+	if (!f) {
+		sprintf(job->error, "Could not create \"%s\".", outFname);
+		free(buf);
+		free(pcm);
+		return FALSE;
+	}
+	// Sizes are filled in at the end
+	_bgm_RenderWavHeader(f, job->freq, chans, useFloat, 0, 0);
+
+	// Channel volume and panning, as BASS would apply them when mixing
+	BASS_ChannelGetAttributes(job->song.id, NULL, &vol, &pan);
+	gainL = gainR = vol/100.0f;
+	if (chans == 2 && pan > 0) gainL *= (100-pan)/100.0f;
+	if (chans == 2 && pan < 0) gainR *= (100+pan)/100.0f;
+
+	QueryPerformanceFrequency(&tps);
+	QueryPerformanceCounter(&t0);
+
+	for (;;) {
+		got = BASS_ChannelGetData(job->song.id, buf,
+		                          BGM_RENDER_BLOCK*chans*sizeof(float));
+		// -1 means the end was reached (or something went wrong)
+		if (got == (DWORD)-1 || got == 0)
+			break;
+		count = got/sizeof(float);
+
+		if (gainL == gainR) {
+			if (gainL != 1.0f)
+				_bgm_DspGain(buf, count, gainL);
+		}
+		else {
+			for (i=0; i+1<count; i+=2) {
+				buf[i] *= gainL;
+				buf[i+1] *= gainR;
+			}
+		}
+
+		if (useFloat)
+			fwrite(buf, sizeof(float), count, f);
+		else {
+			for (i=0; i<count; i++) {
+				v = buf[i]*32767.0;
+				if (v > 32767.0) v = 32767.0;
+				if (v < -32768.0) v = -32768.0;
+				pcm[i] = (short)floor(v+0.5);
+			}
+			fwrite(pcm, sizeof(short), count, f);
+		}
+		dataBytes += count*(useFloat ? 4 : 2);
+		frames += count/chans;
+	}
+
+	QueryPerformanceCounter(&t1);
+	job->elapsed = (double)(t1.QuadPart-t0.QuadPart)/tps.QuadPart;
+	job->seconds = frames/job->freq;
+
+	free(buf);
+	free(pcm);
+
+	// Go back and fill the sizes in
+	fseek(f, 0, SEEK_SET);
+	_bgm_RenderWavHeader(f, job->freq, chans, useFloat, dataBytes, 0);
+	if (ferror(f)) {
+		sprintf(job->error, "Could not write \"%s\".", outFname);
+		fclose(f);
+		return FALSE;
+	}
+	fclose(f);
+
+	// A decoding channel is only "stopped" once it has reached the end
+	if (BASS_ChannelIsActive(job->song.id) != BASS_ACTIVE_STOPPED) {
+		sprintf(job->error, "Decoding stopped early (BASS error %i).",
+		        BASS_ErrorGetCode());
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/*	_bgm_RenderClose() -
+		Internal function that frees the job's decoding channel. */
+void _bgm_RenderClose( RENDERJOB *job )
+{
+	BASS_CHANNELINFO info;
+
+	if (!job->song.id)
+		return;
+
+	_bgm_DspDetach(&job->song);
+	BASS_ChannelGetInfo(job->song.id, &info);
+	if (info.ctype & BASS_CTYPE_MUSIC_MOD)
+		BASS_MusicFree(job->song.id);
+	else
+		BASS_StreamFree(job->song.id);
+	job->song.id = 0;
+}
+
+/* END OF FILE */
@@ -0,0 +1,89 @@
+/******************************************************************************
+ *
+ *	bgm_render.h -
+ *		Prototypes and types for BGM's offline renderer, which decodes a song
+ *		to a WAV file as fast as it can be decoded instead of playing it.
+ *		This is what the bgmrender command line tool (render_main.c) is
+ *		built on; it needs BASS initialised, but the "no sound" device will
+ *		do.
+ *
+ *****************************************************************************/
+
+#ifndef BGM_RENDER_H
+#define BGM_RENDER_H
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// Frames decoded per BASS_ChannelGetData() call
+#define BGM_RENDER_BLOCK 4096
+
+/******************************************************************************
+ * Typedefs, structs, etc.
+ *****************************************************************************/
+
+/*	RENDERJOB -
+		One song being rendered. The decoding channel is kept in a SONG of
+		its own, which is not in the bgm_song list, so that the attribute
+		setters can be used on it as on any loaded song.
+*/
+typedef struct ctagRENDERJOB {
+	SONG	song;			// The decoding channel
+	DWORD	freq;			// Its sample rate...
+	DWORD	chans;			// ...and channel count
+	double	seconds;		// Length of the audio rendered
+	double	elapsed;		// Time it took, in seconds
+	char	error[256];		// Why _bgm_RenderRun() failed, if it did
+} RENDERJOB;
+
+/******************************************************************************
+ * Function prototypes
+ *****************************************************************************/
+
+/*	_bgm_RenderOpen() -
+		Internal function that creates a decoding channel for the given file
+		(a module at the given sample rate, or a stream) in the job.
+		Returns TRUE on success, FALSE on failure (with a BGM error). */
+BOOL _bgm_RenderOpen( RENDERJOB  *job,
+                      const char *fname,
+                      DWORD      freq );
+
+/*	_bgm_RenderAttr() -
+		Internal function that sets a BGM attribute (e.g. "tvolume", "amplify"
+		or "speed") on the job's song, as bgm_SetAttrById() would.
+		Returns TRUE on success, FALSE on failure (with a BGM error). */
+BOOL _bgm_RenderAttr( RENDERJOB *job,
+                      char      *name,
+                      char      *value );
+
+/*	_bgm_RenderWavHeader() -
+		Internal function that writes a WAV header for dataBytes bytes of
+		audio in the given format at the current position of f. extraBytes
+		is the size of any chunks that will follow the audio. */
+void _bgm_RenderWavHeader( FILE  *f,
+                           DWORD freq,
+                           DWORD chans,
+                           BOOL  useFloat,
+                           DWORD dataBytes,
+                           DWORD extraBytes );
+
+/*	_bgm_RenderRun() -
+		Internal function that decodes the whole song into a WAV file, as
+		16-bit PCM or 32-bit float. The channel volume and panning (cvolume,
+		cpanning) are applied here, since BASS leaves them out of decoding
+		channels. Unlike the other two this doesn't use BGM's error globals,
+		so jobs can be run on several threads at once; on failure the reason
+		is put in job->error.
+		Returns TRUE on success, FALSE on failure. */
+BOOL _bgm_RenderRun( RENDERJOB  *job,
+                     const char *outFname,
+                     BOOL       useFloat );
+
+/*	_bgm_RenderClose() -
+		Internal function that frees the job's decoding channel. */
+void _bgm_RenderClose( RENDERJOB *job );
+
+#endif // BGM_RENDER_H
+
+/* END OF FILE */
@@ -0,0 +1,209 @@
+/******************************************************************************
+ *
+ *	bgm_spec.c -
+ *		Implementation of BGM's spectrum analysis.
+ *
+ *	The capture ring holds the newest samples of a song as heard (after its
+ *	effects and the bus). When a spectrum is asked for, the ring is copied
+ *	out under the song's lock, Hann windowed and run through the FFT in
+ *	bgm_dsp.c, and the bins are folded into log spaced bands. The result is
+ *	kept until the DSP has been called again.
+ *
+ *****************************************************************************/
+
+#include "bgm.h"
+
+/******************************************************************************
+ * Globals
+ *****************************************************************************/
+
+// Hann window and FFT twiddle tables, made on first use
+float bgm_specWindow[BGM_SPEC_SIZE];
+float bgm_specTwRe[BGM_SPEC_SIZE];
+float bgm_specTwIm[BGM_SPEC_SIZE];
+BOOL bgm_specTables = FALSE;
+
+/******************************************************************************
+ * Function implementations
+ *****************************************************************************/
+
+/*	_bgm_SpecCapture() -
+		Internal function that appends count interleaved samples of chans
+		channels to the capture ring. Called from the song's DSP with the
+		lock held. */
+void _bgm_SpecCapture( SPECTAP     *spec,
+                       const float *buf,
+                       DWORD       count,
+                       DWORD       chans )
+{
+	DWORD frames = count/chans, f, c;
+	float sum, scale = 1.0f/chans;
+
+	// Only the newest BGM_SPEC_SIZE frames can matter
+	if (frames > BGM_SPEC_SIZE) {
+		buf += (frames-BGM_SPEC_SIZE)*chans;
+		frames = BGM_SPEC_SIZE;
+	}
+
+	for (f=0; f<frames; f++, buf += chans) {
+		sum = buf[0];
+		for (c=1; c<chans; c++)
+			sum += buf[c];
+		spec->ring[spec->pos] = sum*scale;
+		spec->pos = (spec->pos+1) & (BGM_SPEC_SIZE-1);
+	}
+
+	spec->gen++;
+}
+
+/*	_bgm_Spectrum() -
+		Internal function that writes the song's spectrum as bands float
+		magnitudes to out, working it out first if it isn't cached. */
+BOOL _bgm_Spectrum( SONG  *song,
+                    DWORD bands,
+                    float *out )
+{
+	SONGDSP *dsp;
+	SPECTAP *spec;
+	float re[BGM_SPEC_SIZE], im[BGM_SPEC_SIZE];
+	float mag, peak, norm;
+	double ratio;
+	DWORD i, b, lo, hi, pos;
+
+	ERROR_CONTEXT("Failed to get spectrum");
+
+	/* ERROR HANDLER */
+	if (!song) {
+		BGM_ERROR("Invalid song ID or filename.");
+		return FALSE;
+	}
+	if (song->id==0) {
+		BGM_ERROR("No Quick Play song loaded.");
+		return FALSE;
+	}
+	if (bands < 1 || bands > BGM_SPEC_MAXBANDS) {
+		BGM_ERROR("Band count (%i) not between 1 and %i.", bands,
+		          BGM_SPEC_MAXBANDS);
+		return FALSE;
+	}
+	if (!out) {
+		BGM_ERROR("Invalid buffer address.");
+		return FALSE;
+	}
+
+	// Make the shared tables the first time through
+	if (!bgm_specTables) {
+		for (i=0; i<BGM_SPEC_SIZE; i++)
+			bgm_specWindow[i] = (float)(0.5 - 0.5*cos(2.0*3.14159265358979*i
+			                                          /BGM_SPEC_SIZE));
+		_bgm_DspFFTTable(bgm_specTwRe, bgm_specTwIm, BGM_SPEC_SIZE);
+		bgm_specTables = TRUE;
+	}
+
+	dsp = _bgm_DspAttach(song);
+	/* ERROR HANDLER */
+	if (!dsp)
+		return FALSE;
+
+	// Start capturing if this is the first time anyone asked
+	if (!dsp->spec) {
+		spec = NEW(SPECTAP,1);
+		/* ERROR HANDLER */
+		if (!spec) {
+			BGM_ERROR("Out of memory.");
+			return FALSE;
+		}
+		memset(spec, 0, sizeof(SPECTAP));
+		spec->gen = 1;
+		EnterCriticalSection(&dsp->lock);
+		dsp->spec = spec;
+		LeaveCriticalSection(&dsp->lock);
+	}
+	spec = dsp->spec;
+
+	// Work the spectrum out only if the DSP has run since last time (or
+	// the band layout changed)
+	EnterCriticalSection(&dsp->lock);
+	if (spec->cacheGen == spec->gen && spec->cacheBands == bands) {
+		LeaveCriticalSection(&dsp->lock);
+		memcpy(out, spec->cache, sizeof(float)*bands);
+		return TRUE;
+	}
+	spec->cacheGen = spec->gen;
+	pos = spec->pos;
+	for (i=0; i<BGM_SPEC_SIZE; i++)
+		re[i] = spec->ring[(pos+i) & (BGM_SPEC_SIZE-1)];
+	LeaveCriticalSection(&dsp->lock);
+
+	// Window and transform
+	for (i=0; i<BGM_SPEC_SIZE; i++) {
+		re[i] *= bgm_specWindow[i];
+		im[i] = 0.0f;
+	}
+	_bgm_DspFFT(re, im, BGM_SPEC_SIZE, bgm_specTwRe, bgm_specTwIm);
+
+	// Magnitudes of the positive frequency bins, scaled so that a full scale
+	// sine reads 1 (the Hann window halves the amplitude)
+	norm = 4.0f/BGM_SPEC_SIZE;
+	for (i=0; i<BGM_SPEC_SIZE/2; i++)
+		re[i] = (float)sqrt(re[i]*re[i] + im[i]*im[i])*norm;
+
+	// Fold them into log spaced bands, taking the peak of each
+	ratio = dsp->freq/2.0/BGM_SPEC_MINFREQ;
+	hi = (DWORD)(BGM_SPEC_MINFREQ*BGM_SPEC_SIZE/dsp->freq);
+	for (b=0; b<bands; b++) {
+		lo = hi;
+		hi = (DWORD)(BGM_SPEC_MINFREQ*pow(ratio, (double)(b+1)/bands)
+		             *BGM_SPEC_SIZE/dsp->freq);
+		if (lo < 1) lo = 1;
+		if (hi > BGM_SPEC_SIZE/2) hi = BGM_SPEC_SIZE/2;
+		// Bands narrower than a bin just read the nearest bin
+		if (lo >= hi) {
+			if (lo >= BGM_SPEC_SIZE/2)
+				lo = BGM_SPEC_SIZE/2-1;
+			hi = lo+1;
+		}
+		peak = 0.0f;
+		for (i=lo; i<hi; i++) {
+			mag = re[i];
+			if (mag > peak) peak = mag;
+		}
+		spec->cache[b] = peak;
+	}
+	spec->cacheBands = bands;
+
+	memcpy(out, spec->cache, sizeof(float)*bands);
+	return TRUE;
+}
+
+/*	bgm_SpectrumById() -
+		Writes the spectrum of what the song with the given ID is playing
+		into a GM buffer as bands 32-bit floats.
+		Returns 1 on success, 0 on failure. */
+DLL_FUNC
+GM_REAL bgm_SpectrumById( GM_REAL   songId,
+                          GM_REAL   bands,
+                          GM_STRING bufferAddress )
+{
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdCall(BGM_CMD_SPECTRUMBYID, "rrp", songId, bands,
+		                    bufferAddress);
+	return _bgm_Spectrum(_bgm_GetSongById(songId), (DWORD)bands,
+	                     (float*)bufferAddress);
+}
+
+/*	bgm_SpectrumByFname() -
+		Same as bgm_SpectrumById() but uses the song's filename. */
+DLL_FUNC
+GM_REAL bgm_SpectrumByFname( GM_STRING fname,
+                             GM_REAL   bands,
+                             GM_STRING bufferAddress )
+{
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdCall(BGM_CMD_SPECTRUMBYFNAME, "srp", fname, bands,
+		                    bufferAddress);
+	return _bgm_Spectrum(_bgm_GetSongByFname(fname), (DWORD)bands,
+	                     (float*)bufferAddress);
+}
+
+/* END OF FILE */
@@ -0,0 +1,89 @@
+/******************************************************************************
+ *
+ *	bgm_spec.h -
+ *		Prototypes and types for BGM's spectrum analysis. A song's DSP keeps
+ *		the last BGM_SPEC_SIZE samples it played, and the spectrum of them is
+ *		worked out on request - but only once per mixer update, however many
+ *		times it is asked for.
+ *
+ *****************************************************************************/
+
+#ifndef BGM_SPEC_H
+#define BGM_SPEC_H
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// FFT size in samples. Must be a power of two.
+#define BGM_SPEC_SIZE 2048
+
+// Most bands that can be asked for
+#define BGM_SPEC_MAXBANDS 256
+
+// Frequency of the bottom edge of the lowest band, in Hz
+#define BGM_SPEC_MINFREQ 20.0
+
+/******************************************************************************
+ * Typedefs, structs, etc.
+ *****************************************************************************/
+
+/*	SPECTAP -
+		Spectrum capture for one song. The ring and gen are written by the
+		song's DSP with its lock held; the cache is only touched from GM.
+*/
+typedef struct ctagSPECTAP {
+	float	ring[BGM_SPEC_SIZE];		// Last samples played, mixed to mono
+	DWORD	pos;						// Next write position in ring
+	DWORD	gen;						// Counts DSP calls (mixer updates)
+	DWORD	cacheGen;					// gen the cache was worked out at
+	DWORD	cacheBands;					// Band count the cache was made for
+	float	cache[BGM_SPEC_MAXBANDS];	// Band magnitudes
+} SPECTAP;
+
+/******************************************************************************
+ * Function prototypes
+ *****************************************************************************/
+
+/*	_bgm_SpecCapture() -
+		Internal function that appends count interleaved samples of chans
+		channels to the capture ring. Called from the song's DSP with the
+		lock held. */
+void _bgm_SpecCapture( SPECTAP     *spec,
+                       const float *buf,
+                       DWORD       count,
+                       DWORD       chans );
+
+/*	_bgm_Spectrum() -
+		Internal function that writes the song's spectrum as bands float
+		magnitudes to out, working it out first if it isn't cached. */
+BOOL _bgm_Spectrum( SONG  *song,
+                    DWORD bands,
+                    float *out );
+
+/*	bgm_SpectrumById() -
+		Writes the spectrum of what the song with the given ID is playing
+		into a GM buffer as bands 32-bit floats (buffer_f32), lowest band
+		first. The bands are spaced logarithmically from 20Hz up to half the
+		song's sample rate and hold the peak magnitude in each, where a full
+		scale sine reads about 1. bufferAddress is what buffer_get_address()
+		gives, and the buffer must have room for bands*4 bytes.
+		The spectrum is only recalculated once per mixer update, so any number
+		of objects can call this every step. The first call for a song starts
+		the capture, so it returns silence until the song plays on.
+		Returns 1 on success, 0 on failure. */
+DLL_FUNC
+GM_REAL bgm_SpectrumById( GM_REAL   songId,
+                          GM_REAL   bands,
+                          GM_STRING bufferAddress );
+
+/*	bgm_SpectrumByFname() -
+		Same as bgm_SpectrumById() but uses the song's filename. */
+DLL_FUNC
+GM_REAL bgm_SpectrumByFname( GM_STRING fname,
+                             GM_REAL   bands,
+                             GM_STRING bufferAddress );
+
+#endif // BGM_SPEC_H
+
+/* END OF FILE */
@@ -0,0 +1,186 @@
+/******************************************************************************
+ *
+ *	bgm_virt.c -
+ *		Implementation of virtual songs.
+ *
+ *	A virtual song's channel is only paused, so everything set on it stays
+ *	as it was and it can carry on at once. Its clock is where it was paused
+ *	and when, and how many bytes a ms it was playing at then; a frequency
+ *	change while it's virtual is only heard from when it plays again.
+ *	Paused channels cost BASS nothing to mix, and their DSPs don't run.
+ *
+ *	Modules aren't made virtual, as their positions are orders and rows
+ *	rather than bytes, nor are internet streams, which can't be moved to
+ *	where they would be. Nor are samples loaded with voices: BASS could hand
+ *	a paused channel out as a new voice.
+ *
+ *****************************************************************************/
+
+#include "bgm.h"
+
+/******************************************************************************
+ * Function implementations
+ *****************************************************************************/
+
+/*	_bgm_VirtGain() -
+		Internal function that works out how loud a song would be. */
+float _bgm_VirtGain( SONG *song )
+{
+	DWORD vol;
+
+	BASS_ChannelGetAttributes(song->id, NULL, &vol, NULL);
+
+	return _bgm_VirtGainAt(song, vol);
+}
+
+/*	_bgm_VirtGainAt() -
+		Internal function that works out how loud a song would be at a
+		given channel volume. */
+float _bgm_VirtGainAt( SONG  *song,
+                       DWORD vol )
+{
+	float duck;
+
+	EnterCriticalSection(&bgm_bus.lock);
+	duck = _bgm_BusDuckTarget(song->group, NULL, NULL);
+	LeaveCriticalSection(&bgm_bus.lock);
+
+	return vol/100.0f*duck*bgm_bus.gvol;
+}
+
+/*	_bgm_VirtCheck() -
+		Internal function that makes a song virtual, or plays it again, as
+		its level calls for. */
+void _bgm_VirtCheck( SONG  *song,
+                     DWORD now )
+{
+	BASS_CHANNELINFO info;
+	float gain;
+
+	if (!song->id)
+		return;
+
+	if (song->virt) {
+		if (bgm_config.virtualDb == 0.0f ||
+		    _bgm_VirtGain(song) >= bgm_config.virtualGain*BGM_VIRT_HYSTERESIS)
+			_bgm_VirtEnd(song, now, TRUE);
+		return;
+	}
+
+	if (bgm_config.virtualDb == 0.0f || song->music || song->voices ||
+	    BASS_ChannelIsActive(song->id) != BASS_ACTIVE_PLAYING)
+		return;
+	gain = _bgm_VirtGain(song);
+	if (gain >= bgm_config.virtualGain)
+		return;
+	if (!BASS_ChannelGetInfo(song->id, &info) ||
+	    (info.ctype & BASS_CTYPE_MUSIC_MOD) || _bgm_FnameIsUrl(song->fname))
+		return;
+
+	_bgm_VirtPause(song, now);
+}
+
+/*	_bgm_VirtCheckAll() -
+		Internal function that checks every song. */
+void _bgm_VirtCheckAll( )
+{
+	BGM_CONTEXT *ctx = _bgm_Context();
+	SONG *node;
+	DWORD now = GetTickCount();
+
+	for (node = ctx->song; node; node = node->next)
+		_bgm_VirtCheck(node, now);
+	ctx->virtPoll = now;
+}
+
+/*	_bgm_VirtPoll() -
+		Internal function that checks every song, now and then. */
+void _bgm_VirtPoll( )
+{
+	BGM_CONTEXT *ctx = _bgm_Context();
+
+	// With virtual songs off, there are none to bring back either: turning
+	// them off checks every song at once
+	if (bgm_config.virtualDb == 0.0f)
+		return;
+	if (GetTickCount() - ctx->virtPoll < BGM_VIRT_INTERVAL)
+		return;
+
+	_bgm_VirtCheckAll();
+}
+
+/*	_bgm_VirtPause() -
+		Internal function that makes a song virtual. */
+void _bgm_VirtPause( SONG  *song,
+                     DWORD now )
+{
+	BASS_CHANNELINFO info;
+	DWORD freq;
+
+	BASS_ChannelGetInfo(song->id, &info);
+	BASS_ChannelGetAttributes(song->id, &freq, NULL, NULL);
+	if (!freq)
+		freq = info.freq;
+
+	song->virtPos = BASS_ChannelGetPosition(song->id);
+	song->virtRate = (float)BASS_ChannelSeconds2Bytes(song->id, 1.0f)
+	                 *freq/info.freq/1000.0f;
+	song->virtStart = now;
+	BASS_ChannelPause(song->id);
+	song->virt = TRUE;
+
+	_bgm_CmdSnapSong(song);
+}
+
+/*	_bgm_VirtEnd() -
+		Internal function that takes a song out of being virtual. */
+void _bgm_VirtEnd( SONG  *song,
+                   DWORD now,
+                   BOOL  play )
+{
+	BOOL ended;
+	QWORD pos;
+
+	pos = _bgm_VirtPos(song, now, &ended);
+	song->virt = FALSE;
+
+	if (ended)
+		BASS_ChannelStop(song->id);
+	else {
+		BASS_ChannelSetPosition(song->id, pos);
+		if (play)
+			BASS_ChannelPlay(song->id, FALSE);
+	}
+
+	_bgm_CmdSnapSong(song);
+}
+
+/*	_bgm_VirtPos() -
+		Internal function that works out where a virtual song would be. */
+QWORD _bgm_VirtPos( SONG  *song,
+                    DWORD now,
+                    BOOL  *ended )
+{
+	BASS_CHANNELINFO info;
+	QWORD pos, len;
+
+	pos = song->virtPos + (QWORD)(song->virtRate*(now - song->virtStart));
+	len = BASS_ChannelGetLength(song->id);
+	if (ended)
+		*ended = FALSE;
+
+	if (len && pos >= len) {
+		BASS_ChannelGetInfo(song->id, &info);
+		if (info.flags & BASS_SAMPLE_LOOP)
+			pos %= len;
+		else {
+			pos = len;
+			if (ended)
+				*ended = TRUE;
+		}
+	}
+
+	return pos;
+}
+
+/* END OF FILE */
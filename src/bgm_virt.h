@@ -0,0 +1,100 @@
+/******************************************************************************
+ *
+ *	bgm_virt.h -
+ *		Prototypes for virtual songs. With the "virtual" global attribute set
+ *		to a level in dB, a playing song that would be quieter than that
+ *		(its channel volume, times the ducking its group is under, times
+ *		the global volume) has its channel paused, and only a clock keeps
+ *		its place. bgm_IsPlaying*() still say it's playing, and
+ *		bgm_GetPos*() tell where it would be. When it would be loud enough
+ *		again it carries on from there, or stops if a song that doesn't
+ *		loop would have ended.
+ *
+ *		Levels BGM sets itself are looked at straight away, and a virtual
+ *		song fading up to where it would be heard plays again as the fade
+ *		starts. Otherwise fades and ducking move on their own, so they are
+ *		caught by a sweep of every song that plays, attribute changes,
+ *		bgm_IsPlaying*() and bgm_GetPos*() run at most every
+ *		BGM_VIRT_INTERVAL ms.
+ *
+ *****************************************************************************/
+
+#ifndef BGM_VIRT_H
+#define BGM_VIRT_H
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// Least time between two sweeps, in ms
+#define BGM_VIRT_INTERVAL 50
+
+// How much louder than the threshold (about 3dB) a virtual song has to get
+// before it plays again, so one sitting at the threshold doesn't flap
+#define BGM_VIRT_HYSTERESIS 1.41f
+
+/******************************************************************************
+ * Function prototypes
+ *****************************************************************************/
+
+/*	_bgm_VirtGain() -
+		Internal function that works out how loud a song would be, from 0 to
+		1: its channel volume, the ducking its group is under and the global
+		volume. */
+float _bgm_VirtGain( SONG *song );
+
+/*	_bgm_VirtGainAt() -
+		Internal function that works out how loud a song would be, as
+		_bgm_VirtGain() does, with its channel volume at vol instead of
+		where it is now. */
+float _bgm_VirtGainAt( SONG  *song,
+                       DWORD vol );
+
+/*	_bgm_VirtCheck() -
+		Internal function that makes a playing song virtual if it's too
+		quiet to hear, or plays a virtual one again if it's loud enough or
+		virtual songs have been turned off. Songs that can't be virtual
+		(modules, internet streams and samples with voices) are left
+		alone. */
+void _bgm_VirtCheck( SONG  *song,
+                     DWORD now );
+
+/*	_bgm_VirtCheckAll() -
+		Internal function that checks every song in the calling thread's
+		context with _bgm_VirtCheck(). */
+void _bgm_VirtCheckAll( );
+
+/*	_bgm_VirtPoll() -
+		Internal function that checks every song in the calling thread's
+		context, if it has been at least BGM_VIRT_INTERVAL ms since the last
+		time. Does nothing if no song can be virtual. */
+void _bgm_VirtPoll( );
+
+/*	_bgm_VirtPause() -
+		Internal function that makes a song virtual: pauses its channel and
+		starts its clock. */
+void _bgm_VirtPause( SONG  *song,
+                     DWORD now );
+
+/*	_bgm_VirtEnd() -
+		Internal function that takes a song out of being virtual, with its
+		channel moved to where the clock says. If play is TRUE the channel
+		carries on from there; otherwise it's left paused. A song that
+		doesn't loop and would have ended is stopped either way. */
+void _bgm_VirtEnd( SONG  *song,
+                   DWORD now,
+                   BOOL  play );
+
+/*	_bgm_VirtPos() -
+		Internal function that works out where a virtual song would be, in
+		bytes. Only the song's channel and virtual members are looked at,
+		so snapshot stubs will do. If ended isn't NULL, it's set to whether
+		a song that doesn't loop would have ended.
+		Returns the position. */
+QWORD _bgm_VirtPos( SONG  *song,
+                    DWORD now,
+                    BOOL  *ended );
+
+#endif // BGM_VIRT_H
+
+/* END OF FILE */
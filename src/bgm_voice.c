@@ -0,0 +1,403 @@
+/******************************************************************************
+ *
+ *	bgm_voice.c -
+ *		Implementation of sample voices.
+ *
+ *	BASS already keeps a sample's channels together and hands out a free
+ *	one when asked. BGM adds the song's attributes for each new voice, a way
+ *	back from a voice ID to its song for bgm_SetVoice*(), and the limits:
+ *	before BASS is asked for a channel, the playing voices are counted, and
+ *	if there are too many one is stolen. A voice of the same song is simply
+ *	restarted; any other is stopped first, which gives its channel back to
+ *	its own sample. BASS doesn't say when a voice ends, so there is no
+ *	running count to keep: each play asks BASS about every voice of every
+ *	song once (only the song's own if there is no budget), and a steal
+ *	picks from what that found.
+ *
+ *****************************************************************************/
+
+#include "bgm.h"
+
+/******************************************************************************
+ * Function implementations
+ *****************************************************************************/
+
+/*	bgm_LoadSampleVoices() -
+		Loads a sample that can play on up to maxVoices channels at once. */
+DLL_FUNC
+GM_REAL bgm_LoadSampleVoices( GM_STRING fname,
+                              GM_REAL   maxVoices )
+{
+	SONG *song;
+
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdCall(BGM_CMD_LOADSAMPLEVOICES, "sr", fname,
+		                    maxVoices);
+
+	ERROR_CONTEXT("Failed to load sample voices");
+
+	/* ERROR HANDLER */
+	if (maxVoices < 1 || maxVoices > BGM_VOICE_MAX) {
+		BGM_ERROR("Voice count (%g) not between 1 and %i.", maxVoices,
+		          BGM_VOICE_MAX);
+		return 0;
+	}
+
+	song = _bgm_LoadSample(fname, FALSE, (DWORD)maxVoices,
+	                       "Failed to load sample voices");
+	/* ERROR HANDLER */
+	if (!song)
+		return 0;
+
+	/* ERROR HANDLER */
+	if (!_bgm_VoicesNew(song, (DWORD)maxVoices)) {
+		BGM_ERROR("Out of memory.");
+		_bgm_Clear(song);
+		_bgm_DeleteSong(song);
+		return 0;
+	}
+
+	return song->ref;
+}
+
+/*	bgm_PlayVoice() -
+		Plays a song loaded with bgm_LoadSampleVoices() on a voice of its
+		own. */
+DLL_FUNC
+GM_REAL bgm_PlayVoice( GM_REAL songId )
+{
+	BASS_CHANNELINFO info;
+	BGM_CONTEXT *ctx = _bgm_Context();
+	SONG *song, *victim;
+	VOICES *voices;
+	HCHANNEL voice = 0;
+	DWORD freq, vol, now, slot, total;
+	BOOL full;
+	int pan;
+
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdCall(BGM_CMD_PLAYVOICE, "r", songId);
+
+	ERROR_CONTEXT("Failed to play voice");
+
+	_bgm_VirtPoll();
+
+	song = _bgm_GetSongById(songId);
+	/* ERROR HANDLER */
+	if (!song || !song->id) {
+		BGM_ERROR("Invalid song ID.");
+		return 0;
+	}
+	/* ERROR HANDLER */
+	if (!song->voices) {
+		BGM_ERROR("Song was not loaded with bgm_LoadSampleVoices().");
+		return 0;
+	}
+	voices = song->voices;
+	now = GetTickCount();
+
+	// A play merged into the last one isn't a new voice, so no limit
+	// applies to it
+	if (song->coalesce) {
+		voice = _bgm_CoalesceMerge(song, now);
+		if (voice)
+			return voice;
+	}
+
+	/* ERROR HANDLER */
+	if (voices->played && now - voices->lastPlay < voices->cooldown) {
+		ctx->voicesDropped++;
+		BGM_ERROR("Played again within its cooldown.");
+		return 0;
+	}
+
+	// What the voice should sound like, before the song's own channel
+	// might be the one that's used
+	BASS_ChannelGetAttributes(song->id, &freq, &vol, &pan);
+
+	// Over the song's limit or the budget, another voice has to give way
+	total = _bgm_VoicesPlaying(bgm_config.voiceBudget ? NULL : voices);
+	full = (voices->playing >= voices->max);
+	if (full || (bgm_config.voiceBudget && total >= bgm_config.voiceBudget)) {
+		victim = _bgm_VoiceVictim(full ? song : NULL, voices->priority,
+		                          now, &slot);
+		/* ERROR HANDLER */
+		if (!victim) {
+			ctx->voicesDropped++;
+			BGM_ERROR("Every voice is playing something more important.");
+			return 0;
+		}
+		ctx->voicesStolen++;
+		if (victim == song)
+			voice = voices->chan[slot];
+		else
+			_bgm_VoiceStop(victim, victim->voices->chan[slot]);
+	}
+
+	if (!voice) {
+		voice = BASS_SampleGetChannel(song->sample, FALSE);
+		/* ERROR HANDLER */
+		if (!voice) {
+			BGM_ERROR("No voice could be had (BASS error %i).",
+			          BASS_ErrorGetCode());
+			return 0;
+		}
+		slot = _bgm_VoiceAdd(voices, voice);
+	}
+	voices->prio[slot] = voices->priority;
+	voices->start[slot] = now;
+	voices->lastPlay = now;
+	voices->played = TRUE;
+
+	// Voices play once, whatever the song was last played with
+	BASS_ChannelSetAttributes(voice, freq, vol, pan);
+	BASS_ChannelGetInfo(voice, &info);
+	BASS_ChannelSetFlags(voice, info.flags & ~BASS_SAMPLE_LOOP);
+	_bgm_CoalesceOpen(song, voice, now);
+
+	/* ERROR HANDLER */
+	if (!BASS_ChannelPlay(voice, TRUE)) {
+		BGM_ERROR("BASS could not play the voice (error %i).",
+		          BASS_ErrorGetCode());
+		return 0;
+	}
+
+	return voice;
+}
+
+/*	bgm_StopVoice() -
+		Stops the voice with the given ID. */
+DLL_FUNC
+GM_REAL bgm_StopVoice( GM_REAL voiceId )
+{
+	SONG *song;
+
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdPost(BGM_CMD_STOPVOICE, "r", voiceId);
+
+	ERROR_CONTEXT("Failed to stop voice");
+
+	song = _bgm_GetSongByVoice(voiceId);
+	/* ERROR HANDLER */
+	if (!song) {
+		BGM_ERROR("Invalid voice ID.");
+		return FALSE;
+	}
+
+	_bgm_VoiceStop(song, (DWORD)voiceId);
+
+	return TRUE;
+}
+
+/*	bgm_SetVoiceVol() -
+		Sets the volume of the voice with the given ID. */
+DLL_FUNC
+GM_REAL bgm_SetVoiceVol( GM_REAL voiceId,
+                         GM_REAL vol )
+{
+	SONG *song;
+
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdPost(BGM_CMD_SETVOICEVOL, "rr", voiceId, vol);
+
+	ERROR_CONTEXT("Failed to set voice volume");
+
+	/* ERROR HANDLER */
+	if (vol < 0 || vol > 100) {
+		BGM_ERROR("Value (%g) not between 0 and 100.", vol);
+		return FALSE;
+	}
+
+	song = _bgm_GetSongByVoice(voiceId);
+	/* ERROR HANDLER */
+	if (!song || !BASS_ChannelSetAttributes((DWORD)voiceId, -1,
+	                                        (int)(vol*song->normGain + 0.5f),
+	                                        -101)) {
+		BGM_ERROR("Invalid voice ID.");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*	bgm_SetVoicePan() -
+		Sets the panning of the voice with the given ID. */
+DLL_FUNC
+GM_REAL bgm_SetVoicePan( GM_REAL voiceId,
+                         GM_REAL pan )
+{
+	SONG *song;
+
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdPost(BGM_CMD_SETVOICEPAN, "rr", voiceId, pan);
+
+	ERROR_CONTEXT("Failed to set voice panning");
+
+	/* ERROR HANDLER */
+	if (pan < -100 || pan > 100) {
+		BGM_ERROR("Value (%g) not between -100 and 100.", pan);
+		return FALSE;
+	}
+
+	song = _bgm_GetSongByVoice(voiceId);
+	/* ERROR HANDLER */
+	if (!song || !BASS_ChannelSetAttributes((DWORD)voiceId, -1, -1,
+	                                        (int)pan)) {
+		BGM_ERROR("Invalid voice ID.");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*	_bgm_VoicesNew() -
+		Internal function that gives a song its VOICES. */
+BOOL _bgm_VoicesNew( SONG  *song,
+                     DWORD max )
+{
+	VOICES *voices;
+
+	voices = NEW(VOICES,1);
+	if (!voices)
+		return FALSE;
+	memset(voices, 0, sizeof(VOICES));
+	voices->max = max;
+	voices->chan[0] = song->id;
+	voices->next = 1;
+
+	song->voices = voices;
+
+	return TRUE;
+}
+
+/*	_bgm_VoicesFree() -
+		Internal function that frees a song's VOICES. */
+void _bgm_VoicesFree( SONG *song )
+{
+	free(song->voices);
+	song->voices = NULL;
+}
+
+/*	_bgm_VoiceAdd() -
+		Internal function that records a channel given to one of a song's
+		voices. */
+DWORD _bgm_VoiceAdd( VOICES   *voices,
+                     HCHANNEL chan )
+{
+	DWORD i;
+
+	for (i=0; i<voices->max; i++) {
+		if (voices->chan[i] == chan)
+			return i;
+	}
+
+	// Slot 0 is always the song's own channel. BASS never has more than
+	// max at once, so a new one that takes a slot over is one BASS has
+	// replaced.
+	if (voices->max == 1)
+		return 0;
+	i = voices->next;
+	voices->chan[i] = chan;
+	voices->next = voices->next % (voices->max - 1) + 1;
+
+	return i;
+}
+
+/*	_bgm_VoiceStop() -
+		Internal function that stops one of a song's voices. */
+void _bgm_VoiceStop( SONG     *song,
+                     HCHANNEL chan )
+{
+	// The song's own channel is paused, as _bgm_Stop() does, so that it
+	// stays the song's. BASS frees any other, giving its voice back.
+	if (chan == song->id)
+		BASS_ChannelPause(chan);
+	else
+		BASS_ChannelStop(chan);
+}
+
+/*	_bgm_VoicesPlaying() -
+		Internal function that counts playing voices. */
+DWORD _bgm_VoicesPlaying( VOICES *voices )
+{
+	SONG *node;
+	DWORD i, count = 0;
+
+	if (!voices) {
+		for (node = bgm_song; node; node = node->next) {
+			if (node->voices)
+				count += _bgm_VoicesPlaying(node->voices);
+		}
+		return count;
+	}
+
+	for (i=0; i<voices->max; i++) {
+		voices->active[i] = (voices->chan[i] &&
+		    BASS_ChannelIsActive(voices->chan[i]) == BASS_ACTIVE_PLAYING);
+		if (voices->active[i])
+			count++;
+	}
+	voices->playing = count;
+
+	return count;
+}
+
+/*	_bgm_VoiceVictim() -
+		Internal function that picks the playing voice to steal. */
+SONG* _bgm_VoiceVictim( SONG  *only,
+                        DWORD prio,
+                        DWORD now,
+                        DWORD *slot )
+{
+	SONG *node, *best = NULL;
+	VOICES *v;
+	DWORD i, vol, bestPrio = 0, bestVol = 0, bestAge = 0;
+
+	for (node = only ? only : bgm_song; node; node = only ? NULL : node->next) {
+		v = node->voices;
+		if (!v)
+			continue;
+		for (i=0; i<v->max; i++) {
+			if (!v->active[i] || v->prio[i] > prio)
+				continue;
+			BASS_ChannelGetAttributes(v->chan[i], NULL, &vol, NULL);
+
+			// The lowest priority first, then the quietest, then the oldest
+			if (best && (v->prio[i] > bestPrio ||
+			    (v->prio[i] == bestPrio && (vol > bestVol ||
+			    (vol == bestVol && now - v->start[i] <= bestAge)))))
+				continue;
+			best = node;
+			*slot = i;
+			bestPrio = v->prio[i];
+			bestVol = vol;
+			bestAge = now - v->start[i];
+		}
+	}
+
+	return best;
+}
+
+/*	_bgm_GetSongByVoice() -
+		Internal function that finds the song a voice belongs to. */
+SONG* _bgm_GetSongByVoice( DWORD voice )
+{
+	SONG *node;
+	DWORD i;
+
+	if (!voice)
+		return NULL;
+
+	for (node = bgm_song; node; node = node->next) {
+		if (!node->voices)
+			continue;
+		for (i=0; i<node->voices->max; i++) {
+			if (node->voices->chan[i] == voice)
+				return node;
+		}
+	}
+
+	return NULL;
+}
+
+/* END OF FILE */
@@ -0,0 +1,149 @@
+/******************************************************************************
+ *
+ *	bgm_voice.h -
+ *		Prototypes and types for sample voices. A song loaded with
+ *		bgm_LoadSampleVoices() has its sample decoded once, and
+ *		bgm_PlayVoice() plays it on as many as maxVoices channels at once,
+ *		each a voice with its own volume and pan, so a sound fired again
+ *		before it has finished overlaps itself instead of starting over.
+ *		The song's own channel is its first voice; the rest play straight
+ *		through BASS, so the song's effects, the master bus and the meters
+ *		only hear that one.
+ *
+ *		How many voices play is kept in hand three ways: each song has at
+ *		most maxVoices, a play within the song's "vcooldown" of the last is
+ *		dropped, and no more than the "voicebudget" global attribute play
+ *		at once across all songs. A play that would go over either limit
+ *		steals a playing voice of no higher "vpriority" (the lowest first,
+ *		then the quietest, then the oldest), or is dropped if there is
+ *		none; the "voicesstolen" and "voicesdropped" attributes count
+ *		both.
+ *
+ *****************************************************************************/
+
+#ifndef BGM_VOICE_H
+#define BGM_VOICE_H
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// Most voices a song can have
+#define BGM_VOICE_MAX 64
+
+/******************************************************************************
+ * Typedefs, structs, etc.
+ *****************************************************************************/
+
+/*	VOICES -
+		The channels a song's sample plays on, and what the voice limits
+		need to know about them. BASS hands the channels out; BGM decides
+		which is taken over when there are no more.
+*/
+typedef struct ctagVOICES {
+	DWORD		max;					// How many voices there can be
+	DWORD		next;					// Slot the next new channel goes in
+	DWORD		priority;				// Priority new voices get
+	DWORD		cooldown;				// Least time between plays (ms)
+	DWORD		lastPlay;				// When a voice last started...
+	BOOL		played;					// ...if one ever has
+	HCHANNEL	chan[BGM_VOICE_MAX];	// Channels seen so far, or 0; the
+										// first is the song's own
+	DWORD		prio[BGM_VOICE_MAX];	// Priority each started with
+	DWORD		start[BGM_VOICE_MAX];	// When each started
+	BOOL		active[BGM_VOICE_MAX];	// Whether each was playing when
+										// last counted...
+	DWORD		playing;				// ...and how many were
+} VOICES;
+
+/******************************************************************************
+ * Function prototypes
+ *****************************************************************************/
+
+/*	bgm_LoadSampleVoices() -
+		Loads a sample from the given filename that can play on up to
+		maxVoices channels at once (see bgm_PlayVoice()).
+		Returns the ID of the new song on success, 0 on failure. */
+DLL_FUNC
+GM_REAL bgm_LoadSampleVoices( GM_STRING fname,
+                              GM_REAL   maxVoices );
+
+/*	bgm_PlayVoice() -
+		Plays the song with the given ID, which must have been loaded with
+		bgm_LoadSampleVoices(), on a voice of its own. The voice starts with
+		the song's frequency, volume and panning, and plays once.
+		Returns the voice's ID on success, 0 on failure. */
+DLL_FUNC
+GM_REAL bgm_PlayVoice( GM_REAL songId );
+
+/*	bgm_StopVoice() -
+		Stops the voice with the given ID.
+		Returns 1 on success, 0 on failure. */
+DLL_FUNC
+GM_REAL bgm_StopVoice( GM_REAL voiceId );
+
+/*	bgm_SetVoiceVol() -
+		Sets the volume (0 to 100) of the voice with the given ID.
+		Returns 1 on success, 0 on failure. */
+DLL_FUNC
+GM_REAL bgm_SetVoiceVol( GM_REAL voiceId,
+                         GM_REAL vol );
+
+/*	bgm_SetVoicePan() -
+		Sets the panning (-100 to 100) of the voice with the given ID.
+		Returns 1 on success, 0 on failure. */
+DLL_FUNC
+GM_REAL bgm_SetVoicePan( GM_REAL voiceId,
+                         GM_REAL pan );
+
+/*	_bgm_VoicesNew() -
+		Internal function that gives a song loaded as a sample its VOICES,
+		with its own channel as the first.
+		Returns FALSE if it's out of memory. */
+BOOL _bgm_VoicesNew( SONG  *song,
+                     DWORD max );
+
+/*	_bgm_VoicesFree() -
+		Internal function that frees a song's VOICES. Safe to call on songs
+		without any. */
+void _bgm_VoicesFree( SONG *song );
+
+/*	_bgm_VoiceAdd() -
+		Internal function that records a channel BASS gave one of the song's
+		voices, if it hasn't been seen before.
+		Returns its slot in voices. */
+DWORD _bgm_VoiceAdd( VOICES   *voices,
+                     HCHANNEL chan );
+
+/*	_bgm_VoiceStop() -
+		Internal function that stops one of a song's voices. */
+void _bgm_VoiceStop( SONG     *song,
+                     HCHANNEL chan );
+
+/*	_bgm_VoicesPlaying() -
+		Internal function that counts the playing voices of one song, or of
+		every song in the calling thread's context if voices is NULL, and
+		records which they are for _bgm_VoiceVictim(). */
+DWORD _bgm_VoicesPlaying( VOICES *voices );
+
+/*	_bgm_VoiceVictim() -
+		Internal function that picks the playing voice to steal for a new
+		one of the given priority: of the given song only, or of any if
+		only is NULL. Only voices the last _bgm_VoicesPlaying() of those
+		songs found playing are looked at.
+		Returns the song the voice is of, with its slot in *slot, or NULL
+		if every playing voice has a higher priority. */
+SONG* _bgm_VoiceVictim( SONG  *only,
+                        DWORD prio,
+                        DWORD now,
+                        DWORD *slot );
+
+/*	_bgm_GetSongByVoice() -
+		Internal function that finds the song a voice belongs to, in the
+		calling thread's context.
+		Returns the song, or NULL if no song has the voice. */
+SONG* _bgm_GetSongByVoice( DWORD voice );
+
+#endif // BGM_VOICE_H
+
+/* END OF FILE */
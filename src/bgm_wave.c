@@ -0,0 +1,343 @@
+/******************************************************************************
+ *
+ *	bgm_wave.c -
+ *		Implementation of BGM's waveform pyramids and bgm_WaveformRead().
+ *
+ *	The bottom level is filled in as the analysis worker decodes the file;
+ *	the levels above are built from it once the file is done. Sidecar
+ *	layout (after the cache header): freq, frames, levels, count[levels],
+ *	then the pairs of every level, bottom first.
+ *
+ *****************************************************************************/
+
+#include "bgm.h"
+
+/******************************************************************************
+ * Function implementations
+ *****************************************************************************/
+
+/*	_bgm_WaveStart() -
+		Internal function that gets a WAVESTATE ready for a file with the
+		given sample rate. Returns FALSE if out of memory. */
+BOOL _bgm_WaveStart( WAVESTATE *state,
+                     DWORD     freq )
+{
+	state->freq = freq ? freq : 44100;
+	state->frames = 0;
+	state->min = state->max = 0.0f;
+	state->fill = 0;
+	state->count = 0;
+
+	// Room for about 5 minutes to start with
+	state->room = 300*state->freq/BGM_WAVE_BLOCK;
+	state->base = NEW(signed char,state->room*2);
+	return state->base != NULL;
+}
+
+/*	_bgm_WaveFeed() -
+		Internal function that adds frames mono samples to the bottom level
+		of the pyramid. */
+void _bgm_WaveFeed( WAVESTATE   *state,
+                    const float *mono,
+                    DWORD       frames )
+{
+	DWORD i;
+	float v;
+
+	for (i=0; i<frames; i++) {
+		v = mono[i];
+		if (state->fill == 0)
+			state->min = state->max = v;
+		else if (v < state->min)
+			state->min = v;
+		else if (v > state->max)
+			state->max = v;
+
+		if (++state->fill == BGM_WAVE_BLOCK)
+			_bgm_WavePush(state);
+	}
+
+	state->frames += frames;
+}
+
+/*	_bgm_WavePush() -
+		Internal function that stores the block being filled as a bottom
+		level pair and starts a new one. */
+void _bgm_WavePush( WAVESTATE *state )
+{
+	signed char *grown;
+
+	if (state->count == state->room) {
+		grown = (signed char*)realloc(state->base, state->room*4);
+		if (!grown)
+			return;
+		state->base = grown;
+		state->room *= 2;
+	}
+	if (state->min < -1.0f) state->min = -1.0f;
+	if (state->max > 1.0f) state->max = 1.0f;
+	state->base[state->count*2] = (signed char)floor(state->min*127.0f);
+	state->base[state->count*2+1] = (signed char)ceil(state->max*127.0f);
+	state->count++;
+	state->fill = 0;
+}
+
+/*	_bgm_WaveFinish() -
+		Internal function that builds the upper levels of the pyramid from
+		everything fed in and frees the state's memory.
+		Returns the new WAVEPYRAMID, or NULL if out of memory. */
+WAVEPYRAMID* _bgm_WaveFinish( WAVESTATE *state )
+{
+	WAVEPYRAMID *wave;
+	DWORD l, i, total;
+	signed char *below, *here;
+
+	// Keep a partly filled last block too
+	if (state->fill)
+		_bgm_WavePush(state);
+
+	wave = NEW(WAVEPYRAMID,1);
+	if (!wave) {
+		free(state->base);
+		return NULL;
+	}
+	wave->freq = state->freq;
+	wave->frames = state->frames;
+
+	// Work the level sizes out first...
+	wave->count[0] = state->count;
+	wave->offset[0] = 0;
+	total = state->count;
+	for (l=1; l<BGM_WAVE_MAXLEVELS && wave->count[l-1] > 1; l++) {
+		wave->count[l] = (wave->count[l-1]+1)/2;
+		wave->offset[l] = total;
+		total += wave->count[l];
+	}
+	wave->levels = l;
+
+	wave->data = NEW(signed char,total*2+2);
+	if (!wave->data) {
+		free(wave);
+		free(state->base);
+		return NULL;
+	}
+
+	// ...then fill them in from the bottom up
+	memcpy(wave->data, state->base, state->count*2);
+	free(state->base);
+	state->base = NULL;
+	for (l=1; l<wave->levels; l++) {
+		below = wave->data + wave->offset[l-1]*2;
+		here = wave->data + wave->offset[l]*2;
+		for (i=0; i<wave->count[l]; i++) {
+			here[i*2] = below[i*4];
+			here[i*2+1] = below[i*4+1];
+			// The last pair may only have one below it
+			if (i*2+1 < wave->count[l-1]) {
+				if (below[i*4+2] < here[i*2]) here[i*2] = below[i*4+2];
+				if (below[i*4+3] > here[i*2+1]) here[i*2+1] = below[i*4+3];
+			}
+		}
+	}
+
+	return wave;
+}
+
+/*	_bgm_WaveFree() -
+		Internal function that frees a WAVEPYRAMID. */
+void _bgm_WaveFree( WAVEPYRAMID *wave )
+{
+	if (!wave)
+		return;
+	free(wave->data);
+	free(wave);
+}
+
+/*	_bgm_WaveLoad() -
+		Internal function that loads a file's pyramid from its sidecar.
+		Returns NULL if there is no up to date sidecar. */
+WAVEPYRAMID* _bgm_WaveLoad( const char     *fname,
+                            const CACHEKEY *key )
+{
+	FILE *f;
+	WAVEPYRAMID *wave;
+	DWORD l, total = 0, left;
+
+	f = _bgm_CacheOpen(fname, BGM_WAVE_EXT, BGM_WAVE_MAGIC, key);
+	if (!f)
+		return NULL;
+
+	wave = NEW(WAVEPYRAMID,1);
+	if (!wave) {
+		fclose(f);
+		return NULL;
+	}
+	wave->data = NULL;
+
+	// A damaged sidecar can't ask for more than it holds
+	if (fread(&wave->freq, sizeof(DWORD), 1, f) != 1 ||
+	    fread(&wave->frames, sizeof(DWORD), 1, f) != 1 ||
+	    fread(&wave->levels, sizeof(DWORD), 1, f) != 1 ||
+	    wave->levels < 1 || wave->levels > BGM_WAVE_MAXLEVELS ||
+	    fread(wave->count, sizeof(DWORD), wave->levels, f) != wave->levels)
+		goto fail;
+	left = _bgm_CacheLeft(f)/2;
+	for (l=0; l<wave->levels; l++) {
+		wave->offset[l] = total;
+		total += wave->count[l];
+		if (wave->count[l] > left || total > left)
+			goto fail;
+	}
+	wave->data = NEW(signed char,total*2+2);
+	if (!wave->data || fread(wave->data, 2, total, f) != total)
+		goto fail;
+
+	fclose(f);
+	return wave;
+
+fail:
+	fclose(f);
+	_bgm_WaveFree(wave);
+	return NULL;
+}
+
+/*	_bgm_WaveSave() -
+		Internal function that saves a file's pyramid to its sidecar. */
+void _bgm_WaveSave( const char        *fname,
+                    const CACHEKEY    *key,
+                    const WAVEPYRAMID *wave )
+{
+	FILE *f;
+	DWORD l, total = 0;
+
+	f = _bgm_CacheCreate(fname, BGM_WAVE_EXT, BGM_WAVE_MAGIC, key);
+	if (!f)
+		return;
+
+	for (l=0; l<wave->levels; l++)
+		total += wave->count[l];
+	fwrite(&wave->freq, sizeof(DWORD), 1, f);
+	fwrite(&wave->frames, sizeof(DWORD), 1, f);
+	fwrite(&wave->levels, sizeof(DWORD), 1, f);
+	fwrite(wave->count, sizeof(DWORD), wave->levels, f);
+	fwrite(wave->data, 2, total, f);
+	fclose(f);
+}
+
+/*	_bgm_WaveRange() -
+		Internal function that finds the lowest and highest sample between
+		bottom level blocks b0 and b1 (not included). */
+void _bgm_WaveRange( const WAVEPYRAMID *wave,
+                     DWORD             b0,
+                     DWORD             b1,
+                     int               *min,
+                     int               *max )
+{
+	const signed char *p;
+	DWORD l;
+
+	*min = 127;
+	*max = -127;
+
+	// Take the odd pair off either end, then go up a level
+	for (l=0; b0 < b1 && l < wave->levels; l++, b0 >>= 1, b1 >>= 1) {
+		p = wave->data + wave->offset[l]*2;
+		if (b0 & 1) {
+			if (p[b0*2] < *min) *min = p[b0*2];
+			if (p[b0*2+1] > *max) *max = p[b0*2+1];
+			b0++;
+		}
+		if (b1 & 1) {
+			b1--;
+			if (p[b1*2] < *min) *min = p[b1*2];
+			if (p[b1*2+1] > *max) *max = p[b1*2+1];
+		}
+	}
+
+	// Nothing in range
+	if (*min > *max)
+		*min = *max = 0;
+}
+
+/*	bgm_WaveformRead() -
+		Writes the waveform of the song with the given ID between startMs and
+		endMs into a GM buffer as columns (min, max) pairs of 32-bit floats.
+		Returns 1 on success, 0 on failure and -1 if the waveform isn't ready
+		yet. */
+DLL_FUNC
+GM_REAL bgm_WaveformRead( GM_REAL   songId,
+                          GM_REAL   startMs,
+                          GM_REAL   endMs,
+                          GM_REAL   columns,
+                          GM_STRING bufferAddress,
+                          GM_REAL   size )
+{
+	ANALYSIS *entry;
+	WAVEPYRAMID *wave;
+	float *out = (float*)bufferAddress;
+	DWORD cols = (DWORD)columns, c, b0, b1;
+	double blocksPerMs, start;
+	int min, max;
+	BOOL failed;
+
+	if (BGM_CMD_ASYNC)
+		return _bgm_CmdCall(BGM_CMD_WAVEFORMREAD, "rrrrpr", songId, startMs,
+		                    endMs, columns, bufferAddress, size);
+
+	ERROR_CONTEXT("Failed to read waveform");
+
+	/* ERROR HANDLER */
+	if (columns < 1) {
+		BGM_ERROR("Column count (%i) must be at least 1.", (int)columns);
+		return FALSE;
+	}
+	if (endMs <= startMs || startMs < 0) {
+		BGM_ERROR("Invalid time range.");
+		return FALSE;
+	}
+	if (!out) {
+		BGM_ERROR("Invalid buffer address.");
+		return FALSE;
+	}
+	if (size < sizeof(float)*2*(double)cols) {
+		BGM_ERROR("Buffer is too small (needs at least %.0f bytes).",
+		          sizeof(float)*2*(double)cols);
+		return FALSE;
+	}
+
+	entry = _bgm_AnalyzeGet(_bgm_GetSongById(songId), AN_WAVE);
+	/* ERROR HANDLER */
+	if (!entry)
+		return FALSE;
+
+	EnterCriticalSection(&bgm_anLock);
+	wave = (entry->done & AN_WAVE) ? entry->wave : NULL;
+	failed = entry->failed & AN_WAVE;
+	if (!wave) {
+		LeaveCriticalSection(&bgm_anLock);
+		/* ERROR HANDLER */
+		if (failed) {
+			BGM_ERROR("Song could not be decoded for analysis.");
+			return FALSE;
+		}
+		return -1;
+	}
+
+	// Every column gets whatever blocks it overlaps, at least one
+	blocksPerMs = wave->freq/1000.0/BGM_WAVE_BLOCK;
+	for (c=0; c<cols; c++) {
+		start = startMs + (endMs-startMs)*c/cols;
+		b0 = (DWORD)(start*blocksPerMs);
+		b1 = (DWORD)ceil((startMs + (endMs-startMs)*(c+1)/cols)*blocksPerMs);
+		if (b1 <= b0) b1 = b0+1;
+		if (b1 > wave->count[0]) b1 = wave->count[0];
+		_bgm_WaveRange(wave, b0, b1, &min, &max);
+		out[c*2] = min/127.0f;
+		out[c*2+1] = max/127.0f;
+	}
+
+	LeaveCriticalSection(&bgm_anLock);
+	return TRUE;
+}
+
+/* END OF FILE */
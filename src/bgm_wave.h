@@ -0,0 +1,136 @@
+/******************************************************************************
+ *
+ *	bgm_wave.h -
+ *		Prototypes and types for BGM's waveform overviews. A song's waveform
+ *		is kept as a pyramid of min/max pairs: the bottom level has one pair
+ *		per BGM_WAVE_BLOCK samples and each level above has one pair per two
+ *		of the level below, so any stretch of the song can be drawn at any
+ *		width from a handful of pairs per column.
+ *
+ *****************************************************************************/
+
+#ifndef BGM_WAVE_H
+#define BGM_WAVE_H
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// Samples per pair at the bottom of the pyramid
+#define BGM_WAVE_BLOCK 256
+
+// Most levels a pyramid can have (enough for days of audio)
+#define BGM_WAVE_MAXLEVELS 32
+
+// Sidecar extension and magic number
+#define BGM_WAVE_EXT   ".peaks"
+#define BGM_WAVE_MAGIC 0x4B414550 /* "PEAK" */
+
+/******************************************************************************
+ * Typedefs, structs, etc.
+ *****************************************************************************/
+
+/*	WAVEPYRAMID -
+		The waveform of one file. Levels are stored one after the other in
+		data, each as count[level] (min, max) pairs of signed bytes scaled so
+		that 127 is full scale.
+*/
+typedef struct ctagWAVEPYRAMID {
+	DWORD		freq;						// Sample rate of the file
+	DWORD		frames;						// Length of the file in samples
+	DWORD		levels;						// Number of levels
+	DWORD		count[BGM_WAVE_MAXLEVELS];	// Pairs in each level
+	DWORD		offset[BGM_WAVE_MAXLEVELS];	// Where each level starts in data
+	signed char	*data;						// All levels, as min/max pairs
+} WAVEPYRAMID;
+
+/*	WAVESTATE -
+		Working state of the pyramid builder while a file is decoded.
+*/
+typedef struct ctagWAVESTATE {
+	DWORD		freq;		// Sample rate of the file
+	DWORD		frames;		// Samples fed so far
+	float		min, max;	// Extremes of the block being filled
+	DWORD		fill;		// Samples in the block being filled
+	signed char	*base;		// Bottom level pairs so far
+	DWORD		count;		// Pairs in base...
+	DWORD		room;		// ...and room for them
+} WAVESTATE;
+
+/******************************************************************************
+ * Function prototypes
+ *****************************************************************************/
+
+/*	_bgm_WaveStart() -
+		Internal function that gets a WAVESTATE ready for a file with the
+		given sample rate. Returns FALSE if out of memory. */
+BOOL _bgm_WaveStart( WAVESTATE *state,
+                     DWORD     freq );
+
+/*	_bgm_WaveFeed() -
+		Internal function that adds frames mono samples to the bottom level
+		of the pyramid. */
+void _bgm_WaveFeed( WAVESTATE   *state,
+                    const float *mono,
+                    DWORD       frames );
+
+/*	_bgm_WavePush() -
+		Internal function that stores the block being filled as a bottom
+		level pair and starts a new one. */
+void _bgm_WavePush( WAVESTATE *state );
+
+/*	_bgm_WaveFinish() -
+		Internal function that builds the upper levels of the pyramid from
+		everything fed in and frees the state's memory.
+		Returns the new WAVEPYRAMID, or NULL if out of memory. */
+WAVEPYRAMID* _bgm_WaveFinish( WAVESTATE *state );
+
+/*	_bgm_WaveFree() -
+		Internal function that frees a WAVEPYRAMID. */
+void _bgm_WaveFree( WAVEPYRAMID *wave );
+
+/*	_bgm_WaveLoad() -
+		Internal function that loads a file's pyramid from its sidecar.
+		Returns NULL if there is no up to date sidecar. */
+WAVEPYRAMID* _bgm_WaveLoad( const char     *fname,
+                            const CACHEKEY *key );
+
+/*	_bgm_WaveSave() -
+		Internal function that saves a file's pyramid to its sidecar. */
+void _bgm_WaveSave( const char        *fname,
+                    const CACHEKEY    *key,
+                    const WAVEPYRAMID *wave );
+
+/*	_bgm_WaveRange() -
+		Internal function that finds the lowest and highest sample between
+		bottom level blocks b0 and b1 (not included). The range is made up
+		of whole pairs from the levels, like a segment tree, so it only
+		reads two pairs per level at most. */
+void _bgm_WaveRange( const WAVEPYRAMID *wave,
+                     DWORD             b0,
+                     DWORD             b1,
+                     int               *min,
+                     int               *max );
+
+/*	bgm_WaveformRead() -
+		Writes the waveform of the song with the given ID between startMs and
+		endMs into a GM buffer as columns (min, max) pairs of 32-bit floats
+		(buffer_f32), from -1 to 1. bufferAddress is what buffer_get_address()
+		gives, and size is the buffer's size in bytes, which must be at
+		least columns*8.
+		The waveform comes from a pyramid made in the background the first
+		time it is asked for (or loaded from where it was saved last time),
+		so reading it never decodes anything.
+		Returns 1 on success, 0 on failure and -1 if the waveform isn't ready
+		yet. */
+DLL_FUNC
+GM_REAL bgm_WaveformRead( GM_REAL   songId,
+                          GM_REAL   startMs,
+                          GM_REAL   endMs,
+                          GM_REAL   columns,
+                          GM_STRING bufferAddress,
+                          GM_REAL   size );
+
+#endif // BGM_WAVE_H
+
+/* END OF FILE */
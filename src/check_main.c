@@ -0,0 +1,299 @@
+/******************************************************************************
+ *
+ *	check_main.c -
+ *		bgmcheck, a non-interactive check of the parts of BGM that keep
+ *		state behind a song's back: virtual songs being paused and
+ *		unpaused, the cvolume attribute surviving fades and Quick Play,
+ *		voices being stolen and dropped, and songs being parked and put
+ *		back by the Quick Play warm cache. It runs on the null BASS backend
+ *		(see null/bass_null.h), moving its virtual clock on itself, so it
+ *		gives the same answers on every run.
+ *
+ *	Building (Linux):
+ *		gcc -std=gnu99 -O2 -Isrc/null -Isrc -o bgmcheck src/check_main.c
+ *		    src/bgm*.c src/null/bass_null.c src/null/win32_null.c
+ *		    -lpthread -lm
+ *
+ *	Usage: bgmcheck
+ *		Prints one line for each check, "ok" or "FAILED" and what was
+ *		looked at, and exits with 1 if any failed. BGM is built with DEBUG,
+ *		so the checks that expect an error print it too. The songs are
+ *		WAVs written to a "bgmcheck.tmp" folder in the working directory,
+ *		which is removed afterwards.
+ *
+ *****************************************************************************/
+
+#include "bgm.h"
+#include "bass_null.h"
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// The folder the songs are written to, and the songs: a long one for
+// the virtual and Quick Play checks, two more for Quick Play to switch
+// between, and a short one for the voices
+#define CHECK_DIR   "bgmcheck.tmp"
+#define CHECK_LONG  CHECK_DIR "/long.wav"
+#define CHECK_SONGA CHECK_DIR "/a.wav"
+#define CHECK_SONGB CHECK_DIR "/b.wav"
+#define CHECK_VOICE CHECK_DIR "/voice.wav"
+
+/******************************************************************************
+ * Globals
+ *****************************************************************************/
+
+DWORD	check_count;	// Checks made...
+DWORD	check_failed;	// ...and how many of them failed
+
+/******************************************************************************
+ * Function implementations
+ *****************************************************************************/
+
+/*	CheckWriteWav() -
+		Writes the given number of seconds of 8kHz mono WAV. Returns FALSE
+		if it can't. */
+BOOL CheckWriteWav( const char *fname,
+                    DWORD      secs )
+{
+	BYTE head[44] = {
+		'R','I','F','F', 0,0,0,0, 'W','A','V','E',
+		'f','m','t',' ', 16,0,0,0, 1,0, 1,0,
+		0x40,0x1F,0,0, 0x80,0x3E,0,0, 2,0, 16,0,
+		'd','a','t','a', 0,0,0,0
+	};
+	short pcm[8000];
+	DWORD len = sizeof(pcm)*secs, i;
+	FILE *f;
+
+	for (i = 0; i < 8000; i++)
+		pcm[i] = (short)((i % 40) * 500 - 10000);
+	for (i = 0; i < 4; i++) {
+		head[4+i] = (BYTE)((len+36) >> (i*8));
+		head[40+i] = (BYTE)(len >> (i*8));
+	}
+
+	f = fopen(fname, "wb");
+	if (!f)
+		return FALSE;
+	fwrite(head, 1, sizeof(head), f);
+	for (i = 0; i < secs; i++)
+		fwrite(pcm, 1, sizeof(pcm), f);
+	return fclose(f) == 0;
+}
+
+/*	Check() -
+		Counts a check, and prints whether it passed. */
+void Check( BOOL       ok,
+            const char *what )
+{
+	check_count++;
+	if (!ok)
+		check_failed++;
+	printf("%s - %s\n", ok ? "ok" : "FAILED", what);
+}
+
+/*	CheckChannel() -
+		Returns what a song's own channel is doing, whatever BGM says. */
+DWORD CheckChannel( DWORD id )
+{
+	SONG *song = _bgm_PeekSongById(id);
+
+	return song ? BASS_ChannelIsActive(song->id) : (DWORD)-1;
+}
+
+/*	CheckAttr() -
+		Returns TRUE if a song's attribute reads as value. */
+BOOL CheckAttr( DWORD      id,
+                const char *name,
+                const char *value )
+{
+	return strcmp(bgm_GetAttrById(id, (char*)name), value) == 0;
+}
+
+/*	CheckVirtual() -
+		A song turned down below the "virtual" level has its channel paused
+		while it carries on by the clock, through bgm_PauseById() and
+		bgm_UnpauseById(), until it's turned up again. */
+void CheckVirtual( )
+{
+	DWORD id;
+
+	bgm_SetAttrById(0, "virtual", "-30");
+	id = (DWORD)bgm_LoadStream(CHECK_LONG, FALSE);
+	bgm_PlayById(id, TRUE);
+	BASSNULL_Advance(1000);
+
+	bgm_SetAttrById(id, "cvolume", "1");
+	Check(CheckChannel(id) == BASS_ACTIVE_PAUSED &&
+	      bgm_IsPlayingById(id) == BASS_ACTIVE_PLAYING,
+	      "virtual: a song below the level has its channel paused but plays");
+	BASSNULL_Advance(2000);
+	Check(bgm_GetPosById(id) == 3,
+	      "virtual: its position moves on by the clock");
+
+	bgm_UnpauseById(id);
+	Check(CheckChannel(id) == BASS_ACTIVE_PAUSED,
+	      "virtual: unpausing it while it plays leaves the channel paused");
+
+	bgm_PauseById(id);
+	BASSNULL_Advance(2000);
+	Check(bgm_IsPlayingById(id) == BASS_ACTIVE_PAUSED &&
+	      bgm_GetPosById(id) == 3,
+	      "virtual: pausing it stops the clock");
+
+	bgm_UnpauseById(id);
+	Check(CheckChannel(id) == BASS_ACTIVE_PAUSED &&
+	      bgm_IsPlayingById(id) == BASS_ACTIVE_PLAYING,
+	      "virtual: unpausing it starts the clock, not the channel");
+	BASSNULL_Advance(2000);
+	Check(bgm_GetPosById(id) == 5,
+	      "virtual: its position moves on again from where it was paused");
+
+	bgm_SetAttrById(id, "cvolume", "100");
+	BASSNULL_Advance(BASSNULL_PERIOD);
+	Check(CheckChannel(id) == BASS_ACTIVE_PLAYING &&
+	      bgm_GetPosById(id) == 5,
+	      "virtual: turning it up plays the channel from the clock");
+
+	bgm_UnloadById(id);
+	bgm_SetAttrById(0, "virtual", "0");
+}
+
+/*	CheckVolume() -
+		cvolume reads back as it was set, as the level a fade is heading to,
+		and unchanged after the song it's set on leaves Quick Play and comes
+		back. */
+void CheckVolume( )
+{
+	DWORD id, vol;
+
+	id = (DWORD)bgm_LoadStream(CHECK_LONG, FALSE);
+	bgm_SetAttrById(id, "cvolume", "37");
+	Check(CheckAttr(id, "cvolume", "37"), "cvolume: reads back as set");
+
+	bgm_PlayById(id, TRUE);
+	bgm_FadeVolById(id, 20, 500);
+	Check(CheckAttr(id, "cvolume", "20"),
+	      "cvolume: reads as the level a fade is heading to");
+	BASSNULL_Advance(600);
+	BASS_ChannelGetAttributes(_bgm_PeekSongById(id)->id, NULL, &vol, NULL);
+	Check(vol == 20 && CheckAttr(id, "cvolume", "20"),
+	      "cvolume: the channel ends the fade there");
+	bgm_UnloadById(id);
+
+	bgm_Load(CHECK_SONGA, TRUE, TRUE);
+	bgm_SetAttrById(0, "cvolume", "55");
+	bgm_Load(CHECK_SONGB, TRUE, TRUE);
+	Check(CheckAttr(0, "cvolume", "55"),
+	      "cvolume: carries over to the next song at Quick Play");
+	bgm_SetAttrById(0, "cvolume", "70");
+	bgm_Load(CHECK_SONGA, TRUE, TRUE);
+	Check(CheckAttr(0, "cvolume", "70"),
+	      "cvolume: carries over to a song put back at Quick Play");
+	bgm_UnloadById(0);
+}
+
+/*	CheckVoices() -
+		Over the voice budget, a play steals a voice of no higher priority,
+		the lowest first, and is dropped if there is none. */
+void CheckVoices( )
+{
+	DWORD low, high, voice;
+	char stolen[32], dropped[32];
+
+	bgm_SetAttrById(0, "voicebudget", "2");
+	low = (DWORD)bgm_LoadSampleVoices(CHECK_VOICE, 4);
+	high = (DWORD)bgm_LoadSampleVoices(CHECK_VOICE, 4);
+	bgm_SetAttrById(low, "vcooldown", "0");
+	bgm_SetAttrById(high, "vcooldown", "0");
+	bgm_SetAttrById(low, "vpriority", "0");
+	bgm_SetAttrById(high, "vpriority", "5");
+	strcpy(stolen, bgm_GetAttrById(0, "voicesstolen"));
+	strcpy(dropped, bgm_GetAttrById(0, "voicesdropped"));
+
+	Check(bgm_PlayVoice(low) && bgm_PlayVoice(low) &&
+	      CheckAttr(0, "voicesstolen", stolen),
+	      "voices: plays up to the budget take nothing");
+
+	voice = (DWORD)bgm_PlayVoice(high);
+	Check(voice && atoi(bgm_GetAttrById(0, "voicesstolen")) ==
+	               atoi(stolen)+1,
+	      "voices: over the budget, a higher priority play steals one");
+
+	voice = (DWORD)bgm_PlayVoice(high);
+	Check(voice && atoi(bgm_GetAttrById(0, "voicesstolen")) ==
+	               atoi(stolen)+2,
+	      "voices: the lowest priority voice goes first");
+
+	voice = (DWORD)bgm_PlayVoice(low);
+	Check(!voice && atoi(bgm_GetAttrById(0, "voicesdropped")) ==
+	                atoi(dropped)+1,
+	      "voices: a play with nothing of its priority to steal is dropped");
+
+	bgm_UnloadById(low);
+	bgm_UnloadById(high);
+	bgm_SetAttrById(0, "voicebudget", "0");
+}
+
+/*	CheckQuickPlay() -
+		A song replaced at Quick Play is parked, can't be looked up, and is
+		put back (the same channel, not loaded again) when it's loaded at
+		Quick Play again. */
+void CheckQuickPlay( )
+{
+	DWORD chan;
+
+	bgm_SetAttrById(0, "qpwarm", "2");
+	bgm_Load(CHECK_SONGA, TRUE, TRUE);
+	chan = _bgm_PeekSongById(0)->id;
+
+	bgm_Load(CHECK_SONGB, TRUE, TRUE);
+	Check(_bgm_PeekSongById(0)->id != chan &&
+	      !bgm_IsLoadedByFname(CHECK_SONGA),
+	      "quick play: the song it replaces is parked out of sight");
+
+	bgm_Load(CHECK_SONGA, TRUE, TRUE);
+	Check(_bgm_PeekSongById(0)->id == chan,
+	      "quick play: loading it again puts the parked channel back");
+
+	bgm_Load(CHECK_SONGB, TRUE, TRUE);
+	bgm_SetAttrById(0, "qpwarm", "0");
+	bgm_Load(CHECK_SONGA, TRUE, TRUE);
+	Check(_bgm_PeekSongById(0)->id != chan,
+	      "quick play: with qpwarm at 0, nothing is kept parked");
+	bgm_UnloadById(0);
+	bgm_SetAttrById(0, "qpwarm", "2");
+}
+
+int main( int argc, char *argv[] )
+{
+	BOOL ok;
+
+	mkdir(CHECK_DIR, 0777);
+	ok = CheckWriteWav(CHECK_LONG, 10) && CheckWriteWav(CHECK_SONGA, 10) &&
+	     CheckWriteWav(CHECK_SONGB, 10) && CheckWriteWav(CHECK_VOICE, 2);
+	if (!ok || !bgm_Init(-1, 44100, 16, 0, 0)) {
+		fprintf(stderr, "Couldn't set up: %s\n", ok ? bgm_Error()
+		                                           : "can't write songs");
+		return 1;
+	}
+	bgm_SetReportErrors(FALSE);
+
+	CheckVirtual();
+	CheckVolume();
+	CheckVoices();
+	CheckQuickPlay();
+
+	bgm_Close();
+	remove(CHECK_LONG);
+	remove(CHECK_SONGA);
+	remove(CHECK_SONGB);
+	remove(CHECK_VOICE);
+	remove(CHECK_DIR);
+
+	printf("%u checks, %u failed\n", check_count, check_failed);
+	return check_failed ? 1 : 0;
+}
+
+/* END OF FILE */
@@ -0,0 +1,1607 @@
+/******************************************************************************
+ *
+ *	bass_null.c -
+ *		Implementation of the null BASS backend (see bass_null.h).
+ *
+ *	Every channel, sample and DSP lives in one list under one lock, which
+ *	is held while effects run, as BASS holds its mixer's. Channels are
+ *	mixed a block at a time into floats, which effects then get as floats
+ *	or as 16-bit as BASS_CONFIG_FLOATDSP says; nothing else is done with
+ *	the mix.
+ *
+ *****************************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include "windows.h"
+#include <bass.h>
+#include "bass_null.h"
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// Frames mixed at a time, and the most effects a channel can have
+#define NULL_BLOCK  1024
+#define NULL_MAXDSP 32
+
+// Buckets in the handle lookup (a power of two)
+#define NULL_HASH 4096
+
+// Channels and instruments a module has
+#define NULL_MUSCHANS 16
+#define NULL_MUSINSTS 4
+
+// The three things a slide can move
+enum { NULL_FREQ, NULL_VOL, NULL_PAN, NULL_ATTRIBS };
+
+/******************************************************************************
+ * Typedefs, structs, etc.
+ *****************************************************************************/
+
+/*	NULLDSP -
+		An effect set on a channel.
+*/
+typedef struct {
+	HDSP	handle;
+	DSPPROC	*proc;
+	DWORD	user;
+	int		priority;
+} NULLDSP;
+
+/*	NULLCHAN -
+		A stream, module, sample or sample channel. Samples are never
+		played themselves; their channels share their PCM.
+*/
+typedef struct ctagNULLCHAN {
+	DWORD	handle;
+	DWORD	ctype;			// BASS_CTYPE_xxx, or 0 for a sample
+	DWORD	flags;
+	DWORD	freq, chans;	// Default rate and channel count
+	float	*pcm;			// A decoded WAV, or NULL to play the tone
+	QWORD	frames;			// Length in sample frames
+	QWORD	frame;			// Position in sample frames
+	double	owed;			// Part of a frame still to mix
+	DWORD	fileLen;		// Length of the file it came from
+	STREAMFILEPROC *fileProc;	// User file stream's callback
+	DWORD	fileUser;
+	struct ctagNULLCHAN *sample;	// Sample a sample channel is from
+	DWORD	max;			// Sample's most channels at once
+	DWORD	state;			// BASS_ACTIVE_xxx
+	BOOL	buffered;		// Has data buffered to play from where it is
+	DWORD	wait;			// Time left before it's heard, in ms
+	double	attr[NULL_ATTRIBS];	// Rate (0=default), volume and pan
+	double	slideFrom[NULL_ATTRIBS], slideTo[NULL_ATTRIBS];
+	DWORD	sliding;		// BASS_SLIDE_xxx flags
+	DWORD	slideTime, slideDone;
+	DWORD	music[0x200+NULL_MUSINSTS];	// Module attributes
+	double	row;			// Module's position in rows
+	BYTE	*net;			// An internet stream's file, as served...
+	DWORD	netGot;			// ...how much of it has come...
+	QWORD	netStart;		// ...when it was asked for...
+	DOWNLOADPROC *netProc;	// ...and who else gets it
+	DWORD	netUser;
+	BOOL	stalled;		// Waiting for more of it before playing on
+	NULLDSP	dsp[NULL_MAXDSP];
+	int		dsps;
+	struct ctagNULLCHAN *next, *prev;
+	struct ctagNULLCHAN *hashNext;	// Next in its null_hash bucket
+} NULLCHAN;
+
+/******************************************************************************
+ * Global variables
+ *****************************************************************************/
+
+pthread_mutex_t null_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+NULLCHAN *null_chans = NULL;
+NULLCHAN *null_hash[NULL_HASH];	// The same, by handle, so that a lookup
+								// doesn't cost more the more there are
+DWORD null_nextHandle = 0x10000;
+BOOL null_init = FALSE;
+DWORD null_freq = BASSNULL_FREQ;
+QWORD null_clock = 0;
+DWORD null_startDelay = 0;
+char null_netFolder[512] = "";	// Where internet streams are served from...
+DWORD null_netLatency = 0;		// ...how long the first byte takes...
+DWORD null_netRate = 0;			// ...and bytes a second after it
+DWORD null_config[32] = {
+	500, 100, 0, 100, 10000, 10000, 10000, FALSE, FALSE, FALSE,
+	0, 0, 5000, 0, 0, 75
+};
+__thread int null_error = BASS_OK;
+
+/******************************************************************************
+ * Internal functions
+ *****************************************************************************/
+
+/*	_null_Fail() -
+		Sets the calling thread's error code. Returns 0, for the caller to
+		pass on. */
+DWORD _null_Fail( int code )
+{
+	null_error = code;
+	return 0;
+}
+
+/*	_null_Find() -
+		Finds a channel (sample is FALSE) or a sample (sample is TRUE), with
+		the lock held. Sets BASS_ERROR_HANDLE and returns NULL if there's
+		no such thing. */
+NULLCHAN* _null_Find( DWORD handle,
+                      BOOL  sample )
+{
+	NULLCHAN *c;
+
+	for (c = null_hash[handle & (NULL_HASH-1)]; c; c = c->hashNext) {
+		if (c->handle == handle && (c->ctype == 0) == (sample != 0))
+			return c;
+	}
+	_null_Fail(BASS_ERROR_HANDLE);
+	return NULL;
+}
+
+/*	_null_New() -
+		Makes a channel and adds it to the list, with the lock held. */
+NULLCHAN* _null_New( DWORD ctype,
+                     DWORD flags,
+                     DWORD freq,
+                     DWORD chans )
+{
+	NULLCHAN *c = calloc(1, sizeof(NULLCHAN));
+	int i;
+
+	if (!c) {
+		_null_Fail(BASS_ERROR_MEM);
+		return NULL;
+	}
+	c->handle = null_nextHandle++;
+	c->ctype = ctype;
+	c->flags = flags;
+	c->freq = freq;
+	c->chans = chans;
+	c->attr[NULL_VOL] = 100;
+	// Decoding channels are "playing" until they run out
+	c->state = (flags & BASS_STREAM_DECODE) ? BASS_ACTIVE_PLAYING
+	                                        : BASS_ACTIVE_STOPPED;
+
+	c->music[BASS_MUSIC_ATTRIB_AMPLIFY] = 50;
+	c->music[BASS_MUSIC_ATTRIB_PANSEP] = 50;
+	c->music[BASS_MUSIC_ATTRIB_PSCALER] = 1;
+	c->music[BASS_MUSIC_ATTRIB_BPM] = 125;
+	c->music[BASS_MUSIC_ATTRIB_SPEED] = 6;
+	c->music[BASS_MUSIC_ATTRIB_VOL_GLOBAL] = 64;
+	for (i = 0; i < NULL_MUSCHANS; i++)
+		c->music[BASS_MUSIC_ATTRIB_VOL_CHAN+i] = 64;
+	for (i = 0; i < NULL_MUSINSTS; i++)
+		c->music[BASS_MUSIC_ATTRIB_VOL_INST+i] = 64;
+
+	c->next = null_chans;
+	if (null_chans)
+		null_chans->prev = c;
+	null_chans = c;
+	c->hashNext = null_hash[c->handle & (NULL_HASH-1)];
+	null_hash[c->handle & (NULL_HASH-1)] = c;
+	return c;
+}
+
+/*	_null_Free() -
+		Takes a channel out of the list and frees it, with the lock held. */
+void _null_Free( NULLCHAN *c )
+{
+	NULLCHAN **p;
+
+	if (c->prev)
+		c->prev->next = c->next;
+	else
+		null_chans = c->next;
+	if (c->next)
+		c->next->prev = c->prev;
+	for (p = &null_hash[c->handle & (NULL_HASH-1)]; *p; p = &(*p)->hashNext) {
+		if (*p == c) {
+			*p = c->hashNext;
+			break;
+		}
+	}
+	if (c->fileProc)
+		c->fileProc(BASS_FILE_CLOSE, 0, 0, c->fileUser);
+	// Sample channels share their sample's PCM
+	if (!c->sample)
+		free(c->pcm);
+	free(c->net);
+	free(c);
+}
+
+/*	_null_IsMusic() -
+		Returns TRUE if a file name has a module's extension. */
+BOOL _null_IsMusic( const char *fname )
+{
+	static const char *ext[] = {
+		".mod", ".s3m", ".xm", ".it", ".mtm", ".mo3", ".umx", NULL
+	};
+	const char *dot = strrchr(fname, '.');
+	int i;
+
+	for (i = 0; dot && ext[i]; i++) {
+		if (strcasecmp(dot, ext[i]) == 0)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/*	_null_LoadFile() -
+		Reads a whole file into memory, with its length in len. Returns
+		NULL (with the error set) if it can't. */
+BYTE* _null_LoadFile( const char *fname,
+                      DWORD      *len )
+{
+	FILE *f = fopen(fname, "rb");
+	BYTE *data;
+	long n;
+
+	if (!f) {
+		_null_Fail(BASS_ERROR_FILEOPEN);
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	n = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	data = malloc(n > 0 ? n : 1);
+	if (!data || fread(data, 1, n, f) != (size_t)n) {
+		free(data);
+		fclose(f);
+		_null_Fail(BASS_ERROR_FILEOPEN);
+		return NULL;
+	}
+	fclose(f);
+	*len = (DWORD)n;
+	return data;
+}
+
+/*	_null_Wav() -
+		Decodes a WAV file in memory into c. Returns 1 if it did, 0 if it
+		isn't a WAV at all, or -1 if it's a WAV that can't be played. */
+int _null_Wav( NULLCHAN   *c,
+               const BYTE *data,
+               DWORD      len )
+{
+	const BYTE *fmt = NULL, *pcm = NULL;
+	DWORD pos, size, pcmLen = 0, i, n;
+	WORD tag, bits;
+
+	if (len < 12 || memcmp(data, "RIFF", 4) || memcmp(data+8, "WAVE", 4))
+		return 0;
+
+	for (pos = 12; pos + 8 <= len; pos += 8 + ((size+1) & ~1)) {
+		size = data[pos+4] | data[pos+5]<<8 | data[pos+6]<<16 |
+		       (DWORD)data[pos+7]<<24;
+		if (size > len - pos - 8)
+			size = len - pos - 8;
+		if (!memcmp(data+pos, "fmt ", 4) && size >= 16)
+			fmt = data+pos+8;
+		else if (!memcmp(data+pos, "data", 4)) {
+			pcm = data+pos+8;
+			pcmLen = size;
+		}
+	}
+	if (!fmt || !pcm)
+		return -1;
+
+	tag = fmt[0] | fmt[1]<<8;
+	c->chans = fmt[2] | fmt[3]<<8;
+	c->freq = fmt[4] | fmt[5]<<8 | fmt[6]<<16 | (DWORD)fmt[7]<<24;
+	bits = fmt[14] | fmt[15]<<8;
+	if (!c->chans || c->chans > 8 || !c->freq ||
+	    !((tag == 1 && (bits == 8 || bits == 16)) || (tag == 3 && bits == 32)))
+		return -1;
+
+	// Samples keep theirs
+	if (c->ctype)
+		c->ctype = (tag == 3) ? BASS_CTYPE_STREAM_WAV_FLOAT
+		                      : BASS_CTYPE_STREAM_WAV_PCM;
+	c->frames = pcmLen / (c->chans*bits/8);
+	n = (DWORD)c->frames*c->chans;
+	c->pcm = malloc((n ? n : 1)*sizeof(float));
+	if (!c->pcm)
+		return -1;
+	for (i = 0; i < n; i++) {
+		if (bits == 8)
+			c->pcm[i] = (pcm[i] - 128) / 128.0f;
+		else if (bits == 16)
+			c->pcm[i] = (short)(pcm[i*2] | pcm[i*2+1]<<8) / 32768.0f;
+		else
+			memcpy(&c->pcm[i], pcm + i*4, 4);
+	}
+	return 1;
+}
+
+/*	_null_Open() -
+		Fills in a stream or sample's PCM and format from a file. Returns
+		FALSE (with the error set) if it can't be played. */
+BOOL _null_Open( NULLCHAN   *c,
+                 const char *fname )
+{
+	BYTE *data;
+	DWORD len;
+	const char *dot;
+	int wav;
+
+	if (_null_IsMusic(fname))
+		return _null_Fail(BASS_ERROR_FILEFORM);
+	data = _null_LoadFile(fname, &len);
+	if (!data)
+		return FALSE;
+	c->fileLen = len;
+
+	wav = _null_Wav(c, data, len);
+	free(data);
+	if (wav < 0)
+		return _null_Fail(BASS_ERROR_FILEFORM);
+	if (wav > 0)
+		return TRUE;
+
+	// Anything else is the tone, for as long as the file suggests
+	c->frames = (QWORD)len*c->freq/16000;
+	dot = strrchr(fname, '.');
+	if (!c->ctype || !dot)
+		return TRUE;
+	if (strcasecmp(dot, ".ogg") == 0)
+		c->ctype = BASS_CTYPE_STREAM_OGG;
+	else if (strcasecmp(dot, ".mp3") == 0)
+		c->ctype = BASS_CTYPE_STREAM_MP3;
+	return TRUE;
+}
+
+/*	_null_Bytes() -
+		Returns how many bytes a sample frame of a channel takes. */
+DWORD _null_Bytes( NULLCHAN *c )
+{
+	return c->chans * ((c->flags & BASS_SAMPLE_FLOAT) ? 4 : 2);
+}
+
+/*	_null_RowFrames() -
+		Returns how many sample frames a module row lasts at the module's
+		tempo. */
+double _null_RowFrames( NULLCHAN *c )
+{
+	return 2.5*c->music[BASS_MUSIC_ATTRIB_SPEED]*c->freq /
+	       c->music[BASS_MUSIC_ATTRIB_BPM];
+}
+
+/*	_null_Left() -
+		Returns how many sample frames a channel has left to play. */
+QWORD _null_Left( NULLCHAN *c )
+{
+	double rows;
+
+	// A module ends with its last row, whatever the tempo did on the way
+	if (c->ctype & BASS_CTYPE_MUSIC_MOD) {
+		rows = BASSNULL_ORDERS*64 - c->row;
+		return rows > 0 ? (QWORD)ceil(rows*_null_RowFrames(c)) : 0;
+	}
+	return c->frame < c->frames ? c->frames - c->frame : 0;
+}
+
+/*	_null_Rewind() -
+		Puts a channel back to its start. */
+void _null_Rewind( NULLCHAN *c )
+{
+	c->frame = 0;
+	c->row = 0;
+	c->owed = 0;
+}
+
+/*	_null_Render() -
+		Mixes up to n sample frames of a channel into buf as floats, and
+		runs its effects on them. Returns how many it mixed, fewer than n
+		only at the end. */
+DWORD _null_Render( NULLCHAN *c,
+                    float    *buf,
+                    DWORD    n )
+{
+	static __thread short buf16[NULL_BLOCK*8];
+	QWORD left = _null_Left(c), f;
+	BOOL asFloat;
+	DWORD i, ch;
+	int d;
+
+	if (n > left)
+		n = (DWORD)left;
+
+	for (i = 0; i < n; i++) {
+		f = c->frame + i;
+		for (ch = 0; ch < c->chans; ch++) {
+			if (c->pcm)
+				buf[i*c->chans+ch] = c->pcm[f*c->chans+ch];
+			else {
+				// 440Hz, fading out and back in every half second
+				buf[i*c->chans+ch] = (float)(0.25 *
+				    sin(2*M_PI*440.0*f/c->freq) *
+				    exp(-8.0*(f % (c->freq/2))/c->freq));
+			}
+		}
+	}
+	c->frame += n;
+	if (c->ctype & BASS_CTYPE_MUSIC_MOD)
+		c->row += n/_null_RowFrames(c);
+
+	// Effects, highest priority first
+	asFloat = null_config[BASS_CONFIG_FLOATDSP] ||
+	          (c->flags & BASS_SAMPLE_FLOAT);
+	if (!asFloat) {
+		for (i = 0; i < n*c->chans && i < NULL_BLOCK*8; i++)
+			buf16[i] = (short)(buf[i] < -1 ? -32768 : buf[i] > 1 ? 32767
+			                   : buf[i]*32767);
+	}
+	for (d = 0; d < c->dsps && n; d++) {
+		c->dsp[d].proc(c->dsp[d].handle, c->handle,
+		               asFloat ? (void*)buf : (void*)buf16,
+		               n*c->chans*(asFloat ? 4 : 2), c->dsp[d].user);
+	}
+	if (!asFloat) {
+		for (i = 0; i < n*c->chans && i < NULL_BLOCK*8; i++)
+			buf[i] = buf16[i] / 32768.0f;
+	}
+
+	return n;
+}
+
+/*	_null_Download() -
+		Hands an internet stream whatever more of its file has come by now,
+		and the end of it once it all has. */
+void _null_Download( NULLCHAN *c )
+{
+	QWORD elapsed = null_clock - c->netStart, got;
+
+	if (c->netGot == c->fileLen && !c->netProc)
+		return;
+	if (elapsed < null_netLatency)
+		return;
+	got = null_netRate ? (elapsed - null_netLatency)*null_netRate/1000
+	                   : c->fileLen;
+	if (got > c->fileLen)
+		got = c->fileLen;
+
+	if (got > c->netGot && c->netProc)
+		c->netProc(c->net + c->netGot, (DWORD)got - c->netGot, c->netUser);
+	c->netGot = (DWORD)got;
+	if (c->netGot == c->fileLen) {
+		if (c->netProc)
+			c->netProc(NULL, 0, c->netUser);
+		c->netProc = NULL;
+	}
+}
+
+/*	_null_NetStalled() -
+		Returns TRUE if an internet stream has to wait for more of its file
+		before it can play on from where it is. Like BASS, it waits for
+		BASS_CONFIG_NET_PREBUF percent of BASS_CONFIG_NET_BUFFER ms ahead
+		to be there once it has run dry, and until then plays as far as
+		there is anything. */
+BOOL _null_NetStalled( NULLCHAN *c )
+{
+	QWORD need, ahead;
+
+	if (!c->net || c->netGot == c->fileLen || !c->frames)
+		return FALSE;
+
+	need = (QWORD)c->fileLen*c->frame/c->frames;
+	if (c->stalled) {
+		ahead = (QWORD)c->fileLen*c->freq/1000 *
+		        null_config[BASS_CONFIG_NET_BUFFER] *
+		        null_config[BASS_CONFIG_NET_PREBUF]/100 / c->frames;
+		need += ahead;
+	}
+	c->stalled = c->netGot <= need;
+	return c->stalled;
+}
+
+/*	_null_Slide() -
+		Moves a channel's slides on by ms milliseconds. */
+void _null_Slide( NULLCHAN *c,
+                  DWORD    ms )
+{
+	double t;
+	int a;
+
+	if (!c->sliding)
+		return;
+	c->slideDone += ms;
+	t = c->slideDone >= c->slideTime ? 1.0
+	                                 : (double)c->slideDone/c->slideTime;
+	for (a = 0; a < NULL_ATTRIBS; a++) {
+		if (c->sliding & (1 << a))
+			c->attr[a] = c->slideFrom[a] + (c->slideTo[a]-c->slideFrom[a])*t;
+	}
+	if (t >= 1.0)
+		c->sliding = 0;
+}
+
+/******************************************************************************
+ * Null backend functions
+ *****************************************************************************/
+
+void BASSNULL_Advance( DWORD ms )
+{
+	float buf[NULL_BLOCK*8];
+	NULLCHAN *c;
+	DWORD step, n, got, rate;
+
+	pthread_mutex_lock(&null_lock);
+
+	while (ms) {
+		step = ms < BASSNULL_PERIOD ? ms : BASSNULL_PERIOD;
+		ms -= step;
+		null_clock += step;
+
+		for (c = null_chans; c; c = c->next) {
+			if (c->net)
+				_null_Download(c);
+			if (!c->ctype || (c->flags & BASS_STREAM_DECODE))
+				continue;
+			_null_Slide(c, step);
+			if (c->state != BASS_ACTIVE_PLAYING)
+				continue;
+
+			// Still filling its buffer, or waiting for the server
+			if (c->wait) {
+				c->wait -= step < c->wait ? step : c->wait;
+				continue;
+			}
+			if (_null_NetStalled(c))
+				continue;
+
+			rate = c->attr[NULL_FREQ] ? (DWORD)c->attr[NULL_FREQ] : c->freq;
+			c->owed += (double)rate*step/1000.0;
+			n = (DWORD)c->owed;
+			c->owed -= n;
+
+			while (n) {
+				got = _null_Render(c, buf, n < NULL_BLOCK ? n : NULL_BLOCK);
+				n -= got;
+				if (_null_Left(c))
+					continue;
+				// The end: round again, or stop
+				if ((c->flags & BASS_SAMPLE_LOOP) && got) {
+					_null_Rewind(c);
+					continue;
+				}
+				c->state = BASS_ACTIVE_STOPPED;
+				c->owed = 0;
+				c->buffered = FALSE;
+				break;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&null_lock);
+}
+
+DWORD BASSNULL_GetTime( void )
+{
+	DWORD ret;
+
+	pthread_mutex_lock(&null_lock);
+	ret = (DWORD)null_clock;
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+void BASSNULL_SetStartDelay( DWORD ms )
+{
+	pthread_mutex_lock(&null_lock);
+	null_startDelay = ms;
+	pthread_mutex_unlock(&null_lock);
+}
+
+void BASSNULL_SetNet( const char *folder,
+                      DWORD      latency,
+                      DWORD      rate )
+{
+	pthread_mutex_lock(&null_lock);
+	snprintf(null_netFolder, sizeof(null_netFolder), "%s",
+	         folder ? folder : "");
+	null_netLatency = latency;
+	null_netRate = rate;
+	pthread_mutex_unlock(&null_lock);
+}
+
+/******************************************************************************
+ * BASS functions
+ *****************************************************************************/
+
+DWORD BASS_SetConfig( DWORD option,
+                      DWORD value )
+{
+	if (option >= 32)
+		return _null_Fail(BASS_ERROR_ILLTYPE) - 1;
+	pthread_mutex_lock(&null_lock);
+	null_config[option] = value;
+	pthread_mutex_unlock(&null_lock);
+	null_error = BASS_OK;
+	return value;
+}
+
+DWORD BASS_GetConfig( DWORD option )
+{
+	DWORD ret;
+
+	if (option >= 32)
+		return _null_Fail(BASS_ERROR_ILLTYPE) - 1;
+	pthread_mutex_lock(&null_lock);
+	ret = null_config[option];
+	pthread_mutex_unlock(&null_lock);
+	null_error = BASS_OK;
+	return ret;
+}
+
+int BASS_ErrorGetCode( void )
+{
+	return null_error;
+}
+
+BOOL BASS_Init( int   device,
+                DWORD freq,
+                DWORD flags,
+                void  *win,
+                void  *dsguid )
+{
+	BOOL ret = FALSE;
+
+	pthread_mutex_lock(&null_lock);
+	if (device < -1 || device > 1)
+		_null_Fail(BASS_ERROR_DEVICE);
+	else if (null_init)
+		_null_Fail(BASS_ERROR_ALREADY);
+	else {
+		null_init = TRUE;
+		null_freq = freq ? freq : BASSNULL_FREQ;
+		null_error = BASS_OK;
+		ret = TRUE;
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+BOOL BASS_Free( void )
+{
+	pthread_mutex_lock(&null_lock);
+	if (!null_init) {
+		pthread_mutex_unlock(&null_lock);
+		return _null_Fail(BASS_ERROR_INIT);
+	}
+	// Sample channels before their samples
+	while (null_chans)
+		_null_Free(null_chans);
+	null_init = FALSE;
+	pthread_mutex_unlock(&null_lock);
+	null_error = BASS_OK;
+	return TRUE;
+}
+
+HMUSIC BASS_MusicLoad( BOOL       mem,
+                       const void *file,
+                       DWORD      offset,
+                       DWORD      length,
+                       DWORD      flags,
+                       DWORD      freq )
+{
+	const char *dot;
+	NULLCHAN *c;
+	FILE *f;
+	DWORD ret = 0;
+
+	if (mem)
+		return _null_Fail(BASS_ERROR_NOTAVAIL);
+	if (!_null_IsMusic(file))
+		return _null_Fail(BASS_ERROR_FILEFORM);
+	f = fopen(file, "rb");
+	if (!f)
+		return _null_Fail(BASS_ERROR_FILEOPEN);
+	fclose(f);
+
+	pthread_mutex_lock(&null_lock);
+	if (!null_init)
+		_null_Fail(BASS_ERROR_INIT);
+	else if ((c = _null_New(BASS_CTYPE_MUSIC_MOD, flags,
+	                        freq ? freq : null_freq, 2)) != NULL) {
+		dot = strrchr(file, '.');
+		if (strcasecmp(dot, ".s3m") == 0)
+			c->ctype = BASS_CTYPE_MUSIC_S3M;
+		else if (strcasecmp(dot, ".xm") == 0)
+			c->ctype = BASS_CTYPE_MUSIC_XM;
+		else if (strcasecmp(dot, ".it") == 0)
+			c->ctype = BASS_CTYPE_MUSIC_IT;
+		else if (strcasecmp(dot, ".mtm") == 0)
+			c->ctype = BASS_CTYPE_MUSIC_MTM;
+		else if (strcasecmp(dot, ".mo3") == 0)
+			c->ctype = BASS_CTYPE_MUSIC_MOD | BASS_CTYPE_MUSIC_MO3;
+		c->frames = (QWORD)(BASSNULL_ORDERS*64*_null_RowFrames(c));
+		ret = c->handle;
+		null_error = BASS_OK;
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+BOOL BASS_MusicFree( HMUSIC handle )
+{
+	NULLCHAN *c;
+	BOOL ret = FALSE;
+
+	pthread_mutex_lock(&null_lock);
+	c = _null_Find(handle, FALSE);
+	if (c && !(c->ctype & BASS_CTYPE_MUSIC_MOD))
+		_null_Fail(BASS_ERROR_HANDLE);
+	else if (c) {
+		_null_Free(c);
+		null_error = BASS_OK;
+		ret = TRUE;
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+DWORD BASS_MusicSetAttribute( HMUSIC handle,
+                              DWORD  attrib,
+                              DWORD  value )
+{
+	NULLCHAN *c;
+	DWORD ret = (DWORD)-1;
+
+	pthread_mutex_lock(&null_lock);
+	c = _null_Find(handle, FALSE);
+	if (c && !(c->ctype & BASS_CTYPE_MUSIC_MOD))
+		_null_Fail(BASS_ERROR_HANDLE);
+	else if (c && (attrib > BASS_MUSIC_ATTRIB_VOL_GLOBAL &&
+	               (attrib < BASS_MUSIC_ATTRIB_VOL_CHAN ||
+	                attrib >= BASS_MUSIC_ATTRIB_VOL_CHAN+NULL_MUSCHANS) &&
+	               (attrib < BASS_MUSIC_ATTRIB_VOL_INST ||
+	                attrib >= BASS_MUSIC_ATTRIB_VOL_INST+NULL_MUSINSTS)))
+		_null_Fail(BASS_ERROR_ILLTYPE);
+	else if (c && ((attrib == BASS_MUSIC_ATTRIB_BPM &&
+	                (value < 32 || value > 255)) ||
+	               (attrib == BASS_MUSIC_ATTRIB_SPEED &&
+	                (value < 1 || value > 255))))
+		_null_Fail(BASS_ERROR_ILLPARAM);
+	else if (c) {
+		c->music[attrib] = value;
+		null_error = BASS_OK;
+		ret = TRUE;
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+DWORD BASS_MusicGetAttribute( HMUSIC handle,
+                              DWORD  attrib )
+{
+	NULLCHAN *c;
+	DWORD ret = (DWORD)-1;
+
+	pthread_mutex_lock(&null_lock);
+	c = _null_Find(handle, FALSE);
+	if (c && !(c->ctype & BASS_CTYPE_MUSIC_MOD))
+		_null_Fail(BASS_ERROR_HANDLE);
+	else if (c && (attrib > BASS_MUSIC_ATTRIB_VOL_GLOBAL &&
+	               (attrib < BASS_MUSIC_ATTRIB_VOL_CHAN ||
+	                attrib >= BASS_MUSIC_ATTRIB_VOL_CHAN+NULL_MUSCHANS) &&
+	               (attrib < BASS_MUSIC_ATTRIB_VOL_INST ||
+	                attrib >= BASS_MUSIC_ATTRIB_VOL_INST+NULL_MUSINSTS)))
+		_null_Fail(BASS_ERROR_ILLTYPE);
+	else if (c) {
+		ret = c->music[attrib];
+		null_error = BASS_OK;
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+DWORD BASS_MusicGetOrderPosition( HMUSIC handle )
+{
+	NULLCHAN *c;
+	DWORD ret = (DWORD)-1, row;
+
+	pthread_mutex_lock(&null_lock);
+	c = _null_Find(handle, FALSE);
+	if (c && !(c->ctype & BASS_CTYPE_MUSIC_MOD))
+		_null_Fail(BASS_ERROR_HANDLE);
+	else if (c) {
+		row = (DWORD)c->row;
+		if (row >= BASSNULL_ORDERS*64)
+			row = BASSNULL_ORDERS*64 - 1;
+		ret = MAKELONG(row/64, row%64);
+		null_error = BASS_OK;
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+HSAMPLE BASS_SampleLoad( BOOL       mem,
+                         const void *file,
+                         DWORD      offset,
+                         DWORD      length,
+                         DWORD      max,
+                         DWORD      flags )
+{
+	NULLCHAN *c;
+	DWORD ret = 0;
+
+	if (mem)
+		return _null_Fail(BASS_ERROR_NOTAVAIL);
+
+	pthread_mutex_lock(&null_lock);
+	if (!null_init)
+		_null_Fail(BASS_ERROR_INIT);
+	else if ((c = _null_New(0, flags, null_freq, 2)) != NULL) {
+		if (!_null_Open(c, file))
+			_null_Free(c);
+		else {
+			c->max = max ? max : 1;
+			ret = c->handle;
+			null_error = BASS_OK;
+		}
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+BOOL BASS_SampleFree( HSAMPLE handle )
+{
+	NULLCHAN *s, *c, *next;
+	BOOL ret = FALSE;
+
+	pthread_mutex_lock(&null_lock);
+	s = _null_Find(handle, TRUE);
+	if (s) {
+		for (c = null_chans; c; c = next) {
+			next = c->next;
+			if (c->sample == s)
+				_null_Free(c);
+		}
+		_null_Free(s);
+		null_error = BASS_OK;
+		ret = TRUE;
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+BOOL BASS_SampleGetInfo( HSAMPLE     handle,
+                         BASS_SAMPLE *info )
+{
+	NULLCHAN *s;
+	BOOL ret = FALSE;
+
+	pthread_mutex_lock(&null_lock);
+	s = _null_Find(handle, TRUE);
+	if (s) {
+		memset(info, 0, sizeof(BASS_SAMPLE));
+		info->freq = s->freq;
+		info->volume = 100;
+		info->flags = s->flags;
+		info->length = (DWORD)(s->frames*_null_Bytes(s));
+		info->max = s->max;
+		info->origres = (s->flags & BASS_SAMPLE_FLOAT) ? 32 : 16;
+		info->chans = s->chans;
+		null_error = BASS_OK;
+		ret = TRUE;
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+HCHANNEL BASS_SampleGetChannel( HSAMPLE handle,
+                                BOOL    onlynew )
+{
+	NULLCHAN *s, *c, *oldest = NULL;
+	DWORD ret = 0, count = 0;
+
+	pthread_mutex_lock(&null_lock);
+	s = _null_Find(handle, TRUE);
+	if (s) {
+		// The list is newest first, so the last one found is the oldest
+		for (c = null_chans; c; c = c->next) {
+			if (c->sample == s) {
+				count++;
+				oldest = c;
+			}
+		}
+		if (count >= s->max && onlynew)
+			_null_Fail(BASS_ERROR_NOCHAN);
+		else if (count >= s->max) {
+			oldest->state = BASS_ACTIVE_STOPPED;
+			_null_Rewind(oldest);
+			ret = oldest->handle;
+			null_error = BASS_OK;
+		}
+		else if ((c = _null_New(BASS_CTYPE_SAMPLE, s->flags, s->freq,
+		                        s->chans)) != NULL) {
+			c->sample = s;
+			c->pcm = s->pcm;
+			c->frames = s->frames;
+			c->fileLen = s->fileLen;
+			ret = c->handle;
+			null_error = BASS_OK;
+		}
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+BOOL BASS_SampleStop( HSAMPLE handle )
+{
+	NULLCHAN *s, *c;
+	BOOL ret = FALSE;
+
+	pthread_mutex_lock(&null_lock);
+	s = _null_Find(handle, TRUE);
+	if (s) {
+		for (c = null_chans; c; c = c->next) {
+			if (c->sample == s)
+				c->state = BASS_ACTIVE_STOPPED;
+		}
+		null_error = BASS_OK;
+		ret = TRUE;
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+HSTREAM BASS_StreamCreateFile( BOOL       mem,
+                               const void *file,
+                               DWORD      offset,
+                               DWORD      length,
+                               DWORD      flags )
+{
+	NULLCHAN *c;
+	DWORD ret = 0;
+
+	if (mem)
+		return _null_Fail(BASS_ERROR_NOTAVAIL);
+
+	pthread_mutex_lock(&null_lock);
+	if (!null_init)
+		_null_Fail(BASS_ERROR_INIT);
+	else if ((c = _null_New(BASS_CTYPE_STREAM, flags, BASSNULL_FREQ,
+	                        2)) != NULL) {
+		if (!_null_Open(c, file))
+			_null_Free(c);
+		else {
+			ret = c->handle;
+			null_error = BASS_OK;
+		}
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+HSTREAM BASS_StreamCreateURL( const char  *url,
+                              DWORD       offset,
+                              DWORD       flags,
+                              DOWNLOADPROC *proc,
+                              DWORD       user )
+{
+	char path[1024];
+	const char *c;
+	NULLCHAN *chan;
+	DWORD ret = 0;
+
+	pthread_mutex_lock(&null_lock);
+	if (!null_init)
+		_null_Fail(BASS_ERROR_INIT);
+	else if (!null_netFolder[0])
+		_null_Fail(BASS_ERROR_NONET);
+	else if (strncasecmp(url, "http://", 7) != 0)
+		_null_Fail(BASS_ERROR_ILLPARAM);
+	else {
+		// The server's path, under the folder
+		c = strchr(url+7, '/');
+		snprintf(path, sizeof(path), "%s/%s", null_netFolder,
+		         c ? c+1 : "");
+		chan = _null_New(BASS_CTYPE_STREAM, flags, BASSNULL_FREQ, 2);
+		if (chan && (!_null_Open(chan, path) ||
+		             !(chan->net = _null_LoadFile(path, &chan->fileLen))))
+			_null_Free(chan);
+		else if (chan) {
+			chan->netStart = null_clock;
+			chan->netProc = proc;
+			chan->netUser = user;
+			chan->stalled = TRUE;
+			// All of it at once, if the connection is that fast
+			_null_Download(chan);
+			ret = chan->handle;
+			null_error = BASS_OK;
+		}
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+HSTREAM BASS_StreamCreateFileUser( BOOL           buffered,
+                                   DWORD          flags,
+                                   STREAMFILEPROC *proc,
+                                   DWORD          user )
+{
+	NULLCHAN *c;
+	DWORD ret = 0;
+
+	pthread_mutex_lock(&null_lock);
+	if (!null_init)
+		_null_Fail(BASS_ERROR_INIT);
+	else if ((c = _null_New(BASS_CTYPE_STREAM, flags, BASSNULL_FREQ,
+	                        2)) != NULL) {
+		// Never read: the buffer's address can't go through a DWORD on a
+		// 64-bit build, so it's the tone for as long as the file suggests
+		c->fileLen = proc(BASS_FILE_LEN, 0, 0, user);
+		c->frames = (QWORD)c->fileLen*c->freq/16000;
+		c->fileProc = proc;
+		c->fileUser = user;
+		ret = c->handle;
+		null_error = BASS_OK;
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+BOOL BASS_StreamFree( HSTREAM handle )
+{
+	NULLCHAN *c;
+	BOOL ret = FALSE;
+
+	pthread_mutex_lock(&null_lock);
+	c = _null_Find(handle, FALSE);
+	if (c && !(c->ctype & BASS_CTYPE_STREAM))
+		_null_Fail(BASS_ERROR_HANDLE);
+	else if (c) {
+		_null_Free(c);
+		null_error = BASS_OK;
+		ret = TRUE;
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+DWORD BASS_StreamGetFilePosition( HSTREAM handle,
+                                  DWORD   mode )
+{
+	NULLCHAN *c;
+	DWORD ret = (DWORD)-1;
+
+	pthread_mutex_lock(&null_lock);
+	c = _null_Find(handle, FALSE);
+	if (c && !(c->ctype & BASS_CTYPE_STREAM))
+		_null_Fail(BASS_ERROR_NOTFILE);
+	else if (c) {
+		switch (mode) {
+			case BASS_FILEPOS_CURRENT:
+				ret = c->frames ? (DWORD)((double)c->fileLen*c->frame/c->frames)
+				                : 0;
+			break;
+
+			case BASS_FILEPOS_DOWNLOAD:
+				ret = c->net ? c->netGot : c->fileLen;
+			break;
+
+			case BASS_FILEPOS_END:
+				ret = c->fileLen;
+			break;
+
+			case BASS_FILEPOS_START:
+				ret = 0;
+			break;
+
+			default:
+				_null_Fail(BASS_ERROR_ILLTYPE);
+			break;
+		}
+		if (ret != (DWORD)-1)
+			null_error = BASS_OK;
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+float BASS_ChannelBytes2Seconds( DWORD handle,
+                                 QWORD pos )
+{
+	NULLCHAN *c;
+	float ret = -1;
+
+	pthread_mutex_lock(&null_lock);
+	c = _null_Find(handle, FALSE);
+	if (c) {
+		ret = (float)((double)pos/_null_Bytes(c)/c->freq);
+		null_error = BASS_OK;
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+QWORD BASS_ChannelSeconds2Bytes( DWORD handle,
+                                 float pos )
+{
+	NULLCHAN *c;
+	QWORD ret = (QWORD)-1;
+
+	pthread_mutex_lock(&null_lock);
+	c = _null_Find(handle, FALSE);
+	if (c) {
+		ret = (QWORD)((double)pos*c->freq)*_null_Bytes(c);
+		null_error = BASS_OK;
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+DWORD BASS_ChannelIsActive( DWORD handle )
+{
+	NULLCHAN *c;
+	DWORD ret = BASS_ACTIVE_STOPPED;
+
+	pthread_mutex_lock(&null_lock);
+	c = _null_Find(handle, FALSE);
+	if (c) {
+		ret = c->state;
+		if (ret == BASS_ACTIVE_PLAYING && c->stalled && c->netGot < c->fileLen)
+			ret = BASS_ACTIVE_STALLED;
+		null_error = BASS_OK;
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+BOOL BASS_ChannelGetInfo( DWORD            handle,
+                          BASS_CHANNELINFO *info )
+{
+	NULLCHAN *c;
+	BOOL ret = FALSE;
+
+	pthread_mutex_lock(&null_lock);
+	c = _null_Find(handle, FALSE);
+	if (c) {
+		info->freq = c->freq;
+		info->chans = c->chans;
+		info->flags = c->flags;
+		info->ctype = c->ctype;
+		info->origres = (c->flags & BASS_SAMPLE_FLOAT) ? 32 : 16;
+		info->plugin = 0;
+		null_error = BASS_OK;
+		ret = TRUE;
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+const char* BASS_ChannelGetTags( DWORD handle,
+                                 DWORD tags )
+{
+	static const char *inst[NULL_MUSINSTS] = {
+		"Instrument 1", "Instrument 2", "Instrument 3", "Instrument 4"
+	};
+	NULLCHAN *c;
+	const char *ret = NULL;
+
+	pthread_mutex_lock(&null_lock);
+	c = _null_Find(handle, FALSE);
+	if (c && (c->ctype & BASS_CTYPE_MUSIC_MOD)) {
+		if (tags == BASS_TAG_MUSIC_NAME)
+			ret = "bass_null";
+		else if (tags >= BASS_TAG_MUSIC_INST &&
+		         tags < BASS_TAG_MUSIC_INST+NULL_MUSINSTS)
+			ret = inst[tags - BASS_TAG_MUSIC_INST];
+		else if (tags >= BASS_TAG_MUSIC_SAMPLE &&
+		         tags < BASS_TAG_MUSIC_SAMPLE+NULL_MUSINSTS)
+			ret = inst[tags - BASS_TAG_MUSIC_SAMPLE];
+	}
+	if (c)
+		null_error = ret ? BASS_OK : BASS_ERROR_NOTAVAIL;
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+BOOL BASS_ChannelSetFlags( DWORD handle,
+                           DWORD flags )
+{
+	NULLCHAN *c;
+	BOOL ret = FALSE;
+
+	pthread_mutex_lock(&null_lock);
+	c = _null_Find(handle, FALSE);
+	if (c) {
+		// Only the playback flags can change
+		c->flags = (c->flags & (BASS_STREAM_DECODE|BASS_SAMPLE_FLOAT)) |
+		           (flags & ~(BASS_STREAM_DECODE|BASS_SAMPLE_FLOAT));
+		null_error = BASS_OK;
+		ret = TRUE;
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+BOOL BASS_ChannelPreBuf( DWORD handle,
+                         DWORD length )
+{
+	NULLCHAN *c;
+	BOOL ret = FALSE;
+
+	pthread_mutex_lock(&null_lock);
+	c = _null_Find(handle, FALSE);
+	if (c && (c->flags & BASS_STREAM_DECODE))
+		_null_Fail(BASS_ERROR_DECODE);
+	else if (c && (c->ctype == BASS_CTYPE_SAMPLE ||
+	               c->state == BASS_ACTIVE_PLAYING))
+		_null_Fail(BASS_ERROR_NOTAVAIL);
+	else if (c) {
+		c->buffered = TRUE;
+		null_error = BASS_OK;
+		ret = TRUE;
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+BOOL BASS_ChannelPlay( DWORD handle,
+                       BOOL  restart )
+{
+	NULLCHAN *c;
+	BOOL ret = FALSE;
+
+	pthread_mutex_lock(&null_lock);
+	c = _null_Find(handle, FALSE);
+	if (c && (c->flags & BASS_STREAM_DECODE))
+		_null_Fail(BASS_ERROR_DECODE);
+	else if (c) {
+		// Starting over throws away what was buffered
+		if (restart || !_null_Left(c)) {
+			_null_Rewind(c);
+			c->buffered = FALSE;
+		}
+		// A sample channel plays from memory; anything else with nothing
+		// buffered isn't heard until the buffer is filled
+		if (!c->buffered && c->ctype != BASS_CTYPE_SAMPLE &&
+		    c->state != BASS_ACTIVE_PLAYING)
+			c->wait = null_startDelay;
+		c->buffered = TRUE;
+		c->state = BASS_ACTIVE_PLAYING;
+		null_error = BASS_OK;
+		ret = TRUE;
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+BOOL BASS_ChannelStop( DWORD handle )
+{
+	NULLCHAN *c;
+	BOOL ret = FALSE;
+
+	pthread_mutex_lock(&null_lock);
+	c = _null_Find(handle, FALSE);
+	if (c) {
+		if (!(c->flags & BASS_STREAM_DECODE))
+			c->state = BASS_ACTIVE_STOPPED;
+		c->buffered = FALSE;
+		c->wait = 0;
+		null_error = BASS_OK;
+		ret = TRUE;
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+BOOL BASS_ChannelPause( DWORD handle )
+{
+	NULLCHAN *c;
+	BOOL ret = FALSE;
+
+	pthread_mutex_lock(&null_lock);
+	c = _null_Find(handle, FALSE);
+	if (c && (c->flags & BASS_STREAM_DECODE))
+		_null_Fail(BASS_ERROR_DECODE);
+	else if (c && c->state == BASS_ACTIVE_PAUSED)
+		_null_Fail(BASS_ERROR_ALREADY);
+	else if (c && c->state != BASS_ACTIVE_PLAYING)
+		_null_Fail(BASS_ERROR_NOPLAY);
+	else if (c) {
+		c->state = BASS_ACTIVE_PAUSED;
+		null_error = BASS_OK;
+		ret = TRUE;
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+BOOL BASS_ChannelSetAttributes( DWORD handle,
+                                int   freq,
+                                int   volume,
+                                int   pan )
+{
+	NULLCHAN *c;
+	BOOL ret = FALSE;
+
+	pthread_mutex_lock(&null_lock);
+	c = _null_Find(handle, FALSE);
+	if (c && ((freq > 0 && (freq < 100 || freq > 100000)) || volume > 100 ||
+	          volume < -1 || pan > 100 || pan < -101))
+		_null_Fail(BASS_ERROR_ILLPARAM);
+	else if (c) {
+		// Setting something ends its slide
+		if (freq >= 0) {
+			c->attr[NULL_FREQ] = freq;
+			c->sliding &= ~BASS_SLIDE_FREQ;
+		}
+		if (volume >= 0) {
+			c->attr[NULL_VOL] = volume;
+			c->sliding &= ~BASS_SLIDE_VOL;
+		}
+		if (pan >= -100) {
+			c->attr[NULL_PAN] = pan;
+			c->sliding &= ~BASS_SLIDE_PAN;
+		}
+		null_error = BASS_OK;
+		ret = TRUE;
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+BOOL BASS_ChannelGetAttributes( DWORD handle,
+                                DWORD *freq,
+                                DWORD *volume,
+                                int   *pan )
+{
+	NULLCHAN *c;
+	BOOL ret = FALSE;
+
+	pthread_mutex_lock(&null_lock);
+	c = _null_Find(handle, FALSE);
+	if (c) {
+		if (freq)
+			*freq = c->attr[NULL_FREQ] ? (DWORD)(c->attr[NULL_FREQ] + 0.5)
+			                           : c->freq;
+		if (volume)
+			*volume = (DWORD)(c->attr[NULL_VOL] + 0.5);
+		if (pan)
+			*pan = (int)floor(c->attr[NULL_PAN] + 0.5);
+		null_error = BASS_OK;
+		ret = TRUE;
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+BOOL BASS_ChannelSlideAttributes( DWORD handle,
+                                  int   freq,
+                                  int   volume,
+                                  int   pan,
+                                  DWORD time )
+{
+	NULLCHAN *c;
+	BOOL ret = FALSE;
+
+	pthread_mutex_lock(&null_lock);
+	c = _null_Find(handle, FALSE);
+	if (c) {
+		c->sliding = 0;
+		if (freq >= 0) {
+			c->slideFrom[NULL_FREQ] = c->attr[NULL_FREQ] ? c->attr[NULL_FREQ]
+			                                             : c->freq;
+			c->slideTo[NULL_FREQ] = freq ? (double)freq : c->freq;
+			c->sliding |= BASS_SLIDE_FREQ;
+		}
+		if (volume >= 0) {
+			c->slideFrom[NULL_VOL] = c->attr[NULL_VOL];
+			c->slideTo[NULL_VOL] = volume > 100 ? 100 : volume;
+			c->sliding |= BASS_SLIDE_VOL;
+		}
+		if (pan >= -100) {
+			c->slideFrom[NULL_PAN] = c->attr[NULL_PAN];
+			c->slideTo[NULL_PAN] = pan > 100 ? 100 : pan;
+			c->sliding |= BASS_SLIDE_PAN;
+		}
+		c->slideTime = time;
+		c->slideDone = 0;
+		_null_Slide(c, 0);
+		null_error = BASS_OK;
+		ret = TRUE;
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+DWORD BASS_ChannelIsSliding( DWORD handle )
+{
+	NULLCHAN *c;
+	DWORD ret = 0;
+
+	pthread_mutex_lock(&null_lock);
+	c = _null_Find(handle, FALSE);
+	if (c) {
+		ret = c->sliding;
+		null_error = BASS_OK;
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+QWORD BASS_ChannelGetLength( DWORD handle )
+{
+	NULLCHAN *c;
+	QWORD ret = (QWORD)-1;
+
+	pthread_mutex_lock(&null_lock);
+	c = _null_Find(handle, FALSE);
+	if (c) {
+		ret = c->frames*_null_Bytes(c);
+		null_error = BASS_OK;
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+BOOL BASS_ChannelSetPosition( DWORD handle,
+                              QWORD pos )
+{
+	NULLCHAN *c;
+	QWORD frame;
+	double row;
+	BOOL ret = FALSE;
+
+	pthread_mutex_lock(&null_lock);
+	c = _null_Find(handle, FALSE);
+	if (c && (c->ctype & BASS_CTYPE_MUSIC_MOD)) {
+		// MAKELONG(order,row), or MAKELONG(seconds,0xFFFF)
+		if (HIWORD((DWORD)pos) == 0xFFFF)
+			row = LOWORD((DWORD)pos)*(double)c->freq/_null_RowFrames(c);
+		else
+			row = LOWORD((DWORD)pos)*64 + HIWORD((DWORD)pos);
+		if (pos > 0xFFFFFFFF || row >= BASSNULL_ORDERS*64 ||
+		    (HIWORD((DWORD)pos) != 0xFFFF && HIWORD((DWORD)pos) >= 64))
+			_null_Fail(BASS_ERROR_POSITION);
+		else {
+			c->row = row;
+			c->frame = (QWORD)(row*_null_RowFrames(c));
+			c->buffered = (c->state == BASS_ACTIVE_PLAYING);
+			null_error = BASS_OK;
+			ret = TRUE;
+		}
+	}
+	else if (c) {
+		frame = pos/_null_Bytes(c);
+		if (frame > c->frames)
+			_null_Fail(BASS_ERROR_POSITION);
+		else {
+			c->frame = frame;
+			c->buffered = (c->state == BASS_ACTIVE_PLAYING);
+			null_error = BASS_OK;
+			ret = TRUE;
+		}
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+QWORD BASS_ChannelGetPosition( DWORD handle )
+{
+	NULLCHAN *c;
+	QWORD ret = (QWORD)-1;
+
+	pthread_mutex_lock(&null_lock);
+	c = _null_Find(handle, FALSE);
+	if (c) {
+		ret = c->frame*_null_Bytes(c);
+		null_error = BASS_OK;
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+DWORD BASS_ChannelGetData( DWORD handle,
+                           void  *buffer,
+                           DWORD length )
+{
+	float buf[NULL_BLOCK*8];
+	NULLCHAN *c;
+	BOOL asFloat;
+	DWORD want, done = 0, got, i;
+
+	// Sample data only; no FFTs
+	if (length & 0x80000000)
+		return _null_Fail(BASS_ERROR_ILLPARAM) - 1;
+
+	pthread_mutex_lock(&null_lock);
+	c = _null_Find(handle, FALSE);
+	if (!c || !(c->flags & BASS_STREAM_DECODE)) {
+		if (c)
+			_null_Fail(BASS_ERROR_NOTAVAIL);
+		pthread_mutex_unlock(&null_lock);
+		return (DWORD)-1;
+	}
+	if (!_null_Left(c)) {
+		c->state = BASS_ACTIVE_STOPPED;
+		_null_Fail(BASS_ERROR_NOPLAY);
+		pthread_mutex_unlock(&null_lock);
+		return (DWORD)-1;
+	}
+
+	asFloat = (length & BASS_DATA_FLOAT) || (c->flags & BASS_SAMPLE_FLOAT);
+	want = (length & ~BASS_DATA_FLOAT) / (c->chans*(asFloat ? 4 : 2));
+	while (done < want) {
+		got = want - done;
+		got = _null_Render(c, buf, got < NULL_BLOCK ? got : NULL_BLOCK);
+		if (!got)
+			break;
+		for (i = 0; i < got*c->chans; i++) {
+			if (asFloat)
+				((float*)buffer)[done*c->chans+i] = buf[i];
+			else
+				((short*)buffer)[done*c->chans+i] = (short)(buf[i] < -1 ?
+				    -32768 : buf[i] > 1 ? 32767 : buf[i]*32767);
+		}
+		done += got;
+	}
+	if (!_null_Left(c))
+		c->state = BASS_ACTIVE_STOPPED;
+
+	null_error = BASS_OK;
+	pthread_mutex_unlock(&null_lock);
+	return done*c->chans*(asFloat ? 4 : 2);
+}
+
+HDSP BASS_ChannelSetDSP( DWORD  handle,
+                         DSPPROC *proc,
+                         DWORD  user,
+                         int    priority )
+{
+	NULLCHAN *c;
+	DWORD ret = 0;
+	int d;
+
+	pthread_mutex_lock(&null_lock);
+	c = _null_Find(handle, FALSE);
+	if (c && c->dsps == NULL_MAXDSP)
+		_null_Fail(BASS_ERROR_MEM);
+	else if (c) {
+		// Kept highest priority first
+		for (d = c->dsps; d > 0 && c->dsp[d-1].priority < priority; d--)
+			c->dsp[d] = c->dsp[d-1];
+		c->dsp[d].handle = null_nextHandle++;
+		c->dsp[d].proc = proc;
+		c->dsp[d].user = user;
+		c->dsp[d].priority = priority;
+		c->dsps++;
+		ret = c->dsp[d].handle;
+		null_error = BASS_OK;
+	}
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+BOOL BASS_ChannelRemoveDSP( DWORD handle,
+                            HDSP  dsp )
+{
+	NULLCHAN *c;
+	BOOL ret = FALSE;
+	int d;
+
+	pthread_mutex_lock(&null_lock);
+	c = _null_Find(handle, FALSE);
+	for (d = 0; c && d < c->dsps; d++) {
+		if (c->dsp[d].handle == dsp) {
+			c->dsps--;
+			memmove(&c->dsp[d], &c->dsp[d+1], (c->dsps-d)*sizeof(NULLDSP));
+			null_error = BASS_OK;
+			ret = TRUE;
+			break;
+		}
+	}
+	if (c && !ret)
+		_null_Fail(BASS_ERROR_HANDLE);
+	pthread_mutex_unlock(&null_lock);
+	return ret;
+}
+
+/* END OF FILE */
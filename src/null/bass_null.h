@@ -0,0 +1,87 @@
+/******************************************************************************
+ *
+ *	bass_null.h -
+ *		The null BASS backend: a stand-in for bass.dll that plays nothing,
+ *		for running BGM headless on Linux (servers, and tests that need to
+ *		be repeatable down to the sample). Every BASS function BGM calls is
+ *		here, with BASS 2.3's behaviour as far as BGM can tell, but nothing
+ *		is mixed until the program calls BASSNULL_Advance(), which moves a
+ *		virtual clock on and mixes every playing channel by that much,
+ *		running effects and the rest as BASS's mixer would.
+ *
+ *	What channels play:
+ *		WAV files (8/16-bit PCM and 32-bit float) are decoded for real.
+ *		Anything else plays a 440Hz tone that dies away and starts again
+ *		every half second, as long in seconds as the file is in 16000 byte
+ *		lumps (a 128kbps MP3, roughly). Modules (MOD/S3M/XM/IT/MTM/MO3/
+ *		UMX) play the same tone for 8 orders of 64 rows, at their BPM and
+ *		speed attributes.
+ *		Internet streams fail with BASS_ERROR_NONET, unless
+		BASSNULL_SetNet() has given them a folder to be served from.
+ *
+ *	Building:
+ *		gcc -std=gnu99 -Isrc/null -Isrc yourtest.c src/bgm*.c
+ *		    src/null/bass_null.c src/null/win32_null.c -lpthread -lm
+ *
+ *		The stand-in windows.h in this folder is found before any other,
+ *		and the DLL's API is then called directly; bgm_Init(-1, ...) is
+ *		no sound, as with GM, but any device works. Call BASSNULL_Advance()
+ *		from the thread that calls BGM: effects run on it, under the
+ *		backend's lock.
+ *
+ *****************************************************************************/
+
+#ifndef BASS_NULL_H
+#define BASS_NULL_H
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// How much BASSNULL_Advance() mixes at a time (ms); slides, loops and the
+// end of a song are only seen this often, like BASS's update period
+#define BASSNULL_PERIOD 10
+
+// Module length, and the default rate of everything that isn't a WAV
+#define BASSNULL_ORDERS 8
+#define BASSNULL_FREQ   44100
+
+/******************************************************************************
+ * Function prototypes
+ *****************************************************************************/
+
+/*	BASSNULL_Advance() -
+		Moves the virtual clock on by ms milliseconds, mixing every playing
+		channel by as much. */
+void BASSNULL_Advance( DWORD ms );
+
+/*	BASSNULL_GetTime() -
+		Returns the virtual clock, in milliseconds since the program
+		started. GetTickCount() returns the same. */
+DWORD BASSNULL_GetTime( void );
+
+/*	BASSNULL_SetStartDelay() -
+		Sets how long, in ms, a stream or module played with nothing
+		buffered takes to be heard, as BASS takes to fill the buffer before
+		it starts. BASS_ChannelPreBuf() fills it ahead of time; stopping,
+		moving or restarting a channel empties it, and pausing keeps it.
+		0, the default, has everything heard at once. */
+void BASSNULL_SetStartDelay( DWORD ms );
+
+/*	BASSNULL_SetNet() -
+		Serves internet streams from files in folder: "http://host/a/b.wav"
+		is folder/a/b.wav, whatever the host, and a missing file fails with
+		BASS_ERROR_FILEOPEN as a 404 would. The first byte comes latency
+		ms (of virtual time) after the stream is made and the rest at rate
+		bytes a second, 0 being all at once, with the DOWNLOADPROC given
+		each piece as it comes, from BASSNULL_Advance(). A stream that gets
+		ahead of its download stalls until BASS_CONFIG_NET_PREBUF percent
+		of BASS_CONFIG_NET_BUFFER is there again, as one does at the start.
+		A NULL or empty folder goes back to BASS_ERROR_NONET. */
+void BASSNULL_SetNet( const char *folder,
+                      DWORD      latency,
+                      DWORD      rate );
+
+#endif // BASS_NULL_H
+
+/* END OF FILE */
@@ -0,0 +1,336 @@
+/******************************************************************************
+ *
+ *	win32_null.c -
+ *		Implementation of the Win32 stand-in (see windows.h in this folder).
+ *
+ *	A HANDLE is either an event or a thread. Waiting on a thread waits for
+ *	it to finish, as on Windows; closing a thread's handle before then
+ *	leaves it running, detached.
+ *
+ *****************************************************************************/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "windows.h"
+#include "bass_null.h"
+
+/******************************************************************************
+ * Typedefs, structs, etc.
+ *****************************************************************************/
+
+/*	NULLHANDLE -
+		What a HANDLE points to.
+*/
+typedef struct ctagNULLHANDLE {
+	BOOL			isThread;
+	pthread_mutex_t	mutex;		// Guards signaled
+	pthread_cond_t	cond;		// Broadcast when signaled is set
+	BOOL			signaled;	// Event is set, or thread has finished
+	BOOL			manual;		// Event stays set until ResetEvent()
+	pthread_t		thread;
+	LPTHREAD_START_ROUTINE proc;
+	void			*param;
+	BOOL			closed;		// Thread's handle was closed while it ran
+	DWORD			id;			// Thread's ID
+} NULLHANDLE;
+
+/******************************************************************************
+ * Globals
+ *****************************************************************************/
+
+LONG			null_lastThreadId;		// Last thread ID handed out
+__thread DWORD	null_threadId;			// This thread's, once it has one
+
+/******************************************************************************
+ * Function implementations
+ *****************************************************************************/
+
+void InitializeCriticalSection( CRITICAL_SECTION *cs )
+{
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&cs->mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+void DeleteCriticalSection( CRITICAL_SECTION *cs )
+{
+	pthread_mutex_destroy(&cs->mutex);
+}
+
+void EnterCriticalSection( CRITICAL_SECTION *cs )
+{
+	pthread_mutex_lock(&cs->mutex);
+}
+
+void LeaveCriticalSection( CRITICAL_SECTION *cs )
+{
+	pthread_mutex_unlock(&cs->mutex);
+}
+
+/*	_null_NewHandle() -
+		Makes an unsignaled handle. */
+NULLHANDLE* _null_NewHandle( BOOL isThread )
+{
+	NULLHANDLE *h = calloc(1, sizeof(NULLHANDLE));
+
+	if (!h)
+		return NULL;
+	h->isThread = isThread;
+	pthread_mutex_init(&h->mutex, NULL);
+	pthread_cond_init(&h->cond, NULL);
+	return h;
+}
+
+/*	_null_FreeHandle() -
+		Frees a handle nothing is using any more. */
+void _null_FreeHandle( NULLHANDLE *h )
+{
+	pthread_cond_destroy(&h->cond);
+	pthread_mutex_destroy(&h->mutex);
+	free(h);
+}
+
+/*	_null_ThreadMain() -
+		Runs a CreateThread() thread, then signals its handle. */
+void* _null_ThreadMain( void *param )
+{
+	NULLHANDLE *h = param;
+	BOOL closed;
+
+	null_threadId = h->id;
+	h->proc(h->param);
+
+	pthread_mutex_lock(&h->mutex);
+	h->signaled = TRUE;
+	closed = h->closed;
+	pthread_cond_broadcast(&h->cond);
+	pthread_mutex_unlock(&h->mutex);
+
+	// Nobody can wait on it any more, so it's ours to free
+	if (closed)
+		_null_FreeHandle(h);
+	return NULL;
+}
+
+HANDLE CreateThread( void                   *security,
+                     size_t                 stackSize,
+                     LPTHREAD_START_ROUTINE proc,
+                     void                   *param,
+                     DWORD                  flags,
+                     DWORD                  *threadId )
+{
+	NULLHANDLE *h = _null_NewHandle(TRUE);
+
+	if (!h)
+		return NULL;
+	h->proc = proc;
+	h->param = param;
+	h->id = (DWORD)InterlockedIncrement(&null_lastThreadId);
+	if (pthread_create(&h->thread, NULL, _null_ThreadMain, h) != 0) {
+		_null_FreeHandle(h);
+		return NULL;
+	}
+	pthread_detach(h->thread);
+	if (threadId)
+		*threadId = h->id;
+	return h;
+}
+
+DWORD GetCurrentThreadId( void )
+{
+	// Threads it didn't start get theirs the first time they ask
+	if (!null_threadId)
+		null_threadId = (DWORD)InterlockedIncrement(&null_lastThreadId);
+	return null_threadId;
+}
+
+BOOL SetThreadPriority( HANDLE thread,
+                        int    priority )
+{
+	// Scheduling is left to Linux
+	return TRUE;
+}
+
+HANDLE CreateEvent( void       *security,
+                    BOOL       manualReset,
+                    BOOL       initialState,
+                    const char *name )
+{
+	NULLHANDLE *h = _null_NewHandle(FALSE);
+
+	if (!h)
+		return NULL;
+	h->manual = manualReset;
+	h->signaled = initialState;
+	return h;
+}
+
+BOOL SetEvent( HANDLE event )
+{
+	pthread_mutex_lock(&event->mutex);
+	event->signaled = TRUE;
+	pthread_cond_broadcast(&event->cond);
+	pthread_mutex_unlock(&event->mutex);
+	return TRUE;
+}
+
+BOOL ResetEvent( HANDLE event )
+{
+	pthread_mutex_lock(&event->mutex);
+	event->signaled = FALSE;
+	pthread_mutex_unlock(&event->mutex);
+	return TRUE;
+}
+
+DWORD WaitForSingleObject( HANDLE handle,
+                           DWORD  ms )
+{
+	struct timespec until;
+	DWORD ret = WAIT_OBJECT_0;
+
+	if (!handle)
+		return WAIT_FAILED;
+
+	if (ms != INFINITE) {
+		clock_gettime(CLOCK_REALTIME, &until);
+		until.tv_sec += ms/1000;
+		until.tv_nsec += (long)(ms%1000)*1000000;
+		if (until.tv_nsec >= 1000000000) {
+			until.tv_sec++;
+			until.tv_nsec -= 1000000000;
+		}
+	}
+
+	pthread_mutex_lock(&handle->mutex);
+	while (!handle->signaled) {
+		if (ms == INFINITE)
+			pthread_cond_wait(&handle->cond, &handle->mutex);
+		else if (pthread_cond_timedwait(&handle->cond, &handle->mutex,
+		                                &until) == ETIMEDOUT) {
+			ret = WAIT_TIMEOUT;
+			break;
+		}
+	}
+	// Auto-reset events let one waiter through
+	if (ret == WAIT_OBJECT_0 && !handle->isThread && !handle->manual)
+		handle->signaled = FALSE;
+	pthread_mutex_unlock(&handle->mutex);
+
+	return ret;
+}
+
+BOOL CloseHandle( HANDLE handle )
+{
+	BOOL running;
+
+	if (!handle)
+		return FALSE;
+
+	if (handle->isThread) {
+		pthread_mutex_lock(&handle->mutex);
+		running = !handle->signaled;
+		handle->closed = TRUE;
+		pthread_mutex_unlock(&handle->mutex);
+		// The thread frees it when it finishes
+		if (running)
+			return TRUE;
+	}
+
+	_null_FreeHandle(handle);
+	return TRUE;
+}
+
+void Sleep( DWORD ms )
+{
+	usleep((useconds_t)ms*1000);
+}
+
+PVOID InterlockedCompareExchangePointer( PVOID volatile *dest,
+                                         PVOID          exchange,
+                                         PVOID          comparand )
+{
+	return __sync_val_compare_and_swap(dest, comparand, exchange);
+}
+
+LONG InterlockedCompareExchange( LONG volatile *dest,
+                                 LONG          exchange,
+                                 LONG          comparand )
+{
+	return __sync_val_compare_and_swap(dest, comparand, exchange);
+}
+
+LONG InterlockedIncrement( LONG volatile *value )
+{
+	return __sync_add_and_fetch(value, 1);
+}
+
+LONG InterlockedDecrement( LONG volatile *value )
+{
+	return __sync_sub_and_fetch(value, 1);
+}
+
+DWORD TlsAlloc( void )
+{
+	pthread_key_t key;
+
+	// Keys are small integers on Linux, so they pass for TLS indexes
+	if (pthread_key_create(&key, NULL) != 0)
+		return TLS_OUT_OF_INDEXES;
+	return (DWORD)key;
+}
+
+BOOL TlsFree( DWORD index )
+{
+	return pthread_key_delete((pthread_key_t)index) == 0;
+}
+
+void* TlsGetValue( DWORD index )
+{
+	return pthread_getspecific((pthread_key_t)index);
+}
+
+BOOL TlsSetValue( DWORD index,
+                  void  *value )
+{
+	return pthread_setspecific((pthread_key_t)index, value) == 0;
+}
+
+DWORD GetTickCount( void )
+{
+	// Milliseconds of virtual time, so meters and the like move with the
+	// mixing rather than with the wall clock
+	return BASSNULL_GetTime();
+}
+
+BOOL QueryPerformanceCounter( LARGE_INTEGER *count )
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	count->QuadPart = (long long)now.tv_sec*1000000000 + now.tv_nsec;
+	return TRUE;
+}
+
+BOOL QueryPerformanceFrequency( LARGE_INTEGER *freq )
+{
+	freq->QuadPart = 1000000000;
+	return TRUE;
+}
+
+DWORD GetFileAttributes( const char *fname )
+{
+	struct stat st;
+
+	if (stat(fname, &st) != 0)
+		return INVALID_FILE_ATTRIBUTES;
+	return S_ISDIR(st.st_mode) ? FILE_ATTRIBUTE_DIRECTORY
+	                           : FILE_ATTRIBUTE_NORMAL;
+}
+
+/* END OF FILE */
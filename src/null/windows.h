@@ -0,0 +1,134 @@
+/******************************************************************************
+ *
+ *	windows.h -
+ *		Stand-in for the parts of the Win32 API that BGM uses, for building
+ *		it on Linux against the null BASS backend (see bass_null.h). Only
+ *		what BGM's own sources need is here; threads, events and critical
+ *		sections are pthreads underneath (see win32_null.c), and
+ *		GetTickCount() follows the null backend's virtual clock so anything
+ *		timed by it is as repeatable as the mixing.
+ *
+ *****************************************************************************/
+
+#ifndef BGM_NULL_WINDOWS_H
+#define BGM_NULL_WINDOWS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+#define WINAPI
+#define CALLBACK
+#define __declspec(x)
+#define __int64 long long
+
+#ifndef TRUE
+	#define TRUE 1
+#endif
+#ifndef FALSE
+	#define FALSE 0
+#endif
+#ifndef LOWORD
+	#define LOWORD(a) (WORD)(a)
+	#define HIWORD(a) (WORD)((a)>>16)
+	#define MAKELONG(a,b) (DWORD)(((a)&0xffff)|((b)<<16))
+#endif
+
+#define INFINITE 0xFFFFFFFF
+#define WAIT_OBJECT_0 0
+#define WAIT_TIMEOUT 258
+#define WAIT_FAILED 0xFFFFFFFF
+#define MAX_PATH 260
+#define THREAD_PRIORITY_NORMAL 0
+#define THREAD_PRIORITY_ABOVE_NORMAL 1
+#define FILE_ATTRIBUTE_DIRECTORY 0x10
+#define FILE_ATTRIBUTE_NORMAL 0x80
+#define INVALID_FILE_ATTRIBUTES ((DWORD)-1)
+#define TLS_OUT_OF_INDEXES ((DWORD)0xFFFFFFFF)
+
+/******************************************************************************
+ * Typedefs, structs, etc.
+ *****************************************************************************/
+
+// The same as bass.h gives when it isn't built for Windows
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef int BOOL;
+typedef int32_t LONG;	// 32 bits, as on Windows, even where long isn't
+typedef void *PVOID;
+typedef void *HWND;
+typedef struct ctagNULLHANDLE *HANDLE;
+typedef struct { DWORD Data1; WORD Data2, Data3; BYTE Data4[8]; } GUID;
+
+typedef DWORD (WINAPI *LPTHREAD_START_ROUTINE)(void *param);
+
+typedef union {
+	struct { DWORD LowPart; LONG HighPart; } u;
+	long long QuadPart;
+} LARGE_INTEGER;
+
+// Recursive, like the real thing
+typedef struct {
+	pthread_mutex_t mutex;
+} CRITICAL_SECTION;
+
+/******************************************************************************
+ * Function prototypes
+ *****************************************************************************/
+
+void InitializeCriticalSection( CRITICAL_SECTION *cs );
+void DeleteCriticalSection( CRITICAL_SECTION *cs );
+void EnterCriticalSection( CRITICAL_SECTION *cs );
+void LeaveCriticalSection( CRITICAL_SECTION *cs );
+
+HANDLE CreateThread( void                   *security,
+                     size_t                 stackSize,
+                     LPTHREAD_START_ROUTINE proc,
+                     void                   *param,
+                     DWORD                  flags,
+                     DWORD                  *threadId );
+DWORD GetCurrentThreadId( void );
+BOOL SetThreadPriority( HANDLE thread,
+                        int    priority );
+
+HANDLE CreateEvent( void       *security,
+                    BOOL       manualReset,
+                    BOOL       initialState,
+                    const char *name );
+BOOL SetEvent( HANDLE event );
+BOOL ResetEvent( HANDLE event );
+
+DWORD WaitForSingleObject( HANDLE handle,
+                           DWORD  ms );
+BOOL CloseHandle( HANDLE handle );
+void Sleep( DWORD ms );
+
+PVOID InterlockedCompareExchangePointer( PVOID volatile *dest,
+                                         PVOID          exchange,
+                                         PVOID          comparand );
+LONG InterlockedCompareExchange( LONG volatile *dest,
+                                 LONG          exchange,
+                                 LONG          comparand );
+LONG InterlockedIncrement( LONG volatile *value );
+LONG InterlockedDecrement( LONG volatile *value );
+
+DWORD TlsAlloc( void );
+BOOL TlsFree( DWORD index );
+void* TlsGetValue( DWORD index );
+BOOL TlsSetValue( DWORD index,
+                  void  *value );
+
+DWORD GetTickCount( void );
+BOOL QueryPerformanceCounter( LARGE_INTEGER *count );
+BOOL QueryPerformanceFrequency( LARGE_INTEGER *freq );
+
+DWORD GetFileAttributes( const char *fname );
+
+#endif // BGM_NULL_WINDOWS_H
+
+/* END OF FILE */
@@ -0,0 +1,11 @@
+/******************************************************************************
+ *
+ *	wtypes.h -
+ *		Stand-in for wtypes.h; everything BGM needs from it is in the
+ *		stand-in windows.h.
+ *
+ *****************************************************************************/
+
+#include "windows.h"
+
+/* END OF FILE */
@@ -0,0 +1,276 @@
+/******************************************************************************
+ *
+ *	render_main.c -
+ *		bgmrender, a command line tool that renders songs to WAV files
+ *		faster than realtime, with BGM attributes applied. It's built from
+ *		the same sources as BGM.DLL (see BGMRender.dev) and runs BASS on the
+ *		"no sound" device, so it works without a sound card. Folders are
+ *		rendered with one file per core at a time.
+ *
+ *	Usage: bgmrender [options] <file or folder>...
+ *		-o <folder>         Write the WAVs there instead of next to the songs
+ *		-a <name>=<value>   Set an attribute on every song (may be repeated),
+ *		                    e.g. -a tvolume=64 -a amplify=50 -a speed=150
+ *		-r <rate>           Sample rate to render modules at (44100)
+ *		-j <count>          Files to render at once (one per core)
+ *		-f                  Write 32-bit float WAVs instead of 16-bit
+ *
+ *	Each song is written to its own name with ".wav" added, and the time it
+ *	took is reported as a realtime factor (seconds of audio per second).
+ *
+ *****************************************************************************/
+
+#include "bgm.h"
+
+/******************************************************************************
+ * Constants
+ *****************************************************************************/
+
+// Most attributes that can be given with -a
+#define RENDER_MAXATTRS 32
+
+/******************************************************************************
+ * Globals
+ *****************************************************************************/
+
+char	**render_files;					// Songs to render...
+DWORD	render_count, render_room;		// ...how many there are...
+LONG	render_next;					// ...and the next one to start
+char	*render_attrs[RENDER_MAXATTRS];	// -a arguments, as name=value
+DWORD	render_attrCount;
+char	*render_outDir;					// -o argument, or NULL
+DWORD	render_freq = 44100;			// -r argument
+BOOL	render_float;					// -f given?
+LONG	render_failed;					// Songs that failed
+
+// Each thread has a BGM context of its own, so this only keeps the
+// threads' output lines from running into each other
+CRITICAL_SECTION render_lock;
+
+/******************************************************************************
+ * Function implementations
+ *****************************************************************************/
+
+/*	RenderAdd() -
+		Adds a song to the list. */
+void RenderAdd( const char *fname )
+{
+	char **grown;
+
+	if (render_count == render_room) {
+		render_room = render_room ? render_room*2 : 64;
+		grown = RESIZE(render_files, char*, render_room);
+		if (!grown) {
+			printf("Out of memory.\n");
+			exit(1);
+		}
+		render_files = grown;
+	}
+	render_files[render_count] = NEW(char,strlen(fname)+1);
+	strcpy(render_files[render_count++], fname);
+}
+
+/*	RenderAddFolder() -
+		Adds every song in a folder to the list (but not WAVs that look like
+		they were rendered from one of the others). */
+void RenderAddFolder( const char *dir )
+{
+	WIN32_FIND_DATA found;
+	HANDLE find;
+	char path[MAX_PATH], *ext;
+
+	sprintf(path, "%s\\*", dir);
+	find = FindFirstFile(path, &found);
+	if (find == INVALID_HANDLE_VALUE)
+		return;
+
+	do {
+		if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			continue;
+		if (_bgm_GetFileType(found.cFileName) == -1)
+			continue;
+		// Skip "song.it.wav" and the like
+		ext = strrchr(found.cFileName, '.');
+		if (ext && strcmp(ext, ".wav") == 0) {
+			*ext = 0;
+			if (_bgm_GetFileType(found.cFileName) != -1)
+				continue;
+			*ext = '.';
+		}
+		sprintf(path, "%s\\%s", dir, found.cFileName);
+		RenderAdd(path);
+	} while (FindNextFile(find, &found));
+
+	FindClose(find);
+}
+
+/*	RenderOutName() -
+		Works out the WAV name for a song. */
+void RenderOutName( const char *fname,
+                    char       *out )
+{
+	const char *base;
+
+	if (!render_outDir) {
+		sprintf(out, "%s.wav", fname);
+		return;
+	}
+
+	// Just the file name, in the output folder
+	base = strrchr(fname, '\\');
+	if (!base || strrchr(fname, '/') > base)
+		base = strrchr(fname, '/');
+	base = base ? base+1 : fname;
+	sprintf(out, "%s\\%s.wav", render_outDir, base);
+}
+
+/*	RenderThread() -
+		Renders songs from the list until there are none left. */
+DWORD WINAPI RenderThread( void *param )
+{
+	BGM_CONTEXT *ctx;
+	RENDERJOB *job;
+	char outFname[MAX_PATH+16], name[64], *value;
+	DWORD i, a;
+	BOOL ok;
+
+	// This thread's songs go in a context of its own; its errors are
+	// already its own
+	EnterCriticalSection(&render_lock);
+	ctx = _bgm_ContextNew();
+	LeaveCriticalSection(&render_lock);
+	job = NEW(RENDERJOB,1);
+	if (!ctx || !job) {
+		_bgm_ContextFree(ctx);
+		free(job);
+		return 1;
+	}
+	_bgm_ContextUse(ctx);
+
+	while ((i = InterlockedIncrement(&render_next)-1) < render_count) {
+		RenderOutName(render_files[i], outFname);
+
+		// Open the song and set its attributes
+		ok = _bgm_RenderOpen(job, render_files[i], render_freq);
+		for (a=0; ok && a<render_attrCount; a++) {
+			value = strchr(render_attrs[a], '=');
+			strncpy(name, render_attrs[a], value-render_attrs[a]);
+			name[value-render_attrs[a]] = 0;
+			ok = _bgm_RenderAttr(job, name, value+1);
+		}
+		if (!ok) {
+			EnterCriticalSection(&render_lock);
+			printf("%s: %s\n", render_files[i], bgm_Error());
+			LeaveCriticalSection(&render_lock);
+			_bgm_RenderClose(job);
+			InterlockedIncrement(&render_failed);
+			continue;
+		}
+
+		ok = _bgm_RenderRun(job, outFname, render_float);
+
+		EnterCriticalSection(&render_lock);
+		if (ok)
+			printf("%s: %.1fs in %.2fs (%.1fx realtime)\n", render_files[i],
+			       job->seconds, job->elapsed,
+			       job->elapsed > 0.0 ? job->seconds/job->elapsed : 0.0);
+		else {
+			printf("%s: %s\n", render_files[i], job->error);
+			InterlockedIncrement(&render_failed);
+		}
+		LeaveCriticalSection(&render_lock);
+		_bgm_RenderClose(job);
+	}
+
+	_bgm_ContextUse(NULL);
+	_bgm_ContextFree(ctx);
+	_bgm_ThreadFree();
+	free(job);
+	return 0;
+}
+
+int main( int argc, char *argv[] )
+{
+	SYSTEM_INFO sys;
+	HANDLE *threads;
+	DWORD threadCount = 0, i, attr;
+	LARGE_INTEGER tps, t0, t1;
+	int arg;
+
+	// Read the options
+	for (arg=1; arg<argc; arg++) {
+		if (strcmp(argv[arg], "-o") == 0 && arg+1 < argc)
+			render_outDir = argv[++arg];
+		else if (strcmp(argv[arg], "-a") == 0 && arg+1 < argc) {
+			if (!strchr(argv[arg+1], '=') || strchr(argv[arg+1], '=') ==
+			    argv[arg+1] || strchr(argv[arg+1], '=')-argv[arg+1] >= 33 ||
+			    render_attrCount == RENDER_MAXATTRS) {
+				printf("Bad attribute \"%s\" (use name=value).\n", argv[arg+1]);
+				return 1;
+			}
+			render_attrs[render_attrCount++] = argv[++arg];
+		}
+		else if (strcmp(argv[arg], "-r") == 0 && arg+1 < argc)
+			render_freq = atoi(argv[++arg]);
+		else if (strcmp(argv[arg], "-j") == 0 && arg+1 < argc)
+			threadCount = atoi(argv[++arg]);
+		else if (strcmp(argv[arg], "-f") == 0)
+			render_float = TRUE;
+		else {
+			attr = GetFileAttributes(argv[arg]);
+			if (attr != INVALID_FILE_ATTRIBUTES &&
+			    (attr & FILE_ATTRIBUTE_DIRECTORY))
+				RenderAddFolder(argv[arg]);
+			else
+				RenderAdd(argv[arg]);
+		}
+	}
+
+	if (!render_count) {
+		printf("Usage: bgmrender [-o folder] [-a name=value]... [-r rate]"
+		       " [-j count] [-f]\n                 <file or folder>...\n");
+		return 1;
+	}
+
+	// BASS on the "no sound" device; errors are printed, not logged
+	if (!bgm_Init(-1, render_freq, 0, 0, 0)) {
+		printf("%s\n", bgm_Error());
+		return 1;
+	}
+	bgm_SetReportErrors(FALSE);
+	InitializeCriticalSection(&render_lock);
+
+	// One file per core at a time, unless told otherwise
+	if (!threadCount) {
+		GetSystemInfo(&sys);
+		threadCount = sys.dwNumberOfProcessors;
+	}
+	if (threadCount > render_count)
+		threadCount = render_count;
+	if (threadCount > MAXIMUM_WAIT_OBJECTS)
+		threadCount = MAXIMUM_WAIT_OBJECTS;
+	if (threadCount < 1)
+		threadCount = 1;
+
+	QueryPerformanceFrequency(&tps);
+	QueryPerformanceCounter(&t0);
+
+	threads = NEW(HANDLE,threadCount);
+	for (i=0; i<threadCount; i++)
+		threads[i] = CreateThread(NULL, 0, RenderThread, NULL, 0, NULL);
+	WaitForMultipleObjects(threadCount, threads, TRUE, INFINITE);
+	for (i=0; i<threadCount; i++)
+		CloseHandle(threads[i]);
+	free(threads);
+
+	QueryPerformanceCounter(&t1);
+	printf("%i of %i rendered in %.2fs on %i threads.\n",
+	       (int)(render_count-render_failed), (int)render_count,
+	       (double)(t1.QuadPart-t0.QuadPart)/tps.QuadPart, (int)threadCount);
+
+	DeleteCriticalSection(&render_lock);
+	bgm_Close();
+	return render_failed ? 1 : 0;
+}
+
+/* END OF FILE */